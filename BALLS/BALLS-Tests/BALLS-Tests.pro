@@ -4,7 +4,15 @@ TEMPLATE = subdirs
 CONFIG += testcase console c++14
 
 SUBDIRS += \
+		TestClusters \
 		TestConversions \
-		TestJSONConversions
+		TestJSONConversions \
+		TestIcosphere \
+		TestImporter \
+		TestMeshFile \
+		TestMeshOptimizer \
+		TestNormals \
+		TestProcedural \
+		TestSimplifier
 
 DEFINES += GLM_META_PROG_HELPERS
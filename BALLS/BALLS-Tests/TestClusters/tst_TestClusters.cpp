@@ -0,0 +1,314 @@
+#include "precompiled.hpp"
+#include "mesh/Clusters.hpp"
+#include "mesh/Mesh.hpp"
+#include "mesh/MeshFunction.hpp"
+
+#include <cmath>
+#include <vector>
+
+#include <QtTest>
+
+#include <glm/glm.hpp>
+
+using namespace balls::mesh;
+
+Q_DECLARE_METATYPE(Mesh)
+Q_DECLARE_METATYPE(LodChain)
+
+typedef Mesh::IndexType Index;
+
+class TestClusters : public QObject {
+  Q_OBJECT
+
+private Q_SLOTS:
+  void testCoversLevels_data();
+  void testCoversLevels();
+  void testBounds();
+  void testFrustum_data();
+  void testFrustum();
+  void testBackfaces();
+  void testBackfacesKeepsVisible();
+};
+
+// An n-by-n grid of quads on the XY plane, facing +Z, built row by row
+Mesh grid(const Index n) {
+  Mesh mesh;
+  mesh.resize((n + 1) * (n + 1), n * n * 6);
+
+  for (Index y = 0; y <= n; ++y) {
+    for (Index x = 0; x <= n; ++x) {
+      mesh.set_vertex(y * (n + 1) + x, vec3(float(x), float(y), 0.f));
+    }
+  }
+
+  for (Index y = 0; y < n; ++y) {
+    for (Index x = 0; x < n; ++x) {
+      Index corner = y * (n + 1) + x;
+      Index quad = y * n + x;
+      mesh.set_face(quad * 2, corner, corner + 1, corner + n + 2);
+      mesh.set_face(quad * 2 + 1, corner, corner + n + 2, corner + n + 1);
+    }
+  }
+
+  return mesh;
+}
+
+Mesh icosphere(const int subdivisions) {
+  MeshParameters parameters = {
+    {RADIUS, MeshParameter(1.f, 0, 100)},
+    {SUBDIVISIONS, MeshParameter(subdivisions, 0, 8)},
+  };
+
+  return functions::icosahedron(parameters);
+}
+
+// A view whose frustum planes don't cull anything
+ClusterView everywhere(const vec3& camera, const bool cullBackfaces) {
+  ClusterView view;
+  view.planes.fill(vec4(0, 0, 0, 1));
+  view.camera = camera;
+  view.cullBackfaces = cullBackfaces;
+  return view;
+}
+
+// Which triangles the ranges cullClusters() wrote would draw; also checks that
+// they're in order and that touching ranges were merged
+vector<bool> drawn(const Mesh& mesh, const vector<GLsizei>& counts,
+                   const vector<const void*>& offsets) {
+  vector<bool> result(mesh.indices().size() / 3, false);
+  size_t next = 0;
+
+  [&]() {
+    QCOMPARE(counts.size(), offsets.size());
+
+    for (size_t r = 0; r < counts.size(); ++r) {
+      size_t first = reinterpret_cast<size_t>(offsets[r]) / sizeof(GLushort);
+      QVERIFY(counts[r] > 0);
+      QVERIFY(r == 0 || first > next);
+      QCOMPARE(first % 3, size_t(0));
+      QCOMPARE(size_t(counts[r]) % 3, size_t(0));
+
+      next = first + counts[r];
+      QVERIFY(next <= mesh.indices().size());
+
+      for (size_t i = first; i < next; i += 3) {
+        result[i / 3] = true;
+      }
+    }
+  }();
+
+  return result;
+}
+
+void TestClusters::testCoversLevels_data() {
+  QTest::addColumn<Mesh>("mesh");
+  QTest::addColumn<LodChain>("lods");
+
+  Mesh sphere = icosphere(4);
+  size_t split = 1000 * 3;
+  LodChain two = {
+    {{0, split}, {split, sphere.indices().size() - split}}, vec3(0), 1
+  };
+
+  QTest::newRow("icosphere") << sphere << LodChain();
+  QTest::newRow("icosphere, two levels") << sphere << two;
+  QTest::newRow("grid") << grid(32) << LodChain();
+}
+
+void TestClusters::testCoversLevels() {
+  QFETCH(Mesh, mesh);
+  QFETCH(LodChain, lods);
+
+  ClusterSet set = buildClusters(mesh, lods);
+  vector<LodLevel> levels = lods.levels;
+
+  if (levels.empty()) {
+    levels.push_back({0, mesh.indices().size()});
+  }
+
+  size_t count = set.size();
+
+  for (const vector<float>* field : {
+         &set.centerX, &set.centerY, &set.centerZ, &set.radius, &set.axisX,
+         &set.axisY, &set.axisZ, &set.cutoff
+       }) {
+    QCOMPARE(field->size(), count);
+  }
+
+  QCOMPARE(set.indexCount.size(), count);
+  QCOMPARE(set.levels.size(), levels.size());
+
+  size_t next = 0;
+
+  for (size_t l = 0; l < levels.size(); ++l) {
+    const ClusterRange& range = set.levels[l];
+    size_t index = levels[l].firstIndex;
+    size_t end = index + levels[l].indexCount;
+
+    // Each level's clusters follow on from the last level's, and cover it
+    // back to back without crossing into the next level
+    QCOMPARE(range.first, next);
+    QVERIFY(range.count > 0);
+
+    for (size_t c = range.first; c < range.first + range.count; ++c) {
+      size_t triangles = size_t(set.indexCount[c]) / 3;
+
+      QCOMPARE(set.firstIndex[c], index);
+      QCOMPARE(size_t(set.indexCount[c]) % 3, size_t(0));
+      QVERIFY(triangles <= CLUSTER_MAX_TRIANGLES);
+      QVERIFY(triangles >= CLUSTER_MIN_TRIANGLES ||
+              c == range.first + range.count - 1);
+      // Only a level's last cluster may come up short
+
+      index += set.indexCount[c];
+    }
+
+    QCOMPARE(index, end);
+    next = range.first + range.count;
+  }
+
+  QCOMPARE(next, count);
+}
+
+void TestClusters::testBounds() {
+  Mesh mesh = icosphere(4);
+  ClusterSet set = buildClusters(mesh, LodChain());
+  const vector<vec3>& vertices = mesh.vertices();
+  const vector<Index>& indices = mesh.indices();
+
+  for (size_t c = 0; c < set.size(); ++c) {
+    vec3 center(set.centerX[c], set.centerY[c], set.centerZ[c]);
+    vec3 axis(set.axisX[c], set.axisY[c], set.axisZ[c]);
+    float cosine = std::sqrt(1 - set.cutoff[c] * set.cutoff[c]);
+    size_t first = set.firstIndex[c];
+
+    QVERIFY(set.cutoff[c] >= 0 && set.cutoff[c] <= 1);
+
+    for (size_t i = first; i < first + set.indexCount[c]; i += 3) {
+      const vec3& a = vertices[indices[i]];
+      const vec3& b = vertices[indices[i + 1]];
+      const vec3& d = vertices[indices[i + 2]];
+      vec3 normal = glm::normalize(glm::cross(b - a, d - a));
+
+      for (const vec3& v : {a, b, d}) {
+        QVERIFY(glm::distance(v, center) <= set.radius[c] * 1.0001f);
+      }
+
+      // Every face is within its cluster's normal cone
+      QVERIFY(set.cutoff[c] == 1 || glm::dot(normal, axis) >= cosine - 1e-4f);
+    }
+  }
+}
+
+void TestClusters::testFrustum_data() {
+  QTest::addColumn<int>("skip");
+
+  // The SIMD path tests four clusters at a time, and the rest are left over
+  QTest::newRow("every cluster") << 0;
+  QTest::newRow("all but the first") << 1;
+  QTest::newRow("all but the first three") << 3;
+}
+
+void TestClusters::testFrustum() {
+  QFETCH(int, skip);
+
+  Mesh mesh = grid(32);
+  ClusterSet set = buildClusters(mesh, LodChain());
+  ClusterRange range = {size_t(skip), set.size() - skip};
+
+  // Only y <= 8 is inside
+  ClusterView view = everywhere(vec3(16, 16, 100), false);
+  view.planes[0] = vec4(0, -1, 0, 8);
+
+  vector<GLsizei> counts;
+  vector<const void*> offsets;
+  size_t ranges = cullClusters(set, range, view, sizeof(GLushort), counts,
+                               offsets);
+  QCOMPARE(ranges, counts.size());
+
+  vector<bool> draws = drawn(mesh, counts, offsets);
+
+  if (QTest::currentTestFailed()) {
+    return;
+  }
+
+  const vector<vec3>& vertices = mesh.vertices();
+  const vector<Index>& indices = mesh.indices();
+  size_t first = set.firstIndex[range.first];
+  size_t count = 0;
+
+  for (size_t t = 0; t < draws.size(); ++t) {
+    bool inside = vertices[indices[t * 3]].y < 8 ||
+                  vertices[indices[t * 3 + 1]].y < 8 ||
+                  vertices[indices[t * 3 + 2]].y < 8;
+
+    // Nothing outside the range, and nothing visible culled
+    QVERIFY(t * 3 >= first || !draws[t]);
+    QVERIFY(t * 3 < first || !inside || draws[t]);
+    count += draws[t];
+  }
+
+  // The clusters in the top rows are wholly outside
+  QVERIFY(count > 0);
+  QVERIFY(count < draws.size() - first / 3);
+}
+
+void TestClusters::testBackfaces() {
+  Mesh mesh = grid(32);
+  ClusterSet set = buildClusters(mesh, LodChain());
+  ClusterRange all = {0, set.size()};
+  vector<GLsizei> counts;
+  vector<const void*> offsets;
+
+  // From the front, every cluster is drawn, as one range
+  cullClusters(set, all, everywhere(vec3(16, 16, 100), true), sizeof(GLushort),
+               counts, offsets);
+  QCOMPARE(counts.size(), size_t(1));
+  QCOMPARE(size_t(counts[0]), mesh.indices().size());
+  QVERIFY(offsets[0] == nullptr);
+
+  // From behind, none are
+  size_t ranges = cullClusters(set, all, everywhere(vec3(16, 16, -100), true),
+                               sizeof(GLushort), counts, offsets);
+  QCOMPARE(ranges, size_t(0));
+  QVERIFY(counts.empty());
+  QVERIFY(offsets.empty());
+
+  // Unless back faces are drawn anyway
+  ranges = cullClusters(set, all, everywhere(vec3(16, 16, -100), false),
+                        sizeof(GLushort), counts, offsets);
+  QCOMPARE(ranges, size_t(1));
+  QCOMPARE(size_t(counts[0]), mesh.indices().size());
+}
+
+void TestClusters::testBackfacesKeepsVisible() {
+  Mesh mesh = icosphere(4);
+  ClusterSet set = buildClusters(mesh, LodChain());
+  vec3 camera(0.5f, 1, 3);
+  vector<GLsizei> counts;
+  vector<const void*> offsets;
+
+  cullClusters(set, {0, set.size()}, everywhere(camera, true),
+               sizeof(GLushort), counts, offsets);
+  vector<bool> draws = drawn(mesh, counts, offsets);
+
+  if (QTest::currentTestFailed()) {
+    return;
+  }
+
+  const vector<vec3>& vertices = mesh.vertices();
+  const vector<Index>& indices = mesh.indices();
+
+  for (size_t t = 0; t < draws.size(); ++t) {
+    const vec3& a = vertices[indices[t * 3]];
+    vec3 normal = glm::cross(vertices[indices[t * 3 + 1]] - a,
+                             vertices[indices[t * 3 + 2]] - a);
+
+    // Every triangle that faces the camera must still be drawn
+    QVERIFY(glm::dot(normal, camera - a) <= 0 || draws[t]);
+  }
+}
+
+QTEST_APPLESS_MAIN(TestClusters)
+
+#include "tst_TestClusters.moc"
@@ -0,0 +1,124 @@
+#include "precompiled.hpp"
+#include "mesh/EdgeCache.hpp"
+#include "mesh/Mesh.hpp"
+#include "mesh/MeshFunction.hpp"
+
+#include <map>
+#include <utility>
+
+#include <QtTest>
+
+#include <glm/glm.hpp>
+
+using namespace balls::mesh;
+
+class TestIcosphere : public QObject {
+  Q_OBJECT
+
+private Q_SLOTS:
+  void testEdgeCacheIsUndirected();
+  void testEdgeCacheMakesOncePerEdge();
+  void testIcosphere_data();
+  void testIcosphere();
+};
+
+void TestIcosphere::testEdgeCacheIsUndirected() {
+  EdgeCache cache(4);
+
+  typedef Mesh::IndexType Index;
+
+  Index a = cache.get(3, 7, [](Index, Index) { return Index(42); });
+  Index b = cache.get(7, 3, [](Index, Index) { return Index(99); });
+
+  QCOMPARE(a, Index(42));
+  QCOMPARE(b, Index(42));
+  QCOMPARE(cache.size(), size_t(1));
+}
+
+void TestIcosphere::testEdgeCacheMakesOncePerEdge() {
+  constexpr Mesh::IndexType N = 100;
+  EdgeCache cache(N * 2);
+  Mesh::IndexType made = 0;
+  auto make = [&made](Mesh::IndexType, Mesh::IndexType) {
+    return made++;
+  };
+
+  for (int pass = 0; pass < 2; ++pass) {
+    for (Mesh::IndexType i = 0; i < N; ++i) {
+      // Two edges per vertex, visited in both directions across the passes
+      Mesh::IndexType next = (i + 1) % N;
+      Mesh::IndexType across = (i + N / 2) % N;
+
+      if (pass == 0) {
+        cache.get(i, next, make);
+        cache.get(i, across, make);
+      }
+      else {
+        cache.get(next, i, make);
+        cache.get(across, i, make);
+      }
+    }
+  }
+
+  // The "across" edges pair up, so each of those is seen twice per pass
+  QCOMPARE(made, N + N / 2);
+  QCOMPARE(cache.size(), size_t(N + N / 2));
+  QVERIFY(cache.capacity() >= cache.size() * 2);
+}
+
+void TestIcosphere::testIcosphere_data() {
+  QTest::addColumn<int>("subdivisions");
+
+  QTest::newRow("icosahedron") << 0;
+  QTest::newRow("1 subdivision") << 1;
+  QTest::newRow("2 subdivisions") << 2;
+  QTest::newRow("3 subdivisions") << 3;
+  QTest::newRow("4 subdivisions") << 4;
+}
+
+void TestIcosphere::testIcosphere() {
+  QFETCH(int, subdivisions);
+
+  constexpr float radius = 2.5f;
+  MeshParameters parameters = {
+    {RADIUS, MeshParameter(radius, 0, 100)},
+    {SUBDIVISIONS, MeshParameter(subdivisions, 0, 8)},
+  };
+
+  Mesh mesh = functions::icosahedron(parameters);
+  const auto& vertices = mesh.vertices();
+  const auto& indices = mesh.indices();
+  size_t scale = size_t(1) << (2 * subdivisions); // 4^n
+
+  // Euler's formula: every midpoint is shared, so nothing is duplicated
+  QCOMPARE(vertices.size(), 10 * scale + 2);
+  QCOMPARE(indices.size(), 60 * scale);
+
+  for (const glm::vec3& v : vertices) {
+    QVERIFY(qAbs(glm::length(v) - radius) < 1e-4f);
+  }
+
+  std::map<std::pair<Mesh::IndexType, Mesh::IndexType>, int> edges;
+
+  for (size_t i = 0; i < indices.size(); i += 3) {
+    for (size_t j = 0; j < 3; ++j) {
+      Mesh::IndexType a = indices[i + j];
+      Mesh::IndexType b = indices[i + (j + 1) % 3];
+
+      QVERIFY(a < vertices.size());
+      QVERIFY(a != b);
+      ++edges[std::minmax(a, b)];
+    }
+  }
+
+  // Closed and manifold; no cracks where two faces disagree on a midpoint
+  QCOMPARE(edges.size(), 30 * scale);
+
+  for (const auto& edge : edges) {
+    QCOMPARE(edge.second, 2);
+  }
+}
+
+QTEST_APPLESS_MAIN(TestIcosphere)
+
+#include "tst_TestIcosphere.moc"
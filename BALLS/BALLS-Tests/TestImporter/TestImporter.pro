@@ -0,0 +1,14 @@
+include(../../common.pri)
+include(../mesh.pri)
+
+QT       += testlib
+
+TARGET = tst_TestImporter
+CONFIG   += console testcase c++14
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+DEFINES += SRCDIR=\\\"$$PWD/\\\"
+
+SOURCES += tst_TestImporter.cpp
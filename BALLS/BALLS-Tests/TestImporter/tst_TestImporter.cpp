@@ -0,0 +1,279 @@
+#include "precompiled.hpp"
+#include "mesh/Importer.hpp"
+#include "mesh/Mesh.hpp"
+
+#include <cstring>
+#include <vector>
+
+#include <QByteArray>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QtEndian>
+#include <QtTest>
+
+using namespace balls::mesh;
+
+typedef std::vector<Mesh::IndexType> Indices;
+
+Q_DECLARE_METATYPE(Indices)
+
+class TestImporter : public QObject {
+  Q_OBJECT
+
+private:
+  QTemporaryDir _dir;
+
+  QString _write(const QString& name, const QByteArray& data);
+
+private Q_SLOTS:
+  void testObj_data();
+  void testObj();
+  void testObjRejects_data();
+  void testObjRejects();
+  void testAsciiPly();
+  void testBinaryPly();
+  void testPlyRejects();
+  void testAsciiStl();
+  void testBinaryStl();
+  void testUnknownFormat();
+};
+
+// Appends a little-endian copy of t
+template<class T>
+void append(QByteArray& out, const T t) {
+  uchar bytes[sizeof(T)];
+  qToLittleEndian(t, bytes);
+  out.append(reinterpret_cast<const char*>(bytes), sizeof(T));
+}
+
+void appendFloat(QByteArray& out, const float f) {
+  quint32 bits;
+  std::memcpy(&bits, &f, sizeof(bits));
+  append(out, bits);
+}
+
+QString TestImporter::_write(const QString& name, const QByteArray& data) {
+  QString path = _dir.filePath(name);
+  QFile file(path);
+
+  if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size()) {
+    qFatal("Couldn't write %s", qPrintable(path));
+  }
+
+  return path;
+}
+
+void TestImporter::testObj_data() {
+  QTest::addColumn<QByteArray>("obj");
+  QTest::addColumn<int>("vertices");
+  QTest::addColumn<Indices>("indices");
+
+  QByteArray quad = "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n";
+
+  QTest::newRow("triangle")
+      << QByteArray("v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 3\n")
+      << 3 << Indices {0, 1, 2};
+  QTest::newRow("quad is fanned")
+      << quad + "f 1 2 3 4\n" << 4 << Indices {0, 1, 2, 0, 2, 3};
+  QTest::newRow("texture and normal indices")
+      << quad + "vt 0 0\nvn 0 0 1\nf 1/1/1 2/1/1 3//1\n"
+      << 4 << Indices {0, 1, 2};
+  QTest::newRow("relative indices")
+      << quad + "f -4 -3 -2\n" << 4 << Indices {0, 1, 2};
+  QTest::newRow("no newline at the end")
+      << quad + "f 4 3 2" << 4 << Indices {3, 2, 1};
+  QTest::newRow("CRLF and comments")
+      << QByteArray("# A comment\r\nv 0 0 0\r\nv 1 0 0\r\nv 0 1 0\r\n"
+                    "g group\r\nf 1 2 3\r\n")
+      << 3 << Indices {0, 1, 2};
+}
+
+void TestImporter::testObj() {
+  QFETCH(QByteArray, obj);
+  QFETCH(int, vertices);
+  QFETCH(Indices, indices);
+
+  Mesh mesh = importMesh(_write("test.obj", obj), false);
+
+  QCOMPARE(int(mesh.vertices().size()), vertices);
+  QCOMPARE(mesh.indices(), indices);
+}
+
+void TestImporter::testObjRejects_data() {
+  QTest::addColumn<QByteArray>("obj");
+
+  QByteArray triangle = "v 0 0 0\nv 1 0 0\nv 0 1 0\n";
+
+  QTest::newRow("index 0") << triangle + "f 0 1 2\n";
+  QTest::newRow("index past the end") << triangle + "f 1 2 4\n";
+  QTest::newRow("relative index before the start") << triangle + "f -4 1 2\n";
+  QTest::newRow("index overflows")
+      << triangle + "f 1 2 99999999999999999999999\n";
+  QTest::newRow("index too big") << triangle + "f 1 2 4294967296\n";
+  QTest::newRow("two coordinates") << QByteArray("v 0 0\n");
+  QTest::newRow("two corners") << triangle + "f 1 2\n";
+  QTest::newRow("not a number") << triangle + "f 1 2 x\n";
+  QTest::newRow("empty") << QByteArray();
+}
+
+void TestImporter::testObjRejects() {
+  QFETCH(QByteArray, obj);
+
+  QString path = _write("bad.obj", obj);
+
+  QVERIFY_EXCEPTION_THROWN(importMesh(path, false), ImportException);
+}
+
+void TestImporter::testAsciiPly() {
+  QByteArray ply =
+    "ply\n"
+    "format ascii 1.0\n"
+    "comment Made by hand\n"
+    "element vertex 4\n"
+    "property float x\n"
+    "property float y\n"
+    "property float z\n"
+    "property uchar red\n"
+    "element face 1\n"
+    "property list uchar int vertex_indices\n"
+    "end_header\n"
+    "0 0 0 255\n"
+    "1 0 0 255\n"
+    "1 1 0 255\n"
+    "0 1 2.5e-1 255\n"
+    "4 0 1 2 3";
+
+  Mesh mesh = importMesh(_write("test.ply", ply), false);
+
+  QCOMPARE(mesh.vertices().size(), size_t(4));
+  QCOMPARE(mesh.vertices()[3], glm::vec3(0, 1, 0.25f));
+  QCOMPARE(mesh.indices(), (Indices {0, 1, 2, 0, 2, 3}));
+}
+
+void TestImporter::testBinaryPly() {
+  QByteArray ply =
+    "ply\n"
+    "format binary_little_endian 1.0\n"
+    "element vertex 3\n"
+    "property float x\n"
+    "property float y\n"
+    "property float z\n"
+    "element face 1\n"
+    "property list uchar uint vertex_indices\n"
+    "end_header\n";
+
+  const float coordinates[] = {0, 0, 0, 2, 0, 0, 0, 3, 0};
+
+  for (float f : coordinates) {
+    appendFloat(ply, f);
+  }
+
+  ply.append(char(3));
+  append<quint32>(ply, 2);
+  append<quint32>(ply, 1);
+  append<quint32>(ply, 0);
+
+  Mesh mesh = importMesh(_write("binary.ply", ply), false);
+
+  QCOMPARE(mesh.vertices().size(), size_t(3));
+  QCOMPARE(mesh.vertices()[2], glm::vec3(0, 3, 0));
+  QCOMPARE(mesh.indices(), (Indices {2, 1, 0}));
+}
+
+void TestImporter::testPlyRejects() {
+  QByteArray ply =
+    "ply\n"
+    "format ascii 1.0\n"
+    "element vertex 3\n"
+    "property float x\n"
+    "property float y\n"
+    "property float z\n"
+    "element face 1\n"
+    "property list uchar int vertex_indices\n"
+    "end_header\n"
+    "0 0 0\n"
+    "1 0 0\n"
+    "0 1 0\n"
+    "3 0 1 3\n";
+
+  QString outOfRange = _write("range.ply", ply);
+  QVERIFY_EXCEPTION_THROWN(importMesh(outOfRange, false), ImportException);
+
+  QString incomplete = _write("header.ply", "ply\nformat ascii 1.0\n");
+  QVERIFY_EXCEPTION_THROWN(importMesh(incomplete, false), ImportException);
+}
+
+void TestImporter::testAsciiStl() {
+  QByteArray stl =
+    "solid square\n"
+    "  facet normal 0 0 1\n"
+    "    outer loop\n"
+    "      vertex 0 0 0\n"
+    "      vertex 1 0 0\n"
+    "      vertex 1 1 0\n"
+    "    endloop\n"
+    "  endfacet\n"
+    "  facet normal 0 0 1\n"
+    "    outer loop\n"
+    "      vertex 0 0 0\n"
+    "      vertex 1 1 0\n"
+    "      vertex 0 1 0\n"
+    "    endloop\n"
+    "  endfacet\n"
+    "endsolid square\n";
+
+  QString path = _write("square.stl", stl);
+
+  Mesh separate = importMesh(path, false);
+  QCOMPARE(separate.vertices().size(), size_t(6));
+  QCOMPARE(separate.indices().size(), size_t(6));
+
+  // The two triangles share an edge, so welding leaves four corners
+  Mesh welded = importMesh(path, true);
+  QCOMPARE(welded.vertices().size(), size_t(4));
+  QCOMPARE(welded.indices().size(), size_t(6));
+}
+
+void TestImporter::testBinaryStl() {
+  // Starts with "solid" like some exporters write, to check the size wins
+  QByteArray stl("solid binary");
+  stl.append(QByteArray(80 - stl.size(), ' '));
+  append<quint32>(stl, 2);
+
+  const float triangles[2][9] = {
+    {0, 0, 0, 1, 0, 0, 0, 1, 0},
+    {0, 0, 1, 1, 0, 1, 0, 1, 1},
+  };
+
+  for (const auto& triangle : triangles) {
+    for (int i = 0; i < 3; ++i) {
+      appendFloat(stl, 0); // The normal, which is ignored
+    }
+
+    for (float f : triangle) {
+      appendFloat(stl, f);
+    }
+
+    append<quint16>(stl, 0);
+  }
+
+  Mesh mesh = importMesh(_write("binary.stl", stl), false);
+
+  QCOMPARE(mesh.vertices().size(), size_t(6));
+  QCOMPARE(mesh.vertices()[4], glm::vec3(1, 0, 1));
+  QCOMPARE(mesh.indices().size(), size_t(6));
+}
+
+void TestImporter::testUnknownFormat() {
+  QCOMPARE(meshFileFormat("a/b.OBJ"), MeshFileFormat::Obj);
+  QCOMPARE(meshFileFormat("c.ply"), MeshFileFormat::Ply);
+  QCOMPARE(meshFileFormat("d.stl"), MeshFileFormat::Stl);
+  QCOMPARE(meshFileFormat("e.txt"), MeshFileFormat::Unknown);
+
+  QString path = _write("mesh.txt", "v 0 0 0\n");
+  QVERIFY_EXCEPTION_THROWN(importMesh(path), ImportException);
+}
+
+QTEST_APPLESS_MAIN(TestImporter)
+
+#include "tst_TestImporter.moc"
@@ -0,0 +1,179 @@
+#include "precompiled.hpp"
+#include "exception/FileException.hpp"
+#include "mesh/Importer.hpp"
+#include "mesh/Mesh.hpp"
+#include "mesh/MeshFile.hpp"
+#include "mesh/MeshFunction.hpp"
+#include "mesh/VertexFormat.hpp"
+
+#include <cstring>
+#include <functional>
+#include <vector>
+
+#include <QByteArray>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QtEndian>
+#include <QtTest>
+
+using namespace balls;
+using namespace balls::mesh;
+
+typedef std::function<void(QByteArray&)> Edit;
+
+Q_DECLARE_METATYPE(VertexFormat)
+Q_DECLARE_METATYPE(Edit)
+
+// Header field offsets, per the Header struct in MeshFile.cpp
+constexpr int MAGIC_OFFSET = 0;
+constexpr int VERSION_OFFSET = 8;
+constexpr int LOD_OFFSET_OFFSET = 48;
+constexpr int INDEX_OFFSET_OFFSET = 64;
+
+class TestMeshFile : public QObject {
+  Q_OBJECT
+
+private:
+  QTemporaryDir _dir;
+  Mesh _mesh;
+  LodChain _lods;
+
+  QString _save(const QString& name, const VertexFormat& format);
+  QString _corrupt(const QString& name, const Edit& edit);
+
+private Q_SLOTS:
+  void initTestCase();
+  void testRoundTrip_data();
+  void testRoundTrip();
+  void testRejects_data();
+  void testRejects();
+  void testMissingFile();
+};
+
+quint64 readOffset(const QByteArray& data, const int at) {
+  return qFromLittleEndian<quint64>(
+           reinterpret_cast<const uchar*>(data.constData() + at));
+}
+
+void TestMeshFile::initTestCase() {
+  MeshParameters parameters = {
+    {RADIUS, MeshParameter(1.5f, 0, 100)},
+    {SUBDIVISIONS, MeshParameter(2, 0, 8)},
+  };
+
+  _mesh = functions::icosahedron(parameters);
+  _mesh.computeNormals();
+
+  size_t indices = _mesh.indices().size();
+  _lods.levels = {{0, indices}, {indices / 2, indices / 2}};
+  _lods.center = glm::vec3(0);
+  _lods.radius = 1.5f;
+}
+
+QString TestMeshFile::_save(const QString& name, const VertexFormat& format) {
+  QString path = _dir.filePath(name);
+  saveMeshFile(path, _mesh, _lods, format);
+  return path;
+}
+
+QString TestMeshFile::_corrupt(const QString& name, const Edit& edit) {
+  QFile file(_save(name, VertexFormat()));
+
+  if (!file.open(QIODevice::ReadWrite)) {
+    qFatal("Couldn't open %s", qPrintable(file.fileName()));
+  }
+
+  QByteArray data = file.readAll();
+  edit(data);
+  file.resize(0);
+  file.seek(0);
+  file.write(data);
+  return file.fileName();
+}
+
+void TestMeshFile::testRoundTrip_data() {
+  QTest::addColumn<VertexFormat>("format");
+
+  QTest::newRow("float") << VertexFormat();
+  QTest::newRow("half float, packed normals")
+      << VertexFormat(PositionFormat::HalfFloat, NormalFormat::Int2_10_10_10);
+  QTest::newRow("snorm16")
+      << VertexFormat(PositionFormat::Snorm16, NormalFormat::Float);
+}
+
+void TestMeshFile::testRoundTrip() {
+  QFETCH(VertexFormat, format);
+
+  auto file = MeshFile::open(_save("round.bmesh", format));
+  const MeshFileInfo& info = file->info();
+
+  QVERIFY(info.format == format);
+  QCOMPARE(info.indexType, _mesh.indexType());
+  QCOMPARE(info.vertexCount, _mesh.vertices().size());
+  QCOMPARE(info.indexCount, _mesh.indices().size());
+  QCOMPARE(info.lods.levels.size(), _lods.levels.size());
+  QCOMPARE(info.lods.levels[1].firstIndex, _lods.levels[1].firstIndex);
+  QCOMPARE(info.lods.levels[1].indexCount, _lods.levels[1].indexCount);
+  QCOMPARE(info.lods.radius, _lods.radius);
+
+  Quantization quantization = _mesh.quantization(format);
+  QCOMPARE(info.quantization.scale, quantization.scale);
+  QCOMPARE(info.quantization.bias, quantization.bias);
+
+  // The buffers must be exactly what would have been uploaded directly
+  QByteArray vertices(int(_mesh.vertexDataSize(format)), 0);
+  _mesh.interleave(vertices.data(), format, quantization);
+  QCOMPARE(file->vertexDataSize(), size_t(vertices.size()));
+  QVERIFY(std::memcmp(file->vertexData(), vertices.constData(),
+                      vertices.size()) == 0);
+
+  QByteArray indices(int(_mesh.indexDataSize()), 0);
+  _mesh.writeIndices(indices.data());
+  QCOMPARE(file->indexDataSize(), size_t(indices.size()));
+  QVERIFY(std::memcmp(file->indexData(), indices.constData(),
+                      indices.size()) == 0);
+}
+
+void TestMeshFile::testRejects_data() {
+  QTest::addColumn<Edit>("edit");
+
+  QTest::newRow("too small") << Edit([](QByteArray & data) {
+    data.truncate(16);
+  });
+  QTest::newRow("wrong magic") << Edit([](QByteArray & data) {
+    data[MAGIC_OFFSET] = 'X';
+  });
+  QTest::newRow("newer version") << Edit([](QByteArray & data) {
+    data[VERSION_OFFSET] = char(MESH_FILE_VERSION + 1);
+  });
+  QTest::newRow("truncated") << Edit([](QByteArray & data) {
+    data.chop(2);
+  });
+  QTest::newRow("index past the last vertex") << Edit([](QByteArray & data) {
+    int at = int(readOffset(data, INDEX_OFFSET_OFFSET));
+    data[at] = char(0xff);
+    data[at + 1] = char(0xff);
+  });
+  QTest::newRow("level of detail past the end") << Edit([](QByteArray & data) {
+    // The second level's index count, which already reaches the end
+    int at = int(readOffset(data, LOD_OFFSET_OFFSET)) + 3 * sizeof(quint64);
+    data[at] = char(data[at] + 3);
+  });
+}
+
+void TestMeshFile::testRejects() {
+  QFETCH(Edit, edit);
+
+  QString path = _corrupt("bad.bmesh", edit);
+
+  QVERIFY_EXCEPTION_THROWN(MeshFile::open(path), ImportException);
+}
+
+void TestMeshFile::testMissingFile() {
+  QVERIFY_EXCEPTION_THROWN(MeshFile::open(_dir.filePath("nothing.bmesh")),
+                           FileException);
+}
+
+QTEST_APPLESS_MAIN(TestMeshFile)
+
+#include "tst_TestMeshFile.moc"
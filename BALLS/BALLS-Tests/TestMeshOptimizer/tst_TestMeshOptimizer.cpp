@@ -0,0 +1,173 @@
+#include "precompiled.hpp"
+#include "mesh/Mesh.hpp"
+#include "mesh/MeshFunction.hpp"
+#include "mesh/MeshOptimizer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <random>
+#include <vector>
+
+#include <QtTest>
+
+using namespace balls::mesh;
+
+Q_DECLARE_METATYPE(Mesh)
+
+typedef Mesh::IndexType Index;
+
+class TestMeshOptimizer : public QObject {
+  Q_OBJECT
+
+private Q_SLOTS:
+  void testAnalyze();
+  void testAnalyzeEvicts();
+  void testOptimize_data();
+  void testOptimize();
+  void testVertexFetch();
+};
+
+// An n-by-n grid of quads on the XY plane
+Mesh grid(const Index n) {
+  Mesh mesh;
+  mesh.resize((n + 1) * (n + 1), n * n * 6);
+
+  for (Index y = 0; y <= n; ++y) {
+    for (Index x = 0; x <= n; ++x) {
+      mesh.set_vertex(y * (n + 1) + x, vec3(float(x), float(y), 0.f));
+    }
+  }
+
+  for (Index y = 0; y < n; ++y) {
+    for (Index x = 0; x < n; ++x) {
+      Index corner = y * (n + 1) + x;
+      Index quad = y * n + x;
+      mesh.set_face(quad * 2, corner, corner + 1, corner + n + 2);
+      mesh.set_face(quad * 2 + 1, corner, corner + n + 2, corner + n + 1);
+    }
+  }
+
+  return mesh;
+}
+
+// The same triangles in a random order, so there's something to optimize
+Mesh shuffled(Mesh mesh) {
+  const vector<Index>& indices = mesh.indices();
+  vector<std::array<Index, 3>> faces(indices.size() / 3);
+
+  for (size_t f = 0; f < faces.size(); ++f) {
+    faces[f] = {{indices[f * 3], indices[f * 3 + 1], indices[f * 3 + 2]}};
+  }
+
+  std::shuffle(faces.begin(), faces.end(), std::mt19937(1234));
+
+  for (size_t f = 0; f < faces.size(); ++f) {
+    mesh.set_face(f, faces[f][0], faces[f][1], faces[f][2]);
+  }
+
+  return mesh;
+}
+
+// Every triangle by the positions of its corners, starting from the least one
+// so that only the winding matters, not which corner comes first
+vector<std::array<float, 9>> triangles(const Mesh& mesh) {
+  const vector<Index>& indices = mesh.indices();
+  vector<std::array<float, 9>> result;
+
+  for (size_t i = 0; i < indices.size(); i += 3) {
+    std::array<std::array<float, 3>, 3> corners;
+
+    for (size_t k = 0; k < 3; ++k) {
+      const vec3& v = mesh.vertices()[indices[i + k]];
+      corners[k] = {{v.x, v.y, v.z}};
+    }
+
+    std::rotate(corners.begin(),
+                std::min_element(corners.begin(), corners.end()),
+                corners.end());
+
+    std::array<float, 9> triangle;
+
+    for (size_t k = 0; k < 9; ++k) {
+      triangle[k] = corners[k / 3][k % 3];
+    }
+
+    result.push_back(triangle);
+  }
+
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+void TestMeshOptimizer::testAnalyze() {
+  // Two triangles sharing an edge; four vertices, each transformed once
+  VertexCacheStats stats = analyzeVertexCache({0, 1, 2, 2, 1, 3}, 4);
+
+  QCOMPARE(stats.misses, size_t(4));
+  QCOMPARE(stats.acmr, 2.f);
+  QCOMPARE(stats.atvr, 1.f);
+}
+
+void TestMeshOptimizer::testAnalyzeEvicts() {
+  // The second triangle pushes the first one's vertices out of the cache
+  VertexCacheStats stats =
+    analyzeVertexCache({0, 1, 2, 3, 4, 5, 0, 1, 2}, 6, 3);
+
+  QCOMPARE(stats.misses, size_t(9));
+  QCOMPARE(stats.acmr, 3.f);
+  QCOMPARE(stats.atvr, 1.5f);
+}
+
+void TestMeshOptimizer::testOptimize_data() {
+  MeshParameters parameters = {
+    {RADIUS, MeshParameter(1.f, 0, 100)},
+    {SUBDIVISIONS, MeshParameter(4, 0, 8)},
+  };
+
+  QTest::addColumn<Mesh>("mesh");
+  QTest::addColumn<int>("cacheSize");
+
+  QTest::newRow("grid, 16") << shuffled(grid(32)) << 16;
+  QTest::newRow("grid, 32") << shuffled(grid(32)) << 32;
+  QTest::newRow("icosphere, 16")
+      << shuffled(functions::icosahedron(parameters)) << 16;
+}
+
+void TestMeshOptimizer::testOptimize() {
+  QFETCH(Mesh, mesh);
+  QFETCH(int, cacheSize);
+
+  size_t vertexCount = mesh.vertices().size();
+  VertexCacheStats before =
+    analyzeVertexCache(mesh.indices(), vertexCount, cacheSize);
+  vector<std::array<float, 9>> expected = triangles(mesh);
+
+  OptimizationReport report = optimize(mesh, cacheSize);
+  VertexCacheStats after =
+    analyzeVertexCache(mesh.indices(), vertexCount, cacheSize);
+
+  QCOMPARE(report.before.misses, before.misses);
+  QCOMPARE(report.after.misses, after.misses);
+
+  // Random order misses on nearly every corner; a good order on a closed or
+  // flat mesh gets well under one miss per triangle
+  QVERIFY(before.acmr > 2.f);
+  QVERIFY(after.acmr < 1.f);
+
+  // Reordered, not changed
+  QCOMPARE(mesh.vertices().size(), vertexCount);
+  QVERIFY(triangles(mesh) == expected);
+}
+
+void TestMeshOptimizer::testVertexFetch() {
+  // Vertex 2 is never used
+  vector<Index> indices = {4, 1, 3, 3, 1, 0, 0, 1, 4};
+  vector<Index> remap = optimizeVertexFetch(indices, 5);
+
+  QCOMPARE(indices, vector<Index>({0, 1, 2, 2, 1, 3, 3, 1, 0}));
+  QCOMPARE(remap, vector<Index>({3, 1, 4, 2, 0}));
+}
+
+QTEST_APPLESS_MAIN(TestMeshOptimizer)
+
+#include "tst_TestMeshOptimizer.moc"
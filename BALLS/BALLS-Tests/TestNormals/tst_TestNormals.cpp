@@ -0,0 +1,158 @@
+#include "precompiled.hpp"
+#include "mesh/Mesh.hpp"
+#include "mesh/MeshFunction.hpp"
+
+#include <random>
+#include <vector>
+
+#include <QtTest>
+
+#include <glm/glm.hpp>
+
+using namespace balls::mesh;
+
+Q_DECLARE_METATYPE(Mesh)
+
+typedef Mesh::IndexType Index;
+
+class TestNormals : public QObject {
+  Q_OBJECT
+
+private Q_SLOTS:
+  void testMatchesScalar_data();
+  void testMatchesScalar();
+  void testDegenerate();
+  void testIcosphereFacesOut();
+};
+
+// The plain definition, one face at a time; what the SIMD path must match
+vector<vec3> reference(const Mesh& mesh) {
+  const vector<vec3>& vertices = mesh.vertices();
+  const vector<Index>& indices = mesh.indices();
+  vector<vec3> normals(vertices.size(), vec3(0));
+
+  for (size_t i = 0; i < indices.size(); i += 3) {
+    const vec3& a = vertices[indices[i]];
+    vec3 n = glm::cross(vertices[indices[i + 1]] - a,
+                        vertices[indices[i + 2]] - a);
+    float length = glm::length(n);
+
+    if (length > 0) {
+      for (size_t k = 0; k < 3; ++k) {
+        normals[indices[i + k]] += n / length;
+      }
+    }
+  }
+
+  for (vec3& n : normals) {
+    float length = glm::length(n);
+
+    if (length > 0) {
+      n /= length;
+    }
+  }
+
+  return normals;
+}
+
+// Random triangles over random points; some corners repeat within a face
+Mesh scattered(const size_t vertices, const size_t faces) {
+  std::mt19937 engine(42);
+  std::uniform_real_distribution<float> coordinate(-1, 1);
+  std::uniform_int_distribution<Index> index(0, Index(vertices - 1));
+
+  Mesh mesh;
+  mesh.resize(vertices, faces * 3);
+
+  for (size_t v = 0; v < vertices; ++v) {
+    mesh.set_vertex(Index(v), vec3(coordinate(engine), coordinate(engine),
+                                   coordinate(engine)));
+  }
+
+  for (size_t f = 0; f < faces; ++f) {
+    mesh.set_face(f, index(engine), index(engine), index(engine));
+  }
+
+  return mesh;
+}
+
+Mesh icosphere(const int subdivisions) {
+  MeshParameters parameters = {
+    {RADIUS, MeshParameter(1.f, 0, 100)},
+    {SUBDIVISIONS, MeshParameter(subdivisions, 0, 8)},
+  };
+
+  return functions::icosahedron(parameters);
+}
+
+void TestNormals::testMatchesScalar_data() {
+  QTest::addColumn<Mesh>("mesh");
+
+  // The SIMD path takes four faces at a time, and the rest are left over
+  QTest::newRow("1 face") << scattered(3, 1);
+  QTest::newRow("4 faces") << scattered(8, 4);
+  QTest::newRow("7 faces") << scattered(8, 7);
+  QTest::newRow("4099 faces") << scattered(2000, 4099);
+  QTest::newRow("icosphere") << icosphere(3);
+}
+
+void TestNormals::testMatchesScalar() {
+  QFETCH(Mesh, mesh);
+
+  vector<vec3> expected = reference(mesh);
+  mesh.computeNormals();
+  const vector<vec3>& normals = mesh.normals();
+
+  QCOMPARE(normals.size(), expected.size());
+
+  for (size_t v = 0; v < normals.size(); ++v) {
+    // Only the order of the sums differs, so only rounding can
+    QVERIFY2(glm::length(normals[v] - expected[v]) < 1e-5f,
+             qPrintable(QString("Vertex %1").arg(v)));
+  }
+}
+
+void TestNormals::testDegenerate() {
+  Mesh mesh;
+  mesh.resize(7, 15);
+  mesh.set_vertex(0, vec3(0, 0, 0));
+  mesh.set_vertex(1, vec3(1, 0, 0));
+  mesh.set_vertex(2, vec3(0, 1, 0));
+  mesh.set_vertex(3, vec3(0, 0, 1));
+  mesh.set_vertex(4, vec3(0, 0, 2));
+  mesh.set_vertex(5, vec3(0, 0, 3));
+  mesh.set_vertex(6, vec3(1, 1, 0));
+
+  // Four faces for one SIMD pass, then one more; 3, 4, and 5 are only ever
+  // in faces with no area
+  mesh.set_face(0, 0, 1, 2);
+  mesh.set_face(1, 3, 4, 5);
+  mesh.set_face(2, 0, 0, 3);
+  mesh.set_face(3, 2, 1, 6);
+  mesh.set_face(4, 4, 4, 4);
+  mesh.computeNormals();
+
+  const vector<vec3>& normals = mesh.normals();
+
+  for (Index v : {0u, 1u, 2u, 6u}) {
+    QVERIFY(glm::length(normals[v] - vec3(0, 0, 1)) < 1e-6f);
+  }
+
+  for (Index v : {3u, 4u, 5u}) {
+    QCOMPARE(normals[v], vec3(0));
+  }
+}
+
+void TestNormals::testIcosphereFacesOut() {
+  Mesh mesh = icosphere(3);
+  mesh.computeNormals();
+
+  for (size_t v = 0; v < mesh.vertices().size(); ++v) {
+    vec3 out = glm::normalize(mesh.vertices()[v]);
+    QVERIFY(glm::dot(mesh.normals()[v], out) > 0.99f);
+  }
+}
+
+QTEST_APPLESS_MAIN(TestNormals)
+
+#include "tst_TestNormals.moc"
@@ -0,0 +1,126 @@
+#include "precompiled.hpp"
+#include "mesh/Mesh.hpp"
+#include "mesh/MeshFunction.hpp"
+#include "mesh/Procedural.hpp"
+
+#include <QtTest>
+
+using namespace balls::mesh;
+
+Q_DECLARE_METATYPE(ProceduralShape)
+Q_DECLARE_METATYPE(MeshFunction)
+
+class TestProcedural : public QObject {
+  Q_OBJECT
+
+private Q_SLOTS:
+  void testMatchesMesh_data();
+  void testMatchesMesh();
+  void testGrids_data();
+  void testGrids();
+  void testClamped();
+  void testUniformNames();
+  void testUnchangedShaders();
+};
+
+// Every parameter any generator below needs
+MeshParameters parameters(const int resolution, const int uSamples,
+                          const int vSamples) {
+  return {
+    {WIDTH, MeshParameter(1.f, 0, 100)},
+    {LENGTH, MeshParameter(2.f, 0, 100)},
+    {HEIGHT, MeshParameter(3.f, 0, 100)},
+    {RADIUS, MeshParameter(1.f, 0, 100)},
+    {INNER_RADIUS, MeshParameter(.25f, 0, 100)},
+    {OUTER_RADIUS, MeshParameter(1.f, 0, 100)},
+    {X_SCALE, MeshParameter(1.f, 0, 100)},
+    {Y_SCALE, MeshParameter(1.f, 0, 100)},
+    {Z_SCALE, MeshParameter(1.f, 0, 100)},
+    {RESOLUTION, MeshParameter(resolution, 0, 256)},
+    {U_SAMPLES, MeshParameter(uSamples, 0, 256)},
+    {V_SAMPLES, MeshParameter(vSamples, 0, 256)},
+  };
+}
+
+void TestProcedural::testMatchesMesh_data() {
+  QTest::addColumn<ProceduralShape>("shape");
+  QTest::addColumn<MeshFunction>("function");
+  QTest::addColumn<int>("resolution");
+
+  QTest::newRow("quad") << ProceduralShape::Quad << functions::quad << 3;
+  QTest::newRow("box") << ProceduralShape::Box << functions::box << 3;
+  QTest::newRow("cylinder, 3") << ProceduralShape::Cylinder
+                               << functions::cylinder << 3;
+  QTest::newRow("cylinder, 32") << ProceduralShape::Cylinder
+                                << functions::cylinder << 32;
+  QTest::newRow("cone, 3") << ProceduralShape::Cone << functions::cone << 3;
+  QTest::newRow("cone, 100") << ProceduralShape::Cone << functions::cone << 100;
+}
+
+void TestProcedural::testMatchesMesh() {
+  QFETCH(ProceduralShape, shape);
+  QFETCH(MeshFunction, function);
+  QFETCH(int, resolution);
+
+  MeshParameters params = parameters(resolution, 8, 8);
+  Mesh mesh = function(params);
+
+  // One vertex per corner of every triangle the CPU version would have
+  QCOMPARE(size_t(proceduralVertexCount(shape, params)),
+           mesh.indices().size());
+}
+
+void TestProcedural::testGrids_data() {
+  QTest::addColumn<ProceduralShape>("shape");
+  QTest::addColumn<int>("uSamples");
+  QTest::addColumn<int>("vSamples");
+
+  QTest::newRow("sphere, 1x1") << ProceduralShape::UvSphere << 1 << 1;
+  QTest::newRow("sphere, 16x8") << ProceduralShape::UvSphere << 16 << 8;
+  QTest::newRow("torus, 3x5") << ProceduralShape::Torus << 3 << 5;
+  QTest::newRow("torus, 64x32") << ProceduralShape::Torus << 64 << 32;
+}
+
+void TestProcedural::testGrids() {
+  QFETCH(ProceduralShape, shape);
+  QFETCH(int, uSamples);
+  QFETCH(int, vSamples);
+
+  // Two triangles per quad of the grid, poles and seams included
+  QCOMPARE(proceduralVertexCount(shape, parameters(3, uSamples, vSamples)),
+           GLsizei(6 * uSamples * vSamples));
+}
+
+void TestProcedural::testClamped() {
+  // The shaders clamp their uniforms to these minimums too
+  MeshParameters params = parameters(-5, 0, -1);
+
+  QCOMPARE(proceduralVertexCount(ProceduralShape::Cylinder, params),
+           GLsizei(12 * 3));
+  QCOMPARE(proceduralVertexCount(ProceduralShape::Cone, params),
+           GLsizei(6 * 3));
+  QCOMPARE(proceduralVertexCount(ProceduralShape::UvSphere, params),
+           GLsizei(6));
+  QCOMPARE(proceduralVertexCount(ProceduralShape::None, params), GLsizei(0));
+}
+
+void TestProcedural::testUniformNames() {
+  QCOMPARE(proceduralUniform("radius"), QString("shapeRadius"));
+  QCOMPARE(proceduralUniform("outer-radius"), QString("shapeOuterRadius"));
+  QCOMPARE(proceduralUniform("u-samples"), QString("shapeUSamples"));
+}
+
+void TestProcedural::testUnchangedShaders() {
+  MeshParameters params = parameters(8, 8, 8);
+  QString old = "#version 120\nattribute vec3 position;\nvoid main() {}\n";
+  QString modern = "#version 330\nin vec3 position;\nvoid main() {}\n";
+
+  // GLSL 1.20 has no gl_VertexID to generate anything from
+  QCOMPARE(proceduralShader(old, ProceduralShape::Box, params), old);
+  QCOMPARE(proceduralShader(modern, ProceduralShape::None, params), modern);
+  QVERIFY(proceduralShader(modern, ProceduralShape::Box, params) != modern);
+}
+
+QTEST_APPLESS_MAIN(TestProcedural)
+
+#include "tst_TestProcedural.moc"
@@ -0,0 +1,133 @@
+#include "precompiled.hpp"
+#include "mesh/Mesh.hpp"
+#include "mesh/MeshFunction.hpp"
+#include "mesh/Simplifier.hpp"
+
+#include <QtTest>
+
+#include <glm/glm.hpp>
+
+using namespace balls::mesh;
+
+typedef Mesh::IndexType Index;
+
+class TestSimplifier : public QObject {
+  Q_OBJECT
+
+private Q_SLOTS:
+  void testSimplify_data();
+  void testSimplify();
+  void testSmallMeshHasOneLevel();
+  void testLods();
+};
+
+Mesh icosphere(const int subdivisions) {
+  MeshParameters parameters = {
+    {RADIUS, MeshParameter(1.f, 0, 100)},
+    {SUBDIVISIONS, MeshParameter(subdivisions, 0, 8)},
+  };
+
+  return functions::icosahedron(parameters);
+}
+
+void TestSimplifier::testSimplify_data() {
+  QTest::addColumn<int>("target");
+
+  QTest::newRow("1000") << 1000;
+  QTest::newRow("100") << 100;
+}
+
+void TestSimplifier::testSimplify() {
+  QFETCH(int, target);
+
+  Mesh original = icosphere(5);
+  Mesh mesh = simplify(original, size_t(target));
+  const vector<Index>& indices = mesh.indices();
+  size_t vertexCount = mesh.vertices().size();
+
+  // The grid is sized from a guess, so only roughly on target
+  QVERIFY(vertexCount >= size_t(target / 4));
+  QVERIFY(vertexCount <= size_t(target * 4));
+  QVERIFY(indices.size() < original.indices().size());
+  QCOMPARE(indices.size() % 3, size_t(0));
+
+  for (size_t i = 0; i < indices.size(); i += 3) {
+    QVERIFY(indices[i] < vertexCount);
+    QVERIFY(indices[i + 1] < vertexCount);
+    QVERIFY(indices[i + 2] < vertexCount);
+
+    // Faces that collapse are dropped, not kept as slivers
+    QVERIFY(indices[i] != indices[i + 1]);
+    QVERIFY(indices[i + 1] != indices[i + 2]);
+    QVERIFY(indices[i] != indices[i + 2]);
+  }
+
+  for (const vec3& v : mesh.vertices()) {
+    // Each vertex stays in its own cell, which the sphere passes through
+    QVERIFY(qAbs(glm::length(v) - 1.f) < 0.2f);
+  }
+}
+
+void TestSimplifier::testSmallMeshHasOneLevel() {
+  Mesh mesh = icosphere(3);
+  size_t indexCount = mesh.indices().size();
+  QVERIFY(indexCount / 3 < LOD_MIN_TRIANGLES);
+
+  LodChain chain = buildLods(mesh, 4);
+
+  QCOMPARE(chain.levels.size(), size_t(1));
+  QCOMPARE(chain.levels[0].firstIndex, size_t(0));
+  QCOMPARE(chain.levels[0].indexCount, indexCount);
+  QCOMPARE(mesh.indices().size(), indexCount);
+}
+
+void TestSimplifier::testLods() {
+  Mesh mesh = icosphere(6);
+  size_t originalIndices = mesh.indices().size();
+  size_t originalVertices = mesh.vertices().size();
+  QVERIFY(originalIndices / 3 >= LOD_MIN_TRIANGLES);
+
+  size_t prepared = 0;
+  LodChain chain = buildLods(mesh, 4, [&prepared](Mesh&) {
+    ++prepared;
+  });
+
+  const vector<LodLevel>& levels = chain.levels;
+  const vector<Index>& indices = mesh.indices();
+  size_t vertexCount = mesh.vertices().size();
+
+  QVERIFY(levels.size() >= 3);
+  QVERIFY(levels.size() <= 5);
+  QCOMPARE(prepared, levels.size());
+  QCOMPARE(levels[0].firstIndex, size_t(0));
+  QCOMPARE(levels[0].indexCount, originalIndices);
+
+  for (size_t l = 0; l < levels.size(); ++l) {
+    const LodLevel& level = levels[l];
+    QCOMPARE(level.indexCount % 3, size_t(0));
+
+    if (l > 0) {
+      // Back to back, each coarser than the last
+      const LodLevel& finer = levels[l - 1];
+      QCOMPARE(level.firstIndex, finer.firstIndex + finer.indexCount);
+      QVERIFY(level.indexCount < finer.indexCount);
+    }
+
+    for (size_t i = level.firstIndex;
+         i < level.firstIndex + level.indexCount; ++i) {
+      QVERIFY(indices[i] < vertexCount);
+    }
+  }
+
+  QCOMPARE(levels.back().firstIndex + levels.back().indexCount,
+           indices.size());
+
+  for (size_t v = 0; v < originalVertices; ++v) {
+    QVERIFY(glm::distance(mesh.vertices()[v], chain.center) <=
+            chain.radius * 1.0001f);
+  }
+}
+
+QTEST_APPLESS_MAIN(TestSimplifier)
+
+#include "tst_TestSimplifier.moc"
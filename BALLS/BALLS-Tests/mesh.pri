@@ -0,0 +1,31 @@
+# The mesh code and what it needs, for tests that exercise it directly
+
+QT += concurrent
+
+INCLUDEPATH += $$PWD/../BALLS
+
+SOURCES += \
+	$$PWD/../BALLS/precompiled.cpp \
+	$$PWD/../BALLS/Constants.cpp \
+	$$PWD/../BALLS/exception/FileException.cpp \
+	$$PWD/../BALLS/mesh/Clusters.cpp \
+	$$PWD/../BALLS/mesh/Importer.cpp \
+	$$PWD/../BALLS/mesh/Mesh.cpp \
+	$$PWD/../BALLS/mesh/MeshFile.cpp \
+	$$PWD/../BALLS/mesh/MeshFunction.cpp \
+	$$PWD/../BALLS/mesh/MeshGenerator.cpp \
+	$$PWD/../BALLS/mesh/MeshOptimizer.cpp \
+	$$PWD/../BALLS/mesh/ParametricGrid.cpp \
+	$$PWD/../BALLS/mesh/Procedural.cpp \
+	$$PWD/../BALLS/mesh/Simplifier.cpp \
+	$$PWD/../BALLS/mesh/VertexFormat.cpp \
+	$$PWD/../BALLS/shader/ShaderInputs.cpp \
+	$$PWD/../BALLS/util/Logging.cpp \
+	$$PWD/../BALLS/util/Parallel.cpp \
+	$$PWD/../BALLS/util/Util.cpp
+
+# ImportNotifier is a Q_OBJECT, so moc has to see its header
+HEADERS += \
+	$$PWD/../BALLS/mesh/Importer.hpp
+
+DEFINES += GLM_META_PROG_HELPERS
@@ -19,7 +19,7 @@ upx:!UPX {
 
 
 ### <General Configuration> ####################################################
-QT = core gui widgets
+QT = core gui widgets concurrent
 TARGET = BALLS
 TEMPLATE = app
 QTILITIES = core coregui
@@ -67,7 +67,27 @@ SOURCES += \
 	ui/Uniforms.cpp \
 	util/TypeInfo.cpp \
 	ui/QsciLexerGLSL.cpp \
-	ui/property/MatrixProperties.cpp
+	ui/property/MatrixProperties.cpp \
+	mesh/ParametricGrid.cpp \
+	util/Parallel.cpp \
+	mesh/MeshCache.cpp \
+	mesh/MeshOptimizer.cpp \
+	mesh/VertexFormat.cpp \
+	mesh/Simplifier.cpp \
+	mesh/Importer.cpp \
+	mesh/MeshFile.cpp \
+	mesh/Instancing.cpp \
+	mesh/Clusters.cpp \
+	mesh/Procedural.cpp \
+	ui/FrameScheduler.cpp \
+	shader/UniformTable.cpp \
+	shader/BuiltinBlock.cpp \
+	util/GpuProfiler.cpp \
+	util/PipelineStats.cpp \
+	headless/HeadlessRenderer.cpp \
+	util/FrameCapture.cpp \
+	shader/ProgramCache.cpp \
+	shader/ShaderCompiler.cpp
 
 HEADERS  += \
 	precompiled.hpp \
@@ -102,7 +122,28 @@ HEADERS  += \
 	util/MetaTypeConverters.hpp \
 	util/TypeInfo.hpp \
 	ui/Uniforms.hpp \
-	ui/property/MatrixProperties.hpp
+	ui/property/MatrixProperties.hpp \
+	mesh/EdgeCache.hpp \
+	mesh/ParametricGrid.hpp \
+	util/Parallel.hpp \
+	mesh/MeshCache.hpp \
+	mesh/MeshOptimizer.hpp \
+	mesh/VertexFormat.hpp \
+	mesh/Simplifier.hpp \
+	mesh/Importer.hpp \
+	mesh/MeshFile.hpp \
+	mesh/Instancing.hpp \
+	mesh/Clusters.hpp \
+	mesh/Procedural.hpp \
+	ui/FrameScheduler.hpp \
+	shader/UniformTable.hpp \
+	shader/BuiltinBlock.hpp \
+	util/GpuProfiler.hpp \
+	util/PipelineStats.hpp \
+	headless/HeadlessRenderer.hpp \
+	util/FrameCapture.hpp \
+	shader/ProgramCache.hpp \
+	shader/ShaderCompiler.hpp
 
 FORMS += \
 	BallsWindow.ui \
@@ -20,6 +20,7 @@ const char* VERT = "vert";
 const char* UNIFORM = "uniform";
 const char* GL = "gl";
 const char* META = "meta";
+const char* MESH = "mesh";
 
 const char* W = "w";
 const char* X = "x";
@@ -38,6 +39,7 @@ const char* TESS = "tess";
 const char* VERT = "vert";
 const char* NUTS = "nuts";
 const char* NUTZ = "nutz";
+const char* MESH = "bmesh";
 }
 
 namespace filters {
@@ -51,6 +53,7 @@ const char* TESS = "*.tess";
 const char* VERT = "*.vert";
 const char* NUTS = "*.nuts";
 const char* NUTZ = "*.nutz";
+const char* MESH = "*.bmesh";
 }
 
 namespace meta {
@@ -28,6 +28,7 @@ extern const char* CONFIG;
 extern const char* UNIFORMS;
 extern const char* UNIFORM;
 extern const char* GL;
+extern const char* MESH;
 
 extern const char* W;
 extern const char* X;
@@ -53,6 +54,7 @@ extern const char* TESS;
 extern const char* VERT;
 extern const char* NUTS;
 extern const char* NUTZ;
+extern const char* MESH;
 }
 
 namespace filters {
@@ -66,6 +68,7 @@ extern const char* TESS;
 extern const char* VERT;
 extern const char* NUTS;
 extern const char* NUTZ;
+extern const char* MESH;
 }
 
 namespace meta {
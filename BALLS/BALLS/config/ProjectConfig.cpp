@@ -7,8 +7,10 @@
 #include "shader/ShaderUniform.hpp"
 #include "util/Logging.hpp"
 
+#include <QtCore/QDir>
 #include <QtCore/QString>
 #include <QtCore/QFile>
+#include <QtCore/QFileInfo>
 #include <QtCore/QJsonArray>
 #include <QtCore/QJsonDocument>
 #include <QtCore/QJsonObject>
@@ -59,6 +61,11 @@ void saveToFile(const ProjectConfig& project, const QString& path,
       {json::GL_MINOR, project.glMinor},
     };
     balls.insert(json::GL, gl);
+
+    if (!project.mesh.isEmpty()) {
+      QDir dir = QFileInfo(path).absoluteDir();
+      balls.insert(json::MESH, dir.relativeFilePath(project.mesh));
+    }
   }
   out.setObject(balls);
 
@@ -111,6 +118,12 @@ ProjectConfig loadFromFile(const QString& path) {
     p.fragmentShader = shaders[json::FRAG].toString();
   }
 
+  QString mesh = root[json::MESH].toString();
+
+  if (!mesh.isEmpty()) {
+    p.mesh = QFileInfo(path).absoluteDir().absoluteFilePath(mesh);
+  }
+
   QJsonObject uniforms = root[json::UNIFORMS].toObject();
   {
     for (const QString& u : uniforms.keys()) {
@@ -27,6 +27,10 @@ struct ProjectConfig {
   /// The geometry shader of this project (optional)
   QString geometryShader;
 
+  /// The absolute path of the mesh file this project draws (optional); saved
+  /// relative to the project, so the two can be moved together
+  QString mesh;
+
   /// The name of each uniform and their types and values
   unordered_map<QString, QVariant> uniforms;
 
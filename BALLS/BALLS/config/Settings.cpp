@@ -9,6 +9,17 @@ const QString DepthTestEnabled = "depth-test";
 const QString FaceCullingEnabled = "face-culling";
 const QString Dithering = "dithering";
 const QString ClipDistance = "clip-distance";
+const QString MeshCacheSize = "mesh-cache-size";
+const QString MeshCacheGpu = "mesh-cache-gpu";
+const QString MeshOptimize = "mesh-optimize";
+const QString MeshKeepCpu = "mesh-keep-cpu";
+const QString PositionFormat = "position-format";
+const QString NormalFormat = "normal-format";
+const QString MeshLodLevels = "mesh-lod-levels";
+const QString InstanceCount = "instance-count";
+const QString InstanceLayout = "instance-layout";
+const QString ClusterCulling = "cluster-culling";
+const QString ProceduralMeshes = "procedural-meshes";
 };
 
 }
@@ -13,6 +13,17 @@ const extern QString DepthTestEnabled;
 const extern QString FaceCullingEnabled;
 const extern QString Dithering;
 const extern QString ClipDistance;
+const extern QString MeshCacheSize;
+const extern QString MeshCacheGpu;
+const extern QString MeshOptimize;
+const extern QString MeshKeepCpu;
+const extern QString PositionFormat;
+const extern QString NormalFormat;
+const extern QString MeshLodLevels;
+const extern QString InstanceCount;
+const extern QString InstanceLayout;
+const extern QString ClusterCulling;
+const extern QString ProceduralMeshes;
 };
 
 
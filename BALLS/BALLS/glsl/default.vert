@@ -4,13 +4,14 @@ uniform mat4 matrix;
 
 in vec3 position;
 in vec3 normal;
+in mat4 instanceTransform;
 
 out vec3 fragPosition;
 out vec3 fragNormal;
 
 void main(void)
 {
-    gl_Position = matrix * vec4(position, 1);
+    gl_Position = matrix * instanceTransform * vec4(position, 1);
     fragPosition = gl_Position.xyz;
-    fragNormal = normal;
+    fragNormal = normalize(mat3(instanceTransform) * normal);
 }
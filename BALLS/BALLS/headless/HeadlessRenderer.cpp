@@ -0,0 +1,595 @@
+#include "precompiled.hpp"
+#include "headless/HeadlessRenderer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <exception>
+#include <vector>
+
+#include <QtCore/QCommandLineParser>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtGui/QImageWriter>
+#include <QtGui/QOffscreenSurface>
+#include <QtGui/QOpenGLBuffer>
+#include <QtGui/QOpenGLContext>
+#include <QtGui/QOpenGLFramebufferObject>
+#include <QtGui/QOpenGLFunctions>
+#include <QtGui/QOpenGLFunctions_3_0>
+#include <QtGui/QOpenGLFunctions_3_1>
+#include <QtGui/QOpenGLFunctions_3_3_Core>
+#include <QtGui/QOpenGLFunctions_4_0_Core>
+#include <QtGui/QOpenGLShaderProgram>
+#include <QtGui/QOpenGLVertexArrayObject>
+#include <QtGui/QResizeEvent>
+
+#include "config/ProjectConfig.hpp"
+#include "exception/FileException.hpp"
+#include "exception/JsonException.hpp"
+#include "mesh/Generators.hpp"
+#include "mesh/Importer.hpp"
+#include "mesh/MeshFile.hpp"
+#include "mesh/MeshGenerator.hpp"
+#include "mesh/VertexFormat.hpp"
+#include "shader/BuiltinBlock.hpp"
+#include "shader/ShaderInputs.hpp"
+#include "shader/UniformTable.hpp"
+#include "ui/Uniforms.hpp"
+#include "util/GpuProfiler.hpp"
+#include "util/Logging.hpp"
+
+namespace balls {
+namespace headless {
+
+using std::vector;
+
+constexpr int OPENGL_MAJOR = 3;
+constexpr int OPENGL_MINOR = 3;
+constexpr int DEPTH_BUFFER_BITS = 24;
+constexpr int SAMPLES = 4;
+// The same as the canvas, so frames look the same as they do in the window
+
+const QCommandLineOption RENDER(
+  {"r", "render"},
+  QCoreApplication::translate("headless",
+                              "Render <project> without a window, then quit."),
+  "project");
+
+const QCommandLineOption OUTPUT(
+  {"o", "output"},
+  QCoreApplication::translate("headless",
+                              "Write frames and report.json to <directory>."),
+  "directory", ".");
+
+const QCommandLineOption FRAMES(
+  {"n", "frames"},
+  QCoreApplication::translate("headless", "Render <count> frames."),
+  "count", "60");
+
+const QCommandLineOption SIZE(
+  {"s", "size"},
+  QCoreApplication::translate("headless", "Render at <width>x<height>."),
+  "size", "512x512");
+
+const QCommandLineOption TIME_STEP(
+  {"t", "time-step"},
+  QCoreApplication::translate("headless",
+                              "Advance elapsedTime by <ms> every frame."),
+  "ms", "16");
+
+const QCommandLineOption FORMAT(
+  {"f", "format"},
+  QCoreApplication::translate("headless", "Write frames as png or exr."),
+  "format", "png");
+
+void addOptions(QCommandLineParser& parser) noexcept {
+  parser.addOptions({RENDER, OUTPUT, FRAMES, SIZE, TIME_STEP, FORMAT});
+}
+
+bool requested(const QCommandLineParser& parser) noexcept {
+  return parser.isSet(RENDER);
+}
+
+bool readOptions(const QCommandLineParser& parser, Options& options) noexcept {
+  bool frames = false;
+  bool step = false;
+  QStringList size = parser.value(SIZE).split('x');
+
+  options.project = parser.value(RENDER);
+  options.output = parser.value(OUTPUT);
+  options.frames = parser.value(FRAMES).toInt(&frames);
+  options.timeStep = parser.value(TIME_STEP).toUInt(&step);
+  options.format = parser.value(FORMAT).toLower().toLatin1();
+
+  if (size.size() == 2) {
+    options.size = QSize(size[0].toInt(), size[1].toInt());
+  }
+
+  if (!frames || options.frames < 1) {
+    qCCritical(logs::app::headless::Name) << "Need at least one frame, not"
+                                          << parser.value(FRAMES);
+    return false;
+  }
+
+  if (!step) {
+    qCCritical(logs::app::headless::Name) << "Not a time step:"
+                                          << parser.value(TIME_STEP);
+    return false;
+  }
+
+  if (options.size.isEmpty()) {
+    qCCritical(logs::app::headless::Name) << "Not a size:"
+                                          << parser.value(SIZE);
+    return false;
+  }
+
+  if (options.format != "png" && options.format != "exr") {
+    qCCritical(logs::app::headless::Name) << "Can't write frames as"
+                                          << options.format;
+    return false;
+  }
+
+  if (!QImageWriter::supportedImageFormats().contains(options.format)) {
+    // EXR needs a plugin (e.g. from KImageFormats) that may not be installed
+    qCWarning(logs::app::headless::Name)
+        << "No image plugin for" << options.format << "; writing png instead";
+    options.format = "png";
+  }
+
+  return true;
+}
+
+/// Min, median and 99th percentile of a list of times
+static QJsonObject _summarize(vector<double> times) noexcept {
+  std::sort(times.begin(), times.end());
+  size_t n = times.size();
+  size_t p99 = std::min(n - 1, static_cast<size_t>(std::ceil(0.99 * n)) - 1);
+
+  return {
+    {"min", times.front()},
+    {"median", times[n / 2]},
+    {"p99", times[p99]},
+  };
+}
+
+/// Everything that has to exist while the context is current
+class Renderer {
+public:
+  Renderer(const Options& options, QOpenGLContext& context) noexcept;
+  ~Renderer();
+
+  int run() noexcept;
+
+private:
+  bool _compile(const config::ProjectConfig&) noexcept;
+  bool _loadMesh(const config::ProjectConfig&) noexcept;
+  void _initUniforms(const config::ProjectConfig&) noexcept;
+  void _draw() noexcept;
+  bool _writeReport(const QJsonArray& frames, const vector<double>& times)
+  const noexcept;
+
+  const Options& _options;
+  QOpenGLFunctions* _gl;
+  QOpenGLFunctions_3_0* _gl30;
+  QOpenGLFunctions_3_1* _gl31;
+  QOpenGLFunctions_3_3_Core* _gl33;
+  QOpenGLFunctions_4_0_Core* _gl40;
+
+  QOpenGLShaderProgram _program;
+  QOpenGLVertexArrayObject _vao;
+  QOpenGLBuffer _vbo;
+  QOpenGLBuffer _ibo;
+  GLenum _indexType;
+  GLsizei _indexCount;
+
+  Uniforms _uniforms;
+  shader::UniformTable _uniformTable;
+  shader::BuiltinBlock _builtinBlock;
+  bool _usesBuiltinBlock;
+  util::GpuProfiler _profiler;
+};
+
+template<class QOpenGLF>
+static QOpenGLF* _functions(QOpenGLContext& context) noexcept {
+  QOpenGLF* gl = context.versionFunctions<QOpenGLF>();
+
+  if (gl != nullptr) {
+    gl->initializeOpenGLFunctions();
+  }
+
+  return gl;
+}
+
+Renderer::Renderer(const Options& options, QOpenGLContext& context) noexcept
+  : _options(options),
+    _gl(context.functions()),
+    _gl30(_functions<QOpenGLFunctions_3_0>(context)),
+    _gl31(_functions<QOpenGLFunctions_3_1>(context)),
+    _gl33(_functions<QOpenGLFunctions_3_3_Core>(context)),
+    _gl40(_functions<QOpenGLFunctions_4_0_Core>(context)),
+    _vbo(QOpenGLBuffer::VertexBuffer),
+    _ibo(QOpenGLBuffer::IndexBuffer),
+    _indexType(GL_UNSIGNED_SHORT),
+    _indexCount(0),
+    _usesBuiltinBlock(false) {
+}
+
+Renderer::~Renderer() {
+  _profiler.destroy();
+  _builtinBlock.destroy();
+  _ibo.destroy();
+  _vbo.destroy();
+  _vao.destroy();
+  _program.removeAllShaders();
+}
+
+int Renderer::run() noexcept {
+  using config::ProjectConfig;
+
+  if (_gl30 == nullptr) {
+    qCCritical(logs::app::headless::Name) << "BALLS needs OpenGL 3.0";
+    return EXIT_FAILURE;
+  }
+
+  ProjectConfig project;
+
+  try {
+    project = config::loadFromFile(_options.project);
+  }
+  catch (const FileException& e) {
+    qCCritical(logs::app::headless::Name) << e.fullMessage();
+    return EXIT_FAILURE;
+  }
+  catch (const JsonException& e) {
+    qCCritical(logs::app::headless::Name) << e.fullMessage();
+    return EXIT_FAILURE;
+  }
+
+  if (!QDir().mkpath(_options.output)) {
+    qCCritical(logs::app::headless::Name) << "Couldn't create"
+                                          << _options.output;
+    return EXIT_FAILURE;
+  }
+
+  if (!_compile(project) || !_loadMesh(project)) {
+    return EXIT_FAILURE;
+  }
+
+  _initUniforms(project);
+
+  QOpenGLFramebufferObjectFormat format;
+  format.setAttachment(QOpenGLFramebufferObject::CombinedDepthStencil);
+  format.setSamples(SAMPLES);
+
+  QOpenGLFramebufferObject fbo(_options.size, format);
+
+  if (!fbo.isValid()) {
+    qCCritical(logs::app::headless::Name) << "Couldn't create a"
+                                          << _options.size << "framebuffer";
+    return EXIT_FAILURE;
+  }
+
+  fbo.bind();
+  _gl->glViewport(0, 0, _options.size.width(), _options.size.height());
+  _gl->glEnable(GL_DEPTH_TEST);
+  _gl->glEnable(GL_CULL_FACE);
+  // The canvas's defaults
+
+  QDir output(_options.output);
+  QString suffix = QString::fromLatin1(_options.format);
+  QJsonArray frames;
+  vector<double> times;
+  times.reserve(_options.frames);
+
+  for (int i = 0; i < _options.frames; ++i) {
+    qint64 time = qint64(i) * _options.timeStep;
+    QElapsedTimer timer;
+    timer.start();
+
+    _uniforms.setFixedTime(time);
+    fbo.bind();
+    _draw();
+    double submitted = timer.nsecsElapsed() / 1e6;
+
+    _gl->glFinish();
+    double finished = timer.nsecsElapsed() / 1e6;
+    // Only the GPU passes are timed by the profiler; this is the whole frame
+
+    QString path = output.filePath(QString("frame%1.%2")
+                                   .arg(i, 5, 10, QChar('0')).arg(suffix));
+
+    if (!fbo.toImage().save(path, _options.format.constData())) {
+      qCCritical(logs::app::headless::Name) << "Couldn't write" << path;
+      return EXIT_FAILURE;
+    }
+
+    frames.append(QJsonObject {
+      {"frame", i},
+      {"elapsedTime", time},
+      {"submitMs", submitted},
+      {"frameMs", finished},
+    });
+    times.push_back(finished);
+  }
+
+  _profiler.beginFrame();
+  // Everything's finished by now, so this collects the last frames' times
+
+  if (!_writeReport(frames, times)) {
+    return EXIT_FAILURE;
+  }
+
+  qCInfo(logs::app::headless::Name) << "Rendered" << _options.frames
+                                    << "frames to" << output.absolutePath();
+  return EXIT_SUCCESS;
+}
+
+bool Renderer::_compile(const config::ProjectConfig& project) noexcept {
+  using namespace shader;
+
+  bool vert = _program.addShaderFromSourceCode(QOpenGLShader::Vertex,
+                                               project.vertexShader);
+  bool frag = _program.addShaderFromSourceCode(QOpenGLShader::Fragment,
+                                               project.fragmentShader);
+
+  if (vert && frag) {
+    bindAttributeLocations(_program);
+    _gl30->glBindFragDataLocation(_program.programId(), 0,
+                                  qPrintable(out::FRAGMENT));
+  }
+
+  if (!(vert && frag && _program.link() && _program.bind())) {
+    qCCritical(logs::app::headless::Name) << "Couldn't build the shaders:"
+                                          << qPrintable(_program.log());
+    return false;
+  }
+
+  return true;
+}
+
+bool Renderer::_loadMesh(const config::ProjectConfig& project) noexcept {
+  using namespace mesh;
+  using namespace shader;
+
+  QString name = project.mesh.isEmpty() ? generators::quad.getName() :
+                 QFileInfo(project.mesh).fileName();
+  bool prebuilt = meshFileFormat(project.mesh) == MeshFileFormat::BallsMesh;
+  VertexFormat format;
+  size_t vertexCount = 0;
+
+  _vao.create();
+  _vao.bind();
+  _vbo.create();
+  _vbo.bind();
+  _ibo.create();
+  _ibo.bind();
+
+  try {
+    // Not through functions::file, which reports failures to the window and
+    // returns an empty mesh; there's no window here, so they have to be fatal
+    if (prebuilt) {
+      shared_ptr<const MeshFile> file = MeshFile::open(project.mesh);
+      const MeshFileInfo& info = file->info();
+      constexpr size_t MAX_BYTES = size_t(std::numeric_limits<int>::max());
+
+      if (info.format.normalFormat() == NormalFormat::Int2_10_10_10 &&
+          _gl33 == nullptr) {
+        throw ImportException(project.mesh, "Packed normals need OpenGL 3.3");
+      }
+      else if (file->vertexDataSize() > MAX_BYTES ||
+               file->indexDataSize() > MAX_BYTES) {
+        throw ImportException(project.mesh, "Too big to upload");
+      }
+
+      _vbo.allocate(file->vertexData(), int(file->vertexDataSize()));
+      _ibo.allocate(file->indexData(), int(file->indexDataSize()));
+      format = info.format;
+      vertexCount = info.vertexCount;
+      _indexType = info.indexType;
+      _indexCount = static_cast<GLsizei>(info.indexCount);
+      _uniforms.setMeshTransform(info.quantization.matrix());
+    }
+    else {
+      Mesh mesh = project.mesh.isEmpty() ? generators::quad.getMesh() :
+                  importMesh(project.mesh);
+      // The window starts with the first generator too
+
+      vector<Mesh::CoordType> vertices = mesh.combined();
+      vector<char> indices(mesh.indexDataSize());
+      mesh.writeIndices(indices.data());
+      vertexCount = mesh.vertices().size();
+      _indexType = mesh.indexType();
+      _indexCount = static_cast<GLsizei>(mesh.indices().size());
+
+      _vbo.allocate(vertices.data(), static_cast<int>(
+                      vertices.size() * sizeof(Mesh::CoordType)));
+      _ibo.allocate(indices.data(), static_cast<int>(indices.size()));
+    }
+  }
+  catch (const FileException& e) {
+    qCCritical(logs::app::headless::Name) << "Couldn't load" << name << ":"
+                                          << e.fullMessage();
+    return false;
+  }
+  catch (const std::exception& e) {
+    // Includes running out of memory, which a big enough scan can do
+    qCCritical(logs::app::headless::Name) << "Couldn't load" << name << ":"
+                                          << e.what();
+    return false;
+  }
+
+  if (_indexCount == 0) {
+    // Rendering nothing would still "succeed", which is worse than failing
+    qCCritical(logs::app::headless::Name) << "Couldn't load" << name
+                                          << ": it has no triangles";
+    return false;
+  }
+
+  const AttributeLayout& p = format.position();
+  const AttributeLayout& n = format.normal();
+  int position = _program.attributeLocation(attribute::POSITION);
+  int normal = _program.attributeLocation(attribute::NORMAL);
+
+  if (position != -1) {
+    _gl->glVertexAttribPointer(position, p.components, p.type, p.normalized,
+                               format.stride(),
+                               reinterpret_cast<void*>(p.offset));
+    _gl->glEnableVertexAttribArray(position);
+  }
+
+  if (normal != -1) {
+    _gl->glVertexAttribPointer(normal, n.components, n.type, n.normalized,
+                               format.stride(),
+                               reinterpret_cast<void*>(n.offset));
+    _gl->glEnableVertexAttribArray(normal);
+  }
+
+  for (GLuint c = 0; c < 4; ++c) {
+    _gl->glVertexAttrib4f(INSTANCE_TRANSFORM_LOCATION + c, c == 0, c == 1,
+                          c == 2, c == 3);
+  }
+
+  _gl->glVertexAttrib4f(INSTANCE_COLOR_LOCATION, 1, 1, 1, 1);
+  _gl30->glVertexAttribI4ui(INSTANCE_ID_LOCATION, 0, 0, 0, 0);
+  // One copy, left where it is, as the canvas draws it by default
+
+  qCDebug(logs::app::headless::Name) << "Loaded" << name << "with"
+                                     << vertexCount << "vertices";
+  return true;
+}
+
+void Renderer::_initUniforms(const config::ProjectConfig& project) noexcept {
+  QObject canvas;
+  canvas.installEventFilter(&_uniforms);
+  QResizeEvent resize(_options.size, _options.size);
+  QCoreApplication::sendEvent(&canvas, &resize);
+  // Uniforms learns the canvas's size the same way it does in the window
+
+  GLuint program = _program.programId();
+  _uniforms.receiveUniforms(shader::activeUniforms(*_gl, program));
+
+  for (const auto& uniform : project.uniforms) {
+    QByteArray name = uniform.first.toUtf8();
+
+    if (_uniforms.property(name.constData()).isValid()) {
+      // Otherwise the shader doesn't use it (any more)
+      _uniforms.setProperty(name.constData(), uniform.second);
+    }
+  }
+
+  _uniformTable.build({_gl30, _gl40}, program, _uniforms.uniformInfo(),
+                      _uniforms);
+
+  if (_builtinBlock.create(_gl31)) {
+    _usesBuiltinBlock = _builtinBlock.attach(program);
+  }
+
+  _profiler.create(_gl33);
+}
+
+void Renderer::_draw() noexcept {
+  _profiler.beginFrame();
+
+  _profiler.beginPass("clear");
+  _gl->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  _profiler.endPass();
+
+  _uniforms.refresh();
+  _uniformTable.upload();
+
+  if (_usesBuiltinBlock) {
+    _builtinBlock.update(_uniforms.builtinBlock());
+  }
+
+  _profiler.beginPass("draw");
+  _vao.bind();
+  _gl->glDrawElements(GL_TRIANGLES, _indexCount, _indexType, nullptr);
+  _profiler.endPass();
+}
+
+bool Renderer::_writeReport(const QJsonArray& frames,
+                            const vector<double>& times) const noexcept {
+  QJsonArray passes;
+
+  for (const util::GpuProfiler::Stats& stats : _profiler.stats()) {
+    passes.append(QJsonObject {
+      {"pass", stats.pass},
+      {"minMs", stats.min},
+      {"medianMs", stats.median},
+      {"p99Ms", stats.p99},
+      {"samples", static_cast<int>(stats.samples)},
+    });
+  }
+
+  auto string = [this](const GLenum name) {
+    return QString(reinterpret_cast<const char*>(_gl->glGetString(name)));
+  };
+
+  QJsonObject report {
+    {"project", QFileInfo(_options.project).absoluteFilePath()},
+    {"renderer", string(GL_RENDERER)},
+    {"version", string(GL_VERSION)},
+    {"width", _options.size.width()},
+    {"height", _options.size.height()},
+    {"timeStep", static_cast<int>(_options.timeStep)},
+    {"frameMs", _summarize(times)},
+    {"passes", passes},
+    {"frames", frames},
+  };
+
+  QFile file(QDir(_options.output).filePath("report.json"));
+
+  if (!file.open(QFile::WriteOnly | QFile::Truncate | QFile::Text)) {
+    qCCritical(logs::app::headless::Name) << "Couldn't write"
+                                          << file.fileName();
+    return false;
+  }
+
+  file.write(QJsonDocument(report).toJson());
+  return true;
+}
+
+int render(const Options& options) noexcept {
+  QSurfaceFormat format;
+  format.setVersion(OPENGL_MAJOR, OPENGL_MINOR);
+  format.setProfile(QSurfaceFormat::CoreProfile);
+  format.setDepthBufferSize(DEPTH_BUFFER_BITS);
+
+  QOpenGLContext context;
+  context.setFormat(format);
+
+  if (!context.create()) {
+    qCCritical(logs::app::headless::Name) << "Couldn't create an OpenGL"
+                                          << OPENGL_MAJOR << "." << OPENGL_MINOR
+                                          << "context";
+    return EXIT_FAILURE;
+  }
+
+  QOffscreenSurface surface;
+  surface.setFormat(context.format());
+  surface.create();
+
+  if (!surface.isValid() || !context.makeCurrent(&surface)) {
+    qCCritical(logs::app::headless::Name) << "Couldn't create an offscreen"
+                                          << "surface";
+    return EXIT_FAILURE;
+  }
+
+  qCDebug(logs::app::headless::Name) << "Rendering" << options.project
+                                     << "with" << context.format();
+
+  int result = Renderer(options, context).run();
+  // Frees every GL object while the context is still current
+
+  context.doneCurrent();
+  return result;
+}
+}
+}
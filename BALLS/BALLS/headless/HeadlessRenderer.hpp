@@ -0,0 +1,56 @@
+#ifndef HEADLESSRENDERER_HPP
+#define HEADLESSRENDERER_HPP
+
+#include <QtCore/QByteArray>
+#include <QtCore/QSize>
+#include <QtCore/QString>
+
+class QCommandLineParser;
+
+namespace balls {
+namespace headless {
+
+/// How to render a project without a window
+struct Options {
+  /// The .balls project to render
+  QString project;
+
+  /// The directory the frames and the report go in
+  QString output;
+
+  int frames;
+  QSize size;
+
+  /// How much elapsedTime advances between frames, in milliseconds
+  unsigned timeStep;
+
+  /// The image format the frames are written in ("png" or "exr")
+  QByteArray format;
+};
+
+/// Adds --render and the options that go with it
+void addOptions(QCommandLineParser&) noexcept;
+
+/// True if --render was given
+bool requested(const QCommandLineParser&) noexcept;
+
+/**
+ * @brief Reads the options back; returns false (after logging why) if any of
+ * them don't make sense.
+ */
+bool readOptions(const QCommandLineParser&, Options&) noexcept;
+
+/**
+ * @brief Renders the project into a framebuffer object on an offscreen surface
+ * with a fixed resolution and time step, writes every frame as an image, and
+ * finishes with report.json, which has the time each frame and each GPU pass
+ * took. Needs no display, so it works under QT_QPA_PLATFORM=offscreen (e.g. on
+ * Mesa's llvmpipe).
+ *
+ * Returns the process's exit code.
+ */
+int render(const Options&) noexcept;
+}
+}
+
+#endif // HEADLESSRENDERER_HPP
@@ -2,10 +2,14 @@
 #include "ui/BallsWindow.hpp"
 
 #include "Constants.hpp"
+#include "headless/HeadlessRenderer.hpp"
 #include "util/Logging.hpp"
 #include "util/MetaTypeConverters.hpp"
 
+#include <cstdlib>
+
 #include <QApplication>
+#include <QCommandLineParser>
 
 int main(int argc, char* argv[]) {
   using namespace balls::logs;
@@ -28,6 +32,23 @@ int main(int argc, char* argv[]) {
   qCDebug(system::Platform) << balls.platformName();
   qCDebug(system::PID) << balls.applicationPid();
 
+  QCommandLineParser parser;
+  parser.addHelpOption();
+  parser.addVersionOption();
+  balls::headless::addOptions(parser);
+  parser.process(balls);
+
+  if (balls::headless::requested(parser)) {
+    // No window at all, so this also works with QT_QPA_PLATFORM=offscreen
+    balls::headless::Options options;
+
+    if (!balls::headless::readOptions(parser, options)) {
+      return EXIT_FAILURE;
+    }
+
+    return balls::headless::render(options);
+  }
+
   balls::BallsWindow w;
   w.show();
   return balls.exec();
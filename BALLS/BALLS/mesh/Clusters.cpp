@@ -0,0 +1,291 @@
+#include "precompiled.hpp"
+#include "mesh/Clusters.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define BALLS_SSE
+#include <xmmintrin.h>
+#endif
+
+#include "util/Parallel.hpp"
+
+namespace balls {
+namespace mesh {
+
+typedef Mesh::IndexType IndexType;
+
+constexpr float CONE_LIMIT = 0.7f;
+// A triangle whose normal is more than about 45 degrees from its cluster's
+// average may start a new cluster
+
+constexpr size_t FACE_GRAIN = 1 << 14;
+
+constexpr size_t CLUSTER_GRAIN = 256;
+
+size_t ClusterSet::bytes() const noexcept {
+  size_t floats = centerX.capacity() + centerY.capacity() +
+                  centerZ.capacity() + radius.capacity() + axisX.capacity() +
+                  axisY.capacity() + axisZ.capacity() + cutoff.capacity();
+
+  return floats * sizeof(float) + firstIndex.capacity() * sizeof(size_t) +
+         indexCount.capacity() * sizeof(GLsizei) +
+         levels.capacity() * sizeof(ClusterRange);
+}
+
+// Computes the bounding sphere and normal cone of every cluster in [begin, end)
+static void _bounds(const Mesh& mesh, const vector<vec3>& normals,
+                    ClusterSet& set, const size_t begin, const size_t end)
+noexcept {
+  const vector<vec3>& vertices = mesh.vertices();
+  const vector<IndexType>& indices = mesh.indices();
+
+  for (size_t c = begin; c < end; ++c) {
+    size_t first = set.firstIndex[c];
+    size_t last = first + set.indexCount[c];
+    vec3 low = vertices[indices[first]];
+    vec3 high = low;
+    vec3 sum(0);
+
+    for (size_t i = first; i < last; ++i) {
+      low = glm::min(low, vertices[indices[i]]);
+      high = glm::max(high, vertices[indices[i]]);
+    }
+
+    vec3 center = (low + high) * 0.5f;
+    float radius = 0;
+
+    for (size_t i = first; i < last; ++i) {
+      radius = std::max(radius, glm::length(vertices[indices[i]] - center));
+    }
+
+    for (size_t f = first / 3; f < last / 3; ++f) {
+      sum += normals[f];
+    }
+
+    float length = glm::length(sum);
+    vec3 axis = (length > 0) ? sum / length : vec3(0);
+    float minDot = (length > 0) ? 1 : -1;
+
+    for (size_t f = first / 3; f < last / 3; ++f) {
+      if (normals[f] != vec3(0)) {
+        // Degenerate faces can't be seen from any side, so they don't count
+        minDot = std::min(minDot, glm::dot(normals[f], axis));
+      }
+    }
+
+    set.centerX[c] = center.x;
+    set.centerY[c] = center.y;
+    set.centerZ[c] = center.z;
+    set.radius[c] = radius;
+    set.axisX[c] = axis.x;
+    set.axisY[c] = axis.y;
+    set.axisZ[c] = axis.z;
+    set.cutoff[c] = (minDot > 0) ? std::sqrt(1 - minDot * minDot) : 1;
+    // The cone's half-angle is acos(minDot); if that's 90 degrees or more, some
+    // face in the cluster faces the camera from anywhere
+  }
+}
+
+ClusterSet buildClusters(const Mesh& mesh, const LodChain& lods) noexcept {
+  const vector<vec3>& vertices = mesh.vertices();
+  const vector<IndexType>& indices = mesh.indices();
+  size_t triangles = indices.size() / 3;
+  vector<vec3> normals(triangles);
+
+  util::parallelFor(triangles,
+  [&](const size_t begin, const size_t end) noexcept {
+    for (size_t f = begin; f < end; ++f) {
+      const IndexType* t = indices.data() + f * 3;
+      const vec3& a = vertices[t[0]];
+      vec3 n = glm::cross(vertices[t[1]] - a, vertices[t[2]] - a);
+      float length = glm::length(n);
+      normals[f] = (length > 0) ? n / length : vec3(0);
+    }
+  }, FACE_GRAIN);
+
+  ClusterSet set;
+  set.firstIndex.reserve(triangles / CLUSTER_MIN_TRIANGLES + lods.levels.size());
+  set.indexCount.reserve(set.firstIndex.capacity());
+
+  auto close = [&set](const size_t begin, const size_t end) {
+    set.firstIndex.push_back(begin * 3);
+    set.indexCount.push_back(static_cast<GLsizei>((end - begin) * 3));
+  };
+
+  vector<LodLevel> levels = lods.levels;
+
+  if (levels.empty()) {
+    levels.push_back({0, indices.size()});
+  }
+
+  for (const LodLevel& level : levels) {
+    // Clusters never cross levels, so each level can be drawn on its own
+    ClusterRange range = {set.size(), 0};
+    size_t start = level.firstIndex / 3;
+    size_t end = start + level.indexCount / 3;
+    vec3 sum(0);
+
+    for (size_t f = start; f < end; ++f) {
+      size_t size = f - start;
+
+      if (size >= CLUSTER_MAX_TRIANGLES ||
+          (size >= CLUSTER_MIN_TRIANGLES &&
+           glm::dot(normals[f], sum) < CONE_LIMIT * glm::length(sum))) {
+        close(start, f);
+        start = f;
+        sum = vec3(0);
+      }
+
+      sum += normals[f];
+    }
+
+    if (start < end) {
+      close(start, end);
+    }
+
+    range.count = set.size() - range.first;
+    set.levels.push_back(range);
+  }
+
+  size_t count = set.size();
+
+  for (vector<float>* field : {
+         &set.centerX, &set.centerY, &set.centerZ, &set.radius, &set.axisX,
+         &set.axisY, &set.axisZ, &set.cutoff
+       }) {
+    field->resize(count);
+  }
+
+  util::parallelFor(count, [&](const size_t begin, const size_t end) noexcept {
+    _bounds(mesh, normals, set, begin, end);
+  }, CLUSTER_GRAIN);
+
+  return set;
+}
+
+// The scalar version of the test in cullClusters()
+static bool _visible(const ClusterSet& set, const size_t c,
+                     const ClusterView& view) noexcept {
+  vec3 center(set.centerX[c], set.centerY[c], set.centerZ[c]);
+  float radius = set.radius[c];
+
+  for (const vec4& plane : view.planes) {
+    if (glm::dot(vec3(plane), center) + plane.w <= -radius) {
+      return false;
+    }
+  }
+
+  if (view.cullBackfaces) {
+    vec3 axis(set.axisX[c], set.axisY[c], set.axisZ[c]);
+    vec3 v = center - view.camera;
+    float k = set.cutoff[c];
+
+    if (glm::dot(v, axis) > k * glm::length(v) + radius * (1 + k)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+size_t cullClusters(const ClusterSet& clusters, const ClusterRange& range,
+                    const ClusterView& view, const size_t indexSize,
+                    vector<GLsizei>& counts, vector<const void*>& offsets)
+noexcept {
+  counts.clear();
+  offsets.clear();
+  // Cleared, not shrunk; the same vectors are reused every frame
+
+  size_t next = 0;
+
+  auto keep = [&](const size_t c) {
+    size_t first = clusters.firstIndex[c];
+
+    if (!counts.empty() && first == next) {
+      // If this cluster picks up where the last visible one left off...
+      counts.back() += clusters.indexCount[c];
+    }
+    else {
+      counts.push_back(clusters.indexCount[c]);
+      offsets.push_back(reinterpret_cast<const void*>(first * indexSize));
+    }
+
+    next = first + clusters.indexCount[c];
+  };
+
+  size_t c = range.first;
+  size_t end = range.first + range.count;
+
+  #ifdef BALLS_SSE
+  __m128 px[6], py[6], pz[6], pw[6];
+
+  for (int p = 0; p < 6; ++p) {
+    px[p] = _mm_set1_ps(view.planes[p].x);
+    py[p] = _mm_set1_ps(view.planes[p].y);
+    pz[p] = _mm_set1_ps(view.planes[p].z);
+    pw[p] = _mm_set1_ps(view.planes[p].w);
+  }
+
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1);
+  const __m128 cameraX = _mm_set1_ps(view.camera.x);
+  const __m128 cameraY = _mm_set1_ps(view.camera.y);
+  const __m128 cameraZ = _mm_set1_ps(view.camera.z);
+
+  for (; c + 4 <= end; c += 4) {
+    // Each lane tests one cluster; the arrays are already laid out that way
+    __m128 x = _mm_loadu_ps(clusters.centerX.data() + c);
+    __m128 y = _mm_loadu_ps(clusters.centerY.data() + c);
+    __m128 z = _mm_loadu_ps(clusters.centerZ.data() + c);
+    __m128 r = _mm_loadu_ps(clusters.radius.data() + c);
+    __m128 negativeR = _mm_sub_ps(zero, r);
+    __m128 visible = _mm_cmpeq_ps(zero, zero);
+
+    for (int p = 0; p < 6; ++p) {
+      __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px[p], x),
+                                       _mm_mul_ps(py[p], y)),
+                            _mm_add_ps(_mm_mul_ps(pz[p], z), pw[p]));
+      visible = _mm_and_ps(visible, _mm_cmpgt_ps(d, negativeR));
+    }
+
+    if (view.cullBackfaces) {
+      __m128 vx = _mm_sub_ps(x, cameraX);
+      __m128 vy = _mm_sub_ps(y, cameraY);
+      __m128 vz = _mm_sub_ps(z, cameraZ);
+      __m128 k = _mm_loadu_ps(clusters.cutoff.data() + c);
+      __m128 dot = _mm_add_ps(_mm_add_ps(
+                                _mm_mul_ps(vx, _mm_loadu_ps(clusters.axisX.data() + c)),
+                                _mm_mul_ps(vy, _mm_loadu_ps(clusters.axisY.data() + c))),
+                              _mm_mul_ps(vz, _mm_loadu_ps(clusters.axisZ.data() + c)));
+      __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx),
+                                             _mm_mul_ps(vy, vy)),
+                                             _mm_mul_ps(vz, vz)));
+      __m128 limit = _mm_add_ps(_mm_mul_ps(k, length),
+                                _mm_mul_ps(r, _mm_add_ps(one, k)));
+      visible = _mm_andnot_ps(_mm_cmpgt_ps(dot, limit), visible);
+    }
+
+    int mask = _mm_movemask_ps(visible);
+
+    for (int k = 0; k < 4; ++k) {
+      if (mask & (1 << k)) {
+        keep(c + k);
+      }
+    }
+  }
+  #endif
+
+  for (; c < end; ++c) {
+    // The scalar fallback, and whatever's left over after the SIMD loop
+    if (_visible(clusters, c, view)) {
+      keep(c);
+    }
+  }
+
+  return counts.size();
+}
+}
+}
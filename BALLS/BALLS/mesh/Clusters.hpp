@@ -0,0 +1,111 @@
+#ifndef CLUSTERS_HPP
+#define CLUSTERS_HPP
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+#include <QtGui/qopengl.h>
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include "mesh/Mesh.hpp"
+#include "mesh/Simplifier.hpp"
+
+namespace balls {
+namespace mesh {
+
+using std::array;
+using std::size_t;
+using std::vector;
+using glm::vec3;
+using glm::vec4;
+
+/// Clusters are closed once they have this many triangles...
+constexpr size_t CLUSTER_MAX_TRIANGLES = 128;
+
+/// ...or once they have this many and the next triangle would widen the
+/// cluster's normal cone too much
+constexpr size_t CLUSTER_MIN_TRIANGLES = 64;
+
+/// A contiguous run of clusters
+struct ClusterRange {
+  size_t first;
+  size_t count;
+};
+
+/**
+ * @brief A mesh's index buffer cut into clusters of consecutive triangles,
+ * with what's needed to tell whether each one can be seen.
+ *
+ * Every field is its own array (structure-of-arrays), so that cullClusters()
+ * can test four clusters at a time with SIMD.
+ */
+struct ClusterSet {
+  /// Bounding spheres, in the mesh's own space
+  vector<float> centerX, centerY, centerZ, radius;
+
+  /**
+   * @brief Normal cones; every face's normal is within the cone around the
+   * axis. cutoff is the sine of its half-angle, or 1 if the cone is too wide
+   * for the cluster to ever be entirely back-facing.
+   */
+  vector<float> axisX, axisY, axisZ, cutoff;
+
+  vector<size_t> firstIndex;
+  vector<GLsizei> indexCount;
+
+  /// The clusters of each level of detail in the mesh's LodChain
+  vector<ClusterRange> levels;
+
+  size_t size() const noexcept { return firstIndex.size(); }
+
+  /// How much memory all of this takes up
+  size_t bytes() const noexcept;
+};
+
+/**
+ * @brief Cuts each level of detail of a mesh into clusters of 64 to 128
+ * triangles, in index order.
+ *
+ * Optimized index buffers already keep neighbouring triangles together, so
+ * consecutive runs are compact enough; the only extra rule is that a cluster
+ * past the minimum size is closed early rather than take in a triangle that
+ * faces away from the rest, which keeps the normal cones narrow. Face normals
+ * and bounds are computed in parallel.
+ */
+ClusterSet buildClusters(const Mesh& mesh, const LodChain& lods) noexcept;
+
+/// The view frustum's planes and the camera, in the mesh's own space
+struct ClusterView {
+  /**
+   * @brief Normalized so that dot(plane, vec4(p, 1)) is the distance from
+   * the plane, positive on the inside
+   */
+  array<vec4, 6> planes;
+  vec3 camera;
+
+  /// If false, only the frustum is tested
+  bool cullBackfaces;
+};
+
+/**
+ * @brief Tests the given clusters against the view and writes the index
+ * ranges of those that might be visible to counts and offsets (as byte
+ * offsets, ready for glMultiDrawElements()). Visible clusters that are next
+ * to each other in the index buffer are merged into one range.
+ *
+ * Culled clusters are either wholly outside a frustum plane, or face away from
+ * the camera from every point of their bounding sphere.
+ *
+ * @return How many ranges were written; counts and offsets are resized to fit
+ */
+size_t cullClusters(const ClusterSet& clusters, const ClusterRange& range,
+                    const ClusterView& view, const size_t indexSize,
+                    vector<GLsizei>& counts, vector<const void*>& offsets)
+noexcept;
+}
+}
+
+#endif // CLUSTERS_HPP
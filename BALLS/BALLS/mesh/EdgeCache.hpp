@@ -0,0 +1,115 @@
+#ifndef EDGECACHE_HPP
+#define EDGECACHE_HPP
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <QtCore/QtGlobal>
+
+#include "mesh/Mesh.hpp"
+
+namespace balls {
+namespace mesh {
+
+using std::size_t;
+using std::uint64_t;
+using std::vector;
+
+/**
+ * @brief An open-addressing map from undirected edges to vertex indices.
+ *
+ * Used by subdivision surfaces so that an edge shared by two faces only gets
+ * one midpoint. The table never grows on its own; reset() it with the number
+ * of edges the next pass will visit.
+ */
+class EdgeCache {
+public:
+  typedef Mesh::IndexType IndexType;
+
+  explicit EdgeCache(const size_t edges = 0) noexcept { reset(edges); }
+
+  /**
+   * @brief Clears the cache and sizes it to hold the given number of edges
+   * with a load factor of at most 0.5.
+   */
+  void reset(const size_t edges) noexcept;
+
+  /**
+   * @brief Returns the index stored for the edge (a, b), calling make() and
+   * storing its result if the edge hasn't been seen yet. The edge (b, a) is
+   * the same as (a, b).
+   */
+  template<class Function>
+  IndexType get(const IndexType a, const IndexType b, Function make) noexcept;
+
+  size_t size() const noexcept { return _size; }
+  size_t capacity() const noexcept { return _keys.size(); }
+
+private /* constants */:
+  static constexpr uint64_t EMPTY = ~uint64_t(0);
+  // No edge connects a vertex to itself, so this key can never occur
+
+private /* members */:
+  vector<uint64_t> _keys;
+  vector<IndexType> _values;
+  size_t _mask;
+  size_t _size;
+
+private /* methods */:
+  static uint64_t _key(const IndexType, const IndexType) noexcept;
+  static size_t _hash(uint64_t) noexcept;
+};
+
+inline void EdgeCache::reset(const size_t edges) noexcept {
+  size_t capacity = 16;
+
+  while (capacity < edges * 2) {
+    capacity <<= 1;
+  }
+
+  _keys.assign(capacity, uint64_t(EMPTY));
+  _values.resize(capacity);
+  _mask = capacity - 1;
+  _size = 0;
+}
+
+template<class Function>
+inline EdgeCache::IndexType EdgeCache::get(const IndexType a,
+    const IndexType b, Function make) noexcept {
+  uint64_t key = _key(a, b);
+
+  for (size_t slot = _hash(key) & _mask; ; slot = (slot + 1) & _mask) {
+    // Linear probing; the table is never more than half full, so this ends
+    if (_keys[slot] == key) {
+      return _values[slot];
+    }
+
+    if (_keys[slot] == EMPTY) {
+      Q_ASSERT(_size < _keys.size() / 2);
+      _keys[slot] = key;
+      _values[slot] = make(a, b);
+      ++_size;
+      return _values[slot];
+    }
+  }
+}
+
+inline uint64_t EdgeCache::_key(const IndexType a, const IndexType b)
+noexcept {
+  return (a < b) ? ((uint64_t(a) << 32) | b) : ((uint64_t(b) << 32) | a);
+}
+
+inline size_t EdgeCache::_hash(uint64_t key) noexcept {
+  // splitmix64 finalizer; cheap, and scatters sequential indices well
+  key ^= key >> 30;
+  key *= 0xbf58476d1ce4e5b9ull;
+  key ^= key >> 27;
+  key *= 0x94d049bb133111ebull;
+  key ^= key >> 31;
+  return static_cast<size_t>(key);
+}
+}
+}
+
+#endif // EDGECACHE_HPP
@@ -11,14 +11,14 @@ MeshGenerator quad(MeshGenerator::tr("Quad"),  functions::quad,
 {
   {LENGTH, {2.0f, 0, 10}},
   {WIDTH, {2.0f, 0, 10}}
-});
+}, ProceduralShape::Quad);
 
 MeshGenerator box(MeshGenerator::tr("Box"), functions::box,
 {
   {LENGTH, {1.0f, 0, 10}},
   {WIDTH, {1.0f, 0, 10}},
   {HEIGHT, {1.0f, 0, 10}}
-});
+}, ProceduralShape::Box);
 
 MeshGenerator icosahedron(MeshGenerator::tr("Icosahedron"), functions::icosahedron,
 {
@@ -54,14 +54,14 @@ MeshGenerator cylinder(MeshGenerator::tr("Cylinder"), functions::cylinder,
   {RADIUS, {0.5f, 0, 10}},
   {HEIGHT, {2.0f, 0, 10}},
   {RESOLUTION, {64, 3, 512}}
-});
+}, ProceduralShape::Cylinder);
 
 MeshGenerator cone(MeshGenerator::tr("Cone"), functions::cone,
 {
   {RADIUS, {1.0f, 0, 10}},
   {HEIGHT, {3.0f, 0, 10}},
   {RESOLUTION, {64, 3, 512}}
-});
+}, ProceduralShape::Cone);
 
 MeshGenerator uvsphere(MeshGenerator::tr("UV Sphere"), functions::uvsphere,
 {
@@ -70,7 +70,7 @@ MeshGenerator uvsphere(MeshGenerator::tr("UV Sphere"), functions::uvsphere,
   {Z_SCALE, {1.0f, 0, 10}},
   {U_SAMPLES, {128, 3, 512}},
   {V_SAMPLES, {128, 3, 512}}
-});
+}, ProceduralShape::UvSphere);
 
 MeshGenerator ellipsoid(MeshGenerator::tr("Ellipsoid"), functions::uvsphere,
 {
@@ -79,7 +79,7 @@ MeshGenerator ellipsoid(MeshGenerator::tr("Ellipsoid"), functions::uvsphere,
   {Z_SCALE, {0.5f, 0, 10}},
   {U_SAMPLES, {128, 3, 512}},
   {V_SAMPLES, {128, 3, 512}}
-});
+}, ProceduralShape::UvSphere);
 
 MeshGenerator torus(MeshGenerator::tr("Torus"), functions::torus,
 {
@@ -87,7 +87,7 @@ MeshGenerator torus(MeshGenerator::tr("Torus"), functions::torus,
   {INNER_RADIUS, {.5f, 0, 10}},
   {U_SAMPLES, {128, 3, 512}},
   {V_SAMPLES, {128, 3, 512}}
-});
+}, ProceduralShape::Torus);
 
 }
 }
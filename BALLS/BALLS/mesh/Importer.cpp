@@ -0,0 +1,1595 @@
+#include "precompiled.hpp"
+#include "mesh/Importer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <numeric>
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QtEndian>
+
+#include "Constants.hpp"
+#include "exception/FileException.hpp"
+#include "util/Logging.hpp"
+#include "util/Parallel.hpp"
+
+namespace balls {
+namespace mesh {
+
+using std::atomic;
+using std::int64_t;
+using std::max;
+using std::min;
+using std::pair;
+using std::uint64_t;
+
+typedef Mesh::IndexType IndexType;
+
+const char* MESH_FILE_FILTER = "Meshes (*.obj *.ply *.stl *.bmesh)";
+
+constexpr size_t CHUNK_SIZE = 1 << 22;
+// Text is tokenized in pieces of about this many bytes, each on its own thread
+
+constexpr size_t BINARY_GRAIN = 1 << 16;
+
+constexpr size_t WELD_BLOCK = 1 << 18;
+// The weld counts and scatters vertices in blocks of this many
+
+constexpr size_t WELD_BUCKETS = 256;
+// Vertices are split by hash into this many independent tables
+
+constexpr int WELD_BITS = 21;
+// Three 21-bit coordinates have to fit in one 64-bit key
+
+constexpr IndexType EMPTY = std::numeric_limits<IndexType>::max();
+
+// How much of the progress each stage accounts for
+constexpr float PARSE_SHARE = 0.8f;
+constexpr float WELD_SHARE = 0.15f;
+
+MeshFileFormat meshFileFormat(const QString& path) noexcept {
+  QString suffix = QFileInfo(path).suffix().toLower();
+
+  if (suffix == "obj") {
+    return MeshFileFormat::Obj;
+  }
+  else if (suffix == "ply") {
+    return MeshFileFormat::Ply;
+  }
+  else if (suffix == "stl") {
+    return MeshFileFormat::Stl;
+  }
+  else if (suffix == constants::extensions::MESH) {
+    return MeshFileFormat::BallsMesh;
+  }
+
+  return MeshFileFormat::Unknown;
+}
+
+ImportNotifier* ImportNotifier::instance() noexcept {
+  static ImportNotifier notifier;
+  return &notifier;
+}
+
+namespace {
+
+/**
+ * @brief Turns a running count of finished work into calls to an
+ * ImportProgress; safe to advance from several threads at once.
+ */
+class Progress {
+public:
+  Progress(const ImportProgress& callback) noexcept :
+    _callback(callback), _done(0), _total(1), _from(0), _share(0) {}
+
+  // Starts a stage that will do total units of work
+  void stage(const float share, const size_t total) noexcept {
+    _from += _share;
+    _share = share;
+    _total = max<size_t>(total, 1);
+    _done = 0;
+    report(_from);
+  }
+
+  void advance(const size_t units) noexcept {
+    size_t done = (_done += units);
+    report(_from + _share * min(float(done) / _total, 1.f));
+  }
+
+  void report(const float fraction) noexcept {
+    if (_callback) {
+      std::lock_guard<std::mutex> lock(_lock);
+      _callback(fraction);
+    }
+  }
+
+private:
+  const ImportProgress& _callback;
+  std::mutex _lock;
+  atomic<size_t> _done;
+  size_t _total;
+  float _from;
+  float _share;
+};
+
+/// One piece of a text file that ends just past a line break
+struct Chunk {
+  const char* begin;
+  const char* end;
+  size_t firstLine;
+};
+
+/**
+ * @brief What one thread parsed out of one chunk. Parsing code never throws,
+ * since it runs on the thread pool; the first error is kept here instead.
+ */
+struct Block {
+  vector<vec3> vertices;
+  vector<IndexType> indices;
+
+  /// OBJ indices counted back from the latest vertex; they need the chunk's
+  /// first vertex added once that's known. Pairs of (position, local index).
+  vector<pair<size_t, int64_t>> relative;
+
+  const char* error = nullptr;
+  const char* where = nullptr;
+
+  void fail(const char* message, const char* at) noexcept {
+    if (error == nullptr) {
+      error = message;
+      where = at;
+    }
+  }
+};
+
+const double POWERS_OF_TEN[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13,
+  1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+// Every power of ten that a double represents exactly
+
+inline bool _isSpace(const char c) noexcept {
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline bool _isDigit(const char c) noexcept {
+  return unsigned(c - '0') < 10;
+}
+
+inline void _skipSpaces(const char*& p, const char* end) noexcept {
+  while (p < end && _isSpace(*p)) {
+    ++p;
+  }
+}
+
+inline void _skipToken(const char*& p, const char* end) noexcept {
+  while (p < end && !_isSpace(*p)) {
+    ++p;
+  }
+}
+
+inline const char* _lineEnd(const char* p, const char* end) noexcept {
+  const void* n = std::memchr(p, '\n', end - p);
+  return n ? static_cast<const char*>(n) : end;
+}
+
+// The start of the line after the one ending at eol; end if that was the last
+inline const char* _nextLine(const char* eol, const char* end) noexcept {
+  return eol + (eol < end);
+}
+
+// True if the line at p starts with the given keyword, followed by a space
+inline bool _keyword(const char* p, const char* end, const char* word,
+                     const size_t length) noexcept {
+  return size_t(end - p) > length && std::memcmp(p, word, length) == 0 &&
+         _isSpace(p[length]);
+}
+
+/**
+ * @brief Parses a decimal number without strtof(), which is several times
+ * slower and depends on the locale. Exact to within a unit in the last place
+ * of a float, which is all a vertex needs.
+ */
+bool _parseFloat(const char*& p, const char* end, float& out) noexcept {
+  _skipSpaces(p, end);
+  const char* start = p;
+  bool negative = false;
+
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = (*p == '-');
+    ++p;
+  }
+
+  uint64_t mantissa = 0;
+  int exponent = 0;
+  int digits = 0;
+  bool any = false;
+
+  for (; p < end && _isDigit(*p); ++p) {
+    any = true;
+
+    if (digits < 19) {
+      mantissa = mantissa * 10 + (*p - '0');
+      digits += (mantissa != 0);
+    }
+    else {
+      ++exponent;
+    }
+  }
+
+  if (p < end && *p == '.') {
+    for (++p; p < end && _isDigit(*p); ++p) {
+      any = true;
+
+      if (digits < 19) {
+        mantissa = mantissa * 10 + (*p - '0');
+        digits += (mantissa != 0);
+        --exponent;
+      }
+    }
+  }
+
+  if (!any) {
+    p = start;
+    return false;
+  }
+
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char* e = p + 1;
+    bool negativeExponent = false;
+
+    if (e < end && (*e == '-' || *e == '+')) {
+      negativeExponent = (*e == '-');
+      ++e;
+    }
+
+    if (e < end && _isDigit(*e)) {
+      int x = 0;
+
+      for (; e < end && _isDigit(*e); ++e) {
+        x = min(x * 10 + (*e - '0'), 1000);
+      }
+
+      exponent += negativeExponent ? -x : x;
+      p = e;
+    }
+  }
+
+  double value = double(mantissa);
+
+  if (exponent < -22 || exponent > 22) {
+    value *= std::pow(10.0, exponent);
+  }
+  else if (exponent < 0) {
+    value /= POWERS_OF_TEN[-exponent];
+  }
+  else {
+    value *= POWERS_OF_TEN[exponent];
+  }
+
+  out = float(negative ? -value : value);
+  return true;
+}
+
+bool _parseInt(const char*& p, const char* end, int64_t& out) noexcept {
+  _skipSpaces(p, end);
+  const char* start = p;
+  bool negative = false;
+
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = (*p == '-');
+    ++p;
+  }
+
+  if (p >= end || !_isDigit(*p)) {
+    p = start;
+    return false;
+  }
+
+  // Far more than any index or count, but small enough not to overflow
+  constexpr int64_t LIMIT = int64_t(1) << 53;
+  int64_t value = 0;
+
+  for (; p < end && _isDigit(*p); ++p) {
+    value = value * 10 + (*p - '0');
+
+    if (value > LIMIT) {
+      p = start;
+      return false;
+    }
+  }
+
+  out = negative ? -value : value;
+  return true;
+}
+
+inline bool _parseVec3(const char*& p, const char* end, vec3& v) noexcept {
+  return _parseFloat(p, end, v.x) && _parseFloat(p, end, v.y) &&
+         _parseFloat(p, end, v.z);
+}
+
+template<class T>
+inline T _load(const char* p, const bool bigEndian) noexcept {
+  const uchar* bytes = reinterpret_cast<const uchar*>(p);
+  return bigEndian ? qFromBigEndian<T>(bytes) : qFromLittleEndian<T>(bytes);
+}
+
+// Qt only swaps integers, so floats go through one of the same size
+template<class Float, class Bits>
+inline Float _loadFloat(const char* p, const bool bigEndian) noexcept {
+  static_assert(sizeof(Float) == sizeof(Bits), "Sizes must match");
+  Bits bits = _load<Bits>(p, bigEndian);
+  Float f;
+  std::memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+/**
+ * @brief Cuts text into pieces of about CHUNK_SIZE bytes, each ending just
+ * past a line break, and optionally numbers their first lines (which takes
+ * another pass, though a parallel one).
+ */
+vector<Chunk> _chunks(const char* begin, const char* end,
+                      const bool countLines) noexcept {
+  vector<Chunk> chunks;
+
+  while (begin < end) {
+    const char* cut = end;
+
+    if (size_t(end - begin) > CHUNK_SIZE) {
+      cut = _lineEnd(begin + CHUNK_SIZE, end);
+      cut += (cut < end);
+    }
+
+    chunks.push_back({begin, cut, 0});
+    begin = cut;
+  }
+
+  if (countLines && !chunks.empty()) {
+    vector<size_t> lines(chunks.size() + 1, 0);
+
+    util::parallelFor(chunks.size(),
+    [&](const size_t first, const size_t last) noexcept {
+      for (size_t c = first; c < last; ++c) {
+        lines[c + 1] = std::count(chunks[c].begin, chunks[c].end, '\n');
+      }
+    }, 1);
+
+    std::partial_sum(lines.begin(), lines.end(), lines.begin());
+
+    for (size_t c = 0; c < chunks.size(); ++c) {
+      chunks[c].firstLine = lines[c];
+    }
+  }
+
+  return chunks;
+}
+
+// Returns the start of the given line, using chunks from _chunks(..., true)
+const char* _findLine(const vector<Chunk>& chunks, const size_t line,
+                      const char* end) noexcept {
+  auto c = std::upper_bound(chunks.begin(), chunks.end(), line,
+  [](const size_t l, const Chunk & chunk) noexcept {
+    return l < chunk.firstLine;
+  });
+
+  if (c == chunks.begin()) {
+    return end;
+  }
+
+  --c;
+  const char* p = c->begin;
+
+  for (size_t l = c->firstLine; l < line && p < end; ++l) {
+    p = _lineEnd(p, end) + 1;
+  }
+
+  return min(p, end);
+}
+
+// Runs parse on every chunk in parallel, one Block each
+template<class Parse>
+vector<Block> _parseChunks(const vector<Chunk>& chunks, Progress& progress,
+                           const Parse& parse) {
+  vector<Block> blocks(chunks.size());
+
+  util::parallelFor(chunks.size(),
+  [&](const size_t first, const size_t last) noexcept {
+    for (size_t c = first; c < last; ++c) {
+      parse(chunks[c], blocks[c]);
+      progress.advance(chunks[c].end - chunks[c].begin);
+    }
+  }, 1);
+
+  return blocks;
+}
+
+// Throws the first error any block ran into, with its line number
+void _check(const vector<Block>& blocks, const char* data,
+            const QString& path) {
+  for (const Block& b : blocks) {
+    if (b.error != nullptr) {
+      size_t line = std::count(data, b.where, '\n') + 1;
+      throw ImportException(path, QString("line %1: %2").arg(line).arg(
+                              b.error));
+    }
+  }
+}
+
+/**
+ * @brief Concatenates every block's vertices and indices in order, offsetting
+ * each block's relative indices by the vertices that came before it.
+ */
+void _merge(vector<Block>& blocks, vector<vec3>& vertices,
+            vector<IndexType>& indices) noexcept {
+  vector<size_t> vertexOffsets(blocks.size() + 1, 0);
+  vector<size_t> indexOffsets(blocks.size() + 1, 0);
+
+  for (size_t b = 0; b < blocks.size(); ++b) {
+    vertexOffsets[b + 1] = vertexOffsets[b] + blocks[b].vertices.size();
+    indexOffsets[b + 1] = indexOffsets[b] + blocks[b].indices.size();
+  }
+
+  vertices.resize(vertexOffsets.back());
+  indices.resize(indexOffsets.back());
+
+  util::parallelFor(blocks.size(),
+  [&](const size_t first, const size_t last) noexcept {
+    for (size_t b = first; b < last; ++b) {
+      Block& block = blocks[b];
+      std::copy(block.vertices.begin(), block.vertices.end(),
+                vertices.begin() + vertexOffsets[b]);
+      std::copy(block.indices.begin(), block.indices.end(),
+                indices.begin() + indexOffsets[b]);
+
+      for (const pair<size_t, int64_t>& r : block.relative) {
+        int64_t i = r.second + int64_t(vertexOffsets[b]);
+        indices[indexOffsets[b] + r.first] = (i < 0) ? EMPTY : IndexType(i);
+        // A negative index is out of range either way; _validate() will say so
+      }
+
+      vector<vec3>().swap(block.vertices);
+      vector<IndexType>().swap(block.indices);
+      vector<pair<size_t, int64_t>>().swap(block.relative);
+    }
+  }, 1);
+}
+
+void _validate(const vector<IndexType>& indices, const size_t vertexCount,
+               const QString& path) {
+  atomic<bool> valid(true);
+
+  util::parallelFor(indices.size(),
+  [&](const size_t begin, const size_t end) noexcept {
+    for (size_t i = begin; i < end; ++i) {
+      if (indices[i] >= vertexCount) {
+        valid = false;
+        return;
+      }
+    }
+  }, BINARY_GRAIN);
+
+  if (!valid) {
+    throw ImportException(path, QString("A face refers to a vertex past the "
+                                        "last of %1").arg(vertexCount));
+  }
+}
+
+/// One corner of an OBJ face
+struct Corner {
+  int64_t index;
+
+  /// If true, index counts from the chunk's first vertex (and may be negative)
+  bool relative;
+};
+
+// Appends one OBJ corner; relative corners get fixed up in _merge()
+inline void _pushCorner(Block& b, const Corner& corner) noexcept {
+  if (corner.relative) {
+    b.relative.emplace_back(b.indices.size(), corner.index);
+    b.indices.push_back(0);
+  }
+  else {
+    b.indices.push_back(IndexType(corner.index));
+  }
+}
+
+/**
+ * @brief Parses the v and f lines of one chunk of an OBJ file, fanning each
+ * polygon around its first corner. Positive indices are absolute, but negative
+ * ones count back from the latest vertex, which depends on how many vertices
+ * the chunks before this one had.
+ */
+void _parseObj(const Chunk& chunk, Block& b) noexcept {
+  const char* p = chunk.begin;
+
+  while (p < chunk.end && b.error == nullptr) {
+    const char* eol = _lineEnd(p, chunk.end);
+    _skipSpaces(p, eol);
+
+    if (_keyword(p, eol, "v", 1)) {
+      vec3 v;
+      const char* line = p;
+      p += 1;
+
+      if (!_parseVec3(p, eol, v)) {
+        b.fail("A vertex needs three coordinates", line);
+      }
+
+      b.vertices.push_back(v);
+    }
+    else if (_keyword(p, eol, "f", 1)) {
+      const char* line = p;
+      Corner first = {0, false};
+      Corner previous = {0, false};
+      size_t corners = 0;
+      p += 1;
+
+      while (true) {
+        _skipSpaces(p, eol);
+
+        if (p >= eol) {
+          break;
+        }
+
+        int64_t i;
+
+        if (!_parseInt(p, eol, i) || i == 0) {
+          b.fail("Expected a vertex index (starting from 1)", line);
+          break;
+        }
+
+        _skipToken(p, eol);
+        // Skip the texture coordinate and normal indices, if any
+
+        Corner corner = (i > 0) ? Corner {i - 1, false} :
+                        Corner {int64_t(b.vertices.size()) + i, true};
+
+        if (i > int64_t(EMPTY)) {
+          b.fail("Too many vertices", line);
+          break;
+        }
+
+        if (corners == 0) {
+          first = corner;
+        }
+        else if (corners >= 2) {
+          _pushCorner(b, first);
+          _pushCorner(b, previous);
+          _pushCorner(b, corner);
+        }
+
+        previous = corner;
+        ++corners;
+      }
+
+      if (corners < 3) {
+        b.fail("A face needs at least three vertices", line);
+      }
+    }
+    // Anything else (normals, texture coordinates, groups, materials...) is
+    // ignored
+
+    p = _nextLine(eol, chunk.end);
+  }
+}
+
+void _importObj(const char* data, const size_t size, const QString& path,
+                Progress& progress, vector<vec3>& vertices,
+                vector<IndexType>& indices) {
+  vector<Chunk> chunks = _chunks(data, data + size, false);
+  progress.stage(PARSE_SHARE, size);
+
+  vector<Block> blocks = _parseChunks(chunks, progress, _parseObj);
+  _check(blocks, data, path);
+  _merge(blocks, vertices, indices);
+}
+
+void _parseAsciiStl(const Chunk& chunk, Block& b) noexcept {
+  const char* p = chunk.begin;
+
+  while (p < chunk.end && b.error == nullptr) {
+    const char* eol = _lineEnd(p, chunk.end);
+    _skipSpaces(p, eol);
+
+    if (_keyword(p, eol, "vertex", 6)) {
+      vec3 v;
+      const char* line = p;
+      p += 6;
+
+      if (!_parseVec3(p, eol, v)) {
+        b.fail("A vertex needs three coordinates", line);
+      }
+
+      b.vertices.push_back(v);
+    }
+    // Everything else is structure we don't need; facet normals are ignored
+    // in favor of computed ones
+
+    p = _nextLine(eol, chunk.end);
+  }
+}
+
+void _importStl(const char* data, const size_t size, const QString& path,
+                Progress& progress, vector<vec3>& vertices,
+                vector<IndexType>& indices) {
+  constexpr size_t HEADER = 80 + sizeof(std::uint32_t);
+  constexpr size_t TRIANGLE = 50;
+  // A normal, three vertices, and a two-byte attribute count
+
+  size_t triangles = 0;
+
+  if (size >= HEADER) {
+    triangles = qFromLittleEndian<std::uint32_t>(
+                  reinterpret_cast<const uchar*>(data + 80));
+  }
+
+  if (size >= HEADER && size == HEADER + triangles * TRIANGLE) {
+    // Some binary files start with "solid" too, so trust the size over that
+    progress.stage(PARSE_SHARE, triangles);
+    vertices.resize(triangles * 3);
+
+    util::parallelFor(triangles,
+    [&](const size_t begin, const size_t end) noexcept {
+      for (size_t t = begin; t < end; ++t) {
+        const char* v = data + HEADER + t * TRIANGLE + 3 * sizeof(float);
+
+        for (size_t k = 0; k < 3; ++k) {
+          float xyz[3];
+
+          for (size_t c = 0; c < 3; ++c) {
+            xyz[c] = _loadFloat<float, std::uint32_t>(
+                       v + (k * 3 + c) * sizeof(float), false);
+          }
+
+          vertices[t * 3 + k] = vec3(xyz[0], xyz[1], xyz[2]);
+        }
+      }
+
+      progress.advance(end - begin);
+    }, BINARY_GRAIN);
+  }
+  else if (size >= 5 && std::memcmp(data, "solid", 5) == 0) {
+    vector<Chunk> chunks = _chunks(data, data + size, false);
+    progress.stage(PARSE_SHARE, size);
+
+    vector<Block> blocks = _parseChunks(chunks, progress, _parseAsciiStl);
+    _check(blocks, data, path);
+    _merge(blocks, vertices, indices);
+
+    if (vertices.size() % 3 != 0) {
+      throw ImportException(path, "Every facet needs exactly three vertices");
+    }
+  }
+  else {
+    throw ImportException(path, "Neither a binary nor an ASCII STL file");
+  }
+
+  indices.resize(vertices.size());
+  std::iota(indices.begin(), indices.end(), 0);
+}
+
+enum class PlyType {
+  Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64, Invalid
+};
+
+struct PlyProperty {
+  QByteArray name;
+  PlyType type;
+  bool list;
+  PlyType countType;
+};
+
+struct PlyElement {
+  QByteArray name;
+  size_t count;
+  vector<PlyProperty> properties;
+};
+
+PlyType _plyType(const QByteArray& name) noexcept {
+  if (name == "char" || name == "int8") {
+    return PlyType::Int8;
+  }
+  else if (name == "uchar" || name == "uint8") {
+    return PlyType::UInt8;
+  }
+  else if (name == "short" || name == "int16") {
+    return PlyType::Int16;
+  }
+  else if (name == "ushort" || name == "uint16") {
+    return PlyType::UInt16;
+  }
+  else if (name == "int" || name == "int32") {
+    return PlyType::Int32;
+  }
+  else if (name == "uint" || name == "uint32") {
+    return PlyType::UInt32;
+  }
+  else if (name == "float" || name == "float32") {
+    return PlyType::Float32;
+  }
+  else if (name == "double" || name == "float64") {
+    return PlyType::Float64;
+  }
+
+  return PlyType::Invalid;
+}
+
+size_t _plySize(const PlyType type) noexcept {
+  switch (type) {
+  case PlyType::Int8:
+  case PlyType::UInt8:
+    return 1;
+
+  case PlyType::Int16:
+  case PlyType::UInt16:
+    return 2;
+
+  case PlyType::Int32:
+  case PlyType::UInt32:
+  case PlyType::Float32:
+    return 4;
+
+  case PlyType::Float64:
+    return 8;
+
+  default:
+    return 0;
+  }
+}
+
+// Reads one binary PLY scalar of any type as a double
+inline double _plyRead(const char* p, const PlyType type,
+                       const bool bigEndian) noexcept {
+  switch (type) {
+  case PlyType::Int8:
+    return static_cast<std::int8_t>(*p);
+
+  case PlyType::UInt8:
+    return static_cast<std::uint8_t>(*p);
+
+  case PlyType::Int16:
+    return _load<std::int16_t>(p, bigEndian);
+
+  case PlyType::UInt16:
+    return _load<std::uint16_t>(p, bigEndian);
+
+  case PlyType::Int32:
+    return _load<std::int32_t>(p, bigEndian);
+
+  case PlyType::UInt32:
+    return _load<std::uint32_t>(p, bigEndian);
+
+  case PlyType::Float32:
+    return _loadFloat<float, std::uint32_t>(p, bigEndian);
+
+  case PlyType::Float64:
+    return _loadFloat<double, std::uint64_t>(p, bigEndian);
+
+  default:
+    return 0;
+  }
+}
+
+// Reads a vertex index; negative ones become EMPTY, for _validate() to catch
+inline IndexType _plyIndex(const char* p, const PlyType type,
+                           const bool bigEndian) noexcept {
+  int64_t i = int64_t(_plyRead(p, type, bigEndian));
+  return (i < 0 || i > int64_t(EMPTY)) ? EMPTY : IndexType(i);
+}
+
+enum class PlyEncoding { Ascii, BinaryLittleEndian, BinaryBigEndian };
+
+struct PlyHeader {
+  PlyEncoding encoding;
+  vector<PlyElement> elements;
+  size_t size;
+};
+
+PlyHeader _plyHeader(const char* data, const size_t size,
+                     const QString& path) {
+  PlyHeader header;
+  const char* end = data + size;
+  const char* p = data;
+  bool format = false;
+  bool done = false;
+
+  while (p < end && !done) {
+    const char* eol = _lineEnd(p, end);
+    QList<QByteArray> words =
+      QByteArray::fromRawData(p, int(eol - p)).simplified().split(' ');
+    p = _nextLine(eol, end);
+
+    if (words.isEmpty() || words[0].isEmpty()) {
+      continue;
+    }
+
+    const QByteArray& keyword = words[0];
+
+    if (keyword == "ply") {
+      continue;
+    }
+    else if (keyword == "format" && words.size() >= 2) {
+      format = true;
+
+      if (words[1] == "ascii") {
+        header.encoding = PlyEncoding::Ascii;
+      }
+      else if (words[1] == "binary_little_endian") {
+        header.encoding = PlyEncoding::BinaryLittleEndian;
+      }
+      else if (words[1] == "binary_big_endian") {
+        header.encoding = PlyEncoding::BinaryBigEndian;
+      }
+      else {
+        throw ImportException(path, "Unknown PLY format " + words[1]);
+      }
+    }
+    else if (keyword == "element" && words.size() >= 3) {
+      bool ok = false;
+      header.elements.push_back({words[1], words[2].toULongLong(&ok), {}});
+
+      if (!ok) {
+        throw ImportException(path, "Bad element count " + words[2]);
+      }
+    }
+    else if (keyword == "property" && words.size() >= 3) {
+      if (header.elements.empty()) {
+        throw ImportException(path, "A property must follow an element");
+      }
+
+      PlyProperty property;
+
+      if (words[1] == "list" && words.size() >= 5) {
+        property = {words[4], _plyType(words[3]), true, _plyType(words[2])};
+      }
+      else {
+        property = {words[2], _plyType(words[1]), false, PlyType::UInt8};
+      }
+
+      if (property.type == PlyType::Invalid ||
+          property.countType == PlyType::Invalid) {
+        throw ImportException(path, "Unknown type for property " +
+                              property.name);
+      }
+
+      header.elements.back().properties.push_back(property);
+    }
+    else if (keyword == "end_header") {
+      done = true;
+    }
+    // comment and obj_info lines are ignored
+  }
+
+  if (!done || !format) {
+    throw ImportException(path, "Incomplete PLY header");
+  }
+
+  header.size = min<size_t>(p - data, size);
+  return header;
+}
+
+// Finds the property with any of the given names, or returns -1
+int _plyFind(const PlyElement& element,
+             const initializer_list<const char*>& names) noexcept {
+  for (size_t i = 0; i < element.properties.size(); ++i) {
+    for (const char* name : names) {
+      if (element.properties[i].name == name) {
+        return int(i);
+      }
+    }
+  }
+
+  return -1;
+}
+
+struct PlyVertexLayout {
+  int x, y, z;
+};
+
+struct PlyFaceLayout {
+  int indices;
+};
+
+PlyVertexLayout _plyVertexLayout(const PlyElement& element,
+                                 const QString& path) {
+  PlyVertexLayout layout = {
+    _plyFind(element, {"x"}), _plyFind(element, {"y"}), _plyFind(element, {"z"})
+  };
+
+  if (layout.x < 0 || layout.y < 0 || layout.z < 0) {
+    throw ImportException(path, "Vertices need x, y, and z properties");
+  }
+
+  for (const PlyProperty& p : element.properties) {
+    if (p.list) {
+      throw ImportException(path, "Vertices can't have list properties");
+    }
+  }
+
+  return layout;
+}
+
+PlyFaceLayout _plyFaceLayout(const PlyElement& element, const QString& path) {
+  PlyFaceLayout layout = {_plyFind(element, {"vertex_indices", "vertex_index"})};
+
+  if (layout.indices < 0 || !element.properties[layout.indices].list) {
+    throw ImportException(path, "Faces need a vertex_indices list");
+  }
+
+  return layout;
+}
+
+void _importBinaryPly(const char* data, const size_t size,
+                      const PlyHeader& header, const QString& path,
+                      Progress& progress, vector<vec3>& vertices,
+                      vector<IndexType>& indices) {
+  bool bigEndian = (header.encoding == PlyEncoding::BinaryBigEndian);
+  const char* p = data + header.size;
+  const char* end = data + size;
+  progress.stage(PARSE_SHARE, end - p);
+
+  auto truncated = [&path](const PlyElement & e) {
+    return ImportException(path, "File ends in the middle of the " + e.name +
+                           " elements");
+  };
+
+  for (const PlyElement& element : header.elements) {
+    const char* start = p;
+    size_t stride = 0;
+    bool fixed = true;
+    vector<size_t> offsets;
+
+    for (const PlyProperty& property : element.properties) {
+      offsets.push_back(stride);
+      stride += _plySize(property.type);
+      fixed = fixed && !property.list;
+    }
+
+    if (element.name == "vertex") {
+      PlyVertexLayout layout = _plyVertexLayout(element, path);
+      const PlyProperty* props = element.properties.data();
+
+      if (size_t(end - p) / max<size_t>(stride, 1) < element.count) {
+        throw truncated(element);
+      }
+
+      size_t first = vertices.size();
+      vertices.resize(first + element.count);
+
+      util::parallelFor(element.count,
+      [&](const size_t from, const size_t to) noexcept {
+        for (size_t v = from; v < to; ++v) {
+          const char* in = p + v * stride;
+          vertices[first + v] = vec3(
+            _plyRead(in + offsets[layout.x], props[layout.x].type, bigEndian),
+            _plyRead(in + offsets[layout.y], props[layout.y].type, bigEndian),
+            _plyRead(in + offsets[layout.z], props[layout.z].type, bigEndian));
+        }
+
+        progress.advance((to - from) * stride);
+      }, BINARY_GRAIN);
+
+      p += element.count * stride;
+    }
+    else if (element.name == "face" && element.properties.size() == 1 &&
+             element.count > 0 && p < end) {
+      // Almost every file has nothing but indices in its faces, and all of
+      // them triangles (or all quads); if the sizes say so, decode them in
+      // parallel instead of walking face by face
+      PlyFaceLayout layout = _plyFaceLayout(element, path);
+      const PlyProperty& list = element.properties[layout.indices];
+      size_t countSize = _plySize(list.countType);
+      size_t indexSize = _plySize(list.type);
+
+      if (size_t(end - p) < countSize) {
+        throw truncated(element);
+      }
+
+      int64_t corners = int64_t(_plyRead(p, list.countType, bigEndian));
+      stride = countSize + size_t(max<int64_t>(corners, 0)) * indexSize;
+      atomic<bool> uniform(corners >= 3 &&
+                           size_t(end - p) / stride >= element.count);
+
+      if (uniform) {
+        size_t triangles = size_t(corners - 2);
+        size_t first = indices.size();
+        indices.resize(first + element.count * triangles * 3);
+
+        util::parallelFor(element.count,
+        [&](const size_t from, const size_t to) noexcept {
+          for (size_t f = from; f < to && uniform; ++f) {
+            const char* in = p + f * stride;
+
+            if (int64_t(_plyRead(in, list.countType, bigEndian)) != corners) {
+              uniform = false;
+              return;
+            }
+
+            in += countSize;
+            IndexType* out = indices.data() + first + f * triangles * 3;
+            IndexType a = _plyIndex(in, list.type, bigEndian);
+            IndexType b = _plyIndex(in + indexSize, list.type, bigEndian);
+
+            for (int64_t k = 2; k < corners; ++k) {
+              IndexType c = _plyIndex(in + k * indexSize, list.type, bigEndian);
+              *out++ = a;
+              *out++ = b;
+              *out++ = c;
+              b = c;
+            }
+          }
+
+          progress.advance((to - from) * stride);
+        }, BINARY_GRAIN);
+
+        if (uniform) {
+          p += element.count * stride;
+          continue;
+        }
+
+        indices.resize(first);
+        // Not all the same after all; fall through to the careful way
+      }
+    }
+
+    if (p != start) {
+      continue;
+    }
+
+    if (fixed) {
+      // Some element we don't need, but at least it's easy to skip
+      if (element.name == "face") {
+        throw ImportException(path, "Faces need a vertex_indices list");
+      }
+
+      if (size_t(end - p) / max<size_t>(stride, 1) < element.count) {
+        throw truncated(element);
+      }
+
+      p += element.count * stride;
+      progress.advance(element.count * stride);
+      continue;
+    }
+
+    // Lists make every element a different size, so walk them one by one
+    int indexList = (element.name == "face") ?
+                    _plyFaceLayout(element, path).indices : -1;
+
+    for (size_t e = 0; e < element.count; ++e) {
+      for (size_t i = 0; i < element.properties.size(); ++i) {
+        const PlyProperty& property = element.properties[i];
+        size_t scalar = _plySize(property.type);
+
+        if (!property.list) {
+          if (size_t(end - p) < scalar) {
+            throw truncated(element);
+          }
+
+          p += scalar;
+          continue;
+        }
+
+        size_t countSize = _plySize(property.countType);
+
+        if (size_t(end - p) < countSize) {
+          throw truncated(element);
+        }
+
+        int64_t count = int64_t(_plyRead(p, property.countType, bigEndian));
+        p += countSize;
+
+        if (count < 0 || size_t(end - p) / scalar < size_t(count)) {
+          throw truncated(element);
+        }
+
+        if (int(i) == indexList) {
+          if (count < 3) {
+            throw ImportException(path, "A face needs at least three vertices");
+          }
+
+          IndexType a = _plyIndex(p, property.type, bigEndian);
+          IndexType b = _plyIndex(p + scalar, property.type, bigEndian);
+
+          for (int64_t k = 2; k < count; ++k) {
+            IndexType c = _plyIndex(p + k * scalar, property.type, bigEndian);
+            indices.push_back(a);
+            indices.push_back(b);
+            indices.push_back(c);
+            b = c;
+          }
+        }
+
+        p += count * scalar;
+      }
+    }
+
+    progress.advance(p - start);
+  }
+}
+
+// Parses the vertex lines of an ASCII PLY, writing each to its own slot
+void _parseAsciiPlyVertices(const Chunk& chunk, Block& b,
+                            const PlyVertexLayout& layout,
+                            vec3* vertices) noexcept {
+  const char* p = chunk.begin;
+  vec3* out = vertices + chunk.firstLine;
+  int last = max(layout.x, max(layout.y, layout.z));
+
+  while (p < chunk.end && b.error == nullptr) {
+    const char* eol = _lineEnd(p, chunk.end);
+    const char* line = p;
+    vec3 v;
+
+    for (int i = 0; i <= last; ++i) {
+      float value;
+
+      if (!_parseFloat(p, eol, value)) {
+        b.fail("Expected a number", line);
+        break;
+      }
+
+      _skipToken(p, eol);
+      // In case an integer property was written as a float, or vice versa
+
+      if (i == layout.x) {
+        v.x = value;
+      }
+      else if (i == layout.y) {
+        v.y = value;
+      }
+      else if (i == layout.z) {
+        v.z = value;
+      }
+    }
+
+    *out++ = v;
+    p = _nextLine(eol, chunk.end);
+  }
+}
+
+void _parseAsciiPlyFaces(const Chunk& chunk, Block& b,
+                         const PlyElement& element,
+                         const PlyFaceLayout& layout) noexcept {
+  const char* p = chunk.begin;
+
+  while (p < chunk.end && b.error == nullptr) {
+    const char* eol = _lineEnd(p, chunk.end);
+    const char* line = p;
+
+    for (size_t i = 0; i < element.properties.size() && b.error == nullptr;
+         ++i) {
+      if (!element.properties[i].list) {
+        float ignored;
+
+        if (!_parseFloat(p, eol, ignored)) {
+          b.fail("Expected a number", line);
+          break;
+        }
+
+        _skipToken(p, eol);
+        continue;
+      }
+
+      int64_t count;
+
+      if (!_parseInt(p, eol, count) || count < 0) {
+        b.fail("Expected a list length", line);
+        break;
+      }
+
+      if (int(i) == layout.indices && count < 3) {
+        b.fail("A face needs at least three vertices", line);
+        break;
+      }
+
+      int64_t a = 0, c = 0, previous = 0;
+
+      for (int64_t k = 0; k < count; ++k) {
+        if (!_parseInt(p, eol, c) || c < 0 || c >= int64_t(EMPTY)) {
+          b.fail("Expected a vertex index", line);
+          break;
+        }
+
+        if (int(i) != layout.indices) {
+          continue;
+        }
+
+        if (k == 0) {
+          a = c;
+        }
+        else if (k >= 2) {
+          b.indices.push_back(IndexType(a));
+          b.indices.push_back(IndexType(previous));
+          b.indices.push_back(IndexType(c));
+        }
+
+        previous = c;
+      }
+    }
+
+    p = _nextLine(eol, chunk.end);
+  }
+}
+
+void _importAsciiPly(const char* data, const size_t size,
+                     const PlyHeader& header, const QString& path,
+                     Progress& progress, vector<vec3>& vertices,
+                     vector<IndexType>& indices) {
+  const char* body = data + header.size;
+  const char* end = data + size;
+  vector<Chunk> lines = _chunks(body, end, true);
+  progress.stage(PARSE_SHARE, end - body);
+
+  size_t available = 0;
+
+  if (!lines.empty()) {
+    const Chunk& c = lines.back();
+    available = c.firstLine + std::count(c.begin, c.end, '\n') +
+                (c.end[-1] != '\n');
+    // The last line might not have a line break of its own
+  }
+
+  size_t line = 0;
+
+  for (const PlyElement& element : header.elements) {
+    if (available - line < element.count) {
+      throw ImportException(path, "File ends in the middle of the " +
+                            element.name + " elements");
+    }
+
+    const char* first = _findLine(lines, line, end);
+    const char* last = _findLine(lines, line + element.count, end);
+    line += element.count;
+
+    vector<Chunk> chunks = _chunks(first, last, true);
+
+    if (element.name == "vertex") {
+      PlyVertexLayout layout = _plyVertexLayout(element, path);
+      size_t base = vertices.size();
+      vertices.resize(base + element.count);
+
+      vector<Block> blocks = _parseChunks(chunks, progress,
+      [&](const Chunk & c, Block & b) noexcept {
+        _parseAsciiPlyVertices(c, b, layout, vertices.data() + base);
+      });
+      _check(blocks, data, path);
+    }
+    else if (element.name == "face") {
+      PlyFaceLayout layout = _plyFaceLayout(element, path);
+      vector<Block> blocks = _parseChunks(chunks, progress,
+      [&](const Chunk & c, Block & b) noexcept {
+        _parseAsciiPlyFaces(c, b, element, layout);
+      });
+      _check(blocks, data, path);
+
+      vector<vec3> none;
+      vector<IndexType> faces;
+      _merge(blocks, none, faces);
+      indices.insert(indices.end(), faces.begin(), faces.end());
+    }
+    else {
+      progress.advance(last - first);
+    }
+  }
+}
+
+void _importPly(const char* data, const size_t size, const QString& path,
+                Progress& progress, vector<vec3>& vertices,
+                vector<IndexType>& indices) {
+  if (size < 4 || std::memcmp(data, "ply", 3) != 0) {
+    throw ImportException(path, "Not a PLY file");
+  }
+
+  PlyHeader header = _plyHeader(data, size, path);
+
+  if (header.encoding == PlyEncoding::Ascii) {
+    _importAsciiPly(data, size, header, path, progress, vertices, indices);
+  }
+  else {
+    _importBinaryPly(data, size, header, path, progress, vertices, indices);
+  }
+}
+
+inline uint64_t _mix(uint64_t key) noexcept {
+  // The finalizer from MurmurHash3; grid keys are far from random
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdull;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53ull;
+  key ^= key >> 33;
+  return key;
+}
+
+inline size_t _bucket(const uint64_t key) noexcept {
+  return size_t(_mix(key) >> 56);
+  // The top byte; the table within the bucket uses the low bits
+}
+
+/**
+ * @brief Merges vertices that round to the same point on a 2^21 grid across
+ * the bounding box, and renumbers the indices to match. The first occurrence
+ * of each point survives, so the vertex order is otherwise kept.
+ *
+ * Vertices are hashed into WELD_BUCKETS buckets with a parallel counting
+ * sort, and each bucket is then welded with its own open-addressed table, so
+ * every step runs on every core.
+ */
+void _weld(vector<vec3>& vertices, vector<IndexType>& indices,
+           Progress& progress) noexcept {
+  size_t count = vertices.size();
+  size_t blocks = (count + WELD_BLOCK - 1) / WELD_BLOCK;
+  progress.stage(WELD_SHARE, 5);
+
+  if (count == 0) {
+    return;
+  }
+
+  auto forBlocks = [blocks, count](const function<void(size_t, size_t, size_t)>&
+  body) {
+    util::parallelFor(blocks, [&](const size_t first, const size_t last) {
+      for (size_t b = first; b < last; ++b) {
+        body(b, b * WELD_BLOCK, min((b + 1) * WELD_BLOCK, count));
+      }
+    }, 1);
+  };
+
+  vector<vec3> lows(blocks), highs(blocks);
+
+  forBlocks([&](const size_t b, const size_t begin, const size_t end) {
+    vec3 low = vertices[begin], high = vertices[begin];
+
+    for (size_t i = begin + 1; i < end; ++i) {
+      low = glm::min(low, vertices[i]);
+      high = glm::max(high, vertices[i]);
+    }
+
+    lows[b] = low;
+    highs[b] = high;
+  });
+
+  vec3 low = lows[0], high = highs[0];
+
+  for (size_t b = 1; b < blocks; ++b) {
+    low = glm::min(low, lows[b]);
+    high = glm::max(high, highs[b]);
+  }
+
+  vec3 extent = high - low;
+  float side = max(extent.x, max(extent.y, extent.z));
+  float scale = (side > 0) ? float((1 << WELD_BITS) - 1) / side : 0.f;
+
+  vector<uint64_t> keys(count);
+  vector<size_t> counts(blocks * WELD_BUCKETS, 0);
+
+  forBlocks([&](const size_t b, const size_t begin, const size_t end) {
+    size_t* bucketCounts = counts.data() + b * WELD_BUCKETS;
+
+    for (size_t i = begin; i < end; ++i) {
+      vec3 cell = (vertices[i] - low) * scale + 0.5f;
+      uint64_t key = (uint64_t(cell.x) << (2 * WELD_BITS)) |
+                     (uint64_t(cell.y) << WELD_BITS) | uint64_t(cell.z);
+      keys[i] = key;
+      ++bucketCounts[_bucket(key)];
+    }
+  });
+  progress.advance(1);
+
+  // Each bucket gets one contiguous run, ordered by block within it, so every
+  // bucket lists its vertices in their original order
+  vector<size_t> bucketStarts(WELD_BUCKETS + 1, 0);
+  size_t sum = 0;
+
+  for (size_t k = 0; k < WELD_BUCKETS; ++k) {
+    bucketStarts[k] = sum;
+
+    for (size_t b = 0; b < blocks; ++b) {
+      size_t n = counts[b * WELD_BUCKETS + k];
+      counts[b * WELD_BUCKETS + k] = sum;
+      sum += n;
+    }
+  }
+
+  bucketStarts[WELD_BUCKETS] = sum;
+
+  vector<IndexType> order(count);
+
+  forBlocks([&](const size_t b, const size_t begin, const size_t end) {
+    size_t* next = counts.data() + b * WELD_BUCKETS;
+
+    for (size_t i = begin; i < end; ++i) {
+      order[next[_bucket(keys[i])]++] = IndexType(i);
+    }
+  });
+  progress.advance(1);
+
+  vector<IndexType> remap(count);
+  // Each vertex's surviving twin, which is itself if it survives
+
+  util::parallelFor(WELD_BUCKETS,
+  [&](const size_t first, const size_t last) noexcept {
+    vector<IndexType> table;
+
+    for (size_t k = first; k < last; ++k) {
+      size_t n = bucketStarts[k + 1] - bucketStarts[k];
+      size_t capacity = 16;
+
+      while (capacity < n * 2) {
+        capacity *= 2;
+      }
+
+      size_t mask = capacity - 1;
+      table.assign(capacity, EMPTY);
+
+      for (size_t j = bucketStarts[k]; j < bucketStarts[k + 1]; ++j) {
+        IndexType i = order[j];
+        uint64_t key = keys[i];
+        size_t slot = size_t(_mix(key)) & mask;
+
+        while (table[slot] != EMPTY && keys[table[slot]] != key) {
+          slot = (slot + 1) & mask;
+        }
+
+        if (table[slot] == EMPTY) {
+          table[slot] = i;
+        }
+
+        remap[i] = table[slot];
+      }
+    }
+  }, 1);
+  progress.advance(1);
+
+  vector<uint64_t>().swap(keys);
+
+  // Number the survivors in their original order; order is free to hold that
+  vector<size_t> survivors(blocks + 1, 0);
+
+  forBlocks([&](const size_t b, const size_t begin, const size_t end) {
+    size_t n = 0;
+
+    for (size_t i = begin; i < end; ++i) {
+      n += (remap[i] == i);
+    }
+
+    survivors[b + 1] = n;
+  });
+
+  std::partial_sum(survivors.begin(), survivors.end(), survivors.begin());
+  vector<vec3> welded(survivors.back());
+
+  forBlocks([&](const size_t b, const size_t begin, const size_t end) {
+    size_t n = survivors[b];
+
+    for (size_t i = begin; i < end; ++i) {
+      if (remap[i] == i) {
+        order[i] = IndexType(n);
+        welded[n++] = vertices[i];
+      }
+    }
+  });
+
+  forBlocks([&](const size_t, const size_t begin, const size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      if (remap[i] != i) {
+        order[i] = order[remap[i]];
+      }
+    }
+  });
+  progress.advance(1);
+
+  util::parallelFor(indices.size(),
+  [&](const size_t begin, const size_t end) noexcept {
+    for (size_t i = begin; i < end; ++i) {
+      indices[i] = order[indices[i]];
+    }
+  }, BINARY_GRAIN);
+
+  vertices.swap(welded);
+
+  // Faces thinner than the grid just collapsed; drop them
+  size_t kept = 0;
+
+  for (size_t f = 0; f + 2 < indices.size(); f += 3) {
+    IndexType a = indices[f], b = indices[f + 1], c = indices[f + 2];
+
+    if (a != b && b != c && a != c) {
+      indices[kept++] = a;
+      indices[kept++] = b;
+      indices[kept++] = c;
+    }
+  }
+
+  indices.resize(kept);
+  progress.advance(1);
+}
+}
+
+Mesh importMesh(const QString& path, const bool weld,
+                const ImportProgress& callback) {
+  QElapsedTimer timer;
+  timer.start();
+
+  MeshFileFormat format = meshFileFormat(path);
+
+  if (format == MeshFileFormat::Unknown) {
+    throw ImportException(path, "Not an OBJ, PLY, or STL file");
+  }
+  else if (format == MeshFileFormat::BallsMesh) {
+    throw ImportException(path, "Already built; open it with MeshFile::open()");
+  }
+
+  QFile file(path);
+
+  if (!file.open(QIODevice::ReadOnly)) {
+    throw FileException(file);
+  }
+
+  if (file.size() == 0) {
+    throw ImportException(path, "File is empty");
+  }
+
+  const char* data = reinterpret_cast<const char*>(file.map(0, file.size()));
+  // The mapping goes away when file is closed
+
+  if (data == nullptr) {
+    throw FileException(file);
+  }
+
+  size_t size = size_t(file.size());
+  Progress progress(callback);
+  vector<vec3> vertices;
+  vector<IndexType> indices;
+
+  switch (format) {
+  case MeshFileFormat::Obj:
+    _importObj(data, size, path, progress, vertices, indices);
+    break;
+
+  case MeshFileFormat::Ply:
+    _importPly(data, size, path, progress, vertices, indices);
+    break;
+
+  case MeshFileFormat::Stl:
+    _importStl(data, size, path, progress, vertices, indices);
+    break;
+
+  default:
+    break;
+  }
+
+  file.close();
+  // Everything we need has been copied out of the mapping by now
+
+  if (vertices.size() > EMPTY) {
+    throw ImportException(path, "Too many vertices");
+  }
+
+  _validate(indices, vertices.size(), path);
+  size_t parsed = vertices.size();
+
+  if (weld) {
+    _weld(vertices, indices, progress);
+  }
+
+  qCDebug(logs::mesh::Import).nospace()
+      << "Imported " << path << " in " << timer.elapsed() << "ms: "
+      << vertices.size() << " vertices (from " << parsed << "), "
+      << indices.size() / 3 << " triangles";
+
+  Mesh mesh;
+  mesh.set_vertices(std::move(vertices));
+  mesh.set_indices(std::move(indices));
+  progress.report(1);
+
+  return mesh;
+}
+}
+}
@@ -0,0 +1,96 @@
+#ifndef IMPORTER_HPP
+#define IMPORTER_HPP
+
+#include <functional>
+#include <stdexcept>
+
+#include <QtCore/QObject>
+#include <QtCore/QString>
+
+#include "mesh/Mesh.hpp"
+
+namespace balls {
+namespace mesh {
+
+using std::function;
+
+/// The mesh file formats importMesh() understands
+enum class MeshFileFormat : int {
+  Unknown,
+
+  /// Wavefront OBJ; only v and f lines are read, polygons are fanned
+  Obj,
+
+  /// Stanford PLY, ASCII or binary of either endianness
+  Ply,
+
+  /// STL, ASCII or binary; every triangle has its own three vertices
+  Stl,
+
+  /// A mesh saved by saveMeshFile(); opened with MeshFile, not importMesh()
+  BallsMesh,
+};
+
+/// Guesses a file's format from its extension
+MeshFileFormat meshFileFormat(const QString& path) noexcept;
+
+/// A filter for QFileDialog that matches every mesh file format
+extern const char* MESH_FILE_FILTER;
+
+/**
+ * @brief Called now and then while a mesh is imported, with the fraction of
+ * the work that's done. Calls may come from any thread, but never two at once
+ * for the same import.
+ */
+using ImportProgress = function<void(const float)>;
+
+/// Thrown when a mesh file is readable but isn't valid
+class ImportException : public std::runtime_error {
+public:
+  ImportException(const QString& path, const QString& message) noexcept :
+    std::runtime_error(qPrintable(QString("%1: %2").arg(path, message))) {}
+};
+
+/**
+ * @brief Reads an OBJ, PLY, or STL file into a mesh.
+ *
+ * The file is memory-mapped rather than read, and text formats are cut into
+ * chunks at line breaks that are tokenized in parallel, so the cost is about
+ * one pass over the file per core. Binary PLY and STL are decoded in parallel
+ * straight out of the mapping.
+ *
+ * @param weld If true, vertices that land on the same point (to 21 bits per
+ * axis across the bounding box) are merged with a spatial hash. STL files
+ * don't share vertices at all without this, so neither do their normals.
+ *
+ * @throws FileException if the file can't be opened or mapped
+ * @throws ImportException if it isn't a valid mesh
+ */
+Mesh importMesh(const QString& path, const bool weld = true,
+                const ImportProgress& progress = nullptr);
+
+/**
+ * @brief Announces the progress of every import made through functions::file,
+ * which has no other way to reach the UI. Signals are emitted from whichever
+ * thread is importing, so receivers should use queued connections (the
+ * default across threads).
+ */
+class ImportNotifier : public QObject {
+  Q_OBJECT
+
+public:
+  /// Must first be called on the GUI thread, so the notifier lives there
+  static ImportNotifier* instance() noexcept;
+
+signals:
+  void progress(const QString& path, const int percent);
+  void finished(const QString& path, const QString& summary);
+  void failed(const QString& path, const QString& error);
+
+private:
+  ImportNotifier() noexcept = default;
+};
+}
+}
+
+#endif // IMPORTER_HPP
@@ -0,0 +1,97 @@
+#include "precompiled.hpp"
+#include "mesh/Instancing.hpp"
+
+#include <cmath>
+
+#include <glm/gtc/constants.hpp>
+#include <glm/gtx/color_space.hpp>
+#include <glm/gtx/transform.hpp>
+
+#include "util/Parallel.hpp"
+
+namespace balls {
+namespace mesh {
+
+constexpr float GRID_FILL = 0.8f;
+// How much of its cell each copy in a grid takes up, so neighbours don't touch
+
+constexpr float GOLDEN_RATIO = 0.618033989f;
+// Consecutive IDs get hues that are as far apart as possible
+
+constexpr size_t INSTANCE_GRAIN = 4096;
+
+// A well-mixed 32-bit hash (Wellons' "lowbias32"); cheaper than seeding a
+// generator per instance, and it doesn't care which thread asks
+static uint32_t _hash(uint32_t x) noexcept {
+  x ^= x >> 16;
+  x *= 0x7feb352dU;
+  x ^= x >> 15;
+  x *= 0x846ca68bU;
+  x ^= x >> 16;
+  return x;
+}
+
+// A number in [0, 1) that depends only on the instance and which one is asked
+static float _random(const uint32_t id, const uint32_t stream) noexcept {
+  return _hash(_hash(id) + stream) * (1.0f / 4294967296.0f);
+}
+
+static vec3 _randomDirection(const uint32_t id, const uint32_t stream)
+noexcept {
+  float z = _random(id, stream) * 2 - 1;
+  float angle = _random(id, stream + 1) * glm::two_pi<float>();
+  float r = std::sqrt(1 - z * z);
+  return vec3(r * std::cos(angle), r * std::sin(angle), z);
+}
+
+float layoutInstances(Instance* out, const size_t count,
+                      const InstanceLayout layout, const vec3& center,
+                      const float radius, const mat4& meshTransform) noexcept {
+  int side = 1;
+
+  while (size_t(side) * side * side < count) {
+    ++side;
+  }
+
+  float scale = (side == 1) ? 1 : GRID_FILL / side;
+  float cell = 2 * radius / side;
+  mat4 fromMesh = glm::inverse(meshTransform);
+  mat4 toOrigin = glm::translate(-center);
+
+  util::parallelFor(count, [&](const size_t begin, const size_t end) noexcept {
+    for (size_t i = begin; i < end; ++i) {
+      uint32_t id = static_cast<uint32_t>(i);
+      vec3 position;
+      mat4 rotation(1);
+
+      if (layout == InstanceLayout::Grid) {
+        glm::ivec3 c(i % side, (i / side) % side, i / (size_t(side) * side));
+        position = center - vec3(radius) + (vec3(c) + 0.5f) * cell;
+      }
+      else {
+        float distance = radius * std::cbrt(_random(id, 0));
+        // The cube root spreads them evenly through the volume, rather than
+        // bunching them up in the middle
+        position = center + distance * _randomDirection(id, 1);
+        rotation = glm::rotate(_random(id, 3) * glm::two_pi<float>(),
+                               _randomDirection(id, 4));
+      }
+
+      mat4 transform = glm::translate(position) * rotation *
+                       glm::scale(vec3(scale)) * toOrigin;
+
+      Instance& instance = out[i];
+      instance.transform = fromMesh * transform * meshTransform;
+      instance.color = (count == 1) ? vec4(1) :
+                       vec4(glm::rgbColor(vec3(
+                              glm::fract(id * GOLDEN_RATIO) * 360, 0.65f, 0.95f)),
+                            1);
+      instance.id = id;
+      instance.padding[0] = instance.padding[1] = instance.padding[2] = 0;
+    }
+  }, INSTANCE_GRAIN);
+
+  return scale;
+}
+}
+}
@@ -0,0 +1,65 @@
+#ifndef INSTANCING_HPP
+#define INSTANCING_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+namespace balls {
+namespace mesh {
+
+using std::size_t;
+using std::uint32_t;
+using glm::mat4;
+using glm::vec3;
+using glm::vec4;
+
+/// How the copies of the mesh are arranged when it's drawn instanced
+enum class InstanceLayout : int {
+  /// A cube of evenly spaced copies, all facing the same way
+  Grid,
+
+  /// Copies scattered through the mesh's bounding sphere, randomly rotated
+  Cloud,
+};
+
+/**
+ * @brief Everything that's different about one copy of the mesh; one element
+ * of the instance buffer, which is read with a divisor of 1.
+ */
+struct Instance {
+  /// Applied to the vertex's stored position, before the model matrix
+  mat4 transform;
+  vec4 color;
+  uint32_t id;
+  uint32_t padding[3];
+  // Keeps every element 16-byte aligned
+};
+
+static_assert(sizeof(Instance) == 96, "Instance must have no hidden padding");
+
+/**
+ * @brief Fills out with count instances, packed into the bounding box of a
+ * mesh with the given bounding sphere, so that they fill about as much of the
+ * screen as the mesh alone would. The same count and layout always produce
+ * the same instances.
+ *
+ * Instances are independent, so they're written in parallel; out may be a
+ * mapped buffer.
+ *
+ * @param meshTransform Maps the mesh's stored positions to model space (see
+ * Quantization). Each transform is conjugated by it, so shaders can apply
+ * them to the position attribute as-is.
+ *
+ * @return The scale every instance is drawn at, relative to the mesh
+ */
+float layoutInstances(Instance* out, const size_t count,
+                      const InstanceLayout layout, const vec3& center,
+                      const float radius, const mat4& meshTransform) noexcept;
+}
+}
+
+#endif // INSTANCING_HPP
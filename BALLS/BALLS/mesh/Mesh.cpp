@@ -1,76 +1,309 @@
 #include "precompiled.hpp"
 #include "mesh/Mesh.hpp"
 
+#include <cstring>
+#include <numeric>
+
+#if defined(__SSE__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define BALLS_SSE
+#include <xmmintrin.h>
+#endif
+
+#include "util/Parallel.hpp"
+
 namespace balls {
 namespace mesh {
 
 using std::vector;
 
+constexpr size_t INTERLEAVE_GRAIN = 1 << 16;
+// Copying is cheap, so only split up big meshes
+
+constexpr size_t NORMAL_GRAIN = 1 << 14;
+
 vector<Mesh::CoordType> Mesh::combined() noexcept {
-  _computeNormals();
+  computeNormals();
+
+  vector<CoordType> buffer(vertexDataSize() / sizeof(CoordType));
+  interleave(buffer.data());
+
+  return buffer;
+}
+
+template<PositionFormat P, NormalFormat N>
+static void _interleave(const vector<vec3>& vertices,
+                        const vector<vec3>& normals, void* out,
+                        const VertexFormat& format, const Quantization& q)
+noexcept {
+  // One instantiation per pair of formats, so the loop itself never branches
+  size_t stride = format.stride();
+  size_t normal = format.normal().offset;
 
+  util::parallelFor(vertices.size(),
+  [&, out](const size_t begin, const size_t end) noexcept {
+    char* o = static_cast<char*>(out) + begin * stride;
+
+    for (size_t i = begin; i < end; ++i, o += stride) {
+      encodePosition<P>(o, vertices[i], q);
+      encodeNormal<N>(o + normal, normals[i]);
+    }
+  }, INTERLEAVE_GRAIN);
+}
+
+void Mesh::interleave(void* out, const VertexFormat& format,
+                      const Quantization& q) const noexcept {
+  Q_ASSERT(out != nullptr);
   Q_ASSERT(_vertices.size() == _normals.size());
+  using P = PositionFormat;
+  using N = NormalFormat;
+
+  switch (format.positionFormat()) {
+  case P::Float:
+    if (format.normalFormat() == N::Float) {
+      _interleave<P::Float, N::Float>(_vertices, _normals, out, format, q);
+    }
+    else {
+      _interleave<P::Float, N::Int2_10_10_10>(_vertices, _normals, out, format,
+                                              q);
+    }
+
+    break;
 
-  vector<CoordType> buffer;
-  buffer.reserve(_vertices.size() * 6);
-  // ^ *2 because vertices and normals, *3 because x, y, z
-
-  for (auto i = 0u; i < _vertices.size(); ++i) {
-    #ifdef DEBUG
-    const vec3& v = _vertices.at(i);
-    const vec3& n = _normals.at(i);
-    #else
-    const vec3& v = _vertices[i];
-    const vec3& n = _normals[i];
-    #endif
-    buffer.push_back(v.x);
-    buffer.push_back(v.y);
-    buffer.push_back(v.z);
-    buffer.push_back(n.x);
-    buffer.push_back(n.y);
-    buffer.push_back(n.z);
+  case P::HalfFloat:
+    if (format.normalFormat() == N::Float) {
+      _interleave<P::HalfFloat, N::Float>(_vertices, _normals, out, format, q);
+    }
+    else {
+      _interleave<P::HalfFloat, N::Int2_10_10_10>(_vertices, _normals, out,
+          format, q);
+    }
+
+    break;
+
+  case P::Snorm16:
+    if (format.normalFormat() == N::Float) {
+      _interleave<P::Snorm16, N::Float>(_vertices, _normals, out, format, q);
+    }
+    else {
+      _interleave<P::Snorm16, N::Int2_10_10_10>(_vertices, _normals, out,
+          format, q);
+    }
+
+    break;
   }
+}
 
-  return buffer;
+Quantization Mesh::quantization(const VertexFormat& format) const noexcept {
+  Quantization q;
+
+  if (format.positionFormat() != PositionFormat::Snorm16 || _vertices.empty()) {
+    // Only normalized ints need to be mapped back to model space
+    return q;
+  }
+
+  vec3 low = _vertices[0];
+  vec3 high = _vertices[0];
+
+  for (const vec3& v : _vertices) {
+    low = glm::min(low, v);
+    high = glm::max(high, v);
+  }
+
+  vec3 extent = (high - low) * 0.5f;
+  q.bias = (high + low) * 0.5f;
+  q.scale = glm::max(extent.x, glm::max(extent.y, extent.z));
+
+  if (q.scale <= 0) {
+    // If every vertex is in the same place...
+    q.scale = 1;
+  }
+
+  return q;
+}
+
+void Mesh::writeIndices(void* out) const noexcept {
+  Q_ASSERT(out != nullptr);
+
+  if (indexType() == GL_UNSIGNED_SHORT) {
+    // Narrow them on the way out instead of keeping a 16-bit copy around
+    ShortIndexType* o = static_cast<ShortIndexType*>(out);
+
+    util::parallelFor(_indices.size(),
+    [this, o](const size_t begin, const size_t end) noexcept {
+      for (size_t i = begin; i < end; ++i) {
+        o[i] = static_cast<ShortIndexType>(_indices[i]);
+      }
+    }, INTERLEAVE_GRAIN);
+  }
+  else {
+    std::memcpy(out, _indices.data(), indexDataSize());
+  }
+}
+
+Mesh::IndexType Mesh::append(const Mesh& other) noexcept {
+  IndexType base = static_cast<IndexType>(_vertices.size());
+
+  _vertices.insert(_vertices.end(), other._vertices.begin(),
+                   other._vertices.end());
+  _indices.reserve(_indices.size() + other._indices.size());
+
+  for (IndexType i : other._indices) {
+    _indices.push_back(base + i);
+  }
+
+  _normalsValid = false;
+  return base;
+}
+
+void Mesh::release() noexcept {
+  vector<vec3>().swap(_vertices);
+  vector<vec3>().swap(_normals);
+  vector<IndexType>().swap(_indices);
+  // clear() alone keeps the capacity
+}
+
+void Mesh::remap_vertices(const vector<IndexType>& remap) noexcept {
+  Q_ASSERT(remap.size() == _vertices.size());
+
+  vector<vec3> vertices(_vertices.size());
+
+  for (auto i = 0u; i < remap.size(); ++i) {
+    vertices[remap[i]] = _vertices[i];
+  }
+
+  _vertices = std::move(vertices);
+
+  if (_normalsValid) {
+    // Moving vertices around doesn't change their normals, so move those too
+    vector<vec3> normals(_normals.size());
+
+    for (auto i = 0u; i < remap.size(); ++i) {
+      normals[remap[i]] = _normals[i];
+    }
+
+    _normals = std::move(normals);
+  }
 }
 
-void Mesh::_computeNormals() noexcept {
+// Writes the unit normal of each face in [begin, end) to out; degenerate
+// faces get a zero normal, so they don't contribute to their vertices'
+static void _faceNormals(const vector<vec3>& vertices,
+                         const vector<Mesh::IndexType>& indices, vec3* out,
+                         const size_t begin, const size_t end) noexcept {
+  size_t f = begin;
+
+  #ifdef BALLS_SSE
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1);
+
+  for (; f + 4 <= end; f += 4) {
+    // Transpose four faces into SoA so that each lane handles one face
+    alignas(16) float ax[4], ay[4], az[4], bx[4], by[4], bz[4], cx[4], cy[4],
+          cz[4];
+
+    for (size_t k = 0; k < 4; ++k) {
+      const Mesh::IndexType* t = indices.data() + (f + k) * 3;
+      const vec3& a = vertices[t[0]];
+      const vec3& b = vertices[t[1]];
+      const vec3& c = vertices[t[2]];
+      ax[k] = a.x, ay[k] = a.y, az[k] = a.z;
+      bx[k] = b.x, by[k] = b.y, bz[k] = b.z;
+      cx[k] = c.x, cy[k] = c.y, cz[k] = c.z;
+    }
+
+    __m128 Ax = _mm_load_ps(ax), Ay = _mm_load_ps(ay), Az = _mm_load_ps(az);
+    __m128 e1x = _mm_sub_ps(_mm_load_ps(bx), Ax);
+    __m128 e1y = _mm_sub_ps(_mm_load_ps(by), Ay);
+    __m128 e1z = _mm_sub_ps(_mm_load_ps(bz), Az);
+    __m128 e2x = _mm_sub_ps(_mm_load_ps(cx), Ax);
+    __m128 e2y = _mm_sub_ps(_mm_load_ps(cy), Ay);
+    __m128 e2z = _mm_sub_ps(_mm_load_ps(cz), Az);
+
+    // Same as glm::triangleNormal(); normalize(cross(b - a, c - a))
+    __m128 nx = _mm_sub_ps(_mm_mul_ps(e1y, e2z), _mm_mul_ps(e1z, e2y));
+    __m128 ny = _mm_sub_ps(_mm_mul_ps(e1z, e2x), _mm_mul_ps(e1x, e2z));
+    __m128 nz = _mm_sub_ps(_mm_mul_ps(e1x, e2y), _mm_mul_ps(e1y, e2x));
+    __m128 length2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx),
+                                           _mm_mul_ps(ny, ny)),
+                                _mm_mul_ps(nz, nz));
+    __m128 scale = _mm_and_ps(_mm_div_ps(one, _mm_sqrt_ps(length2)),
+                              _mm_cmpgt_ps(length2, zero));
+    // The mask zeroes the lanes that would otherwise divide by zero
+
+    _mm_store_ps(ax, _mm_mul_ps(nx, scale));
+    _mm_store_ps(ay, _mm_mul_ps(ny, scale));
+    _mm_store_ps(az, _mm_mul_ps(nz, scale));
+
+    for (size_t k = 0; k < 4; ++k) {
+      out[f + k] = vec3(ax[k], ay[k], az[k]);
+    }
+  }
+  #endif
+
+  for (; f < end; ++f) {
+    // The scalar fallback, and whatever's left over after the SIMD loop
+    const Mesh::IndexType* t = indices.data() + f * 3;
+    const vec3& a = vertices[t[0]];
+    vec3 n = glm::cross(vertices[t[1]] - a, vertices[t[2]] - a);
+    float length = glm::length(n);
+    out[f] = (length > 0) ? n / length : vec3(0);
+  }
+}
+
+void Mesh::computeNormals() noexcept {
   Q_ASSERT(_indices.size() % 3 == 0);
 
-  _normals = vector<vec3>(_vertices.size(), vec3());
-
-  // To silence sign-compare warnings
-  for (auto i = 0u; i < _indices.size(); i += 3) {
-    #ifdef DEBUG
-    IndexType i1 = _indices.at(i);
-    IndexType i2 = _indices.at(i + 1);
-    IndexType i3 = _indices.at(i + 2);
-    const vec3& v1 = _vertices.at(i1);
-    const vec3& v2 = _vertices.at(i2);
-    const vec3& v3 = _vertices.at(i3);
-
-    vec3 normal = glm::triangleNormal(v1, v2, v3);
-    _normals.at(i1) += normal;
-    _normals.at(i2) += normal;
-    _normals.at(i3) += normal;
-    #else
-    IndexType i1 = _indices[i];
-    IndexType i2 = _indices[i + 1];
-    IndexType i3 = _indices[i + 2];
-    const vec3& v1 = _vertices[i1];
-    const vec3& v2 = _vertices[i2];
-    const vec3& v3 = _vertices[i3];
-
-    vec3 normal = glm::triangleNormal(v1, v2, v3);
-    _normals[i1] += normal;
-    _normals[i2] += normal;
-    _normals[i3] += normal;
-    #endif
+  if (_normalsValid) {
+    // If the geometry hasn't changed since last time...
+    return;
   }
 
-  for (vec3& n : _normals) {
-    n = glm::normalize(n);
+  size_t triangles = _indices.size() / 3;
+  size_t vertexCount = _vertices.size();
+
+  vector<vec3> faceNormals(triangles);
+
+  util::parallelFor(triangles,
+  [this, &faceNormals](const size_t begin, const size_t end) noexcept {
+    _faceNormals(_vertices, _indices, faceNormals.data(), begin, end);
+  }, NORMAL_GRAIN);
+
+  // The faces around each vertex, stored as one flat array; gathering from
+  // these instead of scattering into the vertices means no two threads ever
+  // write to the same normal
+  vector<size_t> offsets(vertexCount + 1, 0);
+
+  for (IndexType i : _indices) {
+    ++offsets[i + 1];
   }
+
+  std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+  vector<IndexType> faces(_indices.size());
+  vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+
+  for (size_t i = 0; i < _indices.size(); ++i) {
+    faces[fill[_indices[i]]++] = static_cast<IndexType>(i / 3);
+  }
+
+  _normals.resize(vertexCount);
+
+  util::parallelFor(vertexCount,
+  [&](const size_t begin, const size_t end) noexcept {
+    for (size_t v = begin; v < end; ++v) {
+      vec3 n(0);
+
+      for (size_t a = offsets[v]; a < offsets[v + 1]; ++a) {
+        n += faceNormals[faces[a]];
+      }
+
+      float length = glm::length(n);
+      _normals[v] = (length > 0) ? n / length : n;
+    }
+  }, NORMAL_GRAIN);
+
+  _normalsValid = true;
 }
 }
 }
@@ -4,12 +4,15 @@
 #include <array>
 #include <cstdint>
 #include <initializer_list>
+#include <limits>
 #include <vector>
 
 #include <QOpenGLContext>
 
 #include <glm/vec3.hpp>
 
+#include "mesh/VertexFormat.hpp"
+
 namespace balls {
 namespace mesh {
 
@@ -17,15 +20,21 @@ using std::array;
 using std::initializer_list;
 using std::size_t;
 using std::uint16_t;
+using std::uint32_t;
 using std::vector;
 using glm::vec3;
 
 class Mesh {
 public:
   typedef float CoordType;
-  typedef uint16_t IndexType;
+  typedef uint32_t IndexType;
+  typedef uint16_t ShortIndexType;
+
+  /// The most vertices a mesh can have and still be drawn with 16-bit indices
+  static constexpr size_t MAX_SHORT_VERTICES =
+    std::numeric_limits<ShortIndexType>::max() + size_t(1);
 
-  Mesh() noexcept {}
+  Mesh() noexcept : _normalsValid(false) {}
 
   inline IndexType add_vertex(const CoordType, const CoordType,
                               const CoordType) noexcept;
@@ -35,13 +44,99 @@ public:
   inline void add_face(const IndexType, const IndexType,
                        const IndexType) noexcept;
 
+  /**
+   * @brief Preallocates room for the given number of vertices and indices, so
+   * generators that know their final size up front don't reallocate.
+   */
+  inline void reserve(const size_t vertices, const size_t indices) noexcept;
+
+  /**
+   * @brief Sets the final vertex and index counts up front, so generators can
+   * fill the mesh in place with set_vertex()/set_face(), possibly in parallel.
+   * Those two don't touch any shared state (resize() already marked the
+   * normals as stale), so they're only meant for that.
+   */
+  inline void resize(const size_t vertices, const size_t indices) noexcept;
+  inline void set_vertex(const IndexType, const vec3&) noexcept;
+  inline void set_face(const size_t, const IndexType, const IndexType,
+                       const IndexType) noexcept;
+
+  /**
+   * @brief Adds every vertex and face of another mesh to this one, as a
+   * separate piece. Returns the index of the first of its vertices.
+   */
+  IndexType append(const Mesh&) noexcept;
+
+  /// Replaces every face at once; used by passes that only reorder them
+  inline void set_indices(vector<IndexType>&&) noexcept;
+
+  /// Replaces every vertex at once; used by importers that build them in bulk
+  inline void set_vertices(vector<vec3>&&) noexcept;
+
+  /**
+   * @brief Moves each vertex i to position remap[i], which must be a
+   * permutation, and updates nothing else; the caller renumbers the indices.
+   */
+  void remap_vertices(const vector<IndexType>& remap) noexcept;
+
+  /**
+   * @brief Computes each vertex's normal by averaging the faces around it, in
+   * parallel. Must be called before interleave(). The normals are kept until
+   * the geometry changes, so calling this again is free until then.
+   */
+  void computeNormals() noexcept;
+
+  /**
+   * @brief Computes normals and returns them interleaved with the vertices.
+   * Prefer interleave() into a mapped buffer, which skips this copy.
+   */
   vector<CoordType> combined() noexcept;
 
+  /**
+   * @brief Writes each vertex followed by its normal to out in the given
+   * format, which must have room for vertexDataSize() bytes. Meant to be
+   * pointed at a mapped GL buffer, so the interleaved data never exists in
+   * main memory.
+   */
+  void interleave(void* out, const VertexFormat& = VertexFormat(),
+                  const Quantization& = Quantization()) const noexcept;
+
+  /**
+   * @brief Returns the transform that fits this mesh's positions into the
+   * range of the given format (the identity unless it's normalized).
+   */
+  Quantization quantization(const VertexFormat&) const noexcept;
+
+  /**
+   * @brief Writes every index as indexType() to out, which must have room for
+   * indexDataSize() bytes.
+   */
+  void writeIndices(void* out) const noexcept;
+
+  /// Frees every vertex, normal, and index (not just clears them)
+  void release() noexcept;
+
 public /* getters */:
   const vector<vec3>& vertices() const noexcept { return this->_vertices; }
   const vector<IndexType>& indices() const noexcept { return this->_indices; }
   const vector<vec3>& normals() const noexcept { return this->_normals; }
 
+  /**
+   * @brief The smallest GL index type that can address every vertex in this
+   * mesh; GL_UNSIGNED_SHORT or GL_UNSIGNED_INT.
+   */
+  inline GLenum indexType() const noexcept;
+
+  /// The size in bytes of one index of indexType()
+  inline size_t indexSize() const noexcept;
+
+  /// The size in bytes of the data interleave() writes
+  inline size_t vertexDataSize(const VertexFormat& = VertexFormat()) const
+  noexcept;
+
+  /// The size in bytes of the data writeIndices() writes
+  inline size_t indexDataSize() const noexcept;
+
   inline vec3& operator[](const IndexType pos);
   inline const vec3& operator[](const IndexType pos) const;
 
@@ -49,12 +144,13 @@ private /* members */:
   vector<vec3> _vertices;
   vector<vec3> _normals;
   vector<IndexType> _indices;
+  bool _normalsValid;
 
-private /* methods */:
-  void _computeNormals() noexcept;
 };
 
 inline vec3& Mesh::operator[](const Mesh::IndexType pos) {
+  _normalsValid = false;
+  // The caller might move this vertex
   #ifdef DEBUG
   return this->_vertices.at(pos);
   // at() has bounds-checking, operator[] doesn't
@@ -71,6 +167,68 @@ inline const vec3& Mesh::operator[](const Mesh::IndexType pos) const {
   #endif
 }
 
+inline GLenum Mesh::indexType() const noexcept {
+  return (_vertices.size() <= MAX_SHORT_VERTICES) ? GL_UNSIGNED_SHORT
+         : GL_UNSIGNED_INT;
+}
+
+inline size_t Mesh::indexSize() const noexcept {
+  return (indexType() == GL_UNSIGNED_SHORT) ? sizeof(ShortIndexType)
+         : sizeof(IndexType);
+}
+
+inline size_t Mesh::vertexDataSize(const VertexFormat& format) const
+noexcept {
+  return _vertices.size() * format.stride();
+}
+
+inline size_t Mesh::indexDataSize() const noexcept {
+  return _indices.size() * indexSize();
+}
+
+inline void Mesh::reserve(const size_t vertices, const size_t indices)
+noexcept {
+  _vertices.reserve(vertices);
+  _indices.reserve(indices);
+}
+
+inline void Mesh::resize(const size_t vertices, const size_t indices)
+noexcept {
+  _normalsValid = false;
+  _vertices.resize(vertices);
+  _indices.resize(indices);
+}
+
+inline void Mesh::set_vertex(const IndexType i, const vec3& v) noexcept {
+  #ifdef DEBUG
+  _vertices.at(i) = v;
+  #else
+  _vertices[i] = v;
+  #endif
+}
+
+inline void Mesh::set_face(const size_t face, const IndexType a,
+                           const IndexType b, const IndexType c) noexcept {
+  #ifdef DEBUG
+  Q_ASSERT(face * 3 + 2 < _indices.size());
+  #endif
+  IndexType* f = _indices.data() + face * 3;
+  f[0] = a;
+  f[1] = b;
+  f[2] = c;
+}
+
+inline void Mesh::set_indices(vector<IndexType>&& indices) noexcept {
+  Q_ASSERT(indices.size() % 3 == 0);
+  _indices = std::move(indices);
+  _normalsValid = false;
+}
+
+inline void Mesh::set_vertices(vector<vec3>&& vertices) noexcept {
+  _vertices = std::move(vertices);
+  _normalsValid = false;
+}
+
 inline Mesh::IndexType Mesh::add_vertex(const CoordType x, const CoordType y,
                                         const CoordType z) noexcept {
   return add_vertex(vec3(x, y, z));
@@ -78,6 +236,7 @@ inline Mesh::IndexType Mesh::add_vertex(const CoordType x, const CoordType y,
 
 inline Mesh::IndexType Mesh::add_vertex(const vec3& v) noexcept {
   _vertices.push_back(v);
+  _normalsValid = false;
 
   return _vertices.size() - 1;
 }
@@ -94,6 +253,7 @@ inline void Mesh::add_face(const IndexType a, const IndexType b,
   _indices.push_back(a);
   _indices.push_back(b);
   _indices.push_back(c);
+  _normalsValid = false;
 }
 }
 }
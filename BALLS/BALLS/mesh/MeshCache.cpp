@@ -0,0 +1,194 @@
+#include "precompiled.hpp"
+#include "mesh/MeshCache.hpp"
+
+#include <algorithm>
+
+#include "mesh/MeshGenerator.hpp"
+#include "util/Logging.hpp"
+#include "util/Util.hpp"
+
+namespace balls {
+namespace mesh {
+
+using std::sort;
+
+size_t BuiltMesh::bytes() const noexcept {
+  size_t b = 0;
+
+  if (mesh) {
+    b += mesh->vertices().capacity() * sizeof(vec3);
+    b += mesh->normals().capacity() * sizeof(vec3);
+    b += mesh->indices().capacity() * sizeof(Mesh::IndexType);
+  }
+
+  if (file) {
+    b += file->size();
+    // Only mapped, but it'll be paged in by the time it's uploaded
+  }
+
+  if (clusters) {
+    b += clusters->bytes();
+  }
+
+  return b;
+}
+
+MeshCache::MeshCache(const size_t budget) noexcept
+  : _budget(budget),
+    _bytes(0),
+    _hits(0),
+    _misses(0),
+    _evictions(0) {}
+
+MeshCache::Key MeshCache::key(const MeshGenerator& generator) noexcept {
+  const MeshParameters& params = generator.getParameters();
+  Key key;
+  key.generator = generator.getName();
+  key.parameters.reserve(params.size());
+
+  for (const auto& p : params) {
+    key.parameters.emplace_back(p.first, p.second.get<QVariant>());
+  }
+
+  sort(key.parameters.begin(), key.parameters.end(),
+  [](const Parameter & a, const Parameter & b) {
+    return a.first < b.first;
+  });
+  // unordered_map's iteration order isn't stable, so compare in a fixed order
+
+  size_t seed = qHash(key.generator);
+
+  for (const auto& p : key.parameters) {
+    seed ^= qHash(p.first) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    seed ^= qHash(p.second.toString()) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+  }
+
+  key.hash = seed;
+  return key;
+}
+
+size_t MeshCache::KeyHash::operator()(const Key& k) const noexcept {
+  return k.hash;
+}
+
+const MeshCache::Entry* MeshCache::find(const Key& key) noexcept {
+  auto it = _index.find(key);
+
+  if (it == _index.end()) {
+    ++_misses;
+    qCDebug(logs::mesh::Cache) << "Miss for" << key.generator;
+    _logStats();
+    return nullptr;
+  }
+
+  _entries.splice(_entries.begin(), _entries, it->second);
+  // Move it to the front; list iterators stay valid across splice()
+
+  ++_hits;
+  qCDebug(logs::mesh::Cache)
+      << "Hit for" << key.generator
+      << (it->second->second.hasGpu ? "(with GPU buffers)" : "");
+  _logStats();
+  return &(it->second->second);
+}
+
+const MeshCache::Entry* MeshCache::peek(const Key& key) const noexcept {
+  auto it = _index.find(key);
+
+  return (it == _index.end()) ? nullptr : &(it->second->second);
+}
+
+void MeshCache::insert(const Key& key, const BuiltMesh& built) noexcept {
+  auto it = _index.find(key);
+
+  if (it != _index.end()) {
+    _bytes -= it->second->second.bytes();
+    _entries.erase(it->second);
+    _index.erase(it);
+  }
+
+  Entry entry {built, GpuMesh(), false};
+  size_t bytes = entry.bytes();
+
+  if (bytes > _budget) {
+    qCDebug(logs::mesh::Cache)
+        << key.generator << "needs" << bytes << "bytes; too big to cache";
+    return;
+  }
+
+  _entries.emplace_front(key, entry);
+  _index[key] = _entries.begin();
+  _bytes += bytes;
+
+  _evict();
+  _logStats();
+}
+
+void MeshCache::insertGpu(const Key& key, const GpuMesh& gpu) noexcept {
+  auto it = _index.find(key);
+
+  if (it == _index.end()) {
+    // If the mesh was evicted (or never fit) in the meantime...
+    return;
+  }
+
+  Entry& entry = it->second->second;
+  _bytes -= entry.bytes();
+  entry.gpu = gpu;
+  entry.hasGpu = true;
+  _bytes += entry.bytes();
+
+  _evict();
+}
+
+void MeshCache::releaseCpu(const Key& key) noexcept {
+  auto it = _index.find(key);
+
+  if (it == _index.end() || !it->second->second.hasGpu) {
+    // If this mesh can't be drawn from the cache without its CPU copy...
+    return;
+  }
+
+  Entry& entry = it->second->second;
+  _bytes -= entry.built.bytes();
+  entry.built.mesh.reset();
+  entry.built.file.reset();
+  entry.built.clusters.reset();
+  // The GPU copy keeps its own reference to the clusters
+}
+
+void MeshCache::setBudget(const size_t budget) noexcept {
+  _budget = budget;
+  _evict();
+
+  qCDebug(logs::mesh::Cache) << "Budget set to" << budget << "bytes";
+}
+
+void MeshCache::clear() noexcept {
+  _entries.clear();
+  _index.clear();
+  _bytes = 0;
+}
+
+void MeshCache::_evict() noexcept {
+  while (_bytes > _budget && !_entries.empty()) {
+    // While we're over budget, drop the least recently used mesh
+    const auto& last = _entries.back();
+    _bytes -= last.second.bytes();
+    ++_evictions;
+
+    qCDebug(logs::mesh::Cache) << "Evicted" << last.first.generator;
+
+    _index.erase(last.first);
+    _entries.pop_back();
+  }
+}
+
+void MeshCache::_logStats() const noexcept {
+  qCDebug(logs::mesh::Cache).nospace()
+      << _hits << " hits, " << _misses << " misses, " << _evictions
+      << " evictions, " << _entries.size() << " meshes in " << _bytes << '/'
+      << _budget << " bytes";
+}
+}
+}
@@ -0,0 +1,157 @@
+#ifndef MESHCACHE_HPP
+#define MESHCACHE_HPP
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <QtCore/QString>
+#include <QtCore/QVariant>
+#include <QtGui/QOpenGLBuffer>
+
+#include "mesh/Clusters.hpp"
+#include "mesh/Mesh.hpp"
+#include "mesh/MeshFile.hpp"
+#include "mesh/MeshParameter.hpp"
+#include "mesh/Simplifier.hpp"
+#include "mesh/VertexFormat.hpp"
+
+namespace balls {
+namespace mesh {
+
+class MeshGenerator;
+
+using std::list;
+using std::shared_ptr;
+using std::size_t;
+using std::unordered_map;
+using std::vector;
+
+/// A generated mesh with its normals computed, ready to upload
+struct BuiltMesh {
+  shared_ptr<const Mesh> mesh;
+  LodChain lods;
+
+  /// If set, a mapped mesh file to upload as-is instead of mesh
+  shared_ptr<const MeshFile> file;
+
+  /// The mesh's clusters, for culling; if not set, it's drawn whole
+  shared_ptr<const ClusterSet> clusters;
+
+  size_t bytes() const noexcept;
+};
+
+/// The GPU-side copy of a BuiltMesh
+struct GpuMesh {
+  QOpenGLBuffer vbo;
+  QOpenGLBuffer ibo;
+  GLenum indexType;
+  GLsizei indexCount;
+  VertexFormat format;
+  Quantization quantization;
+  LodChain lods;
+  shared_ptr<const ClusterSet> clusters;
+  size_t bytes;
+};
+
+/**
+ * @brief A least-recently-used cache of generated meshes, keyed by the name of
+ * the generator and the values of its parameters.
+ *
+ * Entries hold the CPU-side mesh, the buffers it was uploaded to, or both.
+ * Both count towards the byte budget; when it's exceeded, the least recently
+ * used entries are dropped (the GPU buffers are freed once nothing else
+ * refers to them).
+ */
+class MeshCache {
+public /* types */:
+  typedef std::pair<QString, QVariant> Parameter;
+
+  struct Key {
+    QString generator;
+
+    /// The parameters' names and values, sorted by name
+    vector<Parameter> parameters;
+
+    /// Of all the above; only for finding the bucket, never for equality
+    size_t hash = 0;
+
+    bool operator==(const Key& o) const noexcept {
+      return hash == o.hash && generator == o.generator &&
+             parameters == o.parameters;
+    }
+  };
+
+  struct Entry {
+    BuiltMesh built;
+    GpuMesh gpu;
+    bool hasGpu;
+
+    size_t bytes() const noexcept {
+      return built.bytes() + (hasGpu ? gpu.bytes : 0);
+    }
+  };
+
+public:
+  explicit MeshCache(const size_t budget) noexcept;
+
+  static Key key(const MeshGenerator&) noexcept;
+
+  /**
+   * @brief Returns the entry for this key and marks it as the most recently
+   * used, or returns nullptr. The pointer is only valid until the cache is
+   * next modified.
+   */
+  const Entry* find(const Key&) noexcept;
+
+  /// Like find(), but doesn't count as a use or touch the statistics
+  const Entry* peek(const Key&) const noexcept;
+
+  void insert(const Key&, const BuiltMesh&) noexcept;
+
+  /// Attaches the buffers this key's mesh was uploaded to, if it's still cached
+  void insertGpu(const Key&, const GpuMesh&) noexcept;
+
+  /**
+   * @brief Drops the CPU-side mesh for this key if its GPU buffers are cached,
+   * since those are all that's needed to draw it again.
+   */
+  void releaseCpu(const Key&) noexcept;
+
+  void setBudget(const size_t) noexcept;
+  void clear() noexcept;
+
+  size_t budget() const noexcept { return _budget; }
+  size_t bytes() const noexcept { return _bytes; }
+  size_t size() const noexcept { return _entries.size(); }
+  size_t hits() const noexcept { return _hits; }
+  size_t misses() const noexcept { return _misses; }
+  size_t evictions() const noexcept { return _evictions; }
+
+private /* types */:
+  struct KeyHash {
+    size_t operator()(const Key& k) const noexcept;
+  };
+
+  using List = list<std::pair<Key, Entry>>;
+
+private /* members */:
+  List _entries;
+  unordered_map<Key, List::iterator, KeyHash> _index;
+  size_t _budget;
+  size_t _bytes;
+  size_t _hits;
+  size_t _misses;
+  size_t _evictions;
+
+private /* methods */:
+  void _evict() noexcept;
+  void _logStats() const noexcept;
+};
+}
+}
+
+#endif // MESHCACHE_HPP
@@ -0,0 +1,312 @@
+#include "precompiled.hpp"
+#include "mesh/MeshFile.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#include <QtCore/QSysInfo>
+
+#include "exception/FileException.hpp"
+#include "mesh/Importer.hpp"
+#include "util/Logging.hpp"
+#include "util/Parallel.hpp"
+
+namespace balls {
+namespace mesh {
+
+using std::int32_t;
+using std::uint64_t;
+
+constexpr char MAGIC[8] = {'B', 'A', 'L', 'L', 'S', 'M', 'S', 'H'};
+
+constexpr size_t ALIGNMENT = 64;
+// Enough for any vertex attribute, and for SSE/AVX loads if we ever want them
+
+constexpr size_t VALIDATE_GRAIN = 1 << 16;
+
+/**
+ * @brief The first bytes of every mesh file. Only fixed-size fields, so that
+ * it can be read straight out of the mapping.
+ */
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t headerSize;
+  int32_t positionFormat;
+  int32_t normalFormat;
+  uint32_t stride;
+  uint32_t indexType;
+  uint64_t vertexCount;
+  uint64_t indexCount;
+  uint64_t lodOffset;
+  uint64_t vertexOffset;
+  uint64_t indexOffset;
+  uint32_t lodCount;
+  float lodRadius;
+  float lodCenter[3];
+  float quantizationScale;
+  float quantizationBias[3];
+  float low[3];
+  float high[3];
+  uint32_t reserved;
+};
+
+static_assert(sizeof(Header) == 136, "Header must have no padding");
+
+/// One entry in the level of detail table
+struct Lod {
+  uint64_t firstIndex;
+  uint64_t indexCount;
+};
+
+static size_t _align(const size_t offset) noexcept {
+  return (offset + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+static size_t _indexSize(const GLenum type) noexcept {
+  return (type == GL_UNSIGNED_SHORT) ? sizeof(Mesh::ShortIndexType)
+         : sizeof(Mesh::IndexType);
+}
+
+static bool _littleEndian() noexcept {
+  return QSysInfo::ByteOrder == QSysInfo::LittleEndian;
+}
+
+// True if [offset, offset + bytes) is inside a file of the given size
+static bool _fits(const uint64_t offset, const uint64_t bytes,
+                  const size_t size) noexcept {
+  return offset <= size && bytes <= size - offset;
+}
+
+// Returns the largest index in a buffer of the given type, in parallel
+template<class T>
+static size_t _maxIndex(const void* data, const size_t count) noexcept {
+  const T* indices = static_cast<const T*>(data);
+  std::atomic<size_t> result(0);
+
+  util::parallelFor(count, [&](const size_t begin, const size_t end) {
+    T m = 0;
+
+    for (size_t i = begin; i < end; ++i) {
+      m = std::max(m, indices[i]);
+    }
+
+    size_t current = result;
+
+    while (m > current && !result.compare_exchange_weak(current, m)) {}
+  }, VALIDATE_GRAIN);
+
+  return result;
+}
+
+size_t MeshFile::indexDataSize() const noexcept {
+  return _info.indexCount * _indexSize(_info.indexType);
+}
+
+MeshFile::MeshFile(const QString& path) noexcept :
+  _file(path),
+  _vertices(nullptr),
+  _indices(nullptr),
+  _size(0) {}
+
+shared_ptr<const MeshFile> MeshFile::open(const QString& path) {
+  shared_ptr<MeshFile> file(new MeshFile(path));
+  QFile& f = file->_file;
+
+  if (!_littleEndian()) {
+    throw ImportException(path, "Mesh files can only be read on little-endian "
+                          "machines");
+  }
+
+  if (!f.open(QIODevice::ReadOnly)) {
+    throw FileException(f);
+  }
+
+  size_t size = size_t(f.size());
+
+  if (size < sizeof(Header)) {
+    throw ImportException(path, "Too small to be a mesh file");
+  }
+
+  const uchar* data = f.map(0, f.size());
+
+  if (data == nullptr) {
+    throw FileException(f);
+  }
+
+  Header h;
+  std::memcpy(&h, data, sizeof(h));
+
+  if (std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0) {
+    throw ImportException(path, "Not a mesh file");
+  }
+
+  if (h.version != MESH_FILE_VERSION || h.headerSize != sizeof(Header)) {
+    throw ImportException(path, QString("Mesh file version %1 isn't supported "
+                                        "(expected %2)")
+                          .arg(h.version).arg(MESH_FILE_VERSION));
+  }
+
+  auto position = static_cast<PositionFormat>(h.positionFormat);
+  auto normal = static_cast<NormalFormat>(h.normalFormat);
+  VertexFormat format(position, normal);
+
+  if (format.positionFormat() != position || format.normalFormat() != normal ||
+      format.stride() != h.stride) {
+    throw ImportException(path, "Unknown vertex format");
+  }
+
+  if (h.indexType != GL_UNSIGNED_SHORT && h.indexType != GL_UNSIGNED_INT) {
+    throw ImportException(path, "Unknown index type");
+  }
+
+  size_t indexSize = _indexSize(h.indexType);
+
+  if (h.indexCount % 3 != 0 ||
+      h.vertexCount > size / h.stride || h.indexCount > size / indexSize ||
+      h.lodCount > size / sizeof(Lod) ||
+      !_fits(h.lodOffset, h.lodCount * sizeof(Lod), size) ||
+      !_fits(h.vertexOffset, h.vertexCount * h.stride, size) ||
+      !_fits(h.indexOffset, h.indexCount * indexSize, size)) {
+    throw ImportException(path, "Truncated or corrupt mesh file");
+  }
+
+  MeshFileInfo& info = file->_info;
+  info.format = format;
+  info.quantization.scale = h.quantizationScale;
+  info.quantization.bias = vec3(h.quantizationBias[0], h.quantizationBias[1],
+                                h.quantizationBias[2]);
+  info.indexType = h.indexType;
+  info.vertexCount = h.vertexCount;
+  info.indexCount = h.indexCount;
+  info.lods.center = vec3(h.lodCenter[0], h.lodCenter[1], h.lodCenter[2]);
+  info.lods.radius = h.lodRadius;
+  info.low = vec3(h.low[0], h.low[1], h.low[2]);
+  info.high = vec3(h.high[0], h.high[1], h.high[2]);
+
+  for (uint32_t l = 0; l < h.lodCount; ++l) {
+    Lod lod;
+    std::memcpy(&lod, data + h.lodOffset + l * sizeof(Lod), sizeof(lod));
+
+    if (lod.firstIndex > h.indexCount ||
+        lod.indexCount > h.indexCount - lod.firstIndex) {
+      throw ImportException(path, "Level of detail is out of range");
+    }
+
+    info.lods.levels.push_back({lod.firstIndex, lod.indexCount});
+  }
+
+  file->_vertices = data + h.vertexOffset;
+  file->_indices = data + h.indexOffset;
+  file->_size = size;
+
+  // The GPU won't check these for us, and it's cheap next to reading the file
+  size_t highest = (h.indexType == GL_UNSIGNED_SHORT) ?
+                   _maxIndex<Mesh::ShortIndexType>(file->_indices, h.indexCount) :
+                   _maxIndex<Mesh::IndexType>(file->_indices, h.indexCount);
+
+  if (h.indexCount > 0 && highest >= h.vertexCount) {
+    throw ImportException(path, "A face refers to a vertex that isn't there");
+  }
+
+  qCDebug(logs::mesh::Import).nospace()
+      << "Mapped " << path << ": " << h.vertexCount << " vertices, "
+      << h.indexCount / 3 << " triangles, " << info.lods.levels.size()
+      << " levels of detail";
+
+  return file;
+}
+
+void saveMeshFile(const QString& path, const MeshFileInfo& info,
+                  const function<void(void*)>& writeVertices,
+                  const function<void(void*)>& writeIndices) {
+  Header h;
+  std::memset(&h, 0, sizeof(h));
+  std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+  h.version = MESH_FILE_VERSION;
+  h.headerSize = sizeof(Header);
+  h.positionFormat = int32_t(info.format.positionFormat());
+  h.normalFormat = int32_t(info.format.normalFormat());
+  h.stride = uint32_t(info.format.stride());
+  h.indexType = info.indexType;
+  h.vertexCount = info.vertexCount;
+  h.indexCount = info.indexCount;
+  h.lodCount = uint32_t(info.lods.levels.size());
+  h.lodRadius = info.lods.radius;
+  h.quantizationScale = info.quantization.scale;
+
+  for (int i = 0; i < 3; ++i) {
+    h.lodCenter[i] = info.lods.center[i];
+    h.quantizationBias[i] = info.quantization.bias[i];
+    h.low[i] = info.low[i];
+    h.high[i] = info.high[i];
+  }
+
+  size_t vertexBytes = info.vertexCount * info.format.stride();
+  size_t indexBytes = info.indexCount * _indexSize(info.indexType);
+  h.lodOffset = _align(sizeof(Header));
+  h.vertexOffset = _align(h.lodOffset + h.lodCount * sizeof(Lod));
+  h.indexOffset = _align(h.vertexOffset + vertexBytes);
+  size_t size = h.indexOffset + indexBytes;
+
+  QFile file(path);
+
+  if (!file.open(QIODevice::ReadWrite | QIODevice::Truncate) ||
+      !file.resize(qint64(size))) {
+    throw FileException(file);
+  }
+
+  uchar* data = file.map(0, qint64(size));
+
+  if (data == nullptr) {
+    throw FileException(file);
+  }
+
+  std::memcpy(data, &h, sizeof(h));
+
+  for (uint32_t l = 0; l < h.lodCount; ++l) {
+    Lod lod = {info.lods.levels[l].firstIndex, info.lods.levels[l].indexCount};
+    std::memcpy(data + h.lodOffset + l * sizeof(Lod), &lod, sizeof(lod));
+  }
+
+  writeVertices(data + h.vertexOffset);
+  writeIndices(data + h.indexOffset);
+
+  if (!file.unmap(data)) {
+    throw FileException(file);
+  }
+
+  qCDebug(logs::mesh::Import).nospace()
+      << "Saved " << path << ": " << size << " bytes, "
+      << info.format.toString();
+}
+
+void saveMeshFile(const QString& path, const Mesh& mesh, const LodChain& lods,
+                  const VertexFormat& format) {
+  MeshFileInfo info;
+  info.format = format;
+  info.quantization = mesh.quantization(format);
+  info.indexType = mesh.indexType();
+  info.vertexCount = mesh.vertices().size();
+  info.indexCount = mesh.indices().size();
+  info.lods = lods;
+  info.low = info.high = vec3(0);
+
+  if (!mesh.vertices().empty()) {
+    info.low = info.high = mesh.vertices()[0];
+
+    for (const vec3& v : mesh.vertices()) {
+      info.low = glm::min(info.low, v);
+      info.high = glm::max(info.high, v);
+    }
+  }
+
+  saveMeshFile(path, info, [&](void* out) {
+    mesh.interleave(out, format, info.quantization);
+  }, [&mesh](void* out) {
+    mesh.writeIndices(out);
+  });
+}
+}
+}
@@ -0,0 +1,106 @@
+#ifndef MESHFILE_HPP
+#define MESHFILE_HPP
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include <QtCore/QFile>
+#include <QtCore/QString>
+
+#include "mesh/Mesh.hpp"
+#include "mesh/Simplifier.hpp"
+#include "mesh/VertexFormat.hpp"
+
+namespace balls {
+namespace mesh {
+
+using std::function;
+using std::shared_ptr;
+using std::uint32_t;
+
+/// Bumped whenever the layout of a mesh file changes; older files are rejected
+constexpr uint32_t MESH_FILE_VERSION = 1;
+
+/// Everything about a mesh file except its vertex and index data
+struct MeshFileInfo {
+  VertexFormat format;
+  Quantization quantization;
+  GLenum indexType;
+  size_t vertexCount;
+  size_t indexCount;
+  LodChain lods;
+  vec3 low;
+  vec3 high;
+};
+
+/**
+ * @brief A mesh saved exactly as BallsCanvas uploads it, memory-mapped.
+ *
+ * The file is a fixed header, the level of detail table, the interleaved
+ * vertex buffer, and the index buffer, each section aligned to 64 bytes and
+ * every number little-endian. Nothing needs to be parsed or converted, so the
+ * buffers are handed to glBufferData() straight from the mapping.
+ *
+ * The mapping stays open for as long as the MeshFile does.
+ */
+class MeshFile {
+public:
+  /**
+   * @brief Maps and validates the given file.
+   *
+   * @throws FileException if it can't be opened or mapped
+   * @throws ImportException if it isn't a mesh file of this version
+   */
+  static shared_ptr<const MeshFile> open(const QString& path);
+
+  const MeshFileInfo& info() const noexcept { return _info; }
+
+  const void* vertexData() const noexcept { return _vertices; }
+  const void* indexData() const noexcept { return _indices; }
+
+  size_t vertexDataSize() const noexcept {
+    return _info.vertexCount * _info.format.stride();
+  }
+
+  size_t indexDataSize() const noexcept;
+
+  /// The size of the whole mapping
+  size_t size() const noexcept { return _size; }
+
+  MeshFile(const MeshFile&) = delete;
+  MeshFile& operator=(const MeshFile&) = delete;
+private:
+  explicit MeshFile(const QString&) noexcept;
+
+  QFile _file;
+  MeshFileInfo _info;
+  const uchar* _vertices;
+  const uchar* _indices;
+  size_t _size;
+};
+
+/**
+ * @brief Writes a mesh file. The file is sized up front and mapped, and the
+ * callbacks fill in the vertex and index sections in place (with
+ * Mesh::interleave() and Mesh::writeIndices(), say, or by reading back GL
+ * buffers), so the data is never copied on its way to disk.
+ *
+ * @throws FileException if the file can't be written
+ */
+void saveMeshFile(const QString& path, const MeshFileInfo& info,
+                  const function<void(void*)>& writeVertices,
+                  const function<void(void*)>& writeIndices);
+
+/**
+ * @brief Writes a mesh in the given format. Its normals must already be
+ * computed, since they're stored as they are.
+ *
+ * @throws FileException if the file can't be written
+ */
+void saveMeshFile(const QString& path, const Mesh& mesh, const LodChain& lods,
+                  const VertexFormat& format);
+}
+}
+
+#endif // MESHFILE_HPP
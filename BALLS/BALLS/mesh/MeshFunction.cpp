@@ -1,9 +1,14 @@
 #include "precompiled.hpp"
 #include "mesh/MeshFunction.hpp"
 
+#include "exception/FileException.hpp"
+#include "mesh/EdgeCache.hpp"
+#include "mesh/Importer.hpp"
 #include "mesh/Mesh.hpp"
 #include "mesh/MeshParameter.hpp"
 #include "mesh/MeshGenerator.hpp"
+#include "mesh/ParametricGrid.hpp"
+#include "util/Parallel.hpp"
 #include "util/Util.hpp"
 
 namespace balls {
@@ -13,11 +18,13 @@ const QString HEIGHT = "height";
 const QString INNER_RADIUS = "inner-radius";
 const QString LENGTH = "length";
 const QString OUTER_RADIUS = "outer-radius";
+const QString PATH = "path";
 const QString RADIUS = "radius";
 const QString RESOLUTION = "resolution";
 const QString SUBDIVISIONS = "subdivisions";
 const QString U_SAMPLES = "u-samples";
 const QString V_SAMPLES = "v-samples";
+const QString WELD = "weld";
 const QString WIDTH = "width";
 const QString X_SCALE = "x-scale";
 const QString Y_SCALE = "y-scale";
@@ -30,8 +37,6 @@ using std::max;
 using std::min;
 using std::sin;
 using std::sqrt;
-using std::uint64_t;
-using std::unordered_map;
 
 const float PHI = (1 + sqrt(5)) / 2.0f;
 
@@ -108,35 +113,42 @@ MeshFunction tetrahedron = [](const MeshParameters& params) {
 
 
 MeshFunction icosahedron = [](const MeshParameters& params) {
+  using Face = array<Mesh::IndexType, 3>;
+  using Edge = array<Mesh::IndexType, 2>;
+
   float radius = params.at(RADIUS).get<float>();
   int subdivisions = params.at(SUBDIVISIONS).get<int>();
 
   Q_ASSERT(subdivisions >= 0);
 
-  Mesh mesh;
+  // Each subdivision splits every face in four, so after n of them an
+  // icosahedron has 20 * 4^n faces, 30 * 4^n edges, and 10 * 4^n + 2 vertices
+  size_t scale = size_t(1) << (2 * subdivisions);
+  size_t faceCount = 20 * scale;
 
-  unordered_map<uint64_t, Mesh::IndexType> indices;
-  auto makeMidpoint = [&](const Mesh::IndexType p1, const Mesh::IndexType p2) {
-    const vec3& v1 = mesh[p1];
-    const vec3& v2 = mesh[p2];
-    vec3 mid = (v1 + v2) / 2.0f;
-    return mesh.add_vertex(glm::normalize(mid) * radius);
+  Mesh mesh;
+  mesh.resize(10 * scale + 2, faceCount * 3);
+
+  const array<vec3, 12> base = {
+    vec3(-1, PHI, 0),
+    vec3(1, PHI, 0),
+    vec3(-1, -PHI, 0),
+    vec3(1, -PHI, 0),
+    vec3(0, -1, PHI),
+    vec3(0, 1, PHI),
+    vec3(0, -1, -PHI),
+    vec3(0, 1, -PHI),
+    vec3(PHI, 0, -1),
+    vec3(PHI, 0, 1),
+    vec3(-PHI, 0, -1),
+    vec3(-PHI, 0, 1),
   };
 
-  mesh.add_vertex(glm::normalize(vec3(-1, PHI, 0)) * radius);
-  mesh.add_vertex(glm::normalize(vec3(1, PHI, 0)) * radius);
-  mesh.add_vertex(glm::normalize(vec3(-1, -PHI, 0)) * radius);
-  mesh.add_vertex(glm::normalize(vec3(1, -PHI, 0)) * radius);
-  mesh.add_vertex(glm::normalize(vec3(0, -1, PHI)) * radius);
-  mesh.add_vertex(glm::normalize(vec3(0, 1, PHI)) * radius);
-  mesh.add_vertex(glm::normalize(vec3(0, -1, -PHI)) * radius);
-  mesh.add_vertex(glm::normalize(vec3(0, 1, -PHI)) * radius);
-  mesh.add_vertex(glm::normalize(vec3(PHI, 0, -1)) * radius);
-  mesh.add_vertex(glm::normalize(vec3(PHI, 0, 1)) * radius);
-  mesh.add_vertex(glm::normalize(vec3(-PHI, 0, -1)) * radius);
-  mesh.add_vertex(glm::normalize(vec3(-PHI, 0, 1)) * radius);
-
-  vector<array<Mesh::IndexType, 3>> faces({
+  for (Mesh::IndexType i = 0; i < base.size(); ++i) {
+    mesh.set_vertex(i, glm::normalize(base[i]) * radius);
+  }
+
+  vector<Face> faces({
     {0, 11, 5},
     {0, 5, 1},
     {0, 1, 7},
@@ -158,29 +170,76 @@ MeshFunction icosahedron = [](const MeshParameters& params) {
     {8, 6, 7},
     {9, 8, 1}
   });
+  faces.reserve(faceCount);
 
+  vector<Face> faces1;
+  faces1.reserve(faceCount);
 
-  for (int i = 0; i < subdivisions; ++i) {
-    decltype(faces) faces1;
-
-    for (const array<Mesh::IndexType, 3>& face : faces) {
+  vector<Face> midpoints;
+  vector<Edge> parents;
+  EdgeCache edges;
+  Mesh::IndexType next = base.size();
 
-      Mesh::IndexType a = makeMidpoint(face[0], face[1]);
-      Mesh::IndexType b = makeMidpoint(face[1], face[2]);
-      Mesh::IndexType c = makeMidpoint(face[2], face[0]);
+  auto makeMidpoint = [&](const Mesh::IndexType p1, const Mesh::IndexType p2) {
+    parents.push_back({p1, p2});
+    return next++;
+  };
 
-      faces1.push_back({face[0], a, c});
-      faces1.push_back({face[1], b, a});
-      faces1.push_back({face[2], c, b});
-      faces1.push_back({a, b, c});
+  for (int i = 0; i < subdivisions; ++i) {
+    edges.reset(faces.size() * 3 / 2);
+    // Every edge is shared by exactly two faces
+    parents.clear();
+    parents.reserve(faces.size() * 3 / 2);
+    midpoints.resize(faces.size());
+
+    // Numbering the midpoints is just hashing, so do that on one thread...
+    for (size_t f = 0; f < faces.size(); ++f) {
+      const Face& face = faces[f];
+      midpoints[f] = {
+        edges.get(face[0], face[1], makeMidpoint),
+        edges.get(face[1], face[2], makeMidpoint),
+        edges.get(face[2], face[0], makeMidpoint),
+      };
     }
 
+    // ...then place the new vertices and split the faces in parallel
+    Mesh::IndexType first = next - parents.size();
+    const vector<vec3>& vertices = mesh.vertices();
+    // Not mesh[], whose non-const overload marks the normals stale; every
+    // thread doing that at once is a race
+    util::parallelFor(parents.size(), [&](const size_t begin, const size_t end) {
+      for (size_t e = begin; e < end; ++e) {
+        vec3 mid = (vertices[parents[e][0]] + vertices[parents[e][1]]) / 2.0f;
+        mesh.set_vertex(first + e, glm::normalize(mid) * radius);
+      }
+    });
+
+    faces1.resize(faces.size() * 4);
+    util::parallelFor(faces.size(), [&](const size_t begin, const size_t end) {
+      for (size_t f = begin; f < end; ++f) {
+        const Face& face = faces[f];
+        Mesh::IndexType a = midpoints[f][0];
+        Mesh::IndexType b = midpoints[f][1];
+        Mesh::IndexType c = midpoints[f][2];
+
+        faces1[f * 4 + 0] = {face[0], a, c};
+        faces1[f * 4 + 1] = {face[1], b, a};
+        faces1[f * 4 + 2] = {face[2], c, b};
+        faces1[f * 4 + 3] = {a, b, c};
+      }
+    });
+
     faces.swap(faces1);
   }
 
-  for (const array<Mesh::IndexType, 3>& face : faces) {
-    mesh.add_face(face[0], face[1], face[2]);
-  }
+  Q_ASSERT(faces.size() == faceCount);
+  Q_ASSERT(next == mesh.vertices().size());
+
+  util::parallelFor(faces.size(), [&](const size_t begin, const size_t end) {
+    for (size_t f = begin; f < end; ++f) {
+      mesh.set_face(f, faces[f][0], faces[f][1], faces[f][2]);
+    }
+  });
 
   Q_ASSERT(mesh.indices().size() % 3 == 0);
   return mesh;
@@ -188,6 +247,22 @@ MeshFunction icosahedron = [](const MeshParameters& params) {
 
 
 
+/**
+ * @brief The x and z of every vertex around a ring of the given radius,
+ * starting on the x axis; one sin/cos per vertex for the whole shape, rather
+ * than one per vertex per ring.
+ */
+vector<glm::vec2> _ring(const int resolution, const float radius) noexcept {
+  vector<glm::vec2> ring(resolution);
+
+  for (int i = 0; i < resolution; ++i) {
+    float angle = (static_cast<float>(i) / resolution) * (2 * M_PI);
+    ring[i] = glm::vec2(cos(angle), sin(angle)) * radius;
+  }
+
+  return ring;
+}
+
 MeshFunction cylinder = [](const MeshParameters& params) {
   int resolution = params.at(RESOLUTION).get<int>();
   float height = params.at(HEIGHT).get<float>();
@@ -196,29 +271,31 @@ MeshFunction cylinder = [](const MeshParameters& params) {
   Q_ASSERT(resolution >= 3);
 
   float hh = height / 2;
+  vector<glm::vec2> ring = _ring(resolution, radius);
 
+  // The two caps' centers, then a top and bottom vertex for each step around
   Mesh mesh;
+  mesh.resize(2 + resolution * 2, resolution * 4 * 3);
 
-  Mesh::IndexType topCenter = mesh.add_vertex(0, hh, 0);
-  Mesh::IndexType bottomCenter = mesh.add_vertex(0, -hh, 0);
+  Mesh::IndexType topCenter = 0;
+  Mesh::IndexType bottomCenter = 1;
+  mesh.set_vertex(topCenter, vec3(0, hh, 0));
+  mesh.set_vertex(bottomCenter, vec3(0, -hh, 0));
 
   for (int i = 0; i < resolution; ++i) {
-    float angle = (static_cast<float>(i) / resolution) * (2 * M_PI);
-    float opp = qFastSin(angle) * radius;
-    float adj = qFastCos(angle) * radius;
-
-    mesh.add_vertex(adj, hh, opp);
-    mesh.add_vertex(adj, -hh, opp);
-
-    Mesh::IndexType top = ((i + 1) * 2) % ((resolution * 2) + 2);
-    Mesh::IndexType topNext = max(2, (top + 2) % ((resolution * 2) + 2));
+    Mesh::IndexType top = 2 + i * 2;
+    Mesh::IndexType topNext = 2 + ((i + 1) % resolution) * 2;
     Mesh::IndexType bottom = top + 1;
     Mesh::IndexType bottomNext = topNext + 1;
+    size_t face = i * 4;
 
-    mesh.add_face(topCenter, topNext, top);
-    mesh.add_face(top, bottomNext, bottom);
-    mesh.add_face(top, topNext, bottomNext);
-    mesh.add_face(bottomCenter, bottom, bottomNext);
+    mesh.set_vertex(top, vec3(ring[i].x, hh, ring[i].y));
+    mesh.set_vertex(bottom, vec3(ring[i].x, -hh, ring[i].y));
+
+    mesh.set_face(face + 0, topCenter, topNext, top);
+    mesh.set_face(face + 1, top, bottomNext, bottom);
+    mesh.set_face(face + 2, top, topNext, bottomNext);
+    mesh.set_face(face + 3, bottomCenter, bottom, bottomNext);
   }
 
   return mesh;
@@ -232,24 +309,26 @@ MeshFunction cone = [](const MeshParameters& params) {
   Q_ASSERT(resolution >= 3);
 
   float hh = height / 2;
+  vector<glm::vec2> ring = _ring(resolution, radius);
 
+  // The tip and the base's center, then the base's rim
   Mesh mesh;
+  mesh.resize(2 + resolution, resolution * 2 * 3);
 
-  Mesh::IndexType topCenter = mesh.add_vertex(0, hh, 0);
-  Mesh::IndexType bottomCenter = mesh.add_vertex(0, -hh, 0);
+  Mesh::IndexType topCenter = 0;
+  Mesh::IndexType bottomCenter = 1;
+  mesh.set_vertex(topCenter, vec3(0, hh, 0));
+  mesh.set_vertex(bottomCenter, vec3(0, -hh, 0));
 
   for (int i = 0; i < resolution; ++i) {
-    float angle = (static_cast<float>(i) / resolution) * 2 * M_PI;
-    float opp = qFastSin(angle) * radius;
-    float adj = qFastCos(angle) * radius;
-
-    Mesh::IndexType index = mesh.add_vertex(adj, -hh, opp);
+    Mesh::IndexType v = 2 + i;
+    Mesh::IndexType vNext = 2 + (i + 1) % resolution;
+    size_t face = i * 2;
 
-    Mesh::IndexType v = i + 2;
-    Mesh::IndexType vNext = max(2, (v + 1) % (resolution + 2));
+    mesh.set_vertex(v, vec3(ring[i].x, -hh, ring[i].y));
 
-    mesh.add_face(topCenter, vNext, v);
-    mesh.add_face(bottomCenter, v, vNext);
+    mesh.set_face(face + 0, topCenter, vNext, v);
+    mesh.set_face(face + 1, bottomCenter, v, vNext);
   }
 
   return mesh;
@@ -262,41 +341,15 @@ MeshFunction uvsphere = [](const MeshParameters& params) {
   float y_scl = params.at(Y_SCALE).get<float>();
   float z_scl = params.at(Z_SCALE).get<float>();
 
-  Mesh mesh;
-
-  for (int t = 0; t < u_samples; t++) {
-    float theta1 = (static_cast<float>(t) / u_samples) * 2 * M_PI;
-    float theta2 = (static_cast<float>(t + 1) / u_samples) * 2 * M_PI;
-
-    float st1 = qFastSin(theta1), st2 = qFastSin(theta2);
-    float ct1 = qFastCos(theta1), ct2 = qFastCos(theta2);
-
-    for (int p = 0; p < v_samples; p++) {
-      float phi1 = (static_cast<float>(p) / v_samples) * 2 * M_PI;
-      float phi2 = (static_cast<float>(p + 1) / v_samples) * 2 * M_PI;
-
-      float sp1 = qFastSin(phi1), sp2 = qFastSin(phi2);
-      float cp1 = qFastCos(phi1), cp2 = qFastCos(phi2);
-
-      auto v1 = mesh.add_vertex(x_scl * st1 * cp1, y_scl * st1 * sp1, z_scl * ct1);
-      auto v2 = mesh.add_vertex(x_scl * st1 * cp2, y_scl * st1 * sp2, z_scl * ct1);
-      auto v3 = mesh.add_vertex(x_scl * st2 * cp2, y_scl * st2 * sp2, z_scl * ct2);
-      auto v4 = mesh.add_vertex(x_scl * st2 * cp1, y_scl * st2 * sp1, z_scl * ct2);
-
-      if (Q_UNLIKELY(t == 0)) {
-        mesh.add_face(v1, v4, v3);
-      }
-      else if (Q_UNLIKELY(t + 1 == u_samples)) {
-        mesh.add_face(v3, v2, v1);
-      }
-      else {
-        mesh.add_face(v1, v4, v2);
-        mesh.add_face(v2, v4, v3);
-      }
-    }
-  }
-
-  return mesh;
+  // u goes around the z-axis, v goes from the south pole to the north pole
+  // (theta runs backwards so the faces wind outwards)
+  return parametricGrid(
+           u_samples, v_samples,
+           {0, 2 * M_PI, M_PI, 0},
+           {true, false, true, true},
+  [x_scl, y_scl, z_scl](float sp, float cp, float st, float ct) {
+    return vec3(x_scl * st * cp, y_scl * st * sp, z_scl * ct);
+  });
 };
 
 MeshFunction torus = [](const MeshParameters& params) {
@@ -306,35 +359,46 @@ MeshFunction torus = [](const MeshParameters& params) {
   int u_samples = params.at(U_SAMPLES).get<int>();
   int v_samples = params.at(V_SAMPLES).get<int>();
 
-  Mesh mesh;
-  auto f = [R, r](float su, float cu, float sv, float cv) {
+  return parametricGrid(
+           u_samples, v_samples,
+           {0, 2 * M_PI, 0, 2 * M_PI},
+           {true, true, false, false},
+  [R, r](float su, float cu, float sv, float cv) {
     return vec3((R + r * cv) * cu, (R + r * cv) * su, r * sv);
-  };
-
-  for (int u = 0; u < u_samples; u++) {
-    float u1 = 2 * M_PI * (static_cast<float>(u) / u_samples);
-    float u2 = 2 * M_PI * (static_cast<float>(u + 1) / u_samples);
+  });
+};
 
-    float cu1 = qFastCos(u1), cu2 = qFastCos(u2);
-    float su1 = qFastSin(u1), su2 = qFastSin(u2);
+MeshFunction file = [](const MeshParameters& params) {
+  QString path = params.at(PATH).get<QString>();
+  bool weld = params.at(WELD).get<int>() != 0;
+  ImportNotifier* notifier = ImportNotifier::instance();
+  int reported = -1;
 
-    for (int v = 0; v < v_samples; v++) {
-      float v1 = 2 * M_PI * (static_cast<float>(v) / v_samples);
-      float v2 = 2 * M_PI * (static_cast<float>(v + 1) / v_samples);
+  try {
+    Mesh mesh = importMesh(path, weld, [&](const float done) {
+      int percent = int(done * 100);
 
-      float cv1 = qFastCos(v1), cv2 = qFastCos(v2);
-      float sv1 = qFastSin(v1), sv2 = qFastSin(v2);
-      auto i1 = mesh.add_vertex(f(su1, cu1, sv1, cv1));
-      auto i2 = mesh.add_vertex(f(su2, cu2, sv1, cv1));
-      auto i3 = mesh.add_vertex(f(su2, cu2, sv2, cv2));
-      auto i4 = mesh.add_vertex(f(su1, cu1, sv2, cv2));
+      if (percent != reported) {
+        // Don't flood the GUI thread's event queue
+        reported = percent;
+        emit notifier->progress(path, percent);
+      }
+    });
 
-      mesh.add_face(i1, i2, i3);
-      mesh.add_face(i3, i4, i1);
-    }
+    emit notifier->finished(path, QString("%1 vertices, %2 triangles")
+                            .arg(mesh.vertices().size())
+                            .arg(mesh.indices().size() / 3));
+    return mesh;
+  }
+  catch (const FileException& e) {
+    emit notifier->failed(path, e.fullMessage());
+  }
+  catch (const std::exception& e) {
+    // Includes running out of memory, which a big enough scan can do
+    emit notifier->failed(path, e.what());
   }
 
-  return mesh;
+  return Mesh();
 };
 }
 }
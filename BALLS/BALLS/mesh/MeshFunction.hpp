@@ -12,11 +12,13 @@ extern const QString HEIGHT;
 extern const QString INNER_RADIUS;
 extern const QString LENGTH;
 extern const QString OUTER_RADIUS;
+extern const QString PATH;
 extern const QString RADIUS;
 extern const QString RESOLUTION;
 extern const QString SUBDIVISIONS;
 extern const QString U_SAMPLES;
 extern const QString V_SAMPLES;
+extern const QString WELD;
 extern const QString WIDTH;
 extern const QString X_SCALE;
 extern const QString Y_SCALE;
@@ -111,6 +113,14 @@ extern MeshFunction uvsphere;
  * @param v-samples
  */
 extern MeshFunction torus;
+
+/**
+ * @brief Returns the mesh in an OBJ, PLY, or STL file, or an empty mesh if it
+ * can't be read. Progress and errors go through ImportNotifier.
+ * @param path The file to read
+ * @param weld 1 to merge vertices that share a position, 0 to keep them all
+ */
+extern MeshFunction file;
 }
 }
 }
@@ -10,8 +10,9 @@ namespace mesh {
 
 MeshGenerator::MeshGenerator(const QString& name,
                              const MeshFunction& function,
-                             const MeshParameters& params)
-  : _name(name), _function(function), _params(params) {}
+                             const MeshParameters& params,
+                             const ProceduralShape shape)
+  : _name(name), _function(function), _params(params), _shape(shape) {}
 
 Mesh MeshGenerator::getMesh() const {
   #ifdef DEBUG
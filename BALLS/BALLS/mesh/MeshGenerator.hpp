@@ -5,6 +5,7 @@
 
 #include "mesh/MeshParameter.hpp"
 #include "mesh/MeshFunction.hpp"
+#include "mesh/Procedural.hpp"
 #include "util/Util.hpp"
 
 namespace balls {
@@ -18,10 +19,18 @@ class MeshGenerator {
 public:
   MeshGenerator(const QString& name,
                 const MeshFunction& function,
-                const MeshParameters& params = MeshParameters());
+                const MeshParameters& params = MeshParameters(),
+                const ProceduralShape shape = ProceduralShape::None);
 
   const QString& getName() const noexcept { return this->_name; }
 
+  const MeshParameters& getParameters() const noexcept {
+    return this->_params;
+  }
+
+  /// The shape this generator makes, if it can also be made in a shader
+  ProceduralShape getShape() const noexcept { return this->_shape; }
+
   template<class ParamType>
   void set(const QString& name, const ParamType i) noexcept {
     this->_params[name] = i;
@@ -38,6 +47,7 @@ private:
   QString _name;
   MeshFunction _function;
   MeshParameters _params;
+  ProceduralShape _shape;
 };
 }
 }
@@ -0,0 +1,357 @@
+#include "precompiled.hpp"
+#include "mesh/MeshOptimizer.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+#include "util/Parallel.hpp"
+
+namespace balls {
+namespace mesh {
+
+using std::ptrdiff_t;
+
+typedef Mesh::IndexType IndexType;
+
+constexpr IndexType UNUSED = std::numeric_limits<IndexType>::max();
+
+VertexCacheStats analyzeVertexCache(const vector<IndexType>& indices,
+                                    const size_t vertexCount,
+                                    const size_t cacheSize) noexcept {
+  Q_ASSERT(indices.size() % 3 == 0);
+
+  // A vertex is in the FIFO if it missed within the last cacheSize misses
+  vector<size_t> stamps(vertexCount, 0);
+  size_t time = cacheSize + 1;
+  size_t misses = 0;
+  size_t used = 0;
+
+  for (IndexType i : indices) {
+    Q_ASSERT(i < vertexCount);
+
+    if (time - stamps[i] > cacheSize) {
+      used += (stamps[i] == 0);
+      stamps[i] = time++;
+      ++misses;
+    }
+  }
+
+  size_t triangles = indices.size() / 3;
+
+  return {
+    misses,
+    triangles ? float(misses) / triangles : 0.f,
+    used ? float(misses) / used : 0.f,
+  };
+}
+
+vector<IndexType> optimizeVertexCache(const vector<IndexType>& indices,
+                                      const size_t vertexCount,
+                                      const size_t cacheSize,
+                                      vector<size_t>* clusters) noexcept {
+  Q_ASSERT(indices.size() % 3 == 0);
+  size_t triangles = indices.size() / 3;
+
+  vector<IndexType> result;
+  result.reserve(indices.size());
+
+  if (clusters != nullptr) {
+    clusters->clear();
+  }
+
+  if (triangles == 0) {
+    return result;
+  }
+
+  // The triangles around each vertex, stored as one flat array
+  vector<size_t> offsets(vertexCount + 1, 0);
+
+  for (IndexType i : indices) {
+    ++offsets[i + 1];
+  }
+
+  std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+  vector<size_t> adjacency(indices.size());
+  vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+
+  for (size_t t = 0; t < triangles; ++t) {
+    for (size_t k = 0; k < 3; ++k) {
+      adjacency[fill[indices[t * 3 + k]]++] = t;
+    }
+  }
+
+  vector<size_t> live(vertexCount);
+  // How many triangles that use each vertex are still waiting to be emitted
+
+  for (size_t v = 0; v < vertexCount; ++v) {
+    live[v] = offsets[v + 1] - offsets[v];
+  }
+
+  vector<size_t> stamps(vertexCount, 0);
+  vector<bool> emitted(triangles, false);
+  vector<IndexType> deadEnds;
+  vector<IndexType> candidates;
+  deadEnds.reserve(indices.size());
+  size_t time = cacheSize + 1;
+  size_t scan = 0;
+
+  // Called when no vertex near the last fan has triangles left
+  auto skipDeadEnd = [&](IndexType& fan) noexcept {
+    while (!deadEnds.empty()) {
+      // Prefer a recently used vertex; it may still be in the cache
+      IndexType v = deadEnds.back();
+      deadEnds.pop_back();
+
+      if (live[v] > 0) {
+        fan = v;
+        return true;
+      }
+    }
+
+    for (; scan < vertexCount; ++scan) {
+      if (live[scan] > 0) {
+        fan = scan;
+        return true;
+      }
+    }
+
+    return false;
+  };
+
+  IndexType fan = 0;
+  bool more = skipDeadEnd(fan);
+
+  if (clusters != nullptr) {
+    clusters->push_back(0);
+  }
+
+  while (more) {
+    candidates.clear();
+
+    for (size_t a = offsets[fan]; a < offsets[fan + 1]; ++a) {
+      // Emit every remaining triangle around the fanning vertex
+      size_t t = adjacency[a];
+
+      if (emitted[t]) {
+        continue;
+      }
+
+      emitted[t] = true;
+
+      for (size_t k = 0; k < 3; ++k) {
+        IndexType v = indices[t * 3 + k];
+        result.push_back(v);
+        deadEnds.push_back(v);
+        candidates.push_back(v);
+        --live[v];
+
+        if (time - stamps[v] > cacheSize) {
+          stamps[v] = time++;
+        }
+      }
+    }
+
+    // Fan around the vertex that's been in the cache the longest but will
+    // still be there once its own triangles are emitted
+    ptrdiff_t bestPriority = -1;
+    bool found = false;
+
+    for (IndexType v : candidates) {
+      if (live[v] == 0) {
+        continue;
+      }
+
+      ptrdiff_t priority = 0;
+
+      if (time - stamps[v] + 2 * live[v] <= cacheSize) {
+        priority = time - stamps[v];
+      }
+
+      if (priority > bestPriority) {
+        bestPriority = priority;
+        fan = v;
+        found = true;
+      }
+    }
+
+    if (!found) {
+      more = skipDeadEnd(fan);
+
+      if (more && clusters != nullptr) {
+        clusters->push_back(result.size() / 3);
+      }
+    }
+  }
+
+  Q_ASSERT(result.size() == indices.size());
+  return result;
+}
+
+vector<IndexType> optimizeOverdraw(const vector<IndexType>& indices,
+                                   const vector<vec3>& vertices,
+                                   const vector<size_t>& clusters,
+                                   const size_t cacheSize,
+                                   const float threshold) noexcept {
+  Q_ASSERT(indices.size() % 3 == 0);
+  size_t triangles = indices.size() / 3;
+
+  if (triangles == 0 || clusters.empty()) {
+    return indices;
+  }
+
+  VertexCacheStats before = analyzeVertexCache(indices, vertices.size(),
+                            cacheSize);
+
+  // Split the clusters wherever they've amortized their cold start, i.e. once
+  // they're doing as well as the mesh does on average
+  vector<size_t> starts;
+  vector<size_t> stamps(vertices.size(), 0);
+  size_t time = cacheSize + 1;
+
+  for (size_t c = 0; c < clusters.size(); ++c) {
+    size_t end = (c + 1 < clusters.size()) ? clusters[c + 1] : triangles;
+    size_t start = clusters[c];
+    size_t misses = 0;
+    starts.push_back(start);
+    time += cacheSize + 1;
+    // Pretend the cache is cold; this evicts everything at once
+
+    for (size_t t = start; t < end; ++t) {
+      for (size_t k = 0; k < 3; ++k) {
+        IndexType v = indices[t * 3 + k];
+
+        if (time - stamps[v] > cacheSize) {
+          stamps[v] = time++;
+          ++misses;
+        }
+      }
+
+      if (t + 1 < end && misses < before.acmr * (t + 1 - start)) {
+        start = t + 1;
+        misses = 0;
+        starts.push_back(start);
+        time += cacheSize + 1;
+      }
+    }
+  }
+
+  starts.push_back(triangles);
+  size_t count = starts.size() - 1;
+
+  // Sum up each cluster's area-weighted centroid and normal
+  vector<vec3> centroids(count);
+  vector<vec3> normals(count);
+  vector<float> areas(count);
+
+  util::parallelFor(count, [&](const size_t begin, const size_t end) {
+    for (size_t c = begin; c < end; ++c) {
+      vec3 centroid(0), normal(0);
+      float area = 0;
+
+      for (size_t t = starts[c]; t < starts[c + 1]; ++t) {
+        const vec3& a = vertices[indices[t * 3]];
+        const vec3& b = vertices[indices[t * 3 + 1]];
+        const vec3& d = vertices[indices[t * 3 + 2]];
+        vec3 n = glm::cross(b - a, d - a);
+        float w = glm::length(n);
+
+        centroid += (a + b + d) * (w / 3);
+        normal += n;
+        area += w;
+      }
+
+      centroids[c] = centroid;
+      normals[c] = normal;
+      areas[c] = area;
+    }
+  }, 64);
+
+  vec3 middle(0);
+  float total = 0;
+
+  for (size_t c = 0; c < count; ++c) {
+    middle += centroids[c];
+    total += areas[c];
+  }
+
+  if (total <= 0) {
+    // If every triangle is degenerate, there's nothing to sort by
+    return indices;
+  }
+
+  middle /= total;
+
+  vector<float> sortKey(count, 0.f);
+
+  for (size_t c = 0; c < count; ++c) {
+    if (areas[c] > 0 && glm::length(normals[c]) > 0) {
+      sortKey[c] = glm::dot(centroids[c] / areas[c] - middle,
+                            glm::normalize(normals[c]));
+    }
+  }
+
+  vector<size_t> order(count);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(),
+  [&sortKey](const size_t a, const size_t b) noexcept {
+    return sortKey[a] > sortKey[b];
+    // Outward-facing clusters on the hull first
+  });
+
+  vector<IndexType> result;
+  result.reserve(indices.size());
+
+  for (size_t c : order) {
+    result.insert(result.end(), indices.begin() + starts[c] * 3,
+                  indices.begin() + starts[c + 1] * 3);
+  }
+
+  VertexCacheStats after = analyzeVertexCache(result, vertices.size(),
+                           cacheSize);
+
+  return (after.acmr > before.acmr * threshold) ? indices : result;
+}
+
+vector<IndexType> optimizeVertexFetch(vector<IndexType>& indices,
+                                      const size_t vertexCount) noexcept {
+  vector<IndexType> remap(vertexCount, UNUSED);
+  IndexType next = 0;
+
+  for (IndexType& i : indices) {
+    if (remap[i] == UNUSED) {
+      remap[i] = next++;
+    }
+
+    i = remap[i];
+  }
+
+  for (IndexType& r : remap) {
+    if (r == UNUSED) {
+      r = next++;
+    }
+  }
+
+  return remap;
+}
+
+OptimizationReport optimize(Mesh& mesh, const size_t cacheSize) noexcept {
+  size_t vertexCount = mesh.vertices().size();
+  OptimizationReport report;
+  report.before = analyzeVertexCache(mesh.indices(), vertexCount, cacheSize);
+
+  vector<size_t> clusters;
+  vector<IndexType> indices =
+    optimizeVertexCache(mesh.indices(), vertexCount, cacheSize, &clusters);
+  indices = optimizeOverdraw(indices, mesh.vertices(), clusters, cacheSize);
+
+  vector<IndexType> remap = optimizeVertexFetch(indices, vertexCount);
+  mesh.set_indices(std::move(indices));
+  mesh.remap_vertices(remap);
+
+  report.after = analyzeVertexCache(mesh.indices(), vertexCount, cacheSize);
+  return report;
+}
+}
+}
@@ -0,0 +1,107 @@
+#ifndef MESHOPTIMIZER_HPP
+#define MESHOPTIMIZER_HPP
+
+#include <cstddef>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "mesh/Mesh.hpp"
+
+namespace balls {
+namespace mesh {
+
+using std::size_t;
+using std::vector;
+using glm::vec3;
+
+/// A typical post-transform vertex cache holds this many vertices
+constexpr size_t DEFAULT_VERTEX_CACHE_SIZE = 16;
+
+/**
+ * @brief How much clustering may hurt the vertex cache; a cluster order whose
+ * ACMR is more than this much worse than the cache-optimal order is rejected.
+ */
+constexpr float DEFAULT_OVERDRAW_THRESHOLD = 1.05f;
+
+/**
+ * @brief The results of running an index buffer through a simulated FIFO
+ * post-transform vertex cache.
+ */
+struct VertexCacheStats {
+  /// Vertex shader invocations, i.e. cache misses
+  size_t misses;
+
+  /// Average cache miss ratio; misses per triangle (0.5 is ideal for grids)
+  float acmr;
+
+  /// Average transform to vertex ratio; misses per vertex (1.0 is ideal)
+  float atvr;
+};
+
+/// The vertex cache statistics of a mesh before and after optimize()
+struct OptimizationReport {
+  VertexCacheStats before;
+  VertexCacheStats after;
+};
+
+/**
+ * @brief Simulates drawing these triangles through a FIFO vertex cache of the
+ * given size.
+ */
+VertexCacheStats analyzeVertexCache(const vector<Mesh::IndexType>& indices,
+                                    const size_t vertexCount,
+                                    const size_t cacheSize =
+                                      DEFAULT_VERTEX_CACHE_SIZE) noexcept;
+
+/**
+ * @brief Reorders triangles so that consecutive ones reuse recently
+ * transformed vertices (Sander et al., "Fast Triangle Reordering for Vertex
+ * Locality and Reduced Overdraw", 2007; a.k.a. Tipsify). Runs in linear time.
+ *
+ * @param clusters If not null, receives the index of the first triangle of
+ * each run the algorithm produced without jumping elsewhere in the mesh; the
+ * cache is effectively cold at each of these, so they can be reordered freely.
+ */
+vector<Mesh::IndexType> optimizeVertexCache(
+  const vector<Mesh::IndexType>& indices, const size_t vertexCount,
+  const size_t cacheSize = DEFAULT_VERTEX_CACHE_SIZE,
+  vector<size_t>* clusters = nullptr) noexcept;
+
+/**
+ * @brief Reorders the clusters found by optimizeVertexCache() so that ones
+ * facing away from the middle of the mesh are drawn first. Those tend to
+ * occlude the others, so fewer fragments get shaded only to be overwritten.
+ *
+ * Long clusters are split further wherever their vertices have been reused
+ * enough that a cold cache wouldn't cost much. If the result's ACMR is more
+ * than threshold times the input's, the input order is returned unchanged.
+ */
+vector<Mesh::IndexType> optimizeOverdraw(
+  const vector<Mesh::IndexType>& indices, const vector<vec3>& vertices,
+  const vector<size_t>& clusters,
+  const size_t cacheSize = DEFAULT_VERTEX_CACHE_SIZE,
+  const float threshold = DEFAULT_OVERDRAW_THRESHOLD) noexcept;
+
+/**
+ * @brief Renumbers vertices in the order the index buffer first uses them, so
+ * vertex fetches walk through memory linearly. Rewrites indices in place.
+ *
+ * @return For each old vertex, its new position. Unused vertices are moved to
+ * the end.
+ */
+vector<Mesh::IndexType> optimizeVertexFetch(vector<Mesh::IndexType>& indices,
+    const size_t vertexCount) noexcept;
+
+/**
+ * @brief Runs every pass above over a mesh, in order, and reports how much the
+ * vertex cache benefits. The mesh's geometry is unchanged; only the order of
+ * its triangles and vertices is.
+ */
+OptimizationReport optimize(Mesh& mesh,
+                            const size_t cacheSize = DEFAULT_VERTEX_CACHE_SIZE)
+noexcept;
+}
+}
+
+#endif // MESHOPTIMIZER_HPP
@@ -29,6 +29,9 @@ MeshParameter() noexcept :
 
   int getMax() const noexcept { return this->max; }
 
+  /// The QMetaType of the value, e.g. QMetaType::Int or QMetaType::Float
+  int getType() const noexcept { return this->_value.userType(); }
+
   void setMin(const int min) noexcept { this->min = min; }
 
   void setMax(const int max) noexcept { this->max = max; }
@@ -0,0 +1,114 @@
+#include "precompiled.hpp"
+#include "mesh/ParametricGrid.hpp"
+
+#include "mesh/Mesh.hpp"
+#include "util/Parallel.hpp"
+
+namespace balls {
+namespace mesh {
+
+using std::cos;
+using std::sin;
+using std::vector;
+
+Mesh parametricGrid(const int uSamples, const int vSamples,
+                    const GridRange& range, const GridTopology& topology,
+                    const GridFunction& function) {
+  Q_ASSERT(uSamples >= 1 && vSamples >= 1);
+  Q_ASSERT(!(topology.wrapV && (topology.poleAtStart || topology.poleAtEnd)));
+  // A row can't be both a pole and glued to the opposite row
+
+  int columns = topology.wrapU ? uSamples : uSamples + 1;
+  int rows = topology.wrapV ? vSamples : vSamples + 1;
+
+  auto isPole = [&topology, rows](const int row) noexcept {
+    return (row == 0 && topology.poleAtStart) ||
+           (row == rows - 1 && topology.poleAtEnd);
+  };
+
+  vector<Mesh::IndexType> rowStart(rows + 1, 0);
+  // Pole rows collapse to a single vertex, so rows don't all start at j * columns
+
+  for (int j = 0; j < rows; ++j) {
+    rowStart[j + 1] = rowStart[j] + (isPole(j) ? 1 : columns);
+  }
+
+  vector<size_t> faceStart(vSamples + 1, 0);
+  // Quads that touch a pole lose half of their triangles
+
+  for (int j = 0; j < vSamples; ++j) {
+    bool pole = isPole(j) || isPole((j + 1) % rows);
+    faceStart[j + 1] = faceStart[j] + (pole ? 1 : 2) * size_t(uSamples);
+  }
+
+  size_t triangles = faceStart[vSamples];
+
+  Mesh mesh;
+  mesh.resize(rowStart[rows], triangles * 3);
+  // Every row knows where its vertices and faces go, so rows can be filled in
+  // parallel without any push_back
+
+  // Each row and column shares one angle, so only take sin/cos once per ring
+  vector<float> su(columns), cu(columns), sv(rows), cv(rows);
+
+  for (int i = 0; i < columns; ++i) {
+    float u = glm::mix(range.uStart, range.uEnd, float(i) / uSamples);
+    su[i] = sin(u);
+    cu[i] = cos(u);
+  }
+
+  for (int j = 0; j < rows; ++j) {
+    float v = glm::mix(range.vStart, range.vEnd, float(j) / vSamples);
+    sv[j] = sin(v);
+    cv[j] = cos(v);
+  }
+
+  // Rows are the unit of work, so aim for a few thousand vertices per chunk
+  size_t grain = std::max<size_t>(1, 4096 / columns);
+
+  util::parallelFor(rows, [&](const size_t begin, const size_t end) {
+    for (size_t j = begin; j < end; ++j) {
+      int rowColumns = isPole(j) ? 1 : columns;
+      Mesh::IndexType first = rowStart[j];
+
+      for (int i = 0; i < rowColumns; ++i) {
+        mesh.set_vertex(first + i, function(su[i], cu[i], sv[j], cv[j]));
+      }
+    }
+  }, grain);
+
+  auto index = [&](const int i, const int j) noexcept -> Mesh::IndexType {
+    int row = j % rows;
+    return isPole(row) ? rowStart[row] : rowStart[row] + (i % columns);
+  };
+
+  util::parallelFor(vSamples, [&](const size_t begin, const size_t end) {
+    for (size_t j = begin; j < end; ++j) {
+      size_t face = faceStart[j];
+
+      for (int i = 0; i < uSamples; ++i) {
+        Mesh::IndexType a = index(i, j);
+        Mesh::IndexType b = index(i + 1, j);
+        Mesh::IndexType c = index(i + 1, j + 1);
+        Mesh::IndexType d = index(i, j + 1);
+
+        // A quad that touches a pole is really a triangle; drop the degenerate
+        // half
+        if (a != b) {
+          mesh.set_face(face++, a, b, c);
+        }
+
+        if (c != d) {
+          mesh.set_face(face++, c, d, a);
+        }
+      }
+
+      Q_ASSERT(face == faceStart[j + 1]);
+    }
+  }, grain);
+
+  Q_ASSERT(mesh.indices().size() == triangles * 3);
+  return mesh;
+}
+}
+}
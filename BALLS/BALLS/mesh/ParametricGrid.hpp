@@ -0,0 +1,60 @@
+#ifndef PARAMETRICGRID_HPP
+#define PARAMETRICGRID_HPP
+
+#include <functional>
+
+#include <glm/vec3.hpp>
+
+namespace balls {
+namespace mesh {
+
+class Mesh;
+
+using std::function;
+using glm::vec3;
+
+/**
+ * @brief Evaluates a parametric surface at one grid sample, given the sine and
+ * cosine of the u and v angles (in that order: su, cu, sv, cv).
+ */
+using GridFunction = function<vec3(float, float, float, float)>;
+
+/// How the edges of a parametric grid are stitched together
+struct GridTopology {
+  /// The last column of samples is the first one (e.g. a full revolution)
+  bool wrapU;
+
+  /// The last row of samples is the first one
+  bool wrapV;
+
+  /// Every sample in the first row is the same point, so emit it only once
+  bool poleAtStart;
+
+  /// Every sample in the last row is the same point, so emit it only once
+  bool poleAtEnd;
+};
+
+/// The angle each grid axis sweeps through, in radians
+struct GridRange {
+  float uStart;
+  float uEnd;
+  float vStart;
+  float vEnd;
+};
+
+/**
+ * @brief Builds an indexed mesh by sampling a surface on a uSamples by
+ * vSamples grid of quads.
+ *
+ * Neighbouring quads share their vertices, including across wrapped seams and
+ * at poles, so the vertex buffer holds at most (u + 1) * (v + 1) vertices and
+ * normals are smoothed across cell boundaries. Faces are wound
+ * counter-clockwise when viewed from the side that du x dv points towards.
+ */
+Mesh parametricGrid(const int uSamples, const int vSamples,
+                    const GridRange& range, const GridTopology& topology,
+                    const GridFunction& function);
+}
+}
+
+#endif // PARAMETRICGRID_HPP
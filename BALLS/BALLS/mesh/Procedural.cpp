@@ -0,0 +1,267 @@
+#include "precompiled.hpp"
+#include "mesh/Procedural.hpp"
+
+#include <QtCore/QRegularExpression>
+#include <QtCore/QStringList>
+
+#include "mesh/MeshFunction.hpp"
+#include "shader/ShaderInputs.hpp"
+#include "util/Logging.hpp"
+
+namespace balls {
+namespace mesh {
+
+constexpr int GLSL_VERSION = 130;
+// The first version with gl_VertexID
+
+constexpr int MIN_RESOLUTION = 3;
+constexpr int MIN_SAMPLES = 1;
+// The shaders clamp their uniforms the same way, so the vertex count always
+// matches what they generate
+
+// Everything before the shape itself; the prelude renames the shader's main()
+// so that ours can run first
+const QString PRELUDE = R"|(
+// Generated by BALLS; position and normal come from gl_VertexID
+%1
+vec3 %2;
+vec3 %3;
+
+const float BALLS_PI = 3.14159265;
+
+// Each quad is two counter-clockwise triangles, like in parametricGrid()
+const ivec2 BALLS_CORNERS[6] = ivec2[6](ivec2(0, 0), ivec2(1, 0), ivec2(1, 1),
+                                        ivec2(1, 1), ivec2(0, 1), ivec2(0, 0));
+
+// The grid sample this vertex lands on, for a grid with this many columns
+ivec2 ballsSample(int columns) {
+  int quad = gl_VertexID / 6;
+  return ivec2(quad % columns, quad / columns) + BALLS_CORNERS[gl_VertexID % 6];
+}
+
+void ballsGenerate(out vec3 position, out vec3 normal) {
+%4
+}
+
+#define main ballsMain
+)|";
+
+const QString EPILOGUE = R"|(
+#undef main
+
+void main() {
+  ballsGenerate(%1, %2);
+  ballsMain();
+}
+)|";
+
+const QString QUAD = R"|(
+  vec2 c = vec2(BALLS_CORNERS[gl_VertexID % 6]) - 0.5;
+  position = vec3(c.x * shapeWidth, c.y * shapeLength, 0.0);
+  normal = vec3(0.0, 0.0, 1.0);
+)|";
+
+const QString BOX = R"|(
+  // Two faces per axis, positive side first; u x v always points outwards
+  int face = gl_VertexID / 6;
+  int axis = face / 2;
+  float side = (face % 2 == 0) ? 1.0 : -1.0;
+  vec2 c = vec2(BALLS_CORNERS[gl_VertexID % 6]) * 2.0 - 1.0;
+  vec3 n = vec3(equal(ivec3(axis), ivec3(0, 1, 2))) * side;
+  vec3 u = vec3(equal(ivec3((axis + 1) % 3), ivec3(0, 1, 2)));
+  vec3 v = vec3(equal(ivec3((axis + 2) % 3), ivec3(0, 1, 2)));
+
+  if (side < 0.0) {
+    c = c.yx;
+  }
+
+  position = (n + c.x * u + c.y * v) * vec3(shapeWidth, shapeLength,
+                                            shapeHeight) * 0.5;
+  normal = n;
+)|";
+
+const QString CYLINDER = R"|(
+  // Four triangles per segment: the top cap, two for the side, and the bottom
+  // cap. 0-2 are the top's center, this rim vertex and the next; 3-5 the same
+  // on the bottom.
+  const int CORNERS[12] = int[12](0, 2, 1, 1, 5, 4, 1, 2, 5, 3, 4, 5);
+  int segments = max(shapeResolution, 3);
+  int segment = gl_VertexID / 12;
+  int triangle = (gl_VertexID % 12) / 3;
+  int corner = CORNERS[gl_VertexID % 12];
+  int around = (corner % 3 == 2) ? (segment + 1) % segments : segment;
+  float angle = float(around) / float(segments) * 2.0 * BALLS_PI;
+  vec3 rim = vec3(cos(angle), 0.0, sin(angle));
+  float y = (corner < 3) ? 0.5 : -0.5;
+
+  position = vec3(0.0, y * shapeHeight, 0.0) +
+             ((corner % 3 == 0) ? vec3(0.0) : rim * shapeRadius);
+  normal = (triangle == 1 || triangle == 2) ? rim : vec3(0.0, sign(y), 0.0);
+)|";
+
+const QString CONE = R"|(
+  // Two triangles per segment: the side, then the base. 0 is the tip, 1 this
+  // rim vertex, 2 the next, and 3 the base's center.
+  const int CORNERS[6] = int[6](0, 2, 1, 3, 1, 2);
+  int segments = max(shapeResolution, 3);
+  int segment = gl_VertexID / 6;
+  int corner = CORNERS[gl_VertexID % 6];
+  float around = (corner == 2) ? float((segment + 1) % segments) :
+                 (corner == 0) ? float(segment) + 0.5 : float(segment);
+  // The tip gets the normal halfway across its segment
+  float angle = around / float(segments) * 2.0 * BALLS_PI;
+  vec3 rim = vec3(cos(angle), 0.0, sin(angle));
+  float hh = shapeHeight * 0.5;
+
+  position = (corner == 0) ? vec3(0.0, hh, 0.0) :
+             (corner == 3) ? vec3(0.0, -hh, 0.0) :
+             vec3(0.0, -hh, 0.0) + rim * shapeRadius;
+  normal = (gl_VertexID % 6 < 3) ?
+           normalize(vec3(rim.x * shapeHeight, shapeRadius, rim.z * shapeHeight)) :
+           vec3(0.0, -1.0, 0.0);
+)|";
+
+const QString UV_SPHERE = R"|(
+  // Same angles as the uvsphere function; theta runs backwards so the faces
+  // wind outwards
+  int columns = max(shapeUSamples, 1);
+  int rows = max(shapeVSamples, 1);
+  ivec2 s = ballsSample(columns);
+  float phi = float(s.x % columns) / float(columns) * 2.0 * BALLS_PI;
+  float theta = (1.0 - float(s.y) / float(rows)) * BALLS_PI;
+  vec3 scale = vec3(shapeXScale, shapeYScale, shapeZScale);
+  vec3 p = vec3(sin(theta) * cos(phi), sin(theta) * sin(phi), cos(theta));
+
+  position = p * scale;
+  normal = normalize(p / max(scale, vec3(1e-6)));
+  // The gradient of the ellipsoid's implicit equation
+)|";
+
+const QString TORUS = R"|(
+  int columns = max(shapeUSamples, 1);
+  int rows = max(shapeVSamples, 1);
+  ivec2 s = ballsSample(columns);
+  float u = float(s.x % columns) / float(columns) * 2.0 * BALLS_PI;
+  float v = float(s.y % rows) / float(rows) * 2.0 * BALLS_PI;
+
+  normal = vec3(cos(v) * cos(u), cos(v) * sin(u), sin(v));
+  position = vec3(cos(u), sin(u), 0.0) * shapeOuterRadius +
+             normal * shapeInnerRadius;
+)|";
+
+static const QString& _body(const ProceduralShape shape) noexcept {
+  switch (shape) {
+  case ProceduralShape::Quad:
+    return QUAD;
+
+  case ProceduralShape::Box:
+    return BOX;
+
+  case ProceduralShape::Cylinder:
+    return CYLINDER;
+
+  case ProceduralShape::Cone:
+    return CONE;
+
+  case ProceduralShape::UvSphere:
+    return UV_SPHERE;
+
+  case ProceduralShape::Torus:
+    return TORUS;
+
+  default:
+    Q_UNREACHABLE();
+  }
+}
+
+QString proceduralUniform(const QString& parameter) noexcept {
+  QString name = "shape";
+
+  for (const QString& word : parameter.split('-', QString::SkipEmptyParts)) {
+    name += word.left(1).toUpper() + word.mid(1);
+  }
+
+  return name;
+}
+
+QString proceduralShader(const QString& source, const ProceduralShape shape,
+                         const MeshParameters& params) noexcept {
+  using namespace balls::shader;
+
+  if (shape == ProceduralShape::None) {
+    return source;
+  }
+
+  static const QRegularExpression VERSION(
+    R"|(^[ \t]*#[ \t]*version[ \t]+(\d+)[^\n]*\n?)|",
+    QRegularExpression::MultilineOption);
+  QRegularExpressionMatch version = VERSION.match(source);
+
+  if (!version.hasMatch() || version.captured(1).toInt() < GLSL_VERSION) {
+    qCWarning(logs::shader::Name)
+        << "Procedural shapes need a shader with #version" << GLSL_VERSION
+        << "or later";
+    return source;
+  }
+
+  QString uniforms;
+
+  for (const auto& param : params) {
+    bool integer = param.second.getType() == QMetaType::Int;
+    uniforms += QString("uniform %1 %2;\n")
+                .arg(integer ? "int" : "float")
+                .arg(proceduralUniform(param.first));
+  }
+
+  QString body = source;
+
+  for (const AttributeName& input : {attribute::POSITION, attribute::NORMAL}) {
+    // Remove the inputs, but not the line they were on
+    QRegularExpression declaration(
+      QString(R"|(^[ \t]*(layout\s*\([^)]*\)\s*)?in\s+((high|medium|low)p\s+)?vec3\s+%1\s*;)|")
+      .arg(input), QRegularExpression::MultilineOption);
+    body.replace(declaration, QString());
+  }
+
+  int end = version.capturedEnd();
+  int line = source.left(end).count('\n') + 1;
+  // Keep the compiler's line numbers in step with the editor's
+
+  return source.left(end) +
+         PRELUDE.arg(uniforms, attribute::POSITION, attribute::NORMAL,
+                     _body(shape)) +
+         QString("#line %1\n").arg(line) +
+         body.mid(end) +
+         EPILOGUE.arg(attribute::POSITION, attribute::NORMAL);
+}
+
+GLsizei proceduralVertexCount(const ProceduralShape shape,
+                              const MeshParameters& params) noexcept {
+  auto integer = [&params](const QString & name, const int min) {
+    return qMax(params.at(name).get<int>(), min);
+  };
+
+  switch (shape) {
+  case ProceduralShape::Quad:
+    return 6;
+
+  case ProceduralShape::Box:
+    return 6 * 6;
+
+  case ProceduralShape::Cylinder:
+    return 12 * integer(RESOLUTION, MIN_RESOLUTION);
+
+  case ProceduralShape::Cone:
+    return 6 * integer(RESOLUTION, MIN_RESOLUTION);
+
+  case ProceduralShape::UvSphere:
+  case ProceduralShape::Torus:
+    return 6 * integer(U_SAMPLES, MIN_SAMPLES) *
+           integer(V_SAMPLES, MIN_SAMPLES);
+
+  default:
+    return 0;
+  }
+}
+}
+}
@@ -0,0 +1,59 @@
+#ifndef PROCEDURAL_HPP
+#define PROCEDURAL_HPP
+
+#include <QtCore/QString>
+#include <QtGui/qopengl.h>
+
+#include "mesh/MeshParameter.hpp"
+
+namespace balls {
+namespace mesh {
+
+/// The shapes that can be generated entirely in the vertex shader
+enum class ProceduralShape : int {
+  /// Has to be built on the CPU and uploaded as usual
+  None,
+  Quad,
+  Box,
+  Cylinder,
+  Cone,
+
+  /// Also covers ellipsoids; the axes are scaled independently
+  UvSphere,
+  Torus,
+};
+
+/**
+ * @brief The custom uniform that a generator parameter is passed to shaders
+ * as when its shape is drawn procedurally, e.g. "outer-radius" becomes
+ * "shapeOuterRadius".
+ */
+QString proceduralUniform(const QString& parameter) noexcept;
+
+/**
+ * @brief Rewrites a vertex shader so that its position and normal inputs are
+ * computed from gl_VertexID instead of being read from a buffer.
+ *
+ * The declarations of both inputs are removed, and a prelude that declares
+ * them as globals (plus one uniform per parameter, see proceduralUniform()) is
+ * inserted after the #version line. The shader's own main() is renamed and
+ * called after the vertex is generated, so the rest of it needn't change.
+ * Only GLSL 1.30 is needed (no extensions, no buffers), so this also works on
+ * software renderers like llvmpipe.
+ *
+ * @return The rewritten shader, or source unchanged if it's older than GLSL
+ * 1.30 (which has no gl_VertexID) or shape is None
+ */
+QString proceduralShader(const QString& source, const ProceduralShape shape,
+                         const MeshParameters& params) noexcept;
+
+/**
+ * @brief How many vertices to draw (as separate triangles, without indices)
+ * for the given shape with the given parameters.
+ */
+GLsizei proceduralVertexCount(const ProceduralShape shape,
+                              const MeshParameters& params) noexcept;
+}
+}
+
+#endif // PROCEDURAL_HPP
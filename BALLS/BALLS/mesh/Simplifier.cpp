@@ -0,0 +1,330 @@
+#include "precompiled.hpp"
+#include "mesh/Simplifier.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+
+#include "util/Parallel.hpp"
+
+namespace balls {
+namespace mesh {
+
+using std::uint64_t;
+
+typedef Mesh::IndexType IndexType;
+
+constexpr int PROBE_RESOLUTION = 32;
+// Used to estimate how many cells the surface passes through
+
+constexpr int MAX_RESOLUTION = 1 << 20;
+// Three 21-bit cell coordinates have to fit in one 64-bit key
+
+constexpr float MIN_REDUCTION = 0.8f;
+// If a level keeps more than this fraction of the last one's triangles, stop
+
+constexpr size_t MIN_LEVEL_TRIANGLES = 256;
+// Below this, the vertex shader isn't where the time goes anyway
+
+constexpr size_t CELL_GRAIN = 1024;
+
+/**
+ * @brief A symmetric 4x4 matrix that measures the sum of squared distances
+ * from a point to a set of planes (Garland and Heckbert, 1997).
+ */
+struct Quadric {
+  double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+  double b0 = 0, b1 = 0, b2 = 0;
+  double c = 0;
+
+  // Adds the plane dot(n, p) + d = 0, weighted by w
+  void addPlane(const vec3& n, const float d, const float w) noexcept {
+    a00 += w * n.x * n.x;
+    a01 += w * n.x * n.y;
+    a02 += w * n.x * n.z;
+    a11 += w * n.y * n.y;
+    a12 += w * n.y * n.z;
+    a22 += w * n.z * n.z;
+    b0 += w * n.x * d;
+    b1 += w * n.y * d;
+    b2 += w * n.z * d;
+    c += w * double(d) * d;
+  }
+
+  /**
+   * @brief Finds the point with the least error, unless the planes don't pin
+   * one down (e.g. they're all parallel), in which case returns false.
+   */
+  bool minimize(vec3& out) const noexcept {
+    // Solve A x = -b with Cramer's rule
+    double m00 = a11 * a22 - a12 * a12;
+    double m01 = a02 * a12 - a01 * a22;
+    double m02 = a01 * a12 - a02 * a11;
+    double det = a00 * m00 + a01 * m01 + a02 * m02;
+    double trace = a00 + a11 + a22;
+
+    if (std::abs(det) <= 1e-6 * trace * trace * trace) {
+      return false;
+    }
+
+    double m11 = a00 * a22 - a02 * a02;
+    double m12 = a01 * a02 - a00 * a12;
+    double m22 = a00 * a11 - a01 * a01;
+
+    out.x = float(-(m00 * b0 + m01 * b1 + m02 * b2) / det);
+    out.y = float(-(m01 * b0 + m11 * b1 + m12 * b2) / det);
+    out.z = float(-(m02 * b0 + m12 * b1 + m22 * b2) / det);
+    return true;
+  }
+};
+
+struct Grid {
+  vec3 origin;
+  vec3 cellSize;
+  int resolution;
+
+  uint64_t key(const vec3& v) const noexcept {
+    vec3 cell = (v - origin) / cellSize;
+    uint64_t x = uint64_t(glm::clamp(int(cell.x), 0, resolution - 1));
+    uint64_t y = uint64_t(glm::clamp(int(cell.y), 0, resolution - 1));
+    uint64_t z = uint64_t(glm::clamp(int(cell.z), 0, resolution - 1));
+    return (x << 42) | (y << 21) | z;
+  }
+
+  // The corner of the cell with the given key that's nearest the origin
+  vec3 corner(const uint64_t key) const noexcept {
+    constexpr uint64_t MASK = (1 << 21) - 1;
+    vec3 cell(float(key >> 42), float((key >> 21) & MASK), float(key & MASK));
+    return origin + cell * cellSize;
+  }
+};
+
+static Grid _grid(const vec3& low, const vec3& high, const int resolution)
+noexcept {
+  vec3 extent = glm::max(high - low, vec3(1e-6f));
+  float side = glm::max(extent.x, glm::max(extent.y, extent.z));
+  // Cubic cells, so the result doesn't stretch along the longest axis
+
+  return {low, vec3(side / resolution), resolution};
+}
+
+static void _bounds(const vector<vec3>& vertices, vec3& low, vec3& high)
+noexcept {
+  low = high = vertices.empty() ? vec3(0) : vertices[0];
+
+  for (const vec3& v : vertices) {
+    low = glm::min(low, v);
+    high = glm::max(high, v);
+  }
+}
+
+// Returns each vertex's cell key, in parallel
+static vector<uint64_t> _keys(const vector<vec3>& vertices, const Grid& grid)
+noexcept {
+  vector<uint64_t> keys(vertices.size());
+
+  util::parallelFor(vertices.size(),
+  [&](const size_t begin, const size_t end) noexcept {
+    for (size_t i = begin; i < end; ++i) {
+      keys[i] = grid.key(vertices[i]);
+    }
+  });
+
+  return keys;
+}
+
+static vector<uint64_t> _uniqueCells(vector<uint64_t> keys) noexcept {
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  return keys;
+}
+
+Mesh simplify(const Mesh& mesh, const size_t targetVertices) noexcept {
+  const vector<vec3>& vertices = mesh.vertices();
+  const vector<IndexType>& indices = mesh.indices();
+  size_t triangles = indices.size() / 3;
+
+  vec3 low, high;
+  _bounds(vertices, low, high);
+
+  // A surface crosses about resolution^2 cells, so one probe is enough to
+  // pick a resolution that lands close to the target
+  size_t probe = _uniqueCells(
+                   _keys(vertices, _grid(low, high, PROBE_RESOLUTION))).size();
+  double scale = std::sqrt(double(targetVertices) / std::max<size_t>(probe, 1));
+  int resolution = glm::clamp(int(PROBE_RESOLUTION * scale), 1,
+                              MAX_RESOLUTION);
+
+  Grid grid = _grid(low, high, resolution);
+  vector<uint64_t> keys = _keys(vertices, grid);
+  vector<uint64_t> cells = _uniqueCells(keys);
+  size_t cellCount = cells.size();
+
+  // Number the occupied cells; these become the new vertices
+  vector<IndexType> cellOf(vertices.size());
+
+  util::parallelFor(vertices.size(),
+  [&](const size_t begin, const size_t end) noexcept {
+    for (size_t i = begin; i < end; ++i) {
+      cellOf[i] = static_cast<IndexType>(
+                    std::lower_bound(cells.begin(), cells.end(), keys[i]) -
+                    cells.begin());
+    }
+  });
+
+  // The faces that touch each cell, stored as one flat array
+  vector<size_t> offsets(cellCount + 1, 0);
+
+  for (size_t f = 0; f < triangles; ++f) {
+    IndexType a = cellOf[indices[f * 3]];
+    IndexType b = cellOf[indices[f * 3 + 1]];
+    IndexType c = cellOf[indices[f * 3 + 2]];
+    ++offsets[a + 1];
+    offsets[b + 1] += (b != a);
+    offsets[c + 1] += (c != a && c != b);
+  }
+
+  std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+  vector<IndexType> faces(offsets.back());
+  vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+
+  for (size_t f = 0; f < triangles; ++f) {
+    IndexType a = cellOf[indices[f * 3]];
+    IndexType b = cellOf[indices[f * 3 + 1]];
+    IndexType c = cellOf[indices[f * 3 + 2]];
+    faces[fill[a]++] = static_cast<IndexType>(f);
+
+    if (b != a) {
+      faces[fill[b]++] = static_cast<IndexType>(f);
+    }
+
+    if (c != a && c != b) {
+      faces[fill[c]++] = static_cast<IndexType>(f);
+    }
+  }
+
+  // The same goes for the vertices in each cell
+  vector<size_t> members(cellCount + 1, 0);
+
+  for (IndexType c : cellOf) {
+    ++members[c + 1];
+  }
+
+  std::partial_sum(members.begin(), members.end(), members.begin());
+
+  vector<IndexType> cellVertices(vertices.size());
+  fill.assign(members.begin(), members.end() - 1);
+
+  for (size_t v = 0; v < vertices.size(); ++v) {
+    cellVertices[fill[cellOf[v]]++] = static_cast<IndexType>(v);
+  }
+
+  Mesh result;
+  result.resize(cellCount, 0);
+
+  // Cells are independent of one another, so solve them all in parallel
+  util::parallelFor(cellCount,
+  [&](const size_t begin, const size_t end) noexcept {
+    for (size_t c = begin; c < end; ++c) {
+      Quadric q;
+      vec3 mean(0);
+      vec3 cellLow = grid.corner(cells[c]);
+      vec3 cellHigh = cellLow + grid.cellSize;
+
+      for (size_t m = members[c]; m < members[c + 1]; ++m) {
+        mean += vertices[cellVertices[m]];
+      }
+
+      mean /= float(members[c + 1] - members[c]);
+
+      for (size_t i = offsets[c]; i < offsets[c + 1]; ++i) {
+        const IndexType* t = indices.data() + faces[i] * 3;
+        const vec3& a = vertices[t[0]];
+        vec3 n = glm::cross(vertices[t[1]] - a, vertices[t[2]] - a);
+        float area = glm::length(n);
+
+        if (area > 0) {
+          n /= area;
+          q.addPlane(n, -glm::dot(n, a), area);
+          // Big faces get more of a say in where the vertex goes
+        }
+      }
+
+      vec3 position;
+
+      if (!q.minimize(position) ||
+          glm::any(glm::lessThan(position, cellLow)) ||
+          glm::any(glm::greaterThan(position, cellHigh))) {
+        // If the planes don't agree on a point, or they'd pull the vertex out
+        // of its own cluster, settle for the average
+        position = mean;
+      }
+
+      result.set_vertex(c, position);
+    }
+  }, CELL_GRAIN);
+
+  for (size_t f = 0; f < triangles; ++f) {
+    IndexType a = cellOf[indices[f * 3]];
+    IndexType b = cellOf[indices[f * 3 + 1]];
+    IndexType c = cellOf[indices[f * 3 + 2]];
+
+    if (a != b && b != c && a != c) {
+      // If this face didn't collapse into a line or a point...
+      result.add_face(a, b, c);
+    }
+  }
+
+  return result;
+}
+
+LodChain buildLods(Mesh& mesh, const size_t levels,
+                   const function<void(Mesh&)>& prepare) noexcept {
+  LodChain chain;
+  vec3 low, high;
+  _bounds(mesh.vertices(), low, high);
+  chain.center = (low + high) * 0.5f;
+  chain.radius = glm::length(high - low) * 0.5f;
+
+  vector<Mesh> lods;
+  size_t triangles = mesh.indices().size() / 3;
+  size_t target = mesh.vertices().size();
+
+  size_t extra = (triangles >= LOD_MIN_TRIANGLES) ? levels : 0;
+
+  for (size_t l = 0; l < extra; ++l) {
+    // Always simplify the original, so errors don't pile up level by level
+    target = size_t(target * LOD_RATIO);
+    Mesh lod = simplify(mesh, target);
+    size_t lodTriangles = lod.indices().size() / 3;
+
+    if (lodTriangles < MIN_LEVEL_TRIANGLES ||
+        lodTriangles > MIN_REDUCTION * triangles) {
+      break;
+    }
+
+    triangles = lodTriangles;
+    lods.push_back(std::move(lod));
+  }
+
+  if (prepare) {
+    prepare(mesh);
+  }
+
+  chain.levels.push_back({0, mesh.indices().size()});
+
+  for (Mesh& lod : lods) {
+    if (prepare) {
+      prepare(lod);
+    }
+
+    chain.levels.push_back({mesh.indices().size(), lod.indices().size()});
+    mesh.append(lod);
+  }
+
+  return chain;
+}
+}
+}
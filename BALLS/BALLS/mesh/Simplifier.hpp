@@ -0,0 +1,69 @@
+#ifndef SIMPLIFIER_HPP
+#define SIMPLIFIER_HPP
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "mesh/Mesh.hpp"
+
+namespace balls {
+namespace mesh {
+
+using std::function;
+using std::size_t;
+using std::vector;
+using glm::vec3;
+
+/// Meshes with fewer triangles than this aren't worth building LODs for
+constexpr size_t LOD_MIN_TRIANGLES = 1 << 15;
+
+/// Each level of detail aims for this fraction of the previous one's vertices
+constexpr float LOD_RATIO = 0.25f;
+
+/// One level of detail; a contiguous range of the mesh's index buffer
+struct LodLevel {
+  size_t firstIndex;
+  size_t indexCount;
+};
+
+/**
+ * @brief Every level of detail of one mesh, finest first, plus the bounding
+ * sphere used to decide which one to draw.
+ */
+struct LodChain {
+  vector<LodLevel> levels;
+  vec3 center;
+  float radius;
+};
+
+/**
+ * @brief Simplifies a mesh to roughly the given number of vertices with
+ * quadric-error vertex clustering (Lindstrom, "Out-of-Core Simplification of
+ * Large Polygonal Models", 2000).
+ *
+ * The mesh's bounding box is cut into a uniform grid, every vertex in a cell
+ * is merged into one, and that vertex is placed where it minimizes the
+ * squared distance to the planes of the faces around the cell. Cells don't
+ * depend on one another, so they're solved in parallel. Faces whose corners
+ * all land in fewer than three cells are dropped.
+ */
+Mesh simplify(const Mesh& mesh, const size_t targetVertices) noexcept;
+
+/**
+ * @brief Appends progressively simpler copies of a mesh to it, each with about
+ * LOD_RATIO times the vertices of the last, until there are the given number
+ * of extra levels or simplifying stops paying off.
+ *
+ * @param prepare If given, is called on every level (the original included)
+ * before it's appended; e.g. to optimize its index order, which must happen
+ * per level so that the levels stay contiguous.
+ */
+LodChain buildLods(Mesh& mesh, const size_t levels,
+                   const function<void(Mesh&)>& prepare = nullptr) noexcept;
+}
+}
+
+#endif // SIMPLIFIER_HPP
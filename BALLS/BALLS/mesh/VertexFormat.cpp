@@ -0,0 +1,83 @@
+#include "precompiled.hpp"
+#include "mesh/VertexFormat.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace balls {
+namespace mesh {
+
+mat4 Quantization::matrix() const noexcept {
+  return glm::scale(glm::translate(mat4(1), bias), vec3(scale));
+}
+
+VertexFormat::VertexFormat(const PositionFormat position,
+                           const NormalFormat normal) noexcept
+  : _positionFormat(position),
+    _normalFormat(normal) {
+  switch (position) {
+  case PositionFormat::HalfFloat:
+    _position = {4, GL_HALF_FLOAT, GL_FALSE, 0, 4 * sizeof(std::uint16_t)};
+    break;
+
+  case PositionFormat::Snorm16:
+    _position = {4, GL_SHORT, GL_TRUE, 0, 4 * sizeof(std::int16_t)};
+    break;
+
+  case PositionFormat::Float:
+  default:
+    _positionFormat = PositionFormat::Float;
+    _position = {3, GL_FLOAT, GL_FALSE, 0, 3 * sizeof(float)};
+    break;
+  }
+
+  // A vec3 of 16-bit values would leave the next attribute misaligned, so
+  // both 16-bit formats carry a w
+
+  switch (normal) {
+  case NormalFormat::Int2_10_10_10:
+    _normal = {4, GL_INT_2_10_10_10_REV, GL_TRUE, _position.size,
+               sizeof(std::uint32_t)
+              };
+    break;
+
+  case NormalFormat::Float:
+  default:
+    _normalFormat = NormalFormat::Float;
+    _normal = {3, GL_FLOAT, GL_FALSE, _position.size, 3 * sizeof(float)};
+    break;
+  }
+}
+
+QString VertexFormat::toString() const noexcept {
+  QString position;
+  QString normal;
+
+  switch (_positionFormat) {
+  case PositionFormat::Float:
+    position = "float";
+    break;
+
+  case PositionFormat::HalfFloat:
+    position = "half-float";
+    break;
+
+  case PositionFormat::Snorm16:
+    position = "snorm16";
+    break;
+  }
+
+  switch (_normalFormat) {
+  case NormalFormat::Float:
+    normal = "float";
+    break;
+
+  case NormalFormat::Int2_10_10_10:
+    normal = "2_10_10_10";
+    break;
+  }
+
+  return QString("%1 positions, %2 normals, %3 bytes per vertex")
+         .arg(position, normal).arg(stride());
+}
+}
+}
@@ -0,0 +1,140 @@
+#ifndef VERTEXFORMAT_HPP
+#define VERTEXFORMAT_HPP
+
+#include <cstdint>
+#include <cstring>
+
+#include <QtCore/QString>
+#include <QtGui/qopengl.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+namespace balls {
+namespace mesh {
+
+using std::size_t;
+using glm::mat4;
+using glm::vec3;
+using glm::vec4;
+
+/// How each vertex position is stored in the vertex buffer
+enum class PositionFormat : int {
+  /// Three 32-bit floats; 12 bytes
+  Float,
+
+  /// Four 16-bit floats (w is 1); 8 bytes, exact enough for most scenes
+  HalfFloat,
+
+  /// Four normalized 16-bit ints (w is 1); 8 bytes, with uniform precision
+  /// across the mesh's bounding box. See Quantization.
+  Snorm16,
+};
+
+/// How each vertex normal is stored in the vertex buffer
+enum class NormalFormat : int {
+  /// Three 32-bit floats; 12 bytes
+  Float,
+
+  /// GL_INT_2_10_10_10_REV, normalized; 4 bytes, plenty for lighting
+  Int2_10_10_10,
+};
+
+/// Everything glVertexAttribPointer() needs to know about one attribute
+struct AttributeLayout {
+  GLint components;
+  GLenum type;
+  GLboolean normalized;
+  size_t offset;
+  size_t size;
+};
+
+/**
+ * @brief Maps quantized positions back to model space, as p * scale + bias.
+ *
+ * The scale is the same along every axis so that the transform doesn't skew
+ * normals; BallsCanvas folds it into the model matrix, so shaders don't need
+ * to know about it.
+ */
+struct Quantization {
+  vec3 bias = vec3(0);
+  float scale = 1;
+
+  mat4 matrix() const noexcept;
+};
+
+/// The layout of one interleaved vertex: its position, followed by its normal
+class VertexFormat {
+public:
+  explicit VertexFormat(const PositionFormat = PositionFormat::Float,
+                        const NormalFormat = NormalFormat::Float) noexcept;
+
+  PositionFormat positionFormat() const noexcept { return _positionFormat; }
+  NormalFormat normalFormat() const noexcept { return _normalFormat; }
+
+  const AttributeLayout& position() const noexcept { return _position; }
+  const AttributeLayout& normal() const noexcept { return _normal; }
+
+  /// The size of one vertex in bytes
+  size_t stride() const noexcept { return _position.size + _normal.size; }
+
+  /// A short human-readable description, for logging
+  QString toString() const noexcept;
+
+  bool operator==(const VertexFormat& o) const noexcept {
+    return _positionFormat == o._positionFormat &&
+           _normalFormat == o._normalFormat;
+  }
+
+private /* members */:
+  PositionFormat _positionFormat;
+  NormalFormat _normalFormat;
+  AttributeLayout _position;
+  AttributeLayout _normal;
+};
+
+template<PositionFormat P>
+inline void encodePosition(void*, const vec3&, const Quantization&) noexcept;
+
+template<NormalFormat N>
+inline void encodeNormal(void*, const vec3&) noexcept;
+
+// memcpy() because vertices aren't necessarily aligned for any of these types
+
+template<>
+inline void encodePosition<PositionFormat::Float>(void* out, const vec3& p,
+    const Quantization&) noexcept {
+  std::memcpy(out, &p, sizeof(vec3));
+}
+
+template<>
+inline void encodePosition<PositionFormat::HalfFloat>(void* out,
+    const vec3& p, const Quantization&) noexcept {
+  std::uint64_t packed = glm::packHalf4x16(vec4(p, 1));
+  std::memcpy(out, &packed, sizeof(packed));
+}
+
+template<>
+inline void encodePosition<PositionFormat::Snorm16>(void* out, const vec3& p,
+    const Quantization& q) noexcept {
+  std::uint64_t packed = glm::packSnorm4x16(vec4((p - q.bias) / q.scale, 1));
+  std::memcpy(out, &packed, sizeof(packed));
+}
+
+template<>
+inline void encodeNormal<NormalFormat::Float>(void* out, const vec3& n)
+noexcept {
+  std::memcpy(out, &n, sizeof(vec3));
+}
+
+template<>
+inline void encodeNormal<NormalFormat::Int2_10_10_10>(void* out,
+    const vec3& n) noexcept {
+  std::uint32_t packed = glm::packSnorm3x10_1x2(vec4(n, 0));
+  // x is in the lowest bits, which is what GL's _REV layout expects
+  std::memcpy(out, &packed, sizeof(packed));
+}
+}
+}
+
+#endif // VERTEXFORMAT_HPP
@@ -9,6 +9,7 @@
 // STL template instantiations
 namespace std {
 template struct array<uint16_t, 3>;
+template struct array<uint32_t, 3>;
 
 template struct pair<GLenum, GLenum>;
 template struct pair<QString, QVariant>;
@@ -17,6 +18,7 @@ template struct pair<QString, QVariant>;
 
 template class vector<float>;
 template class vector<uint16_t>;
+template class vector<uint32_t>;
 template class vector<glm::vec3>;
 }
 
@@ -234,6 +234,7 @@ extern template struct tmat4x4<double>;
 // STL template instantiations
 namespace std {
 extern template struct array<uint16_t, 3>;
+extern template struct array<uint32_t, 3>;
 
 template<> struct hash<QString>;
 template<> struct hash<QByteArray>;
@@ -245,6 +246,7 @@ extern template struct pair<QString, QVariant>;
 
 extern template class vector<float>;
 extern template class vector<uint16_t>;
+extern template class vector<uint32_t>;
 extern template class vector<glm::vec3>;
 }
 
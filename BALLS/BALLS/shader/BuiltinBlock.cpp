@@ -0,0 +1,119 @@
+#include "precompiled.hpp"
+#include "shader/BuiltinBlock.hpp"
+
+#include <cstddef>
+#include <cstring>
+
+#include <QtGui/QOpenGLFunctions_3_1>
+
+#include "util/Logging.hpp"
+
+namespace balls {
+namespace shader {
+
+// std140 puts each of these at a multiple of its own size (or 16 bytes for
+// matrix columns), which the order of BuiltinBlockData already does for us
+static_assert(offsetof(BuiltinBlockData, mousePos) == 6 * 64, "std140");
+static_assert(offsetof(BuiltinBlockData, canvasSize) == 6 * 64 + 16, "std140");
+static_assert(offsetof(BuiltinBlockData, canvasWidth) == 6 * 64 + 32, "std140");
+static_assert(sizeof(BuiltinBlockData) == 6 * 64 + 48, "std140");
+
+const QString BUILTIN_BLOCK = "BallsBuiltins";
+
+// Needs #version 140 or later
+const QString BUILTIN_BLOCK_SOURCE = R"|(
+layout(std140) uniform BallsBuiltins {
+  mat4 matrix;
+  mat4 model;
+  mat4 view;
+  mat4 modelView;
+  mat4 projection;
+  mat4 trackball;
+  ivec2 mousePos;
+  ivec2 lastMousePos;
+  uvec2 canvasSize;
+  uvec2 lastCanvasSize;
+  uint canvasWidth;
+  uint canvasHeight;
+  uint elapsedTime;
+  uint instanceCount;
+};
+)|";
+
+bool BuiltinBlock::create(QOpenGLFunctions_3_1* gl) noexcept {
+  if (gl == nullptr) {
+    qCWarning(logs::gl::Feature)
+        << "Uniform blocks need OpenGL 3.1; the" << BUILTIN_BLOCK
+        << "block won't be available";
+    return false;
+  }
+
+  _gl = gl;
+  _gl->glGenBuffers(1, &_buffer);
+  _gl->glBindBuffer(GL_UNIFORM_BUFFER, _buffer);
+  _gl->glBufferData(GL_UNIFORM_BUFFER, sizeof(BuiltinBlockData), nullptr,
+                    GL_DYNAMIC_DRAW);
+  _gl->glBindBufferBase(GL_UNIFORM_BUFFER, BUILTIN_BINDING, _buffer);
+  _gl->glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  _uploaded = false;
+
+  qCDebug(logs::gl::Feature) << "Built-in uniform block" << _buffer
+                             << "bound to" << BUILTIN_BINDING;
+  return _buffer != 0;
+}
+
+void BuiltinBlock::destroy() noexcept {
+  if (_buffer != 0) {
+    _gl->glDeleteBuffers(1, &_buffer);
+    _buffer = 0;
+  }
+}
+
+bool BuiltinBlock::attach(const GLuint program) noexcept {
+  if (_buffer == 0) {
+    return false;
+  }
+
+  GLuint index = _gl->glGetUniformBlockIndex(program, qPrintable(BUILTIN_BLOCK));
+
+  if (index == GL_INVALID_INDEX) {
+    return false;
+  }
+
+  GLint size = 0;
+  _gl->glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_DATA_SIZE,
+                                 &size);
+
+  if (Q_UNLIKELY(size != GLint(sizeof(BuiltinBlockData)))) {
+    qCWarning(logs::uniform::Type)
+        << "The" << BUILTIN_BLOCK << "block should be" << sizeof(BuiltinBlockData)
+        << "bytes, not" << size << "; declare it like this:"
+        << qPrintable(BUILTIN_BLOCK_SOURCE);
+    return false;
+  }
+
+  _gl->glUniformBlockBinding(program, index, BUILTIN_BINDING);
+  _gl->glBindBufferBase(GL_UNIFORM_BUFFER, BUILTIN_BINDING, _buffer);
+  // In case something else was bound here since
+
+  qCDebug(logs::uniform::Name) << "Program" << program << "uses the"
+                               << BUILTIN_BLOCK << "block";
+  return true;
+}
+
+bool BuiltinBlock::update(const BuiltinBlockData& data) noexcept {
+  if (_buffer == 0 ||
+      (_uploaded && std::memcmp(&_data, &data, sizeof(data)) == 0)) {
+    return false;
+  }
+
+  _data = data;
+  _uploaded = true;
+
+  _gl->glBindBuffer(GL_UNIFORM_BUFFER, _buffer);
+  _gl->glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(_data), &_data);
+  _gl->glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  return true;
+}
+}
+}
@@ -0,0 +1,82 @@
+#ifndef BUILTINBLOCK_HPP
+#define BUILTINBLOCK_HPP
+
+#include <QtCore/QString>
+#include <QtGui/qopengl.h>
+
+#include <glm/glm.hpp>
+
+class QOpenGLFunctions_3_1;
+
+namespace balls {
+namespace shader {
+
+/// The binding point the built-in block is always attached to
+constexpr GLuint BUILTIN_BINDING = 0;
+
+/// What a shader names the block to opt into it
+extern const QString BUILTIN_BLOCK;
+
+/**
+ * @brief The block's GLSL declaration, for shaders to paste in. Its members
+ * have the same names as the built-in uniforms, so a shader that declares it
+ * doesn't need any other changes.
+ */
+extern const QString BUILTIN_BLOCK_SOURCE;
+
+/**
+ * @brief Every built-in uniform, laid out by std140's rules. Matrices come
+ * first so nothing needs padding until the end.
+ */
+struct BuiltinBlockData {
+  glm::mat4 matrix;
+  glm::mat4 model;
+  glm::mat4 view;
+  glm::mat4 modelView;
+  glm::mat4 projection;
+  glm::mat4 trackball;
+  glm::ivec2 mousePos;
+  glm::ivec2 lastMousePos;
+  glm::uvec2 canvasSize;
+  glm::uvec2 lastCanvasSize;
+  GLuint canvasWidth;
+  GLuint canvasHeight;
+  GLuint elapsedTime;
+  GLuint instanceCount;
+};
+
+/**
+ * @brief One uniform buffer that holds every built-in uniform, shared by any
+ * program that declares BUILTIN_BLOCK. It's updated at most once per frame
+ * with a single glBufferSubData(), instead of one glUniform*() per built-in
+ * per program.
+ *
+ * Needs OpenGL 3.1; without it, shaders should use the plain uniforms.
+ */
+class BuiltinBlock {
+public:
+  /// Creates the buffer and attaches it to BUILTIN_BINDING; needs a context
+  bool create(QOpenGLFunctions_3_1*) noexcept;
+  void destroy() noexcept;
+
+  bool isCreated() const noexcept { return _buffer != 0; }
+
+  /**
+   * @brief Points the given program's block at BUILTIN_BINDING, and returns
+   * whether it has one at all (or false if the buffer was never created).
+   */
+  bool attach(const GLuint program) noexcept;
+
+  /// Uploads data if it's any different from what the buffer has now
+  bool update(const BuiltinBlockData&) noexcept;
+
+private:
+  QOpenGLFunctions_3_1* _gl = nullptr;
+  GLuint _buffer = 0;
+  BuiltinBlockData _data;
+  bool _uploaded = false;
+};
+}
+}
+
+#endif // BUILTINBLOCK_HPP
@@ -0,0 +1,249 @@
+#include "precompiled.hpp"
+#include "shader/ProgramCache.hpp"
+
+#include <cstring>
+
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDataStream>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QSaveFile>
+#include <QtCore/QStandardPaths>
+#include <QtGui/QOpenGLFunctions_4_1_Core>
+
+#include "config/Settings.hpp"
+#include "util/Logging.hpp"
+
+namespace balls {
+namespace shader {
+
+constexpr quint32 ProgramCache::VERSION;
+
+constexpr char MAGIC[8] = {'B', 'A', 'L', 'L', 'S', 'P', 'R', 'G'};
+constexpr char SUFFIX[] = ".bin";
+
+/// More uniforms than any driver allows; anything past this is corruption
+constexpr quint32 MAX_UNIFORMS = 1 << 16;
+
+QString ProgramCache::defaultDirectory() noexcept {
+  QString cache = QStandardPaths::writableLocation(
+                    QStandardPaths::CacheLocation);
+  return cache.isEmpty() ? cache : QDir(cache).filePath("programs");
+}
+
+ProgramCache::ProgramCache(const QString& directory) noexcept
+  : _gl(nullptr),
+    _directory(directory),
+    _hits(0),
+    _misses(0),
+    _rejected(0) {
+}
+
+bool ProgramCache::create(QOpenGLFunctions_4_1_Core* gl) noexcept {
+  _gl = nullptr;
+  // If this fails, don't keep using whatever functions we had before
+
+  if (gl == nullptr) {
+    qCInfo(logs::gl::Feature)
+        << "Program binaries need OpenGL 4.1; shaders won't be cached";
+    return false;
+  }
+
+  GLint formats = 0;
+  gl->glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+
+  if (formats <= 0) {
+    qCInfo(logs::gl::Feature)
+        << "Driver has no program binary formats; shaders won't be cached";
+    return false;
+  }
+
+  if (_directory.isEmpty()) {
+    qCInfo(logs::shader::Cache) << "No cache directory; shaders won't be cached";
+    return false;
+  }
+
+  _gl = gl;
+  _driver.clear();
+
+  for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+    _driver += reinterpret_cast<const char*>(_gl->glGetString(name));
+    _driver += '\n';
+  }
+
+  qCDebug(logs::shader::Cache) << "Caching program binaries in" << _directory;
+  return true;
+}
+
+QByteArray ProgramCache::key(const std::initializer_list<QString>& sources)
+const noexcept {
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+  quint32 version = VERSION;
+  hash.addData(reinterpret_cast<const char*>(&version), sizeof(version));
+  hash.addData(_driver);
+
+  for (const QString& source : sources) {
+    hash.addData(source.toUtf8());
+    hash.addData("\0", 1);
+    // So moving code from one stage to the next changes the key
+  }
+
+  return hash.result().toHex();
+}
+
+bool ProgramCache::load(const QByteArray& key, const GLuint program,
+                        UniformCollection& uniforms) noexcept {
+  if (_gl == nullptr) {
+    return false;
+  }
+
+  QFile file(_path(key));
+
+  if (!file.open(QIODevice::ReadOnly)) {
+    ++_misses;
+    return false;
+  }
+
+  QDataStream in(&file);
+  in.setVersion(QDataStream::Qt_5_0);
+
+  char magic[sizeof(MAGIC)];
+  quint32 version = 0;
+  QByteArray driver;
+  quint32 format = 0;
+  quint32 count = 0;
+
+  in.readRawData(magic, sizeof(magic));
+  in >> version >> driver >> format >> count;
+
+  if (std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || version != VERSION ||
+      driver != _driver || count > MAX_UNIFORMS) {
+    qCDebug(logs::shader::Cache) << "Discarding stale entry" << key;
+    file.remove();
+    ++_misses;
+    return false;
+  }
+
+  UniformCollection cached;
+  cached.reserve(count);
+
+  for (quint32 i = 0; i < count; ++i) {
+    QString name;
+    qint32 index = 0;
+    quint32 type = 0;
+    qint32 size = 0;
+    in >> name >> index >> type >> size;
+    cached.push_back({name, index, type, size});
+  }
+
+  QByteArray binary;
+  in >> binary;
+
+  if (in.status() != QDataStream::Ok || binary.isEmpty()) {
+    qCWarning(logs::shader::Cache) << "Discarding truncated entry" << key;
+    file.remove();
+    ++_misses;
+    return false;
+  }
+
+  _gl->glProgramBinary(program, format, binary.constData(), binary.size());
+
+  GLint linked = GL_FALSE;
+  _gl->glGetProgramiv(program, GL_LINK_STATUS, &linked);
+
+  if (!linked) {
+    // Drivers may turn down their own binaries (e.g. after an update)
+    qCInfo(logs::shader::Cache) << "Driver rejected cached program" << key
+                                << "; compiling from source";
+    file.remove();
+    ++_rejected;
+    return false;
+  }
+
+  uniforms = std::move(cached);
+  ++_hits;
+  qCDebug(logs::shader::Cache) << "Loaded program" << program << "from" << key;
+  return true;
+}
+
+void ProgramCache::prepare(const GLuint program) noexcept {
+  if (_gl != nullptr) {
+    _gl->glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+                             GL_TRUE);
+  }
+}
+
+void ProgramCache::store(const QByteArray& key, const GLuint program,
+                         const UniformCollection& uniforms) noexcept {
+  if (_gl == nullptr) {
+    return;
+  }
+
+  GLint length = 0;
+  _gl->glGetProgramiv(program, static_cast<GLenum>(
+                        config::ProgramParameter::ProgramBinaryLength),
+                      &length);
+
+  if (length <= 0) {
+    qCDebug(logs::shader::Cache) << "Program" << program << "has no binary";
+    return;
+  }
+
+  QByteArray binary(length, Qt::Uninitialized);
+  GLsizei written = 0;
+  GLenum format = 0;
+  _gl->glGetProgramBinary(program, length, &written, &format, binary.data());
+  binary.resize(written);
+
+  if (!QDir().mkpath(_directory)) {
+    qCWarning(logs::shader::Cache) << "Couldn't create" << _directory;
+    return;
+  }
+
+  QSaveFile file(_path(key));
+  // Written to a temporary file first, so a crash can't leave half an entry
+
+  if (!file.open(QIODevice::WriteOnly)) {
+    qCWarning(logs::shader::Cache) << "Couldn't write" << file.fileName()
+                                   << ":" << file.errorString();
+    return;
+  }
+
+  QDataStream out(&file);
+  out.setVersion(QDataStream::Qt_5_0);
+  out.writeRawData(MAGIC, sizeof(MAGIC));
+  out << VERSION << _driver << quint32(format) << quint32(uniforms.size());
+
+  for (const auto& uniform : uniforms) {
+    out << uniform.name << qint32(uniform.index) << quint32(uniform.type)
+        << qint32(uniform.size);
+  }
+
+  out << binary;
+
+  if (!file.commit()) {
+    qCWarning(logs::shader::Cache) << "Couldn't write" << file.fileName()
+                                   << ":" << file.errorString();
+    return;
+  }
+
+  qCDebug(logs::shader::Cache) << "Stored program" << program << "as" << key
+                               << "(" << written << "bytes)";
+}
+
+void ProgramCache::clear() noexcept {
+  QDir directory(_directory);
+
+  for (const QString& entry : directory.entryList({QString("*") + SUFFIX},
+       QDir::Files)) {
+    directory.remove(entry);
+  }
+
+  qCInfo(logs::shader::Cache) << "Cleared" << _directory;
+}
+
+QString ProgramCache::_path(const QByteArray& key) const noexcept {
+  return QDir(_directory).filePath(QString::fromLatin1(key) + SUFFIX);
+}
+}
+}
@@ -0,0 +1,86 @@
+#ifndef PROGRAMCACHE_HPP
+#define PROGRAMCACHE_HPP
+
+#include <initializer_list>
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+#include <QtGui/qopengl.h>
+
+#include "util/TypeInfo.hpp"
+
+class QOpenGLFunctions_4_1_Core;
+
+namespace balls {
+namespace shader {
+
+using balls::util::types::UniformCollection;
+
+/**
+ * @brief Keeps linked programs on disk, so a project whose shaders haven't
+ * changed since it was last opened skips the driver's compiler entirely.
+ *
+ * Entries are keyed by a hash of every stage's source and the GL vendor,
+ * renderer and version strings, since a binary is only good for the driver
+ * that made it. Each one also has the program's active uniforms, so they
+ * don't have to be queried again. The driver is free to reject a binary
+ * anyway (e.g. after an update that kept the version string); if it does, the
+ * entry is deleted and the caller compiles from source like usual.
+ *
+ * Needs OpenGL 4.1 and a driver with at least one binary format.
+ */
+class ProgramCache {
+public:
+  /// Bumped whenever the file layout changes, which invalidates every entry
+  static constexpr quint32 VERSION = 1;
+
+  /// Where the cache goes unless told otherwise: programs/ in the cache dir
+  static QString defaultDirectory() noexcept;
+
+  explicit ProgramCache(const QString& directory = defaultDirectory()) noexcept;
+
+  bool create(QOpenGLFunctions_4_1_Core*) noexcept;
+  void destroy() noexcept { _gl = nullptr; }
+
+  bool isCreated() const noexcept { return _gl != nullptr; }
+
+  /// The key for a program built from these sources, in stage order
+  QByteArray key(const std::initializer_list<QString>& sources) const noexcept;
+
+  /**
+   * @brief Loads the cached binary into the program (which must have no
+   * shaders attached) and reads its uniforms. Returns false if there's no
+   * entry or the driver wouldn't take it, in which case the program still
+   * needs linking.
+   */
+  bool load(const QByteArray& key, const GLuint program,
+            UniformCollection& uniforms) noexcept;
+
+  /// Call before linking a program that will be stored
+  void prepare(const GLuint program) noexcept;
+
+  /// Writes a linked program and its uniforms to the cache
+  void store(const QByteArray& key, const GLuint program,
+             const UniformCollection& uniforms) noexcept;
+
+  /// Deletes every entry
+  void clear() noexcept;
+
+  size_t hits() const noexcept { return _hits; }
+  size_t misses() const noexcept { return _misses; }
+  size_t rejected() const noexcept { return _rejected; }
+
+private:
+  QString _path(const QByteArray& key) const noexcept;
+
+  QOpenGLFunctions_4_1_Core* _gl;
+  QString _directory;
+  QByteArray _driver;
+  size_t _hits;
+  size_t _misses;
+  size_t _rejected;
+};
+}
+}
+
+#endif // PROGRAMCACHE_HPP
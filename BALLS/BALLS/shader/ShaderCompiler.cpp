@@ -0,0 +1,252 @@
+#include "precompiled.hpp"
+#include "shader/ShaderCompiler.hpp"
+
+#include <QtGui/QOffscreenSurface>
+#include <QtGui/QOpenGLContext>
+#include <QtGui/QOpenGLFunctions>
+#include <QtGui/QOpenGLFunctions_4_1_Core>
+#include <QtGui/QOpenGLShaderProgram>
+
+#include "shader/ShaderInputs.hpp"
+#include "shader/UniformTable.hpp"
+#include "util/Logging.hpp"
+
+namespace balls {
+namespace shader {
+
+using MaxShaderCompilerThreads = void (QOPENGLF_APIENTRYP)(GLuint);
+
+/// Lets the driver use as many threads as it likes
+constexpr GLuint ALL_THREADS = 0xFFFFFFFF;
+
+CompiledProgram buildProgram(QOpenGLContext& context, ProgramCache& cache,
+                             const QString& vertex,
+                             const QString& fragment) noexcept {
+  Q_ASSERT(&context == QOpenGLContext::currentContext());
+
+  CompiledProgram result;
+  shared_ptr<QOpenGLShaderProgram> program =
+    std::make_shared<QOpenGLShaderProgram>();
+
+  QByteArray key = cache.key({vertex, fragment});
+  bool cached = cache.isCreated() && program->create() &&
+                cache.load(key, program->programId(), result.uniforms) &&
+                program->link();
+  // With no shaders attached, link() just picks up the binary's link status
+
+  if (!cached) {
+    bool vert = program->addShaderFromSourceCode(QOpenGLShader::Vertex, vertex);
+    bool frag = program->addShaderFromSourceCode(QOpenGLShader::Fragment,
+                                                 fragment);
+    bool link = false;
+
+    if (Q_UNLIKELY(!vert)) {
+      qCWarning(logs::shader::Name) << "Couldn't compile vertex shader";
+    }
+
+    if (Q_UNLIKELY(!frag)) {
+      qCWarning(logs::shader::Name) << "Couldn't compile fragment shader";
+    }
+
+    if (vert && frag) {
+      bindAttributeLocations(*program);
+      cache.prepare(program->programId());
+      link = program->link();
+
+      if (Q_UNLIKELY(!link)) {
+        qCWarning(logs::shader::Name) << "Couldn't link shaders together";
+      }
+    }
+
+    result.log = program->log();
+
+    if (Q_UNLIKELY(!link)) {
+      qCWarning(logs::shader::Name) << result.log;
+      return result;
+    }
+
+    result.uniforms = activeUniforms(*context.functions(),
+                                     program->programId());
+    cache.store(key, program->programId(), result.uniforms);
+  }
+
+  result.program = program;
+  return result;
+}
+
+CompileWorker::CompileWorker(QOpenGLContext* context,
+                             QOffscreenSurface* surface, QThread* home,
+                             const atomic<int>& latest,
+                             ProgramCache& cache) noexcept
+  : _context(context),
+    _surface(surface),
+    _home(home),
+    _latest(latest),
+    _cache(cache),
+    _initialized(false) {
+}
+
+CompileWorker::~CompileWorker() {
+  _context->doneCurrent();
+  delete _context;
+}
+
+void CompileWorker::compile(const int request, const QString& vertex,
+                            const QString& fragment) noexcept {
+  if (request != _latest) {
+    // The user's still typing; only the newest shaders matter
+    return;
+  }
+
+  CompiledProgram result;
+
+  if (_makeCurrent()) {
+    result = buildProgram(*_context, _cache, vertex, fragment);
+  }
+  else {
+    result.log = tr("Couldn't make the shader compiler's context current");
+  }
+
+  result.request = request;
+
+  if (result.program) {
+    _context->functions()->glFinish();
+    // The canvas's context may use the program as soon as it gets it
+
+    result.program->moveToThread(_home);
+  }
+
+  emit compiled(result);
+}
+
+bool CompileWorker::_makeCurrent() noexcept {
+  if (!_context->makeCurrent(_surface)) {
+    qCWarning(logs::shader::Name) << "Couldn't make the compiler's context current";
+    return false;
+  }
+
+  if (_initialized) {
+    return true;
+  }
+
+  _initialized = true;
+
+  auto gl41 = _context->versionFunctions<QOpenGLFunctions_4_1_Core>();
+  _cache.create((gl41 != nullptr && gl41->initializeOpenGLFunctions()) ? gl41
+                : nullptr);
+  // The cache was set up with the canvas's functions; from now on, only this
+  // thread uses it
+
+  const char* function = nullptr;
+
+  if (_context->hasExtension("GL_KHR_parallel_shader_compile")) {
+    function = "glMaxShaderCompilerThreadsKHR";
+  }
+  else if (_context->hasExtension("GL_ARB_parallel_shader_compile")) {
+    function = "glMaxShaderCompilerThreadsARB";
+  }
+
+  if (function != nullptr) {
+    auto maxThreads = reinterpret_cast<MaxShaderCompilerThreads>(
+                        _context->getProcAddress(function));
+
+    if (maxThreads != nullptr) {
+      maxThreads(ALL_THREADS);
+      qCDebug(logs::gl::Feature) << "Compiling shaders with" << function;
+    }
+  }
+
+  return true;
+}
+
+ShaderCompiler::ShaderCompiler(QObject* parent) noexcept
+  : QObject(parent),
+    _surface(nullptr),
+    _worker(nullptr),
+    _request(0) {
+  qRegisterMetaType<CompiledProgram>();
+}
+
+ShaderCompiler::~ShaderCompiler() {
+  destroy();
+}
+
+bool ShaderCompiler::create(QOpenGLContext* share,
+                            ProgramCache* cache) noexcept {
+  Q_ASSERT(share != nullptr);
+  Q_ASSERT(cache != nullptr);
+  Q_ASSERT(_worker == nullptr);
+
+  QOpenGLContext* context = new QOpenGLContext;
+  context->setFormat(share->format());
+  context->setShareContext(share);
+
+  if (!context->create() || !QOpenGLContext::areSharing(context, share)) {
+    qCWarning(logs::gl::Feature) << "Couldn't create a shared context; "
+                                    "shaders will be compiled on the GUI thread";
+    delete context;
+    return false;
+  }
+
+  _surface = new QOffscreenSurface;
+  _surface->setFormat(context->format());
+  _surface->create();
+
+  if (!_surface->isValid()) {
+    qCWarning(logs::gl::Feature) << "Couldn't create an offscreen surface; "
+                                    "shaders will be compiled on the GUI thread";
+    delete context;
+    delete _surface;
+    _surface = nullptr;
+    return false;
+  }
+
+  context->moveToThread(&_thread);
+  _worker = new CompileWorker(context, _surface, thread(), _request, *cache);
+  _worker->moveToThread(&_thread);
+
+  connect(&_thread, &QThread::finished, _worker, &QObject::deleteLater);
+  connect(_worker, &CompileWorker::compiled, this,
+  [this](const CompiledProgram & result) {
+    if (result.request == _request) {
+      emit compiled(result);
+    }
+    else {
+      qCDebug(logs::shader::Name) << "Dropped program" << result.request
+                                  << "; request" << _request << "replaced it";
+    }
+  });
+
+  _thread.setObjectName("Shader Compiler");
+  _thread.start();
+
+  qCDebug(logs::gl::Feature) << "Compiling shaders on a shared context";
+  return true;
+}
+
+void ShaderCompiler::destroy() noexcept {
+  if (_worker == nullptr) {
+    return;
+  }
+
+  _thread.quit();
+  _thread.wait();
+  // The worker deletes itself (and its context) once the thread finishes
+
+  _worker = nullptr;
+  delete _surface;
+  _surface = nullptr;
+}
+
+int ShaderCompiler::compile(const QString& vertex,
+                            const QString& fragment) noexcept {
+  Q_ASSERT(_worker != nullptr);
+
+  int request = ++_request;
+  QMetaObject::invokeMethod(_worker, "compile", Qt::QueuedConnection,
+                            Q_ARG(int, request), Q_ARG(QString, vertex),
+                            Q_ARG(QString, fragment));
+  return request;
+}
+}
+}
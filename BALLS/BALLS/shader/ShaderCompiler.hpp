@@ -0,0 +1,133 @@
+#ifndef SHADERCOMPILER_HPP
+#define SHADERCOMPILER_HPP
+
+#include <atomic>
+#include <memory>
+
+#include <QtCore/QMetaType>
+#include <QtCore/QObject>
+#include <QtCore/QString>
+#include <QtCore/QThread>
+
+#include "shader/ProgramCache.hpp"
+#include "util/TypeInfo.hpp"
+
+class QOffscreenSurface;
+class QOpenGLContext;
+class QOpenGLShaderProgram;
+
+namespace balls {
+namespace shader {
+
+using std::atomic;
+using std::shared_ptr;
+using balls::util::types::UniformCollection;
+
+/// What compiling a pair of shaders came to
+struct CompiledProgram {
+  /// Which call to ShaderCompiler::compile() this answers
+  int request = 0;
+
+  /// The linked program, or null if it didn't compile or link
+  shared_ptr<QOpenGLShaderProgram> program;
+
+  UniformCollection uniforms;
+
+  /// The compiler's and linker's messages
+  QString log;
+};
+
+/**
+ * @brief Compiles and links a new program on the current context, or loads
+ * it from the cache; the program's attribute locations are bound first.
+ */
+CompiledProgram buildProgram(QOpenGLContext&, ProgramCache&,
+                             const QString& vertex,
+                             const QString& fragment) noexcept;
+
+/// Does the compiling for ShaderCompiler; lives on its thread
+class CompileWorker : public QObject {
+  Q_OBJECT
+
+public:
+  /**
+   * @brief Takes ownership of the context, which must already be on this
+   * thread; programs are moved to home once built. Requests older than latest
+   * are skipped without being compiled. The cache is rebound to the context's
+   * functions the first time it's made current, but it stays the caller's to
+   * destroy() once this is gone.
+   */
+  CompileWorker(QOpenGLContext*, QOffscreenSurface*, QThread* home,
+                const atomic<int>& latest, ProgramCache& cache) noexcept;
+  ~CompileWorker();
+
+public slots:
+  void compile(const int request, const QString& vertex,
+               const QString& fragment) noexcept;
+
+signals:
+  void compiled(const balls::shader::CompiledProgram&);
+
+private:
+  bool _makeCurrent() noexcept;
+
+  QOpenGLContext* _context;
+  QOffscreenSurface* _surface;
+  QThread* _home;
+  const atomic<int>& _latest;
+  ProgramCache& _cache;
+  bool _initialized;
+};
+
+/**
+ * @brief Compiles shaders on a worker thread with a context of its own, shared
+ * with the canvas's, so a big shader doesn't freeze the editor.
+ *
+ * Programs are shared between the contexts, so the canvas can draw with the
+ * new one as soon as it arrives, and keep drawing with the old one until
+ * then (or for good, if the new one doesn't link). Uses
+ * GL_KHR_parallel_shader_compile if the driver has it.
+ */
+class ShaderCompiler : public QObject {
+  Q_OBJECT
+
+public:
+  explicit ShaderCompiler(QObject* parent = nullptr) noexcept;
+  ~ShaderCompiler();
+
+  /**
+   * @brief Needs the context to share with to be current. Programs are cached
+   * in the given cache, which the compiler's thread takes over; it mustn't be
+   * used elsewhere until destroy() is called. It still belongs to the caller,
+   * who must then destroy() it, since it may be bound to the compiler's
+   * context's functions.
+   */
+  bool create(QOpenGLContext* share, ProgramCache* cache) noexcept;
+
+  /// Waits for the compile in progress (if any) and stops the thread
+  void destroy() noexcept;
+
+  bool isCreated() const noexcept { return _worker != nullptr; }
+
+  /// Starts compiling; returns the request's number
+  int compile(const QString& vertex, const QString& fragment) noexcept;
+
+signals:
+  /**
+   * @brief Emitted on this object's thread with the newest request's program;
+   * anything older that finishes after a newer request was made is dropped.
+   */
+  void compiled(const balls::shader::CompiledProgram&);
+
+private:
+  QThread _thread;
+  QOffscreenSurface* _surface;
+  CompileWorker* _worker;
+  atomic<int> _request;
+};
+}
+}
+
+Q_DECLARE_METATYPE(balls::shader::CompiledProgram)
+
+#endif // SHADERCOMPILER_HPP
@@ -1,12 +1,18 @@
 #include "precompiled.hpp"
 #include "shader/ShaderInputs.hpp"
 
+#include <QtGui/QOpenGLShaderProgram>
+
 namespace balls {
 namespace shader {
 
 namespace attribute {
 const AttributeName POSITION = "position";
 const AttributeName NORMAL = "normal";
+
+const AttributeName INSTANCE_TRANSFORM = "instanceTransform";
+const AttributeName INSTANCE_COLOR = "instanceColor";
+const AttributeName INSTANCE_ID = "instanceID";
 }
 
 namespace uniform {
@@ -26,5 +32,16 @@ const UniformName TRACKBALL = "trackball";
 namespace out {
 const OutName FRAGMENT = "fragment";
 }
+
+void bindAttributeLocations(QOpenGLShaderProgram& program) noexcept {
+  using namespace attribute;
+
+  program.bindAttributeLocation(POSITION, POSITION_LOCATION);
+  program.bindAttributeLocation(NORMAL, NORMAL_LOCATION);
+  program.bindAttributeLocation(INSTANCE_TRANSFORM,
+                                INSTANCE_TRANSFORM_LOCATION);
+  program.bindAttributeLocation(INSTANCE_COLOR, INSTANCE_COLOR_LOCATION);
+  program.bindAttributeLocation(INSTANCE_ID, INSTANCE_ID_LOCATION);
+}
 }
 }
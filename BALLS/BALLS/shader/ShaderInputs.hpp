@@ -1,6 +1,9 @@
 #ifndef SHADERINPUTS_HPP
 #define SHADERINPUTS_HPP
 
+#include <QtGui/qopengl.h>
+
+class QOpenGLShaderProgram;
 class QString;
 
 namespace balls {
@@ -13,8 +16,24 @@ using OutName = QString;
 namespace attribute {
 extern const AttributeName POSITION;
 extern const AttributeName NORMAL;
+
+// Per-instance; see mesh::Instance
+extern const AttributeName INSTANCE_TRANSFORM;
+extern const AttributeName INSTANCE_COLOR;
+extern const AttributeName INSTANCE_ID;
 }
 
+constexpr GLuint POSITION_LOCATION = 0;
+constexpr GLuint NORMAL_LOCATION = 1;
+constexpr GLuint INSTANCE_TRANSFORM_LOCATION = 8;
+constexpr GLuint INSTANCE_COLOR_LOCATION = 12;
+constexpr GLuint INSTANCE_ID_LOCATION = 13;
+// Bound before linking, so they're the same in every program; the transform
+// is a mat4, so it takes up four locations
+
+/// Binds the attributes above to their locations; call before linking
+void bindAttributeLocations(QOpenGLShaderProgram&) noexcept;
+
 namespace uniform {
 extern const UniformName MODEL;
 extern const UniformName VIEW;
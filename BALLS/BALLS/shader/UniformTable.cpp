@@ -0,0 +1,385 @@
+#include "precompiled.hpp"
+#include "shader/UniformTable.hpp"
+
+#include <algorithm>
+#include <array>
+#include <unordered_map>
+#include <utility>
+
+#include <QtGui/QOpenGLFunctions>
+#include <QtGui/QOpenGLFunctions_3_0>
+#include <QtGui/QOpenGLFunctions_4_0_Core>
+
+#include "ui/Uniforms.hpp"
+#include "util/Logging.hpp"
+#include "util/Util.hpp"
+
+namespace balls {
+namespace shader {
+
+using std::pair;
+using std::unordered_map;
+using Functions = UniformTable::Functions;
+using Upload = UniformTable::Upload;
+using GL30 = QOpenGLFunctions_3_0;
+using GL40 = QOpenGLFunctions_4_0_Core;
+
+template<class From, class To = From>
+static bool _assign(UniformSlot& slot, const QVariant& value) noexcept {
+  if (!value.canConvert<From>()) {
+    return false;
+  }
+
+  slot.set(To(value.value<From>()));
+  return true;
+}
+
+bool UniformSlot::assign(const QVariant& value) noexcept {
+  switch (type) {
+  case GL_FLOAT:
+    return _assign<float>(*this, value);
+
+  case GL_FLOAT_VEC2:
+    return _assign<vec2>(*this, value);
+
+  case GL_FLOAT_VEC3:
+    return _assign<vec3>(*this, value);
+
+  case GL_FLOAT_VEC4:
+    return _assign<vec4>(*this, value);
+
+  case GL_DOUBLE:
+    return _assign<double>(*this, value);
+
+  case GL_DOUBLE_VEC2:
+    return _assign<dvec2>(*this, value);
+
+  case GL_DOUBLE_VEC3:
+    return _assign<dvec3>(*this, value);
+
+  case GL_DOUBLE_VEC4:
+    return _assign<dvec4>(*this, value);
+
+  case GL_INT:
+    return _assign<int>(*this, value);
+
+  case GL_INT_VEC2:
+    return _assign<ivec2>(*this, value);
+
+  case GL_INT_VEC3:
+    return _assign<ivec3>(*this, value);
+
+  case GL_INT_VEC4:
+    return _assign<ivec4>(*this, value);
+
+  case GL_UNSIGNED_INT:
+    return _assign<unsigned int>(*this, value);
+
+  case GL_UNSIGNED_INT_VEC2:
+    return _assign<uvec2>(*this, value);
+
+  case GL_UNSIGNED_INT_VEC3:
+    return _assign<uvec3>(*this, value);
+
+  case GL_UNSIGNED_INT_VEC4:
+    return _assign<uvec4>(*this, value);
+
+  // glUniform*i() is how bools are set, so store them as ints
+  case GL_BOOL:
+    return _assign<bool, GLint>(*this, value);
+
+  case GL_BOOL_VEC2:
+    return _assign<bvec2, ivec2>(*this, value);
+
+  case GL_BOOL_VEC3:
+    return _assign<bvec3, ivec3>(*this, value);
+
+  case GL_BOOL_VEC4:
+    return _assign<bvec4, ivec4>(*this, value);
+
+  case GL_FLOAT_MAT2:
+    return _assign<mat2>(*this, value);
+
+  case GL_FLOAT_MAT2x3:
+    return _assign<mat2x3>(*this, value);
+
+  case GL_FLOAT_MAT2x4:
+    return _assign<mat2x4>(*this, value);
+
+  case GL_FLOAT_MAT3x2:
+    return _assign<mat3x2>(*this, value);
+
+  case GL_FLOAT_MAT3:
+    return _assign<mat3>(*this, value);
+
+  case GL_FLOAT_MAT3x4:
+    return _assign<mat3x4>(*this, value);
+
+  case GL_FLOAT_MAT4x2:
+    return _assign<mat4x2>(*this, value);
+
+  case GL_FLOAT_MAT4x3:
+    return _assign<mat4x3>(*this, value);
+
+  case GL_FLOAT_MAT4:
+    return _assign<mat4>(*this, value);
+
+  case GL_DOUBLE_MAT2:
+    return _assign<dmat2>(*this, value);
+
+  case GL_DOUBLE_MAT2x3:
+    return _assign<dmat2x3>(*this, value);
+
+  case GL_DOUBLE_MAT2x4:
+    return _assign<dmat2x4>(*this, value);
+
+  case GL_DOUBLE_MAT3x2:
+    return _assign<dmat3x2>(*this, value);
+
+  case GL_DOUBLE_MAT3:
+    return _assign<dmat3>(*this, value);
+
+  case GL_DOUBLE_MAT3x4:
+    return _assign<dmat3x4>(*this, value);
+
+  case GL_DOUBLE_MAT4x2:
+    return _assign<dmat4x2>(*this, value);
+
+  case GL_DOUBLE_MAT4x3:
+    return _assign<dmat4x3>(*this, value);
+
+  case GL_DOUBLE_MAT4:
+    return _assign<dmat4>(*this, value);
+
+  default:
+    return false;
+  }
+}
+
+template<class T, void (GL30::*F)(GLint, GLsizei, const T*)>
+static void _vector(const Functions& gl, const GLint location,
+                    const void* value) noexcept {
+  (gl.gl30->*F)(location, 1, static_cast<const T*>(value));
+}
+
+template<void (GL30::*F)(GLint, GLsizei, GLboolean, const GLfloat*)>
+static void _matrix(const Functions& gl, const GLint location,
+                    const void* value) noexcept {
+  (gl.gl30->*F)(location, 1, GL_FALSE, static_cast<const GLfloat*>(value));
+}
+
+template<void (GL40::*F)(GLint, GLsizei, const GLdouble*)>
+static void _dvector(const Functions& gl, const GLint location,
+                     const void* value) noexcept {
+  (gl.gl40->*F)(location, 1, static_cast<const GLdouble*>(value));
+}
+
+template<void (GL40::*F)(GLint, GLsizei, GLboolean, const GLdouble*)>
+static void _dmatrix(const Functions& gl, const GLint location,
+                     const void* value) noexcept {
+  (gl.gl40->*F)(location, 1, GL_FALSE, static_cast<const GLdouble*>(value));
+}
+
+// Without OpenGL 4.0, doubles are sent as floats (as they always were)
+template<size_t N, Upload FloatUpload>
+static void _narrow(const Functions& gl, const GLint location,
+                    const void* value) noexcept {
+  const GLdouble* d = static_cast<const GLdouble*>(value);
+  std::array<GLfloat, N> f;
+  std::copy(d, d + N, f.begin());
+  FloatUpload(gl, location, f.data());
+}
+
+// The function that uploads each type, and for doubles, the one to use instead
+// without OpenGL 4.0; bools are stored as ints, so they're uploaded like them
+static const unordered_map<GLenum, pair<Upload, Upload>>& _uploads() noexcept {
+  static const unordered_map<GLenum, pair<Upload, Upload>> uploads = {
+    {GL_FLOAT, {_vector<GLfloat, &GL30::glUniform1fv>, nullptr}},
+    {GL_FLOAT_VEC2, {_vector<GLfloat, &GL30::glUniform2fv>, nullptr}},
+    {GL_FLOAT_VEC3, {_vector<GLfloat, &GL30::glUniform3fv>, nullptr}},
+    {GL_FLOAT_VEC4, {_vector<GLfloat, &GL30::glUniform4fv>, nullptr}},
+    {GL_INT, {_vector<GLint, &GL30::glUniform1iv>, nullptr}},
+    {GL_INT_VEC2, {_vector<GLint, &GL30::glUniform2iv>, nullptr}},
+    {GL_INT_VEC3, {_vector<GLint, &GL30::glUniform3iv>, nullptr}},
+    {GL_INT_VEC4, {_vector<GLint, &GL30::glUniform4iv>, nullptr}},
+    {GL_UNSIGNED_INT, {_vector<GLuint, &GL30::glUniform1uiv>, nullptr}},
+    {GL_UNSIGNED_INT_VEC2, {_vector<GLuint, &GL30::glUniform2uiv>, nullptr}},
+    {GL_UNSIGNED_INT_VEC3, {_vector<GLuint, &GL30::glUniform3uiv>, nullptr}},
+    {GL_UNSIGNED_INT_VEC4, {_vector<GLuint, &GL30::glUniform4uiv>, nullptr}},
+    {GL_BOOL, {_vector<GLint, &GL30::glUniform1iv>, nullptr}},
+    {GL_BOOL_VEC2, {_vector<GLint, &GL30::glUniform2iv>, nullptr}},
+    {GL_BOOL_VEC3, {_vector<GLint, &GL30::glUniform3iv>, nullptr}},
+    {GL_BOOL_VEC4, {_vector<GLint, &GL30::glUniform4iv>, nullptr}},
+    {GL_FLOAT_MAT2, {_matrix<&GL30::glUniformMatrix2fv>, nullptr}},
+    {GL_FLOAT_MAT2x3, {_matrix<&GL30::glUniformMatrix2x3fv>, nullptr}},
+    {GL_FLOAT_MAT2x4, {_matrix<&GL30::glUniformMatrix2x4fv>, nullptr}},
+    {GL_FLOAT_MAT3x2, {_matrix<&GL30::glUniformMatrix3x2fv>, nullptr}},
+    {GL_FLOAT_MAT3, {_matrix<&GL30::glUniformMatrix3fv>, nullptr}},
+    {GL_FLOAT_MAT3x4, {_matrix<&GL30::glUniformMatrix3x4fv>, nullptr}},
+    {GL_FLOAT_MAT4x2, {_matrix<&GL30::glUniformMatrix4x2fv>, nullptr}},
+    {GL_FLOAT_MAT4x3, {_matrix<&GL30::glUniformMatrix4x3fv>, nullptr}},
+    {GL_FLOAT_MAT4, {_matrix<&GL30::glUniformMatrix4fv>, nullptr}},
+    {
+      GL_DOUBLE, {
+        _dvector<&GL40::glUniform1dv>,
+        _narrow<1, _vector<GLfloat, &GL30::glUniform1fv>>
+      }
+    },
+    {
+      GL_DOUBLE_VEC2, {
+        _dvector<&GL40::glUniform2dv>,
+        _narrow<2, _vector<GLfloat, &GL30::glUniform2fv>>
+      }
+    },
+    {
+      GL_DOUBLE_VEC3, {
+        _dvector<&GL40::glUniform3dv>,
+        _narrow<3, _vector<GLfloat, &GL30::glUniform3fv>>
+      }
+    },
+    {
+      GL_DOUBLE_VEC4, {
+        _dvector<&GL40::glUniform4dv>,
+        _narrow<4, _vector<GLfloat, &GL30::glUniform4fv>>
+      }
+    },
+    {
+      GL_DOUBLE_MAT2, {
+        _dmatrix<&GL40::glUniformMatrix2dv>,
+        _narrow<4, _matrix<&GL30::glUniformMatrix2fv>>
+      }
+    },
+    {
+      GL_DOUBLE_MAT2x3, {
+        _dmatrix<&GL40::glUniformMatrix2x3dv>,
+        _narrow<6, _matrix<&GL30::glUniformMatrix2x3fv>>
+      }
+    },
+    {
+      GL_DOUBLE_MAT2x4, {
+        _dmatrix<&GL40::glUniformMatrix2x4dv>,
+        _narrow<8, _matrix<&GL30::glUniformMatrix2x4fv>>
+      }
+    },
+    {
+      GL_DOUBLE_MAT3x2, {
+        _dmatrix<&GL40::glUniformMatrix3x2dv>,
+        _narrow<6, _matrix<&GL30::glUniformMatrix3x2fv>>
+      }
+    },
+    {
+      GL_DOUBLE_MAT3, {
+        _dmatrix<&GL40::glUniformMatrix3dv>,
+        _narrow<9, _matrix<&GL30::glUniformMatrix3fv>>
+      }
+    },
+    {
+      GL_DOUBLE_MAT3x4, {
+        _dmatrix<&GL40::glUniformMatrix3x4dv>,
+        _narrow<12, _matrix<&GL30::glUniformMatrix3x4fv>>
+      }
+    },
+    {
+      GL_DOUBLE_MAT4x2, {
+        _dmatrix<&GL40::glUniformMatrix4x2dv>,
+        _narrow<8, _matrix<&GL30::glUniformMatrix4x2fv>>
+      }
+    },
+    {
+      GL_DOUBLE_MAT4x3, {
+        _dmatrix<&GL40::glUniformMatrix4x3dv>,
+        _narrow<12, _matrix<&GL30::glUniformMatrix4x3fv>>
+      }
+    },
+    {
+      GL_DOUBLE_MAT4, {
+        _dmatrix<&GL40::glUniformMatrix4dv>,
+        _narrow<16, _matrix<&GL30::glUniformMatrix4fv>>
+      }
+    }
+  };
+
+  return uploads;
+}
+
+UniformCollection activeUniforms(QOpenGLFunctions& gl,
+                                 const GLuint program) noexcept {
+  std::array<GLchar, 128> name;
+  GLsizei length = 0;
+  GLint size = 0;
+  GLenum type = 0;
+  int count = 0;
+  gl.glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+
+  UniformCollection uniforms;
+  uniforms.reserve(count);
+
+  for (int i = 0; i < count; ++i) {
+    gl.glGetActiveUniform(program, i, name.size() - 1, &length, &size, &type,
+                          name.data());
+    QString sname(name.data());
+    Q_ASSERT(sname.size() == length);
+
+    uniforms.push_back({sname, i, type, size});
+  }
+
+  return uniforms;
+}
+
+void UniformTable::build(const Functions& gl, const GLuint program,
+                         const UniformCollection& uniforms,
+                         const Uniforms& values) noexcept {
+  Q_ASSERT(gl.gl30 != nullptr);
+
+  _gl = gl;
+  _bindings.clear();
+  _bindings.reserve(uniforms.size());
+
+  const auto& uploads = _uploads();
+
+  for (const util::types::UniformInfo& info : uniforms) {
+    auto upload = uploads.find(info.type);
+    const UniformSlot* slot = values.slot(info.name);
+
+    GLint location = gl.gl30->glGetUniformLocation(program,
+                     qPrintable(info.name));
+
+    if (location == -1) {
+      // Built-in GLSL variables (gl_*) are active, but can't be set
+      continue;
+    }
+
+    if (upload == uploads.end() || slot == nullptr) {
+      qCWarning(logs::uniform::Type)
+          << "Can't upload" << util::resolveGLType(info.type) << info.name;
+      continue;
+    }
+
+    const pair<Upload, Upload>& functions = upload->second;
+    Upload function = (gl.gl40 == nullptr && functions.second != nullptr) ?
+                      functions.second : functions.first;
+    _bindings.push_back({location, function, slot, slot->version - 1});
+    // Out of date on purpose, since a newly-linked program has no values yet
+  }
+
+  qCDebug(logs::uniform::Name) << "Bound" << _bindings.size() << "of"
+                               << uniforms.size() << "uniforms";
+}
+
+size_t UniformTable::upload() noexcept {
+  size_t uploaded = 0;
+
+  for (Binding& binding : _bindings) {
+    unsigned version = binding.slot->version;
+
+    if (version != binding.uploaded) {
+      binding.upload(_gl, binding.location, binding.slot->data);
+      binding.uploaded = version;
+      ++uploaded;
+    }
+  }
+
+  return uploaded;
+}
+}
+}
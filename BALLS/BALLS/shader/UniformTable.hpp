@@ -0,0 +1,114 @@
+#ifndef UNIFORMTABLE_HPP
+#define UNIFORMTABLE_HPP
+
+#include <cstring>
+#include <vector>
+
+#include <QtCore/QString>
+#include <QtCore/QVariant>
+#include <QtGui/qopengl.h>
+
+#include <glm/mat4x4.hpp>
+
+#include "util/TypeInfo.hpp"
+
+class QOpenGLFunctions;
+class QOpenGLFunctions_3_0;
+class QOpenGLFunctions_4_0_Core;
+
+namespace balls {
+
+class Uniforms;
+
+namespace shader {
+
+using std::vector;
+using balls::util::types::UniformCollection;
+
+/**
+ * @brief Where one uniform's value is kept between frames, already laid out
+ * the way glUniform*() expects it (e.g. bools as GLints, matrices
+ * column-major), along with how many times it has changed.
+ */
+struct UniformSlot {
+  alignas(glm::dmat4) unsigned char data[sizeof(glm::dmat4)] = {};
+  // Big enough for anything GLSL has short of an array
+
+  /// The GLSL type the data is stored as
+  GLenum type = GL_NONE;
+
+  /// Bumped whenever the data actually changes
+  unsigned version = 0;
+
+  template<class T>
+  void set(const T& value) noexcept {
+    static_assert(sizeof(T) <= sizeof(data), "Too big for a uniform slot");
+
+    if (std::memcmp(data, &value, sizeof(T)) != 0) {
+      std::memcpy(data, &value, sizeof(T));
+      ++version;
+    }
+  }
+
+  /**
+   * @brief Converts value to this slot's type and stores it; returns false
+   * (and leaves the slot alone) if it can't be converted.
+   */
+  bool assign(const QVariant& value) noexcept;
+};
+
+/// Lists every active uniform of the given program, which must be linked
+UniformCollection activeUniforms(QOpenGLFunctions&, const GLuint) noexcept;
+
+/**
+ * @brief Every active uniform of a linked program, resolved once per link:
+ * each has its location, an upload function chosen for its type (and for
+ * what the context supports), and the slot its value comes from.
+ *
+ * Each frame, only uniforms whose slots changed since their last upload are
+ * sent; a program keeps its uniforms' values until it's relinked, so the rest
+ * are still there.
+ */
+class UniformTable {
+public:
+  /// The function tables the upload functions call
+  struct Functions {
+    QOpenGLFunctions_3_0* gl30;
+    QOpenGLFunctions_4_0_Core* gl40;
+  };
+
+  using Upload = void (*)(const Functions&, const GLint, const void*);
+
+  struct Binding {
+    GLint location;
+    Upload upload;
+    const UniformSlot* slot;
+
+    /// The slot's version as of the last upload
+    unsigned uploaded;
+  };
+
+  /**
+   * @brief Builds the table for the given program, which must be current and
+   * linked; every binding is uploaded at least once. Uniforms of types that
+   * can't be uploaded are logged and left out.
+   */
+  void build(const Functions&, const GLuint program,
+             const UniformCollection&, const Uniforms&) noexcept;
+
+  /// Forgets every binding, e.g. if the program failed to link
+  void clear() noexcept { _bindings.clear(); }
+
+  /// Sends every uniform that changed to the current program
+  size_t upload() noexcept;
+
+  size_t size() const noexcept { return _bindings.size(); }
+
+private:
+  Functions _gl = {nullptr, nullptr};
+  vector<Binding> _bindings;
+};
+}
+}
+
+#endif // UNIFORMTABLE_HPP
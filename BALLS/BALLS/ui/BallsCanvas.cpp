@@ -1,8 +1,11 @@
 #include "precompiled.hpp"
 #include "ui/BallsCanvas.hpp"
 
+#include <cstddef>
 #include <stdexcept>
 
+#include <QtConcurrent/QtConcurrentRun>
+#include <QtCore/QFile>
 #include <QtGui/QCursor>
 #include <QtGui/QOpenGLContext>
 #include <QtGui/QOpenGLFunctions_3_0>
@@ -16,16 +19,27 @@
 #include <QtGui/QSurfaceFormat>
 #include <QtWidgets/QOpenGLWidget>
 
+#include <glm/gtc/constants.hpp>
+
 #include "util/Logging.hpp"
 #include "util/Util.hpp"
 #include "Constants.hpp"
+#include "exception/FileException.hpp"
+#include "mesh/Clusters.hpp"
+#include "mesh/Importer.hpp"
+#include "mesh/Instancing.hpp"
 #include "mesh/Mesh.hpp"
+#include "mesh/MeshFile.hpp"
 #include "mesh/MeshGenerator.hpp"
+#include "mesh/MeshOptimizer.hpp"
+#include "mesh/Procedural.hpp"
+#include "mesh/Simplifier.hpp"
 #include "config/Settings.hpp"
 #include "ui/BallsWindow.hpp"
 
 namespace balls {
 
+using std::function;
 using std::pair;
 using std::runtime_error;
 using std::vector;
@@ -55,18 +69,41 @@ constexpr FormatOptions FLAGS(FORMAT_OPTION | RENDER_TYPE | PROFILE |
 
 constexpr UsagePattern USAGE_PATTERN = UsagePattern::StaticDraw;
 
+constexpr int DEFAULT_MESH_CACHE_MB = 256;
+constexpr size_t MB = 1024 * 1024;
+
+constexpr int DEFAULT_LOD_LEVELS = 4;
+constexpr float PIXELS_PER_TRIANGLE = 8;
+// Denser than this and triangles are smaller than the pixels they land in
+
+constexpr int DEFAULT_INSTANCE_COUNT = 1;
+
 constexpr float DEFAULT_ZOOM = -8;
 constexpr float TRACKBALL_RADIUS = 1;
 
 BallsCanvas::BallsCanvas(QWidget* parent)
   : QOpenGLWidget(parent),
+    _meshgen(nullptr),
+    _meshCache(DEFAULT_MESH_CACHE_MB * MB),
+    _meshJobRequest(0),
+    _meshRequest(0),
+    _hasPendingMesh(false),
+    _indexType(GL_UNSIGNED_SHORT),
+    _indexCount(0),
+    _lod(0),
+    _instanceCount(DEFAULT_INSTANCE_COUNT),
+    _instanceScale(1),
+    _instancesMoved(false),
+    _procedural(mesh::ProceduralShape::None),
+    _hasPendingShape(false),
     _uniforms(nullptr),
-    _uniformsMeta(_uniforms.metaObject()),
-    _uniformsPropertyOffset(_uniformsMeta->propertyOffset()),
-    _uniformsPropertyCount(_uniformsMeta->propertyCount()),
+    _scheduler(this),
+    _usesBuiltinBlock(false),
     _log(nullptr),
     _vbo(QOpenGLBuffer::VertexBuffer),
     _ibo(QOpenGLBuffer::IndexBuffer),
+    _instanceVbo(QOpenGLBuffer::VertexBuffer),
+    _shader(new QOpenGLShaderProgram),
     _gl30(nullptr),
     _gl31(nullptr),
     _gl32(nullptr),
@@ -85,18 +122,62 @@ BallsCanvas::BallsCanvas(QWidget* parent)
   // ^ So it will show up
   // TODO: Handle uniforms whose names start with "_" or "_q_" or even "__"
 
+  connect(&_uniforms, &Uniforms::edited, &_scheduler, [this]() {
+    _scheduler.invalidate(FrameScheduler::Uniforms);
+  });
+  connect(&_uniforms, &Uniforms::moved, &_scheduler, [this]() {
+    _scheduler.invalidate(FrameScheduler::Input);
+  });
+
+  connect(&_meshJob, &QFutureWatcherBase::finished, this,
+          &BallsCanvas::_receiveMesh);
+  connect(&_compiler, &ShaderCompiler::compiled, this,
+          &BallsCanvas::_receiveProgram);
+
+  connect(&_capture, &util::FrameCapture::stopped, this, [this]() {
+    _scheduler.setAnimating(_uniforms.animated());
+    emit captureStopped();
+  });
+  connect(&_capture, &util::FrameCapture::failed, this,
+  [this](const QString& message) {
+    emit graphicsWarning(tr("Capture failed"), message);
+  });
 }
 
 BallsCanvas::~BallsCanvas() {
+  _queuedMesh.reset();
+  ++_meshRequest;
+  _meshJob.waitForFinished();
+  // The job refers to _meshRequest, so it can't outlive us
+
+  makeCurrent();
+  // Deleting GL objects needs our context, which may not be current here
+
+  _shader->release();
+  _shader.reset();
+  // The program was linked on the compiler's context (unless that couldn't be
+  // made), but programs are shared between the two, so deleting it with ours
+  // current frees it now, before either context goes away
+
   _ibo.release();
   _vbo.release();
   _vao.release();
   _ibo.destroy();
   _vbo.destroy();
+  _instanceVbo.destroy();
   _vao.destroy();
-  _shader.disableAttributeArray(_attributes[attribute::POSITION]);
-  _shader.disableAttributeArray(_attributes[attribute::NORMAL]);
-  _shader.removeAllShaders();
+  _proceduralVao.destroy();
+  _builtinBlock.destroy();
+  _profiler.destroy();
+  _pipelineStats.destroy();
+  _capture.disconnect();
+  _capture.destroy();
+  doneCurrent();
+
+  _compiler.destroy();
+  // Only once we're done with our context, which its context shares with
+  _programCache.destroy();
+  // Its thread may have been using the cache up to now; only we destroy it
 }
 
 void BallsCanvas::initializeGL() {
@@ -113,7 +194,6 @@ void BallsCanvas::initializeGL() {
   //_updateUniformList();
 
   this->finishedInitializing();
-  this->startTimer(1000.f / 60, Qt::PreciseTimer);
 }
 
 void BallsCanvas::_initSettings() noexcept {
@@ -121,6 +201,17 @@ void BallsCanvas::_initSettings() noexcept {
   this->_settings[SettingKey::DepthTestEnabled] = {true, true};
   this->_settings[SettingKey::FaceCullingEnabled] = {true, true};
   this->_settings[SettingKey::Dithering] = {true, true};
+  this->_settings[SettingKey::MeshCacheSize] = {DEFAULT_MESH_CACHE_MB};
+  this->_settings[SettingKey::MeshCacheGpu] = {true};
+  this->_settings[SettingKey::MeshOptimize] = {true};
+  this->_settings[SettingKey::MeshKeepCpu] = {false};
+  this->_settings[SettingKey::PositionFormat] = {0};
+  this->_settings[SettingKey::NormalFormat] = {0};
+  this->_settings[SettingKey::MeshLodLevels] = {DEFAULT_LOD_LEVELS};
+  this->_settings[SettingKey::InstanceCount] = {DEFAULT_INSTANCE_COUNT};
+  this->_settings[SettingKey::InstanceLayout] = {0};
+  this->_settings[SettingKey::ClusterCulling] = {true};
+  this->_settings[SettingKey::ProceduralMeshes] = {false};
 }
 
 template <int Major, int Minor, class QOpenGLF>
@@ -231,6 +322,33 @@ void BallsCanvas::_initGLMemory() {
   _ibo.setUsagePattern(USAGE_PATTERN);
   qCDebug(logs::gl::Feature) << "IBO" << _ibo.bufferId() <<
                              "created and bound";
+
+  if (Q_UNLIKELY(!(_instanceVbo.create() && _instanceVbo.bind()))) {
+    throw std::runtime_error("Could not create the instance buffer");
+  }
+
+  _instanceVbo.setUsagePattern(USAGE_PATTERN);
+  _uploadInstances();
+  // Even a single copy is drawn from the instance buffer, so shaders that use
+  // its attributes work the same way with instancing on or off
+
+  if (!_proceduralVao.create()) {
+    throw runtime_error("Could not create the VAO for procedural shapes");
+  }
+
+  _proceduralVao.bind();
+  _initInstanceAttributes();
+  // Procedural shapes don't read any vertex buffers, but a core profile still
+  // won't draw without a VAO; this one only has the instance attributes
+  _vao.bind();
+  _vbo.bind();
+
+  _builtinBlock.create(_gl31);
+  _profiler.create(_gl33);
+  _pipelineStats.create(_gl33, context()->hasExtension(
+                          "GL_ARB_pipeline_statistics_query"));
+  _capture.create(_gl32);
+  _programCache.create(_gl41);
 }
 
 void BallsCanvas::_initLogger() noexcept {
@@ -251,14 +369,23 @@ void BallsCanvas::_initShaders() noexcept {
   Q_ASSERT(this->isValid());
   Q_ASSERT(this->context() == QOpenGLContext::currentContext());
 
-  Q_ASSUME(_shader.addShaderFromSourceFile(
-    QOpenGLShader::Vertex, constants::paths::DEFAULT_VERTEX));
-  Q_ASSUME(_shader.addShaderFromSourceFile(
-    QOpenGLShader::Fragment, constants::paths::DEFAULT_FRAGMENT));
+  QFile vertex(constants::paths::DEFAULT_VERTEX);
+  QFile fragment(constants::paths::DEFAULT_FRAGMENT);
+  Q_ASSUME(vertex.open(QIODevice::ReadOnly | QIODevice::Text) &&
+           fragment.open(QIODevice::ReadOnly | QIODevice::Text));
   // These shaders are built into the binary via the resource system
-  Q_ASSUME(_shader.link() && _shader.bind());
+  _vertexSource = QString::fromUtf8(vertex.readAll());
+  _fragmentSource = QString::fromUtf8(fragment.readAll());
+
+  CompiledProgram compiled = buildProgram(*context(), _programCache,
+                                          _vertexSource, _fragmentSource);
+  Q_ASSUME(compiled.program && compiled.program->bind());
   // If we've gotten this far, then the code that checked for the availability
   // of shaders has already given us the green light
+  _shader = compiled.program;
+
+  _compiler.create(context(), &_programCache);
+  // Only now, since its thread takes the cache over
 }
 
 void BallsCanvas::_initAttributeLocations() noexcept {
@@ -269,57 +396,34 @@ void BallsCanvas::_initAttributeLocations() noexcept {
   #ifdef DEBUG
   int currentShader = 0;
   glGetIntegerv(GL_CURRENT_PROGRAM, &currentShader);
-  Q_ASSERT(static_cast<GLuint>(currentShader) == _shader.programId());
+  Q_ASSERT(static_cast<GLuint>(currentShader) == _shader->programId());
   #endif
-  _attributes[POSITION] = _shader.attributeLocation(qPrintable(POSITION));
-  _attributes[NORMAL] = _shader.attributeLocation(qPrintable(NORMAL));
-  _gl30->glBindFragDataLocation(_shader.programId(), 0, qPrintable(out::FRAGMENT));
+  _attributes[POSITION] = _shader->attributeLocation(qPrintable(POSITION));
+  _attributes[NORMAL] = _shader->attributeLocation(qPrintable(NORMAL));
+  _gl30->glBindFragDataLocation(_shader->programId(), 0, qPrintable(out::FRAGMENT));
 }
 
 // Called on recompile
-void BallsCanvas::_updateUniformList() noexcept {
-  using std::array;
-  using util::resolveGLType;
-  using util::types::UniformInfo;
-
+void BallsCanvas::_updateUniformList(const UniformCollection& uniforms)
+noexcept {
   Q_ASSERT(this->isValid());
   Q_ASSERT(this->context() == QOpenGLContext::currentContext());
 
-  array<GLchar, 128> name;
-  GLuint program = _shader.programId();
-
-  GLsizei length = 0;
-  GLint size = 0;
-  GLenum type = 0;
-  int activeUniforms = 0;
-  glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &activeUniforms);
-
-  balls::util::types::UniformCollection uniformInfo;
-  uniformInfo.reserve(activeUniforms);
-
-  for (int i = 0; i < activeUniforms; ++i) {
-    glGetActiveUniform(program, i, name.size() - 1, &length, &size, &type,
-    name.data());
-    QString sname(name.data());
-    Q_ASSERT(sname.size() == length);
-
-    uniformInfo.push_back({sname, i, type, size});
-  }
-
-  this->uniformsDiscovered(uniformInfo);
+  this->uniformsDiscovered(uniforms);
 
   qCDebug(logs::uniform::Name) << "Updated uniform list";
 }
 
 void BallsCanvas::_updateUniformValues() noexcept {
-  using util::types::UniformInfo;
-
   Q_ASSERT(this->isValid());
   Q_ASSERT(this->context() == QOpenGLContext::currentContext());
 
-  for (const UniformInfo& i : this->_uniforms.uniformInfo()) {
-    QVariant u = _uniforms.property(qPrintable(i.name));
-    setUniform(i, u);
+  _uniforms.refresh();
+  _uniformTable.upload();
+  // Built-ins in the block have no locations, so the table skips them
+
+  if (_usesBuiltinBlock) {
+    _builtinBlock.update(_uniforms.builtinBlock());
   }
 }
 
@@ -330,17 +434,117 @@ void BallsCanvas::_initAttributes() noexcept {
   #ifdef DEBUG
   int currentShader = 0;
   glGetIntegerv(GL_CURRENT_PROGRAM, &currentShader);
-  Q_ASSERT(static_cast<GLuint>(currentShader) == _shader.programId());
+  Q_ASSERT(static_cast<GLuint>(currentShader) == _shader->programId());
   #endif
 
   int position = _attributes[attribute::POSITION];
   int normal = _attributes[attribute::NORMAL];
-  glVertexAttribPointer(position, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float),
-  (void*)0);
-  glVertexAttribPointer(
-    normal, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-  _shader.enableAttributeArray(position);
-  _shader.enableAttributeArray(normal);
+  const mesh::AttributeLayout& p = _vertexFormat.position();
+  const mesh::AttributeLayout& n = _vertexFormat.normal();
+  GLsizei stride = _vertexFormat.stride();
+  glVertexAttribPointer(position, p.components, p.type, p.normalized, stride,
+  reinterpret_cast<void*>(p.offset));
+  glVertexAttribPointer(normal, n.components, n.type, n.normalized, stride,
+  reinterpret_cast<void*>(n.offset));
+  // Packed formats are unpacked by the vertex fetcher, so shaders still just
+  // see a vec3 position and a vec3 normal
+  _shader->enableAttributeArray(position);
+  _shader->enableAttributeArray(normal);
+
+  _initInstanceAttributes();
+}
+
+void BallsCanvas::_initInstanceAttributes() noexcept {
+  using mesh::Instance;
+  Q_ASSERT(this->_gl30 != nullptr);
+
+  _instanceVbo.bind();
+
+  if (_gl33 == nullptr) {
+    // Without attribute divisors, every vertex would read a different
+    // instance; give every copy the same constant values instead
+    for (GLuint c = 0; c < 4; ++c) {
+      glDisableVertexAttribArray(INSTANCE_TRANSFORM_LOCATION + c);
+      glVertexAttrib4f(INSTANCE_TRANSFORM_LOCATION + c, c == 0, c == 1, c == 2,
+                       c == 3);
+    }
+
+    glDisableVertexAttribArray(INSTANCE_COLOR_LOCATION);
+    glVertexAttrib4f(INSTANCE_COLOR_LOCATION, 1, 1, 1, 1);
+    glDisableVertexAttribArray(INSTANCE_ID_LOCATION);
+    _gl30->glVertexAttribI4ui(INSTANCE_ID_LOCATION, 0, 0, 0, 0);
+    _vbo.bind();
+    return;
+  }
+
+  GLsizei stride = sizeof(Instance);
+
+  for (GLuint c = 0; c < 4; ++c) {
+    // A mat4 attribute is read as four vec4 columns
+    size_t offset = offsetof(Instance, transform) + c * sizeof(glm::vec4);
+    glVertexAttribPointer(INSTANCE_TRANSFORM_LOCATION + c, 4, GL_FLOAT,
+                          GL_FALSE, stride, reinterpret_cast<void*>(offset));
+    _gl33->glVertexAttribDivisor(INSTANCE_TRANSFORM_LOCATION + c, 1);
+    glEnableVertexAttribArray(INSTANCE_TRANSFORM_LOCATION + c);
+  }
+
+  glVertexAttribPointer(INSTANCE_COLOR_LOCATION, 4, GL_FLOAT, GL_FALSE, stride,
+                        reinterpret_cast<void*>(offsetof(Instance, color)));
+  _gl33->glVertexAttribDivisor(INSTANCE_COLOR_LOCATION, 1);
+  glEnableVertexAttribArray(INSTANCE_COLOR_LOCATION);
+
+  _gl30->glVertexAttribIPointer(INSTANCE_ID_LOCATION, 1, GL_UNSIGNED_INT,
+                                stride,
+                                reinterpret_cast<void*>(offsetof(Instance, id)));
+  _gl33->glVertexAttribDivisor(INSTANCE_ID_LOCATION, 1);
+  glEnableVertexAttribArray(INSTANCE_ID_LOCATION);
+
+  _vbo.bind();
+  // The mesh's attributes are set up against it
+}
+
+void BallsCanvas::_uploadInstances() noexcept {
+  using mesh::Instance;
+  using mesh::InstanceLayout;
+
+  size_t count = qMax(_settings[SettingKey::InstanceCount].value.toUInt(), 1u);
+  auto layout = static_cast<InstanceLayout>(
+                  _settings[SettingKey::InstanceLayout].value.toInt());
+
+  if (count > 1 && _gl31 == nullptr) {
+    qCWarning(logs::gl::Feature)
+        << "Instanced drawing needs OpenGL 3.1; only drawing one copy";
+    count = 1;
+  }
+  else if (count > 1 && _gl33 == nullptr) {
+    qCWarning(logs::gl::Feature)
+        << "Per-instance attributes need OpenGL 3.3; copies will only differ "
+        "by gl_InstanceID";
+  }
+
+  bool bounded = !_lods.levels.empty();
+  glm::vec3 center = bounded ? _lods.center : glm::vec3(0);
+  float radius = bounded ? _lods.radius : 1;
+  glm::mat4 meshTransform = _quantization.matrix();
+
+  // Every instance is written in one go, straight into the buffer
+  _instanceVbo.bind();
+  bool mapped = _writeBuffer(_instanceVbo, count * sizeof(Instance),
+  [&](void* out) {
+    _instanceScale = mesh::layoutInstances(static_cast<Instance*>(out), count,
+                                           layout, center, radius,
+                                           meshTransform);
+  });
+
+  _instanceCount = static_cast<GLsizei>(count);
+  _instancesMoved = count > 1 || layout != InstanceLayout::Grid;
+  // A grid of one is centered on the mesh at full scale, i.e. not moved at
+  // all; a cloud of one is still scattered and rotated
+  _uniforms.setInstanceCount(static_cast<uint>(count));
+
+  qCDebug(logs::gl::Resource)
+      << count << "instances"
+      << (mapped ? "written to a mapped buffer" : "copied through staging");
 }
 
 void BallsCanvas::resizeGL(const int width, const int height) {
@@ -351,385 +555,779 @@ void BallsCanvas::paintGL() {
   Q_ASSERT(this->_vbo.isCreated());
   Q_ASSERT(this->_ibo.isCreated());
 
+  _scheduler.beginFrame();
+  // Anything asked for from here on needs another frame
+
+  _profiler.beginFrame();
+
   _updateGLSetting<GL_DEPTH_TEST>(SettingKey::DepthTestEnabled);
   _updateGLSetting<GL_CULL_FACE>(SettingKey::FaceCullingEnabled);
   _updateGLSetting<GL_DITHER>(SettingKey::Dithering);
 
+  Setting& cacheSize = _settings[SettingKey::MeshCacheSize];
+
+  if (cacheSize.changed) {
+    _meshCache.setBudget(cacheSize.value.toInt() * MB);
+    cacheSize.changed = false;
+  }
+
+  Setting& positionFormat = _settings[SettingKey::PositionFormat];
+  Setting& normalFormat = _settings[SettingKey::NormalFormat];
+
+  if (positionFormat.changed || normalFormat.changed) {
+    // Cached buffers are in the old format, and the CPU copy may be gone, so
+    // build the current mesh again
+    positionFormat.changed = false;
+    normalFormat.changed = false;
+    _meshCache.clear();
+
+    if (_meshgen != nullptr) {
+      setMesh(_meshgen);
+    }
+  }
+
+  Setting& procedural = _settings[SettingKey::ProceduralMeshes];
+
+  if (procedural.changed) {
+    procedural.changed = false;
+
+    if (_meshgen != nullptr) {
+      setMesh(_meshgen);
+    }
+  }
+
+  bool newMesh = _hasPendingMesh;
+
+  if (_hasPendingMesh) {
+    // If a new mesh finished building since the last frame, swap it in now that
+    // the context is current; until then we keep drawing the old one
+    _uploadMesh();
+  }
+
+  Setting& instanceCount = _settings[SettingKey::InstanceCount];
+  Setting& instanceLayout = _settings[SettingKey::InstanceLayout];
+
+  if (newMesh || instanceCount.changed || instanceLayout.changed) {
+    // Instances are placed relative to the mesh's bounds and stored in its
+    // quantized space, so they depend on the mesh as well
+    instanceCount.changed = false;
+    instanceLayout.changed = false;
+    _uploadInstances();
+  }
+
+  _profiler.beginPass("clear");
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  _profiler.endPass();
+
+  mesh::MeshParameters shape;
+
+  if (_procedural != mesh::ProceduralShape::None) {
+    shape = _proceduralParameters();
+    // Before the uniforms go out, in case any had to be clamped
+  }
 
   _updateUniformValues();
-  glDrawElements(
-    _settings[SettingKey::WireFrame].value.toBool() ? GL_LINE_STRIP
-    : GL_TRIANGLES,
-    _mesh.indices().size(),
-    GL_UNSIGNED_SHORT,
-    nullptr
-  );
+
+  GLsizei count = _indexCount;
+  size_t first = 0;
+  size_t lod = 0;
+
+  if (!_lods.levels.empty()) {
+    lod = _chooseLod();
+    const mesh::LodLevel& level = _lods.levels[lod];
+    count = level.indexCount;
+    first = level.firstIndex;
+  }
+
+  size_t indexSize = (_indexType == GL_UNSIGNED_SHORT) ? sizeof(GLushort)
+                     : sizeof(GLuint);
+
+  bool wireframe = _settings[SettingKey::WireFrame].value.toBool();
+  GLenum mode = wireframe ? GL_LINE_STRIP : GL_TRIANGLES;
+  void* offset = reinterpret_cast<void*>(first * indexSize);
+
+  _profiler.beginPass("draw");
+  _pipelineStats.begin();
+
+  if (_procedural != mesh::ProceduralShape::None) {
+    GLsizei vertices = mesh::proceduralVertexCount(_procedural, shape);
+    _proceduralVao.bind();
+
+    if (_gl31 != nullptr) {
+      _gl31->glDrawArraysInstanced(mode, 0, vertices, _instanceCount);
+    }
+    else {
+      glDrawArrays(mode, 0, vertices);
+    }
+
+    _vao.bind();
+  }
+  else if (_indexCount == 0) {
+    // No mesh made it onto the GPU, so there's nothing in the buffers to draw
+  }
+  else if (_settings[SettingKey::ClusterCulling].value.toBool() && _clusters &&
+           lod < _clusters->levels.size() && !_instancesMoved) {
+    // Clusters are tested in the mesh's own space, so this only works for
+    // one copy that hasn't been moved
+    mesh::ClusterView view;
+    view.planes = _uniforms.frustumPlanes();
+    view.camera = _uniforms.cameraPosition();
+    view.cullBackfaces = !wireframe &&
+                         _settings[SettingKey::FaceCullingEnabled].value.toBool();
+    // If back faces are drawn anyway, the cones don't tell us anything
+
+    size_t ranges = mesh::cullClusters(*_clusters, _clusters->levels[lod], view,
+                                       indexSize, _drawCounts, _drawOffsets);
+
+    if (ranges > 0) {
+      _gl30->glMultiDrawElements(mode, _drawCounts.data(), _indexType,
+                                 _drawOffsets.data(),
+                                 static_cast<GLsizei>(ranges));
+    }
+  }
+  else if (_gl31 != nullptr) {
+    // One draw call for every copy, whatever the instance count
+    _gl31->glDrawElementsInstanced(mode, count, _indexType, offset,
+                                   _instanceCount);
+  }
+  else {
+    glDrawElements(mode, count, _indexType, offset);
+  }
+
+  _pipelineStats.end();
+  _profiler.endPass();
+
+  _capture.capture(defaultFramebufferObject(), size() * devicePixelRatio());
 }
 
 void BallsCanvas::setMesh(mesh::MeshGenerator* generator) noexcept {
-  using mesh::Mesh;
+  using mesh::MeshCache;
+  using mesh::MeshGenerator;
   Q_ASSERT(generator != nullptr);
 
   this->_meshgen = generator;
-  this->_mesh = this->_meshgen->getMesh();
+  ++this->_meshRequest;
 
-  vector<Mesh::CoordType> data = this->_mesh.combined();
-  const vector<Mesh::IndexType>& indices = this->_mesh.indices();
+  _useProcedural(*generator);
 
-  this->_vbo.bind();
-  this->_vbo.allocate(data.data(), data.size() * sizeof(Mesh::CoordType));
-  this->_ibo.bind();
-  this->_ibo.allocate(indices.data(), indices.size() * sizeof(Mesh::IndexType));
-}
+  if (_procedural != mesh::ProceduralShape::None) {
+    // Nothing to build; whatever was on its way is stale now
+    _queuedMesh.reset();
+    _pendingMesh = mesh::BuiltMesh();
+    _hasPendingMesh = false;
+    _scheduler.invalidate(FrameScheduler::Mesh);
+    return;
+  }
 
-void BallsCanvas::setOption(const bool value) noexcept {
-  QObject* send = sender();
-  QVariant name = send->property(constants::properties::OPTION);
+  MeshCache::Key key = MeshCache::key(*generator);
 
-  Q_ASSERT(send != nullptr); // Must be called as a slot!
-  Q_ASSERT(name.isValid()&&  name.type() == QVariant::String);
+  if (const MeshCache::Entry* entry = _meshCache.find(key)) {
+    // If we've built this exact mesh before, skip the generator entirely
+    _queuedMesh.reset();
+    _pendingKey = key;
+    _pendingMesh = entry->built;
+    _hasPendingMesh = true;
+    _scheduler.invalidate(FrameScheduler::Mesh);
+    return;
+  }
 
-  this->_settings[name.toString()] = Setting(value, true);
+  this->_queuedMesh.reset(new MeshGenerator(*generator));
+  // Copy the generator so the job sees the parameters as they are right now;
+  // if a job is already running, this replaces whatever was queued behind it
 
-  qCDebug(logs::gl::State) << "Set" << name.toString() << "to" << value;
+  if (!this->_meshJob.isRunning()) {
+    _startMeshJob();
+  }
 }
 
-void BallsCanvas::setOption(const int value) noexcept {
-  QObject* send = sender();
-  QVariant name = send->property(constants::properties::OPTION);
+void BallsCanvas::_useProcedural(const mesh::MeshGenerator& generator)
+noexcept {
+  using mesh::ProceduralShape;
 
-  Q_ASSERT(send != nullptr); // Must be called as a slot!");
-  Q_ASSERT(name.isValid() && name.type() == QVariant::String);
+  bool enabled = _settings[SettingKey::ProceduralMeshes].value.toBool();
+  ProceduralShape shape = enabled ? generator.getShape() : ProceduralShape::None;
+  bool relink = shape != _procedural && !_vertexSource.isEmpty();
+  _procedural = shape;
+  _hasPendingShape = false;
 
-  this->_settings[name.toString()] = Setting(value, true);
+  if (shape != ProceduralShape::None) {
+    _pendingShapeParameters = generator.getParameters();
+    _hasPendingShape = true;
+  }
 
-  qCDebug(logs::gl::State) << "Set" << name.toString() << "to" << value;
-}
+  if (relink) {
+    // The prelude declares a uniform per parameter, so it depends on the shape;
+    // those uniforms only exist once the new program arrives, which may not be
+    // right away
+    _linkShaders();
+  }
+  else if (_hasPendingShape) {
+    _seedProceduralUniforms();
+  }
 
-void BallsCanvas::mouseMoveEvent(QMouseEvent *e) {
-}
+  if (shape == ProceduralShape::None) {
+    return;
+  }
 
-void BallsCanvas::wheelEvent(QWheelEvent *) {
+  this->makeCurrent();
+  _lods = mesh::LodChain();
+  _clusters.reset();
+  _quantization = mesh::Quantization();
+  _uniforms.setMeshTransform(_quantization.matrix());
+  _uploadInstances();
+  // Every generator's defaults are about the size of the unit sphere, which is
+  // what instances are laid out around when there are no bounds
+
+  qCDebug(logs::mesh::Name) << "Generating" << generator.getName()
+                            << "in the vertex shader";
 }
 
-void BallsCanvas::timerEvent(QTimerEvent * e) {
-  update();
-}
+void BallsCanvas::_seedProceduralUniforms() noexcept {
+  Q_ASSERT(_hasPendingShape);
 
-void BallsCanvas::setUniform(const UniformInfo& info, const QVariant& var) noexcept {
-  if (!_shader.isLinked()) return;
-  if (_shader.programId() == 0) return;
-  // If the shader wasn't compiled properly, the object's ID will be 0 (no shader)
+  for (const auto& param : _pendingShapeParameters) {
+    QByteArray name = mesh::proceduralUniform(param.first).toLatin1();
 
-  Q_ASSERT(var.isValid());
-  Q_ASSERT(_shader.uniformLocation(info.name) == info.index);
+    if (_uniforms.property(name.constData()).isValid()) {
+      // If the shader actually uses this parameter...
+      bool integer = param.second.getType() == QMetaType::Int;
+      _uniforms.setProperty(name.constData(), integer ?
+                            QVariant(param.second.get<int>()) :
+                            QVariant(param.second.get<float>()));
+    }
+  }
 
-  int index = info.index;
+  _pendingShapeParameters.clear();
+  _hasPendingShape = false;
+}
 
-  if (index != -1) {
-    this->makeCurrent();
+mesh::MeshParameters BallsCanvas::_proceduralParameters() noexcept {
+  Q_ASSERT(_meshgen != nullptr);
 
-    switch (info.type) {
-    case GL_INT: {
-      Q_ASSERT(var.canConvert<int>());
-      _gl30->glUniform1i(index, var.value<int>());
-      break;
-    }
+  mesh::MeshParameters params = _meshgen->getParameters();
 
-    case GL_DOUBLE: {
-      if (_gl40) {
-        // If the GPU supports double types...
-        Q_ASSERT(var.canConvert<double>());
-        _gl40->glUniform1d(index, var.value<double>());
-        break;
-      }
-    }
+  for (auto& param : params) {
+    QByteArray name = mesh::proceduralUniform(param.first).toLatin1();
+    QVariant value = _uniforms.property(name.constData());
 
-    // Otherwise, just treat it like a float
-    case GL_FLOAT: {
-      Q_ASSERT(var.canConvert<float>());
-      _gl30->glUniform1f(index, var.value<float>());
-      break;
+    if (!value.isValid()) {
+      // If the shader doesn't use this one, the generator's value stands
+      continue;
     }
 
-    case GL_UNSIGNED_INT: {
-      Q_ASSERT(var.canConvert<unsigned int>());
-      _gl30->glUniform1ui(index, var.value<unsigned int>());
-      break;
-    }
+    // The uniforms can be edited freely, but the vertex count comes from them
+    double bounded = qBound<double>(param.second.getMin(), value.toDouble(),
+                                    param.second.getMax());
+    QVariant clamped = (param.second.getType() == QMetaType::Int) ?
+                       QVariant(static_cast<int>(bounded)) :
+                       QVariant(static_cast<float>(bounded));
 
-    case GL_BOOL: {
-      Q_ASSERT(var.canConvert<bool>());
-      _gl30->glUniform1i(index, var.value<bool>());
-      break;
+    if (clamped != value) {
+      _uniforms.setProperty(name.constData(), clamped);
     }
 
-    case GL_DOUBLE_VEC2: {
-      if (_gl40) {
-        Q_ASSERT(var.canConvert<glm::dvec2>());
-        glm::dvec2 dvec2 = var.value<glm::dvec2>();
-        _gl40->glUniform2d(index, dvec2.x, dvec2.y);
-        break;
+    param.second.set(clamped);
+  }
+
+  return params;
+}
+
+void BallsCanvas::_startMeshJob() noexcept {
+  using mesh::BuiltMesh;
+  using mesh::Mesh;
+  using mesh::MeshCache;
+  using mesh::MeshGenerator;
+  using std::make_shared;
+  Q_ASSERT(_queuedMesh != nullptr);
+  Q_ASSERT(!_meshJob.isRunning());
+
+  MeshGenerator generator = *_queuedMesh;
+  QString path = generator.getParameters().count(mesh::PATH) ?
+                 generator.get<QString>(mesh::PATH) : QString();
+  bool prebuilt = mesh::meshFileFormat(path) == mesh::MeshFileFormat::BallsMesh;
+  bool optimize = _settings[SettingKey::MeshOptimize].value.toBool();
+  size_t lodLevels = _settings[SettingKey::MeshLodLevels].value.toUInt();
+  unsigned request = _meshRequest;
+  atomic<unsigned>* latest = &_meshRequest;
+  _queuedMesh.reset();
+  _meshJobKey = MeshCache::key(generator);
+  _meshJobRequest = request;
+
+  qCDebug(logs::gl::Resource) << "Building mesh" << generator.getName()
+                              << "in the background";
+
+  _meshJob.setFuture(QtConcurrent::run([ = ]() {
+    BuiltMesh built;
+
+    if (prebuilt) {
+      // Already optimized, simplified, and interleaved; just map it
+      mesh::ImportNotifier* notifier = mesh::ImportNotifier::instance();
+
+      try {
+        built.file = mesh::MeshFile::open(path);
+        built.lods = built.file->info().lods;
+        emit notifier->finished(path, QString("%1 triangles, mapped")
+                                .arg(built.file->info().indexCount / 3));
+      }
+      catch (const FileException& e) {
+        emit notifier->failed(path, e.fullMessage());
+      }
+      catch (const std::exception& e) {
+        emit notifier->failed(path, e.what());
       }
-    }
 
-    case GL_FLOAT_VEC2: {
-      Q_ASSERT(var.canConvert<glm::vec2>());
-      glm::vec2 vec2 = var.value<glm::vec2>();
-      _gl30->glUniform2f(index, vec2.x, vec2.y);
-      break;
+      built.mesh = make_shared<const Mesh>();
+      return built;
     }
 
-    case GL_INT_VEC2: {
-      Q_ASSERT(var.canConvert<glm::ivec2>());
-      glm::ivec2 ivec2 = var.value<glm::ivec2>();
-      _gl30->glUniform2i(index, ivec2.x, ivec2.y);
-      break;
-    }
+    // Nobody will look at this mesh if another was asked for since, so check
+    // between every step and give up as soon as that happens; _receiveMesh()
+    // drops whatever a stale job returns
+    auto stale = [request, latest]() {
+      return request != *latest;
+    };
 
-    case GL_UNSIGNED_INT_VEC2: {
-      Q_ASSERT(var.canConvert<glm::uvec2>());
-      glm::uvec2 uvec2 = var.value<glm::uvec2>();
-      _gl30->glUniform2ui(index, uvec2.x, uvec2.y);
-      break;
-    }
+    Mesh mesh = generator.getMesh();
 
-    case GL_BOOL_VEC2: {
-      Q_ASSERT(var.canConvert<glm::bvec2>());
-      glm::bvec2 bvec2 = var.value<glm::bvec2>();
-      _gl30->glUniform2i(index, bvec2.x, bvec2.y);
-      break;
+    if (stale()) {
+      return built;
     }
 
-    case GL_DOUBLE_VEC3: {
-      if (_gl40) {
-        Q_ASSERT(var.canConvert<glm::dvec3>());
-        glm::dvec3 dvec3 = var.value<glm::dvec3>();
-        _gl40->glUniform3d(index, dvec3.x, dvec3.y, dvec3.z);
-        break;
+    auto prepare = [&generator, &stale](Mesh & level) {
+      if (stale()) {
+        // buildLods() can't be stopped midway, but it can skip the optimizing
+        return;
       }
-      // Otherwise, case to GL_FLOAT_VEC3
-    }
 
-    case GL_FLOAT_VEC3: {
-      Q_ASSERT(var.canConvert<glm::vec3>());
-      glm::vec3 vec3 = var.value<glm::vec3>();
-      _gl30->glUniform3f(index, vec3.x, vec3.y, vec3.z);
-      break;
-    }
+      mesh::OptimizationReport report = mesh::optimize(level);
 
-    case GL_INT_VEC3: {
-      Q_ASSERT(var.canConvert<glm::ivec3>());
-      glm::ivec3 ivec3 = var.value<glm::ivec3>();
-      _gl30->glUniform3i(index, ivec3.x, ivec3.y, ivec3.z);
-      break;
-    }
+      qCDebug(logs::mesh::Optimize).nospace()
+          << "Optimized " << generator.getName() << ": ACMR "
+          << report.before.acmr << " -> " << report.after.acmr << ", ATVR "
+          << report.before.atvr << " -> " << report.after.atvr << " ("
+          << report.before.misses << " -> " << report.after.misses
+          << " vertex shader invocations)";
+    };
 
-    case GL_UNSIGNED_INT_VEC3: {
-      Q_ASSERT(var.canConvert<glm::uvec3>());
-      glm::uvec3 uvec3 = var.value<glm::uvec3>();
-      _gl30->glUniform3ui(index, uvec3.x, uvec3.y, uvec3.z);
-      break;
-    }
+    built.lods = mesh::buildLods(mesh, lodLevels, optimize ? prepare :
+                                 function<void(Mesh&)>());
 
-    case GL_BOOL_VEC3: {
-      Q_ASSERT(var.canConvert<glm::bvec3>());
-      glm::bvec3 bvec3 = var.value<glm::bvec3>();
-      _gl30->glUniform3i(index, bvec3.x, bvec3.y, bvec3.z);
-      break;
+    if (stale()) {
+      return built;
     }
 
-    case GL_DOUBLE_VEC4: {
-      if (_gl40) {
-        Q_ASSERT(var.canConvert<glm::dvec4>());
-        glm::dvec4 dvec4 = var.value<glm::dvec4>();
-        _gl40->glUniform4d(index, dvec4.x, dvec4.y, dvec4.z, dvec4.w);
-        break;
-      }
-    }
+    mesh.computeNormals();
 
-    case GL_FLOAT_VEC4: {
-      Q_ASSERT(var.canConvert<glm::vec4>());
-      glm::vec4 vec4 = var.value<glm::vec4>();
-      _gl30->glUniform4f(index, vec4.x, vec4.y, vec4.z, vec4.w);
-      break;
+    if (stale()) {
+      return built;
     }
 
-    case GL_INT_VEC4: {
-      Q_ASSERT(var.canConvert<glm::ivec4>());
-      glm::ivec4 ivec4 = var.value<glm::ivec4>();
-      _gl30->glUniform4i(index, ivec4.x, ivec4.y, ivec4.z, ivec4.w);
-      break;
-    }
+    built.clusters = make_shared<const mesh::ClusterSet>(
+                       mesh::buildClusters(mesh, built.lods));
+    // After optimizing, so the clusters follow the final triangle order
 
-    case GL_UNSIGNED_INT_VEC4: {
-      Q_ASSERT(var.canConvert<glm::uvec4>());
-      glm::uvec4 uvec4 = var.value<glm::uvec4>();
-      _gl30->glUniform4ui(index, uvec4.x, uvec4.y, uvec4.z, uvec4.w);
-      break;
-    }
+    qCDebug(logs::mesh::Name) << generator.getName() << "has"
+                              << built.lods.levels.size()
+                              << "levels of detail and"
+                              << built.clusters->size() << "clusters";
 
-    case GL_BOOL_VEC4: {
-      Q_ASSERT(var.canConvert<glm::bvec4>());
-      glm::bvec4 bvec4 = var.value<glm::bvec4>();
-      _gl30->glUniform4i(index, bvec4.x, bvec4.y, bvec4.z, bvec4.w);
-      break;
-    }
+    built.mesh = make_shared<const Mesh>(std::move(mesh));
+    return built;
+  }));
+}
 
-    case GL_DOUBLE_MAT2: {
-      if (_gl40) {
-        Q_ASSERT(var.canConvert<glm::dmat2>());
-        glm::dmat2 dmat2 = var.value<glm::dmat2>();
-        _gl40->glUniformMatrix2dv(index, 1, false, glm::value_ptr(dmat2));
-        break;
-      }
-    }
+void BallsCanvas::_receiveMesh() noexcept {
+  if (_queuedMesh != nullptr) {
+    // If another mesh was requested while this one was building, then this one
+    // is stale; drop it and build the newest request instead
+    qCDebug(logs::gl::Resource) << "Discarded a superseded mesh";
+    _startMeshJob();
+    return;
+  }
 
-    case GL_FLOAT_MAT2: {
-      Q_ASSERT(var.canConvert<glm::mat2>());
-      glm::mat2 mat2 = var.value<glm::mat2>();
-      _gl30->glUniformMatrix2fv(index, 1, false, glm::value_ptr(mat2));
-      break;
-    }
+  if (_meshJobRequest != _meshRequest) {
+    // If a cached mesh was picked while this one was building...
+    qCDebug(logs::gl::Resource) << "Discarded a superseded mesh";
+    return;
+  }
 
-    case GL_DOUBLE_MAT2x3: {
-      if (_gl40) {
-        Q_ASSERT(var.canConvert<glm::dmat2x3>());
-        glm::dmat2x3 dmat2x3 = var.value<glm::dmat2x3>();
-        _gl40->glUniformMatrix2x3dv(index, 1, false, glm::value_ptr(dmat2x3));
-        break;
-      }
-    }
+  _pendingKey = _meshJobKey;
+  _pendingMesh = _meshJob.result();
+  _hasPendingMesh = true;
 
-    case GL_FLOAT_MAT2x3: {
-      Q_ASSERT(var.canConvert<glm::mat2x3>());
-      glm::mat2x3 mat2x3 = var.value<glm::mat2x3>();
-      _gl30->glUniformMatrix2x3fv(index, 1, false, glm::value_ptr(mat2x3));
-      break;
-    }
+  if (_pendingMesh.file ||
+      (_pendingMesh.mesh && !_pendingMesh.mesh->vertices().empty())) {
+    // A file that failed to open comes back empty; don't remember that, or
+    // fixing the file and opening it again would find the failure cached
+    _meshCache.insert(_pendingKey, _pendingMesh);
+  }
 
-    case GL_DOUBLE_MAT2x4: {
-      if (_gl40) {
-        Q_ASSERT(var.canConvert<glm::dmat2x4>());
-        glm::dmat2x4 dmat2x4 = var.value<glm::dmat2x4>();
-        _gl40->glUniformMatrix2x4dv(index, 1, false, glm::value_ptr(dmat2x4));
-        break;
-      }
-    }
+  _scheduler.invalidate(FrameScheduler::Mesh);
+}
 
-    case GL_FLOAT_MAT2x4: {
-      Q_ASSERT(var.canConvert<glm::mat2x4>());
-      glm::mat2x4 mat2x4 = var.value<glm::mat2x4>();
-      _gl30->glUniformMatrix2x4fv(index, 1, false, glm::value_ptr(mat2x4));
-      break;
-    }
+void BallsCanvas::_uploadMesh() noexcept {
+  using mesh::Mesh;
+  using mesh::MeshCache;
+  Q_ASSERT(this->context() == QOpenGLContext::currentContext());
+  Q_ASSERT(_hasPendingMesh);
+
+  this->_mesh = _pendingMesh;
+  _pendingMesh = mesh::BuiltMesh();
+  _hasPendingMesh = false;
+
+  const MeshCache::Entry* cached = _meshCache.peek(_pendingKey);
+
+  if (cached != nullptr && cached->hasGpu) {
+    // If this mesh's buffers are still on the GPU, just point the VAO at them
+    _vbo = cached->gpu.vbo;
+    _ibo = cached->gpu.ibo;
+    _indexType = cached->gpu.indexType;
+    _indexCount = cached->gpu.indexCount;
+    _vertexFormat = cached->gpu.format;
+    _quantization = cached->gpu.quantization;
+    _lods = cached->gpu.lods;
+    _clusters = cached->gpu.clusters;
+    _uniforms.setMeshTransform(_quantization.matrix());
+    _bindMeshBuffers();
+    _releaseMesh();
+    return;
+  }
 
-    case GL_DOUBLE_MAT3x2: {
-      if (_gl40) {
-        Q_ASSERT(var.canConvert<glm::dmat3x2>());
-        glm::dmat3x2 dmat3x2 = var.value<glm::dmat3x2>();
-        _gl40->glUniformMatrix3x2dv(index, 1, false, glm::value_ptr(dmat3x2));
-        break;
-      }
-    }
+  if (this->_mesh.file) {
+    _uploadMeshFile(*this->_mesh.file);
+    return;
+  }
 
-    case GL_FLOAT_MAT3x2: {
-      Q_ASSERT(var.canConvert<glm::mat3x2>());
-      glm::mat3x2 mat3x2 = var.value<glm::mat3x2>();
-      _gl30->glUniformMatrix3x2fv(index, 1, false, glm::value_ptr(mat3x2));
-      break;
-    }
+  const Mesh& mesh = *this->_mesh.mesh;
+  mesh::VertexFormat format = _chooseVertexFormat();
+  mesh::Quantization quantization = mesh.quantization(format);
+  size_t vertexBytes = mesh.vertexDataSize(format);
+  size_t indexBytes = mesh.indexDataSize();
+  _vertexFormat = format;
+  _quantization = quantization;
+  _lods = this->_mesh.lods;
+  _clusters = this->_mesh.clusters;
+  _uniforms.setMeshTransform(quantization.matrix());
+  // The VAO's attribute pointers are set up from _vertexFormat
+
+  // Always upload into fresh buffers; the old ones may belong to a cached mesh
+  _vbo = QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+  _ibo = QOpenGLBuffer(QOpenGLBuffer::IndexBuffer);
+  _vbo.create();
+  _ibo.create();
+  _vbo.setUsagePattern(USAGE_PATTERN);
+  _ibo.setUsagePattern(USAGE_PATTERN);
+  _bindMeshBuffers();
 
-    case GL_DOUBLE_MAT3: {
-      if (_gl40) {
-        Q_ASSERT(var.canConvert<glm::dmat3>());
-        glm::dmat3 dmat3 = var.value<glm::dmat3>();
-        _gl40->glUniformMatrix3dv(index, 1, false, glm::value_ptr(dmat3));
-        break;
-      }
-    }
+  // Interleave straight into driver memory; no CPU-side copy of the buffer
+  bool mapped = _writeBuffer(_vbo, vertexBytes, [&](void* out) {
+    mesh.interleave(out, format, quantization);
+  });
 
-    case GL_FLOAT_MAT3: {
-      Q_ASSERT(var.canConvert<glm::mat3>());
-      glm::mat3 mat3 = var.value<glm::mat3>();
-      _gl30->glUniformMatrix3fv(index, 1, false, glm::value_ptr(mat3));
-      break;
-    }
+  // If every vertex can be addressed with 16 bits, this halves the bandwidth
+  mapped &= _writeBuffer(_ibo, indexBytes, [&mesh](void* out) {
+    mesh.writeIndices(out);
+  });
 
-    case GL_DOUBLE_MAT3x4: {
-      if (_gl40) {
-        Q_ASSERT(var.canConvert<glm::dmat3x4>());
-        glm::dmat3x4 dmat3x4 = var.value<glm::dmat3x4>();
-        _gl40->glUniformMatrix3x4dv(index, 1, false, glm::value_ptr(dmat3x4));
-        break;
-      }
-    }
+  this->_indexType = mesh.indexType();
 
-    case GL_FLOAT_MAT3x4: {
-      Q_ASSERT(var.canConvert<glm::mat3x4>());
-      glm::mat3x4 mat3x4 = var.value<glm::mat3x4>();
-      _gl30->glUniformMatrix3x4fv(index, 1, false, glm::value_ptr(mat3x4));
-      break;
-    }
+  if (_vbo.size() > 0 && _ibo.size() > 0) {
+    this->_indexCount = mesh.indices().size();
+  }
+  else {
+    // If either was too big to allocate, draw nothing rather than overrun them;
+    // the levels of detail and clusters would otherwise be drawn from instead
+    this->_indexCount = 0;
+    _lods = mesh::LodChain();
+    _clusters.reset();
+  }
 
-    case GL_DOUBLE_MAT4x2: {
-      if (_gl40) {
-        Q_ASSERT(var.canConvert<glm::dmat4x2>());
-        glm::dmat4x2 dmat4x2 = var.value<glm::dmat4x2>();
-        _gl40->glUniformMatrix4x2dv(index, 1, false, glm::value_ptr(dmat4x2));
-        break;
-      }
-    }
+  if (_settings[SettingKey::MeshCacheGpu].value.toBool() && _indexCount > 0) {
+    size_t bytes = vertexBytes + indexBytes +
+                   (_clusters ? _clusters->bytes() : 0);
+    _meshCache.insertGpu(_pendingKey, {
+      _vbo, _ibo, _indexType, _indexCount, format, quantization, _lods,
+      _clusters, bytes
+    });
+  }
 
-    case GL_FLOAT_MAT4x2: {
-      Q_ASSERT(var.canConvert<glm::mat4x2>());
-      glm::mat4x2 mat4x2 = var.value<glm::mat4x2>();
-      _gl30->glUniformMatrix4x2fv(index, 1, false, glm::value_ptr(mat4x2));
-      break;
-    }
+  qCDebug(logs::gl::Resource)
+      << mesh.vertices().size() << "vertices with"
+      << util::resolveGLType(this->_indexType) << "indices"
+      << (mapped ? "written to mapped buffers" : "copied through staging");
+  qCDebug(logs::gl::Resource).noquote()
+      << "Vertex format:" << format.toString() << '(' << vertexBytes
+      << "bytes in total)";
 
-    case GL_DOUBLE_MAT4x3: {
-      if (_gl40) {
-        Q_ASSERT(var.canConvert<glm::dmat4x3>());
-        glm::dmat4x3 dmat4x3 = var.value<glm::dmat4x3>();
-        _gl40->glUniformMatrix4x3dv(index, 1, false, glm::value_ptr(dmat4x3));
-        break;
-      }
-    }
+  _releaseMesh();
+}
 
-    case GL_FLOAT_MAT4x3: {
-      Q_ASSERT(var.canConvert<glm::mat4x3>());
-      glm::mat4x3 mat4x3 = var.value<glm::mat4x3>();
-      _gl30->glUniformMatrix4x3fv(index, 1, false, glm::value_ptr(mat4x3));
-      break;
-    }
+void BallsCanvas::_uploadMeshFile(const mesh::MeshFile& file) noexcept {
+  using mesh::NormalFormat;
+  const mesh::MeshFileInfo& info = file.info();
+
+  if (info.format.normalFormat() == NormalFormat::Int2_10_10_10 &&
+      _gl33 == nullptr) {
+    // The data can't be converted without a CPU-side copy, which we don't have
+    qCWarning(logs::gl::Feature)
+        << "This mesh file has packed normals, which need OpenGL 3.3";
+    _indexCount = 0;
+    _lods = mesh::LodChain();
+    _clusters.reset();
+    _releaseMesh();
+    return;
+  }
+
+  constexpr size_t MAX_BYTES = size_t(std::numeric_limits<int>::max());
+
+  if (file.vertexDataSize() > MAX_BYTES || file.indexDataSize() > MAX_BYTES) {
+    // QOpenGLBuffer takes sizes as ints; don't let these wrap around
+    qCWarning(logs::gl::Resource)
+        << "This mesh file's buffers are too big to allocate";
+    _indexCount = 0;
+    _lods = mesh::LodChain();
+    _clusters.reset();
+    _releaseMesh();
+    return;
+  }
+
+  _vertexFormat = info.format;
+  _quantization = info.quantization;
+  _lods = info.lods;
+  _clusters.reset();
+  // Mesh files don't store clusters, and there's no CPU-side copy to build
+  // them from, so these are drawn whole
+  _uniforms.setMeshTransform(_quantization.matrix());
+
+  _vbo = QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+  _ibo = QOpenGLBuffer(QOpenGLBuffer::IndexBuffer);
+  _vbo.create();
+  _ibo.create();
+  _vbo.setUsagePattern(USAGE_PATTERN);
+  _ibo.setUsagePattern(USAGE_PATTERN);
+  _bindMeshBuffers();
+
+  // The file is laid out exactly like the buffers, so the driver can copy
+  // straight out of the mapping
+  _vbo.allocate(file.vertexData(), static_cast<int>(file.vertexDataSize()));
+  _ibo.allocate(file.indexData(), static_cast<int>(file.indexDataSize()));
+  _indexType = info.indexType;
+  _indexCount = info.indexCount;
+
+  if (_settings[SettingKey::MeshCacheGpu].value.toBool()) {
+    size_t bytes = file.vertexDataSize() + file.indexDataSize();
+    _meshCache.insertGpu(_pendingKey, {
+      _vbo, _ibo, _indexType, _indexCount, _vertexFormat, _quantization, _lods,
+      nullptr, bytes
+    });
+  }
+
+  qCDebug(logs::gl::Resource).noquote()
+      << info.vertexCount << "vertices uploaded from a mesh file;"
+      << info.format.toString();
 
-    case GL_DOUBLE_MAT4: {
-      if (_gl40) {
-        Q_ASSERT(var.canConvert<glm::dmat4>());
-        glm::dmat4 dmat4 = var.value<glm::dmat4>();
-        _gl40->glUniformMatrix4dv(index, 1, false, glm::value_ptr(dmat4));
-        break;
+  _releaseMesh();
+}
+
+void BallsCanvas::saveMesh(const QString& path) {
+  using mesh::MeshFileInfo;
+
+  if (_mesh.mesh && !_mesh.mesh->vertices().empty()) {
+    // If we still have the CPU-side mesh, there's no need to touch the GPU
+    mesh::saveMeshFile(path, *_mesh.mesh, _mesh.lods, _vertexFormat);
+    return;
+  }
+
+  // Otherwise read the buffers back; they're already laid out like the file
+  makeCurrent();
+
+  MeshFileInfo info;
+  info.format = _vertexFormat;
+  info.quantization = _quantization;
+  info.indexType = _indexType;
+  info.vertexCount = _vbo.isCreated() ? _vbo.size() / _vertexFormat.stride()
+                     : 0;
+  info.indexCount = _indexCount;
+  info.lods = _lods;
+  info.low = _lods.center - glm::vec3(_lods.radius);
+  info.high = _lods.center + glm::vec3(_lods.radius);
+  // Without the vertices, the bounding sphere's box is the best we can do
+
+  auto read = [](QOpenGLBuffer & buffer, void* out) {
+    if (buffer.isCreated() && buffer.size() > 0) {
+      buffer.bind();
+
+      if (!buffer.read(0, out, buffer.size())) {
+        qCWarning(logs::gl::Resource) << "Couldn't read back buffer"
+                                      << buffer.bufferId();
       }
     }
+  };
 
-    case GL_FLOAT_MAT4: {
-      Q_ASSERT(var.canConvert<glm::mat4>());
-      glm::mat4 mat4 = var.value<glm::mat4>();
-      _gl30->glUniformMatrix4fv(index, 1, false, glm::value_ptr(mat4));
-      break;
-    }
+  mesh::saveMeshFile(path, info, [&](void* out) {
+    read(_vbo, out);
+  }, [&](void* out) {
+    read(_ibo, out);
+  });
+
+  doneCurrent();
+}
+
+void BallsCanvas::startCapture(const util::CaptureTarget& target) noexcept {
+  makeCurrent();
+  _capture.start(target);
+  doneCurrent();
+
+  if (_capture.isActive()) {
+    // Record every frame, not just the ones where something changed
+    _scheduler.setAnimating(_uniforms.animated() || target.frames != 1);
+    _scheduler.invalidate(FrameScheduler::Animation);
+  }
+}
+
+void BallsCanvas::stopCapture() noexcept {
+  makeCurrent();
+  _capture.stop();
+  doneCurrent();
+}
+
+bool BallsCanvas::_writeBuffer(QOpenGLBuffer& buffer, const size_t bytes,
+                               const function<void(void*)>& write) noexcept {
+  using Access = QOpenGLBuffer::RangeAccessFlag;
+  Q_ASSERT(this->context() == QOpenGLContext::currentContext());
+
+  if (bytes > size_t(std::numeric_limits<int>::max())) {
+    // QOpenGLBuffer takes sizes as ints; don't let this one wrap around
+    qCWarning(logs::gl::Resource) << "Can't allocate" << bytes
+                                  << "bytes for buffer" << buffer.bufferId()
+                                  << "(more than an int can hold)";
+    buffer.allocate(0);
+    return false;
+  }
+
+  int size = static_cast<int>(bytes);
+  buffer.allocate(size);
+
+  if (size == 0) {
+    return true;
+  }
+
+  void* out = buffer.mapRange(0, size,
+                              Access::RangeWrite |
+                              Access::RangeInvalidateBuffer);
 
-    default:
-      qCWarning(logs::uniform::Type)
-          << "Unsupported GLSL type" << util::resolveGLType(info.type);
+  if (out != nullptr) {
+    write(out);
+
+    if (buffer.unmap()) {
+      return true;
     }
+
+    // If the driver lost the mapped storage (e.g. a mode switch), try again
+    qCWarning(logs::gl::Resource) << "Buffer" << buffer.bufferId()
+                                  << "was corrupted while mapped";
   }
-  else {
-    qCWarning(logs::uniform::Name)
-        << "Attempted to set non-existing uniform" << info.name << "to" << var;
+
+  vector<char> staging(bytes);
+  write(staging.data());
+  buffer.write(0, staging.data(), size);
+  return false;
+}
+
+size_t BallsCanvas::_chooseLod() noexcept {
+  const vector<mesh::LodLevel>& levels = _lods.levels;
+  Q_ASSERT(!levels.empty());
+
+  float radius = _uniforms.projectedRadius(_lods.center,
+                 _lods.radius * _instanceScale);
+  // When instanced, each copy is drawn smaller than the whole mesh would be
+  float budget = glm::pi<float>() * radius * radius / PIXELS_PER_TRIANGLE;
+  size_t lod = 0;
+
+  while (lod + 1 < levels.size() && levels[lod].indexCount / 3 > budget) {
+    // Use the finest level that doesn't cram in more triangles than it can
+    // show at this size
+    ++lod;
   }
+
+  if (lod != _lod) {
+    qCDebug(logs::mesh::Name) << "Switched to level of detail" << lod << "("
+                              << levels[lod].indexCount / 3 << "triangles,"
+                              << radius << "pixels across)";
+    _lod = lod;
+  }
+
+  return lod;
+}
+
+mesh::VertexFormat BallsCanvas::_chooseVertexFormat() const noexcept {
+  using mesh::NormalFormat;
+  using mesh::PositionFormat;
+
+  auto position = static_cast<PositionFormat>(
+                    _settings.at(SettingKey::PositionFormat).value.toInt());
+  auto normal = static_cast<NormalFormat>(
+                  _settings.at(SettingKey::NormalFormat).value.toInt());
+
+  if (normal == NormalFormat::Int2_10_10_10 && _gl33 == nullptr) {
+    // GL_INT_2_10_10_10_REV vertex attributes are core in OpenGL 3.3
+    qCWarning(logs::gl::Feature)
+        << "Packed normals need OpenGL 3.3; using floats instead";
+    normal = NormalFormat::Float;
+  }
+
+  return mesh::VertexFormat(position, normal);
+}
+
+void BallsCanvas::_releaseMesh() noexcept {
+  if (_settings[SettingKey::MeshKeepCpu].value.toBool()) {
+    return;
+  }
+
+  // The GPU has its own copy now; only keep ours if the cache needs it to
+  // re-upload this mesh later
+  _meshCache.releaseCpu(_pendingKey);
+  this->_mesh = mesh::BuiltMesh();
+}
+
+void BallsCanvas::_bindMeshBuffers() noexcept {
+  // The VAO remembers which buffers its attributes and indices come from
+  _vao.bind();
+  _vbo.bind();
+  _initAttributes();
+  _ibo.bind();
+}
+
+void BallsCanvas::setOption(const bool value) noexcept {
+  QObject* send = sender();
+  QVariant name = send->property(constants::properties::OPTION);
+
+  Q_ASSERT(send != nullptr); // Must be called as a slot!
+  Q_ASSERT(name.isValid()&&  name.type() == QVariant::String);
+
+  this->_settings[name.toString()] = Setting(value, true);
+  _scheduler.invalidate(FrameScheduler::Settings);
+
+  qCDebug(logs::gl::State) << "Set" << name.toString() << "to" << value;
+}
+
+void BallsCanvas::setOption(const int value) noexcept {
+  QObject* send = sender();
+  QVariant name = send->property(constants::properties::OPTION);
+
+  Q_ASSERT(send != nullptr); // Must be called as a slot!");
+  Q_ASSERT(name.isValid() && name.type() == QVariant::String);
+
+  this->_settings[name.toString()] = Setting(value, true);
+  _scheduler.invalidate(FrameScheduler::Settings);
+
+  qCDebug(logs::gl::State) << "Set" << name.toString() << "to" << value;
+}
+
+void BallsCanvas::mouseMoveEvent(QMouseEvent *e) {
+}
+
+void BallsCanvas::wheelEvent(QWheelEvent *) {
 }
 
 void BallsCanvas::resetCamera() noexcept {
@@ -738,49 +1336,69 @@ void BallsCanvas::resetCamera() noexcept {
   qCDebug(logs::uniform::Env) << "Reset camera and model rotation to default";
 }
 
-bool BallsCanvas::updateShaders(const QString& vertex,
+void BallsCanvas::updateShaders(const QString& vertex,
                                 const QString& geometry,
                                 const QString& fragment) noexcept {
 
   Q_UNUSED(geometry);
-  using namespace balls::shader;
 
-  this->makeCurrent();
-  this->_shader.release();
-  this->_shader.removeAllShaders();
+  _vertexSource = vertex;
+  _fragmentSource = fragment;
+  _linkShaders();
+}
 
-  bool vert = _shader.addShaderFromSourceCode(QOpenGLShader::Vertex, vertex);
-  bool frag = _shader.addShaderFromSourceCode(QOpenGLShader::Fragment, fragment);
-  bool link = _shader.link();
-  bool bind = _shader.bind();
-  bool result = vert && frag && link && bind;
+void BallsCanvas::_linkShaders() noexcept {
+  QString vertex = _vertexSource;
 
-  if (Q_UNLIKELY(!vert)) {
-    qCWarning(logs::shader::Name) << "Couldn't compile vertex shader";
+  if (_procedural != mesh::ProceduralShape::None) {
+    Q_ASSERT(_meshgen != nullptr);
+    vertex = mesh::proceduralShader(vertex, _procedural,
+                                    _meshgen->getParameters());
   }
 
-  if (Q_UNLIKELY(!frag)) {
-    qCWarning(logs::shader::Name) << "Couldn't compile fragment shader";
+  if (_compiler.isCreated()) {
+    int request = _compiler.compile(vertex, _fragmentSource);
+    qCDebug(logs::shader::Name) << "Compiling shaders in the background"
+                                << "(request" << request << ")";
+    return;
   }
 
-  if (Q_UNLIKELY(!link)) {
-    qCWarning(logs::shader::Name) << "Couldn't link shaders together";
+  // Without a shared context, fall back to compiling right here
+  this->makeCurrent();
+  _receiveProgram(buildProgram(*context(), _programCache, vertex,
+                               _fragmentSource));
+}
+
+void BallsCanvas::_receiveProgram(const CompiledProgram& compiled) noexcept {
+  if (Q_UNLIKELY(!compiled.program)) {
+    // Keep drawing with the last program that worked
+    emit shadersUpdated(false, compiled.log);
+    return;
   }
 
-  if (Q_UNLIKELY(!bind)) {
+  this->makeCurrent();
+  _shader->release();
+  _shader = compiled.program;
+  // The old program is deleted here, with the context current
+
+  if (Q_UNLIKELY(!_shader->bind())) {
     qCWarning(logs::shader::Name) << "Couldn't bind shader program to context";
   }
 
-  if (Q_UNLIKELY(!result)) {
-    qCWarning(logs::shader::Name) << _shader.log();
-    _shader.removeAllShaders();
-  }
+  this->_updateUniformList(compiled.uniforms);
 
-  if (Q_LIKELY(result)) {
-    this->_updateUniformList();
-    qCDebug(logs::shader::Name) << "Updated shaders";
+  if (_hasPendingShape) {
+    _seedProceduralUniforms();
   }
 
-  return result;
+  _uniformTable.build({_gl30, _gl40}, _shader->programId(),
+                      _uniforms.uniformInfo(), _uniforms);
+  _usesBuiltinBlock = _builtinBlock.attach(_shader->programId());
+  qCDebug(logs::shader::Name) << "Updated shaders";
+
+  _scheduler.setAnimating(_uniforms.animated() || _capture.isActive());
+  _scheduler.invalidate(FrameScheduler::Shaders);
+
+  emit shadersUpdated(true, compiled.log);
 }
 }
@@ -1,8 +1,12 @@
 #ifndef BALLSCANVAS_HPP
 #define BALLSCANVAS_HPP
 
+#include <atomic>
+#include <functional>
+#include <memory>
 #include <unordered_map>
 
+#include <QtCore/QFutureWatcher>
 #include <QtCore/QtGlobal>
 #include <QtGui/QOpenGLBuffer>
 #include <QtGui/QOpenGLDebugLogger>
@@ -12,12 +16,22 @@
 #include <QtWidgets/QOpenGLWidget>
 
 #include "mesh/Mesh.hpp"
+#include "mesh/MeshCache.hpp"
+#include "mesh/Procedural.hpp"
 #include "shader/ShaderInputs.hpp"
+#include "shader/BuiltinBlock.hpp"
+#include "shader/ProgramCache.hpp"
+#include "shader/ShaderCompiler.hpp"
 #include "shader/ShaderUniform.hpp"
+#include "shader/UniformTable.hpp"
 #include "config/Settings.hpp"
+#include "util/FrameCapture.hpp"
+#include "util/GpuProfiler.hpp"
 #include "util/Logging.hpp"
+#include "util/PipelineStats.hpp"
 #include "util/Trackball.hpp"
 #include "util/TypeInfo.hpp"
+#include "ui/FrameScheduler.hpp"
 #include "ui/Uniforms.hpp"
 
 class QOpenGLFunctions_3_0;
@@ -36,9 +50,13 @@ class MeshGenerator;
 }
 
 
+using std::atomic;
 using std::pair;
+using std::shared_ptr;
+using std::unique_ptr;
 using std::unordered_map;
 using std::uint8_t;
+using std::vector;
 using namespace balls::config;
 using namespace balls::shader;
 using balls::util::types::UniformCollection;
@@ -59,10 +77,29 @@ public:
   void paintGL() override;
   void resizeGL(const int, const int) override;
   void setMesh(mesh::MeshGenerator*) noexcept;
-  bool updateShaders(const QString&, const QString&, const QString&) noexcept;
+
+  /**
+   * @brief Saves the current mesh, as uploaded, to a mesh file that can be
+   * drawn again without building it.
+   * @throws FileException if the file can't be written
+   */
+  void saveMesh(const QString&);
+
+  /**
+   * @brief Starts reading back every frame the canvas draws (and keeps it
+   * drawing until the capture stops) without waiting on the GPU.
+   */
+  void startCapture(const util::CaptureTarget&) noexcept;
+  void stopCapture() noexcept;
+
+  /**
+   * @brief Starts compiling new shaders in the background; the current ones
+   * stay in use until they've linked. shadersUpdated() says how it went.
+   */
+  void updateShaders(const QString&, const QString&, const QString&) noexcept;
 public /* getters/setters */:
-  QOpenGLShaderProgram& getShader() noexcept { return _shader; }
-  const QOpenGLShaderProgram& getShader() const noexcept { return _shader;  }
+  QOpenGLShaderProgram& getShader() noexcept { return *_shader; }
+  const QOpenGLShaderProgram& getShader() const noexcept { return *_shader;  }
 
   QOpenGLDebugLogger& getLogger() noexcept { return _log; }
   const QOpenGLDebugLogger& getLogger() const noexcept { return _log; }
@@ -72,42 +109,99 @@ public /* getters/setters */:
 
   const Uniforms& getUniforms() const noexcept { return _uniforms; }
   Uniforms& getUniforms() noexcept { return _uniforms; }
+  const util::GpuProfiler& getProfiler() const noexcept { return _profiler; }
+  const util::PipelineStats& getPipelineStats() const noexcept {
+    return _pipelineStats;
+  }
+  const util::FrameCapture& getCapture() const noexcept { return _capture; }
 signals:
   void geometryShadersSupported(const bool);
   void gl3NotSupported();
   void finishedInitializing();
   void fatalGraphicsError(const QString&, const QString&, const int);
   void graphicsWarning(const QString&, const QString&);
+  void captureStopped();
+
+  /// Emitted once shaders from updateShaders() are in use, or failed to build
+  void shadersUpdated(const bool, const QString& log);
 
   void uniformsDiscovered(const UniformCollection&);
 public slots:
   void setOption(const bool) noexcept;
   void setOption(const int) noexcept;
   void resetCamera() noexcept;
-public:
-  void setUniform(const UniformInfo&, const QVariant&) noexcept;
 protected:
   void mouseMoveEvent(QMouseEvent *e) override;
   void wheelEvent(QWheelEvent *) override;
-  void timerEvent(QTimerEvent *) override;
+private slots:
+  void _receiveMesh() noexcept;
+  void _receiveProgram(const shader::CompiledProgram&) noexcept;
 private /* mesh information */:
   mesh::MeshGenerator* _meshgen;
-  mesh::Mesh _mesh;
+  mesh::BuiltMesh _mesh;
+  mesh::MeshCache _meshCache;
+  QFutureWatcher<mesh::BuiltMesh> _meshJob;
+  mesh::MeshCache::Key _meshJobKey;
+  unsigned _meshJobRequest;
+  unique_ptr<mesh::MeshGenerator> _queuedMesh;
+  atomic<unsigned> _meshRequest;
+  mesh::MeshCache::Key _pendingKey;
+  mesh::BuiltMesh _pendingMesh;
+  bool _hasPendingMesh;
+  GLenum _indexType;
+  GLsizei _indexCount;
+  mesh::VertexFormat _vertexFormat;
+  mesh::Quantization _quantization;
+  mesh::LodChain _lods;
+  size_t _lod;
+  shared_ptr<const mesh::ClusterSet> _clusters;
+  vector<GLsizei> _drawCounts;
+  vector<const void*> _drawOffsets;
+  // The ranges of the index buffer that survived culling this frame
+  GLsizei _instanceCount;
+  float _instanceScale;
+  bool _instancesMoved;
+  // False if there's one instance and it's drawn exactly where the mesh is
+  mesh::ProceduralShape _procedural;
+  // While set, the vertex shader generates the shape and no mesh buffers are
+  // drawn
+  mesh::MeshParameters _pendingShapeParameters;
+  bool _hasPendingShape;
+  // What to seed the shape's uniforms with once they exist, i.e. once the
+  // program that declares them has been received
 
 private /* shader attributes/uniforms */:
   Uniforms _uniforms;
-  const QMetaObject* _uniformsMeta;
-  int _uniformsPropertyOffset;
-  int _uniformsPropertyCount;
+  FrameScheduler _scheduler;
+
+  /// Rebuilt whenever the program is linked
+  shader::UniformTable _uniformTable;
+
+  /// Shared by every program that declares it; see BUILTIN_BLOCK
+  shader::BuiltinBlock _builtinBlock;
+  bool _usesBuiltinBlock;
 
   unordered_map<AttributeName, int> _attributes;
   unordered_map<QString, Setting> _settings;
+  QString _vertexSource;
+  QString _fragmentSource;
+  // As they were given to updateShaders(); the program is linked again from
+  // these when procedural shapes are switched on or off
 private /* OpenGL structures */:
   QOpenGLDebugLogger _log;
   QOpenGLBuffer _vbo;
   QOpenGLBuffer _ibo;
+  QOpenGLBuffer _instanceVbo;
   QOpenGLVertexArrayObject _vao;
-  QOpenGLShaderProgram _shader;
+  QOpenGLVertexArrayObject _proceduralVao;
+  shared_ptr<QOpenGLShaderProgram> _shader;
+  // Swapped for each newly compiled program, so it's never left unlinked
+  util::GpuProfiler _profiler;
+  util::PipelineStats _pipelineStats;
+  util::FrameCapture _capture;
+  shader::ProgramCache _programCache;
+  // The only one; _compiler uses it too, or this does if it can't be created
+  shader::ShaderCompiler _compiler;
   uint8_t _glmajor : 3;
   uint8_t _glminor : 3;
 
@@ -122,8 +216,53 @@ private /* OpenGL function pointers */:
   QOpenGLFunctions_4_3_Core* _gl43;
 
 private /* update methods */:
-  void _updateUniformList() noexcept;
+  void _startMeshJob() noexcept;
+  void _uploadMesh() noexcept;
+  void _uploadMeshFile(const mesh::MeshFile&) noexcept;
+  void _bindMeshBuffers() noexcept;
+
+  /**
+   * @brief Switches procedural drawing on or off for the given generator,
+   * relinking the program if that changes, and resets the shape's uniforms to
+   * the generator's parameters (once the relinked program arrives, if any).
+   */
+  void _useProcedural(const mesh::MeshGenerator&) noexcept;
+
+  /// Sets the shape's uniforms that the program has to the pending parameters
+  void _seedProceduralUniforms() noexcept;
+
+  /**
+   * @brief The current generator's parameters as the shape's uniforms have
+   * them right now, within the generator's limits.
+   */
+  mesh::MeshParameters _proceduralParameters() noexcept;
+
+  /**
+   * @brief Lays out as many copies of the mesh as the settings ask for, and
+   * uploads them to the instance buffer in one go.
+   */
+  void _uploadInstances() noexcept;
+
+  /**
+   * @brief Allocates a bound buffer and has write() fill it in place through
+   * glMapBufferRange(); if mapping isn't possible, write() fills a temporary
+   * copy instead. Returns true if the buffer was mapped. Leaves the buffer
+   * empty (and returns false) if it would need more bytes than an int holds.
+   */
+  bool _writeBuffer(QOpenGLBuffer&, const size_t,
+                    const std::function<void(void*)>&) noexcept;
+
+  /// Drops the CPU-side copy of the current mesh, unless told to keep it
+  void _releaseMesh() noexcept;
+
+  /// Picks a level of detail by how big the mesh looks on screen right now
+  size_t _chooseLod() noexcept;
+
+  /// The vertex format the settings ask for, if this context supports it
+  mesh::VertexFormat _chooseVertexFormat() const noexcept;
+  void _updateUniformList(const UniformCollection&) noexcept;
   void _updateUniformValues() noexcept;
+  void _linkShaders() noexcept;
 private /* initializers */:
   void _initAttributeLocations() noexcept;
   void _initSettings() noexcept;
@@ -132,6 +271,7 @@ private /* initializers */:
   void _initLogger() noexcept;
   void _initShaders() noexcept ;
   void _initAttributes() noexcept;
+  void _initInstanceAttributes() noexcept;
 
 private /* templated utility methods */:
   template <GLenum E>
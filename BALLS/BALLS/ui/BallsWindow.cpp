@@ -1,11 +1,14 @@
 ﻿#include "precompiled.hpp"
 #include "ui/BallsWindow.hpp"
 
+#include <QtCore/QDir>
+#include <QtCore/QFileInfo>
 #include <QtCore/QMetaEnum>
 #include <QtCore/QSettings>
 #include <QtWidgets/QErrorMessage>
 #include <QtWidgets/QComboBox>
 #include <QtWidgets/QFileDialog>
+#include <QtWidgets/QInputDialog>
 #include <QtWidgets/QMessageBox>
 
 #include "ui/QsciLexerGLSL.h"
@@ -16,8 +19,10 @@
 #include "mesh/MeshFunction.hpp"
 #include "mesh/MeshGenerator.hpp"
 #include "mesh/Generators.hpp"
+#include "mesh/Importer.hpp"
 #include "util/Util.hpp"
 #include "shader/ShaderUniform.hpp"
+#include "ui/docks/OpenGLInfo.hpp"
 
 Q_DECLARE_METATYPE(balls::mesh::MeshGenerator*)
 
@@ -36,7 +41,11 @@ QMainWindow(parent),
             _geomLexer(new QsciLexerGLSL(this)),
             _save(new QFileDialog(this, tr("Save BALLS project"), ".")),
             _load(new QFileDialog(this, tr("Load BALLS project"), ".")),
+            _import(new QFileDialog(this, tr("Import mesh"), ".")),
+            _saveMesh(new QFileDialog(this, tr("Save mesh"), ".")),
+            _screenshot(new QFileDialog(this, tr("Save screenshot"), ".")),
             _error(new QErrorMessage(this)),
+            _glInfo(new OpenGLInfo(this)),
 _settings(new QSettings(this)) {
   ui.setupUi(this);
 
@@ -58,8 +67,56 @@ _settings(new QSettings(this)) {
   _load->setFileMode(QFileDialog::FileMode::ExistingFile);
   _load->setNameFilterDetailsVisible(true);
 
+  _import->setAcceptMode(QFileDialog::AcceptOpen);
+  _import->setFileMode(QFileDialog::FileMode::ExistingFile);
+  _import->setNameFilters({tr(mesh::MESH_FILE_FILTER), tr("All files (*)")});
+
+  _saveMesh->setAcceptMode(QFileDialog::AcceptSave);
+  _saveMesh->setDefaultSuffix(extensions::MESH);
+  _saveMesh->setFileMode(QFileDialog::FileMode::AnyFile);
+  _saveMesh->setNameFilters({filters::MESH});
+  _saveMesh->setNameFilterDetailsVisible(true);
+
+  _screenshot->setAcceptMode(QFileDialog::AcceptSave);
+  _screenshot->setDefaultSuffix("png");
+  _screenshot->setFileMode(QFileDialog::FileMode::AnyFile);
+  _screenshot->setNameFilters({tr("PNG images (*.png)")});
+  _screenshot->setNameFilterDetailsVisible(true);
+
+  mesh::ImportNotifier* notifier = mesh::ImportNotifier::instance();
+  // Imports run on the thread pool, so these are all queued connections
+
+  connect(notifier, &mesh::ImportNotifier::progress, this,
+  [this](const QString & path, const int percent) {
+    ui.statusBar->showMessage(tr("Importing %1... %2%")
+                              .arg(QFileInfo(path).fileName()).arg(percent));
+  });
+  connect(notifier, &mesh::ImportNotifier::finished, this,
+  [this](const QString & path, const QString & summary) {
+    ui.statusBar->showMessage(tr("Imported %1 (%2)")
+                              .arg(QFileInfo(path).fileName(), summary), 10000);
+  });
+  connect(notifier, &mesh::ImportNotifier::failed, this,
+  [this](const QString & path, const QString & error) {
+    ui.statusBar->clearMessage();
+    qCWarning(logs::mesh::Import) << "Couldn't import" << path << ":" << error;
+    _error->showMessage(error);
+  });
+
   ui.uniforms->setObject(&ui.canvas->getUniforms());
   ui.uniforms->registerCustomPropertyCB(shader::createShaderProperty);
+
+  addDockWidget(Qt::LeftDockWidgetArea, _glInfo);
+  tabifyDockWidget(ui.sceneDock, _glInfo);
+  ui.sceneDock->raise();
+  ui.menuView->addAction(_glInfo->toggleViewAction());
+  _glInfo->setProfiler(&ui.canvas->getProfiler());
+  _glInfo->setPipelineStats(&ui.canvas->getPipelineStats());
+
+  connect(ui.canvas, &BallsCanvas::captureStopped, this,
+          &BallsWindow::_captureStopped);
+  connect(ui.canvas, &BallsCanvas::shadersUpdated, this,
+          &BallsWindow::_shadersUpdated);
 }
 
 BallsWindow::~BallsWindow() { _settings->sync(); }
@@ -71,6 +128,14 @@ ProjectConfig BallsWindow::getProjectConfig() const noexcept {
   project.glMajor = ui.canvas->getOpenGLMajor();
   project.glMinor = ui.canvas->getOpenGLMinor();
 
+  mesh::MeshGenerator* generator =
+    ui.meshComboBox->currentData().value<mesh::MeshGenerator*>();
+
+  if (generator != nullptr && generator->getParameters().count(mesh::PATH)) {
+    // If the current mesh came from a file, point the project at it
+    project.mesh = generator->get<QString>(mesh::PATH);
+  }
+
   const Uniforms& uniforms = ui.canvas->getUniforms();
 
   for (const QByteArray& u : uniforms.dynamicPropertyNames()) {
@@ -130,28 +195,33 @@ void BallsWindow::forceShaderUpdate() noexcept {
   QString vertex = ui.vertexEditor->text();
   QString geometry = ui.geometryEditor->text();
   QString fragment = ui.fragmentEditor->text();
-  ui.log->clear();
 
   ui.uniforms->setObject(&ui.canvas->getUniforms());
-  ui.canvas->makeCurrent();
+  ui.statusBar->showMessage(tr("Compiling shaders..."));
+  ui.canvas->updateShaders(vertex, geometry, fragment);
+  // The canvas keeps drawing with the old shaders until these are ready
+}
 
-  if (this->ui.canvas->updateShaders(vertex, geometry, fragment))
-  {
+void BallsWindow::_shadersUpdated(const bool success,
+                                  const QString& log) noexcept {
+  ui.log->clear();
+  ui.statusBar->clearMessage();
+
+  if (success) {
     ui.canvas->update();
     this->ui.log->appendPlainText(tr("Success"));
   }
 
   else {
-    const QOpenGLShaderProgram& shader = this->ui.canvas->getShader();
-    const QOpenGLDebugLogger& log = ui.canvas->getLogger();
+    const QOpenGLDebugLogger& debug = ui.canvas->getLogger();
 
-    this->ui.log->appendPlainText(shader.log());
-    qDebug() << shader.log();
+    this->ui.log->appendPlainText(log);
+    qDebug() << log;
 
-    if (Q_LIKELY(log.isLogging())) {
+    if (Q_LIKELY(debug.isLogging())) {
       using namespace logs;
 
-      for (const QOpenGLDebugMessage& message : log.loggedMessages()) {
+      for (const QOpenGLDebugMessage& message : debug.loggedMessages()) {
         qCDebug(gl::Message) << message;
         this->ui.log->appendPlainText(message.message());
       }
@@ -196,8 +266,8 @@ void BallsWindow::_loadProject(const QString& path) noexcept {
 
       forceShaderUpdate();
 
-      for (const auto& u : project.uniforms) {
-        //ui.canvas->setUniform(u., u.second);
+      if (!project.mesh.isEmpty()) {
+        _importMesh(project.mesh);
       }
     }
 
@@ -219,6 +289,132 @@ void BallsWindow::_loadProject(const QString& path) noexcept {
   }
 }
 
+void BallsWindow::importMesh() noexcept {
+  _import->open(this, SLOT(_importMesh(QString)));
+  qCDebug(logs::ui::Name) << "Opened import dialog...";
+}
+
+void BallsWindow::_importMesh(const QString& path) noexcept {
+  using namespace balls::mesh;
+
+  for (int i = 0; i < ui.meshComboBox->count(); ++i) {
+    MeshGenerator* gen = ui.meshComboBox->itemData(i).value<MeshGenerator*>();
+
+    if (gen->getParameters().count(PATH) &&
+        gen->get<QString>(PATH) == path) {
+      // If we've already imported this file, just switch back to it
+      ui.meshComboBox->setCurrentIndex(i);
+      return;
+    }
+  }
+
+  _importedMeshes.emplace_back(new MeshGenerator(
+                                 QFileInfo(path).fileName(), functions::file,
+  {
+    {PATH, {path, 0, 0}},
+    {WELD, {1, 0, 1}}
+  }));
+
+  MeshGenerator* gen = _importedMeshes.back().get();
+  ui.meshComboBox->addItem(gen->getName(), QVariant::fromValue(gen));
+  ui.meshComboBox->setCurrentIndex(ui.meshComboBox->count() - 1);
+  // This calls setMesh(), which starts the import in the background
+
+  qCDebug(logs::ui::Name) << "Added imported mesh" << path << "to selector";
+}
+
+void BallsWindow::saveMesh() noexcept {
+  _saveMesh->open(this, SLOT(_saveMeshFile(QString)));
+  qCDebug(logs::ui::Name) << "Opened mesh save dialog...";
+}
+
+void BallsWindow::_saveMeshFile(const QString& path) noexcept {
+  try {
+    ui.canvas->saveMesh(path);
+    ui.statusBar->showMessage(tr("Saved %1").arg(QFileInfo(path).fileName()),
+                              10000);
+  }
+  catch (const FileException& error) {
+    QString e = error.fullMessage();
+    qCWarning(logs::mesh::Import) << e;
+    _error->showMessage(e);
+  }
+  catch (...) {
+    qCritical() << "Unknown error";
+    _error->showMessage(tr("Unknown error"));
+  }
+}
+
+void BallsWindow::saveScreenshot() noexcept {
+  _screenshot->open(this, SLOT(_saveScreenshot(QString)));
+  qCDebug(logs::ui::Name) << "Opened screenshot save dialog...";
+}
+
+void BallsWindow::_saveScreenshot(const QString& path) noexcept {
+  util::CaptureTarget target;
+  target.destination = path;
+  target.frames = 1;
+  ui.canvas->startCapture(target);
+}
+
+void BallsWindow::recordFrames(const bool record) noexcept {
+  if (!record) {
+    ui.canvas->stopCapture();
+    return;
+  }
+
+  QString dir = QFileDialog::getExistingDirectory(this, tr("Record frames to"));
+
+  if (dir.isEmpty()) {
+    QSignalBlocker blocker(ui.actionRecord_Frames);
+    ui.actionRecord_Frames->setChecked(false);
+    return;
+  }
+
+  util::CaptureTarget target;
+  target.destination = QDir(dir).filePath("frame%1.png");
+  ui.canvas->startCapture(target);
+  ui.statusBar->showMessage(tr("Recording to %1...").arg(dir));
+}
+
+void BallsWindow::recordToEncoder() noexcept {
+  QSize size = ui.canvas->size() * ui.canvas->devicePixelRatio();
+  QString command = QString(
+                      "ffmpeg -y -f rawvideo -pix_fmt rgba -s %1x%2 -r 60 -i - "
+                      "-pix_fmt yuv420p capture.mp4")
+                    .arg(size.width()).arg(size.height());
+  // The frames are raw, top-down RGBA at the canvas's size in pixels
+
+  bool ok = false;
+  command = QInputDialog::getText(this, tr("Record to encoder"),
+                                  tr("Command to pipe raw RGBA frames into:"),
+                                  QLineEdit::Normal, command, &ok);
+
+  if (!ok || command.isEmpty()) {
+    return;
+  }
+
+  util::CaptureTarget target;
+  target.format = util::CaptureFormat::Pipe;
+  target.destination = command;
+  ui.canvas->startCapture(target);
+
+  QSignalBlocker blocker(ui.actionRecord_Frames);
+  ui.actionRecord_Frames->setChecked(ui.canvas->getCapture().isActive());
+  // Unchecking it stops the recording, whichever kind it is
+  ui.statusBar->showMessage(tr("Recording to \"%1\"...").arg(command));
+}
+
+void BallsWindow::_captureStopped() noexcept {
+  const util::FrameCapture& capture = ui.canvas->getCapture();
+
+  QSignalBlocker blocker(ui.actionRecord_Frames);
+  ui.actionRecord_Frames->setChecked(false);
+  ui.statusBar->showMessage(tr("Captured %1 frames (%2 dropped)")
+                            .arg(capture.captured()).arg(capture.dropped()),
+                            10000);
+}
+
 void BallsWindow::loadExample() noexcept {
 
   QObject* s = sender();
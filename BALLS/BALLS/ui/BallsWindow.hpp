@@ -3,6 +3,9 @@
 
 #include "ui_BallsWindow.h"
 
+#include <memory>
+#include <vector>
+
 #include <QtGlobal>
 
 #include "config/ProjectConfig.hpp"
@@ -17,6 +20,12 @@ class QCloseEvent;
 
 namespace balls {
 
+namespace mesh {
+class MeshGenerator;
+}
+
+class OpenGLInfo;
+
 using std::random_device;
 using std::default_random_engine;
 using std::uniform_real_distribution;
@@ -33,6 +42,11 @@ public slots:
   void setMesh(const int) noexcept;
   void saveProject() noexcept;
   void loadProject();
+  void importMesh() noexcept;
+  void saveMesh() noexcept;
+  void saveScreenshot() noexcept;
+  void recordFrames(const bool) noexcept;
+  void recordToEncoder() noexcept;
 protected /* events */:
   void closeEvent(QCloseEvent *) override;
 
@@ -41,16 +55,28 @@ private /* members */:
   bool _generatorsInitialized;
 
   QSettings* _settings;
+
+  std::vector<std::unique_ptr<mesh::MeshGenerator>> _importedMeshes;
+  // Generators for files the user opened; the mesh selector points into these
 private /* UI components/dialogs/etc. */:
   QsciLexerGLSL* _vertLexer;
   QsciLexerGLSL* _fragLexer;
   QsciLexerGLSL* _geomLexer;
   QFileDialog* _save;
   QFileDialog* _load;
+  QFileDialog* _import;
+  QFileDialog* _saveMesh;
+  QFileDialog* _screenshot;
   QErrorMessage* _error;
+  OpenGLInfo* _glInfo;
 private slots:
   void _saveProject(const QString&) noexcept;
   void _loadProject(const QString&) noexcept;
+  void _importMesh(const QString&) noexcept;
+  void _saveMeshFile(const QString&) noexcept;
+  void _saveScreenshot(const QString&) noexcept;
+  void _captureStopped() noexcept;
+  void _shadersUpdated(const bool, const QString&) noexcept;
   void loadExample() noexcept;
 
   void initializeMeshGenerators() noexcept;
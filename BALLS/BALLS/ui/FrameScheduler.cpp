@@ -0,0 +1,105 @@
+#include "precompiled.hpp"
+#include "ui/FrameScheduler.hpp"
+
+#include <QtCore/QEvent>
+#include <QtCore/QTimerEvent>
+#include <QtWidgets/QWidget>
+
+#include "util/Logging.hpp"
+
+namespace balls {
+
+constexpr int FRAME_INTERVAL_MS = 1000 / 60;
+
+FrameScheduler::FrameScheduler(QWidget* canvas) noexcept
+  : QObject(canvas),
+    _canvas(canvas),
+    _reasons(None),
+    _requested(false),
+    _animating(false) {
+  Q_ASSERT(canvas != nullptr);
+
+  _canvas->installEventFilter(this);
+}
+
+void FrameScheduler::invalidate(const Reason reason) noexcept {
+  _reasons |= reason;
+
+  if (!_requested && _visible()) {
+    // Every widget update before the next paint is merged into one anyway, but
+    // this saves asking Qt a few hundred times during a mouse drag
+    _requested = true;
+    _canvas->update();
+  }
+}
+
+void FrameScheduler::setAnimating(const bool animating) noexcept {
+  if (animating != _animating) {
+    _animating = animating;
+    _updateTimer();
+
+    qCDebug(logs::ui::Frame) << (animating ? "Drawing continuously" :
+                                 "Drawing only when something changes");
+  }
+}
+
+FrameScheduler::Reasons FrameScheduler::beginFrame() noexcept {
+  Reasons reasons = _reasons;
+  _reasons = None;
+  _requested = false;
+
+  qCDebug(logs::ui::Frame) << "Drawing a frame for" << reasons;
+  return reasons;
+}
+
+bool FrameScheduler::eventFilter(QObject* object, QEvent* event) {
+  switch (event->type()) {
+  case QEvent::Show:
+    if (object == _canvas) {
+      // The window can only be found once the canvas is in it, and it may be
+      // minimized without the canvas itself being hidden
+      _canvas->window()->installEventFilter(this);
+    }
+
+  // Fall through
+  case QEvent::Hide:
+  case QEvent::WindowStateChange:
+    _updateTimer();
+
+    if (_visible() && _reasons != None) {
+      // Whatever was asked for while hidden is drawn all at once
+      _requested = true;
+      _canvas->update();
+    }
+
+    break;
+
+  default:
+    break;
+  }
+
+  return false;
+}
+
+void FrameScheduler::timerEvent(QTimerEvent* e) {
+  if (e->timerId() == _timer.timerId()) {
+    invalidate(Animation);
+  }
+}
+
+bool FrameScheduler::_visible() const noexcept {
+  return _canvas->isVisible() && !_canvas->window()->isMinimized();
+}
+
+void FrameScheduler::_updateTimer() noexcept {
+  if (_animating && _visible()) {
+    if (!_timer.isActive()) {
+      _timer.start(FRAME_INTERVAL_MS, Qt::PreciseTimer, this);
+    }
+  }
+  else if (_timer.isActive()) {
+    _timer.stop();
+    qCDebug(logs::ui::Frame) << "Paused the animation timer";
+  }
+}
+}
@@ -0,0 +1,89 @@
+#ifndef FRAMESCHEDULER_HPP
+#define FRAMESCHEDULER_HPP
+
+#include <QtCore/QBasicTimer>
+#include <QtCore/QFlags>
+#include <QtCore/QObject>
+
+class QWidget;
+
+namespace balls {
+
+/**
+ * @brief Decides when the canvas is drawn. Instead of repainting on a fixed
+ * timer, everything that can change the picture asks for a frame with the
+ * reason why, and asks made before the next frame are merged into one.
+ *
+ * Only a shader that reads a uniform that changes on its own (like
+ * elapsedTime) is redrawn continuously, and nothing is drawn at all while the
+ * canvas can't be seen; whatever was asked for in the meantime is drawn once
+ * it's shown again.
+ */
+class FrameScheduler final : public QObject {
+  Q_OBJECT
+
+public:
+  /// Why a frame was asked for
+  enum Reason : unsigned {
+    None = 0,
+
+    /// A uniform's value was edited
+    Uniforms = 1 << 0,
+
+    /// The mouse moved the camera or the model, or the view was reset
+    Input = 1 << 1,
+
+    /// A new mesh was swapped in
+    Mesh = 1 << 2,
+
+    /// The shader program was relinked
+    Shaders = 1 << 3,
+
+    /// A rendering setting changed
+    Settings = 1 << 4,
+
+    /// The shader reads something that changes every frame
+    Animation = 1 << 5,
+  };
+
+  Q_DECLARE_FLAGS(Reasons, Reason)
+
+  /// The canvas is watched for being shown, hidden, or minimized
+  explicit FrameScheduler(QWidget* canvas) noexcept;
+
+  /// Asks for a frame; does nothing if one is already on its way
+  void invalidate(const Reason) noexcept;
+
+  /// Whether to keep drawing frames even if nothing asks for them
+  void setAnimating(const bool) noexcept;
+  bool isAnimating() const noexcept { return _animating; }
+
+  /**
+   * @brief Called when the canvas starts drawing; returns everything that was
+   * asked for since the last frame, and forgets it. None if the frame is
+   * Qt's own idea (e.g. after a resize).
+   */
+  Reasons beginFrame() noexcept;
+
+protected:
+  bool eventFilter(QObject*, QEvent*) override;
+  void timerEvent(QTimerEvent*) override;
+
+private:
+  /// True unless the canvas is hidden or its window is minimized
+  bool _visible() const noexcept;
+
+  /// Runs the animation timer only while it would actually draw something
+  void _updateTimer() noexcept;
+
+  QWidget* _canvas;
+  Reasons _reasons;
+  bool _requested;
+  bool _animating;
+  QBasicTimer _timer;
+};
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(FrameScheduler::Reasons)
+}
+
+#endif // FRAMESCHEDULER_HPP
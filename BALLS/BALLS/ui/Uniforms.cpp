@@ -2,11 +2,15 @@
 #include "ui/Uniforms.hpp"
 #include "util/Logging.hpp"
 
+#include <limits>
+
 #include <QtCore/QEvent>
 #include <QtGui/QMouseEvent>
 #include <QtGui/QResizeEvent>
 #include <QtGui/QWheelEvent>
 
+#include <glm/gtc/matrix_access.hpp>
+
 #include "util/Trackball.hpp"
 #include "util/TypeInfo.hpp"
 #include "util/Util.hpp"
@@ -28,6 +32,8 @@ QObject(parent),
         _farPlane(100),
         _canvasSize(1, 1),
         _lastCanvasSize(1, 1),
+        _instanceCount(1),
+        _fixedTime(-1),
         _meta(metaObject())
 {
   setFov(glm::radians(45.0f));
@@ -83,6 +89,145 @@ void Uniforms::receiveUniforms(const UniformCollection& uniforms) noexcept {
   _handleKeptUniforms(temp);
 
   this->_uniformList = uniforms;
+  _updateSlots();
+}
+
+const std::unordered_map<QString, std::pair<GLenum, Uniforms::BuiltinWriter>>&
+Uniforms::_builtinWriters() noexcept {
+  using shader::UniformSlot;
+
+  // Straight from the source values; no QVariant, no property lookup
+  static const std::unordered_map<QString, std::pair<GLenum, BuiltinWriter>>
+  writers = {
+    {
+      "elapsedTime", {GL_UNSIGNED_INT, [](const Uniforms & u, UniformSlot & s) {
+        s.set(u.elapsedTime());
+      }}
+    },
+    {
+      "mousePos", {GL_INT_VEC2, [](const Uniforms & u, UniformSlot & s) {
+        s.set(u.mousePos());
+      }}
+    },
+    {
+      "lastMousePos", {GL_INT_VEC2, [](const Uniforms & u, UniformSlot & s) {
+        s.set(u.lastMousePos());
+      }}
+    },
+    {
+      "canvasSize", {GL_UNSIGNED_INT_VEC2, [](const Uniforms & u, UniformSlot & s) {
+        s.set(u.canvasSize());
+      }}
+    },
+    {
+      "canvasWidth", {GL_UNSIGNED_INT, [](const Uniforms & u, UniformSlot & s) {
+        s.set(u.canvasWidth());
+      }}
+    },
+    {
+      "canvasHeight", {GL_UNSIGNED_INT, [](const Uniforms & u, UniformSlot & s) {
+        s.set(u.canvasHeight());
+      }}
+    },
+    {
+      "lastCanvasSize", {GL_UNSIGNED_INT_VEC2, [](const Uniforms & u, UniformSlot & s) {
+        s.set(u.lastCanvasSize());
+      }}
+    },
+    {
+      "trackball", {GL_FLOAT_MAT4, [](const Uniforms & u, UniformSlot & s) {
+        s.set(u.trackball());
+      }}
+    },
+    {
+      "matrix", {GL_FLOAT_MAT4, [](const Uniforms & u, UniformSlot & s) {
+        s.set(u.matrix());
+      }}
+    },
+    {
+      "model", {GL_FLOAT_MAT4, [](const Uniforms & u, UniformSlot & s) {
+        s.set(u.meshModel());
+      }}
+    },
+    {
+      "view", {GL_FLOAT_MAT4, [](const Uniforms & u, UniformSlot & s) {
+        s.set(u._view);
+      }}
+    },
+    {
+      "modelView", {GL_FLOAT_MAT4, [](const Uniforms & u, UniformSlot & s) {
+        s.set(u.modelView());
+      }}
+    },
+    {
+      "projection", {GL_FLOAT_MAT4, [](const Uniforms & u, UniformSlot & s) {
+        s.set(u._projection);
+      }}
+    },
+    {
+      "instanceCount", {GL_UNSIGNED_INT, [](const Uniforms & u, UniformSlot & s) {
+        s.set(u.instanceCount());
+      }}
+    },
+  };
+
+  return writers;
+}
+
+void Uniforms::_updateSlots() noexcept {
+  const auto& writers = _builtinWriters();
+  std::unordered_map<QString, shader::UniformSlot> slots;
+  _builtins.clear();
+
+  for (const UniformInfo& i : _uniformList) {
+    shader::UniformSlot& slot = slots[i.name];
+    slot.type = i.type;
+
+    QByteArray name = i.name.toLocal8Bit();
+
+    if (_meta->indexOfProperty(name.constData()) == -1) {
+      // Custom uniforms are dynamic properties; this is their value for now,
+      // and event() keeps it up to date
+      slot.assign(property(name.constData()));
+    }
+    else {
+      auto writer = writers.find(i.name);
+      bool usual = writer != writers.end() && writer->second.first == i.type;
+      _builtins.push_back({&slot, usual ? writer->second.second : nullptr, name});
+    }
+  }
+
+  _slots.swap(slots);
+  // Swapping doesn't move the slots, so the pointers above stay good
+}
+
+shader::BuiltinBlockData Uniforms::builtinBlock() const noexcept {
+  return {
+    matrix(), meshModel(), _view, modelView(), _projection, trackball(),
+    mousePos(), lastMousePos(), canvasSize(), lastCanvasSize(),
+    canvasWidth(), canvasHeight(), elapsedTime(), instanceCount()
+  };
+}
+
+void Uniforms::setFixedTime(const qint64 ms) noexcept {
+  _fixedTime = ms;
+}
+
+const shader::UniformSlot* Uniforms::slot(const QString& name) const noexcept {
+  auto slot = _slots.find(name);
+  return (slot != _slots.end()) ? &slot->second : nullptr;
+}
+
+void Uniforms::refresh() noexcept {
+  for (Builtin& builtin : _builtins) {
+    if (builtin.write != nullptr) {
+      builtin.write(*this, *builtin.slot);
+    }
+    else {
+      // If the shader declared it as some other type, convert it the slow way
+      builtin.slot->assign(property(builtin.name.constData()));
+    }
+  }
 }
 
 void Uniforms::_handleDiscardedUniforms(const UniformCollection& temp)
@@ -181,6 +326,49 @@ void Uniforms::_handleKeptUniforms(const UniformCollection& temp) noexcept {
 void Uniforms::resetModelView() noexcept {
   _model = mat4();
   _view = mat4();
+  emit moved();
+}
+
+float Uniforms::projectedRadius(const vec3& center, const float radius) const
+noexcept {
+  mat4 modelView = _view * _model;
+  // Not modelView(); the sphere is in the mesh's own space, before any
+  // quantization transform
+
+  vec4 c = modelView * vec4(center, 1);
+  float scale = glm::max(glm::length(vec3(modelView[0])),
+                         glm::max(glm::length(vec3(modelView[1])),
+                                  glm::length(vec3(modelView[2]))));
+  float r = radius * scale;
+  float depth = -c.z;
+
+  if (depth <= r) {
+    return std::numeric_limits<float>::max();
+  }
+
+  return r * _projection[1][1] * _canvasSize.y * 0.5f / depth;
+}
+
+std::array<vec4, 6> Uniforms::frustumPlanes() const noexcept {
+  mat4 m = _projection * _view * _model;
+  vec4 x = glm::row(m, 0);
+  vec4 y = glm::row(m, 1);
+  vec4 z = glm::row(m, 2);
+  vec4 w = glm::row(m, 3);
+
+  // Gribb and Hartmann, "Fast Extraction of Viewing Frustum Planes from the
+  // World-View-Projection Matrix" (2001)
+  std::array<vec4, 6> planes = {w + x, w - x, w + y, w - y, w + z, w - z};
+
+  for (vec4& p : planes) {
+    p /= glm::length(vec3(p));
+  }
+
+  return planes;
+}
+
+vec3 Uniforms::cameraPosition() const noexcept {
+  return vec3(glm::inverse(_view * _model) * vec4(0, 0, 0, 1));
 }
 
 void Uniforms::setFov(const float fov) noexcept {
@@ -200,6 +388,18 @@ void Uniforms::_updateProjection() noexcept {
 }
 
 bool Uniforms::event(QEvent* e) {
+  if (e->type() == QEvent::DynamicPropertyChange) {
+    // Custom uniforms are dynamic properties, so this is how edits show up
+    QByteArray name = static_cast<QDynamicPropertyChangeEvent*>(e)->propertyName();
+    auto slot = _slots.find(QString::fromLocal8Bit(name));
+
+    if (slot != _slots.end()) {
+      slot->second.assign(property(name.constData()));
+    }
+
+    emit edited();
+  }
+
   return false;
 }
 
@@ -239,6 +439,11 @@ void Uniforms::mouseMoveEvent(QMouseEvent* e) noexcept {
     vec2 delta = localPos - vec2(_lastMousePos);
     _model = glm::rotate(_model, glm::radians(delta.x), vec3(0, 1, 0));
     _model = glm::rotate(_model, glm::radians(delta.y), vec3(1, 0, 0));
+    emit moved();
+  }
+  else if (active("mousePos") || active("lastMousePos")) {
+    // Otherwise it's only worth drawing again if the shader can tell
+    emit moved();
   }
 
   this->_lastMousePos = localPos;
@@ -261,6 +466,7 @@ void Uniforms::wheelEvent(QWheelEvent* e) noexcept {
   int delta = e->angleDelta().y();
   //this->setFov(_fov + ((delta > 0) ? ZOOM_INTERVAL : -ZOOM_INTERVAL));
   _view = glm::translate(_view, {0.0f, 0.0f, (delta > 0 ? ZOOM_INTERVAL : -ZOOM_INTERVAL)});
+  emit moved();
 }
 
 void Uniforms::resizeEvent(QResizeEvent* e) noexcept {
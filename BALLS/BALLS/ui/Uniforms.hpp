@@ -1,6 +1,10 @@
 #ifndef UNIFORMMEDIATOR_HPP
 #define UNIFORMMEDIATOR_HPP
 
+#include <array>
+#include <unordered_map>
+#include <vector>
+
 #include <QtCore/QElapsedTimer>
 #include <QtCore/QObject>
 
@@ -8,6 +12,8 @@
 #include <glm/gtx/transform.hpp>
 #include <glm/gtx/string_cast.hpp>
 
+#include "shader/BuiltinBlock.hpp"
+#include "shader/UniformTable.hpp"
 #include "util/Trackball.hpp"
 #include "util/TypeInfo.hpp"
 
@@ -43,10 +49,12 @@ class Uniforms final : public QObject {
              active("lastCanvasSize") FINAL)
   Q_PROPERTY(mat4 trackball READ trackball DESIGNABLE active("trackball") STORED false FINAL)
   Q_PROPERTY(mat4 matrix READ matrix DESIGNABLE active("matrix") STORED false FINAL)
-  Q_PROPERTY(mat4 model MEMBER _model DESIGNABLE active("model") FINAL)
-  Q_PROPERTY(mat4 view MEMBER _view DESIGNABLE active("view") FINAL)
+  Q_PROPERTY(mat4 model MEMBER _model NOTIFY edited DESIGNABLE active("model") FINAL)
+  Q_PROPERTY(mat4 view MEMBER _view NOTIFY edited DESIGNABLE active("view") FINAL)
   Q_PROPERTY(mat4 modelView READ modelView DESIGNABLE active("modelView") STORED false FINAL)
-  Q_PROPERTY(mat4 projection MEMBER _projection DESIGNABLE active("projection") FINAL)
+  Q_PROPERTY(mat4 projection MEMBER _projection NOTIFY edited DESIGNABLE active("projection") FINAL)
+  Q_PROPERTY(uint instanceCount READ instanceCount DESIGNABLE
+             active("instanceCount") STORED false FINAL)
 
   // How about I *ignore* the GLSL type here and let BallsCanvas decide what conversion to make?
   // But maybe use tags for deciding how often to update a static property?
@@ -69,10 +77,80 @@ private /* uniform property accessors */:
   const mat4 matrix() const noexcept;
   const mat4 modelView() const noexcept;
 
+  /**
+   * @brief The model matrix as shaders see it, i.e. with the mesh transform
+   * applied first; the model property itself is only what the user set.
+   */
+  const mat4 meshModel() const noexcept;
+  uint instanceCount() const noexcept;
+
 public /* uniform list queries */:
   bool active(const QString& name) const noexcept;
+
+  /**
+   * @brief Whether the shader reads a uniform that changes on its own (like
+   * elapsedTime), so that the canvas must keep drawing to show it.
+   */
+  bool animated() const noexcept;
 public /* setters */:
   void setFov(const float) noexcept;
+
+  /**
+   * @brief Sets the transform that maps the current mesh's stored positions
+   * to model space (e.g. to undo quantization). The model, matrix, and
+   * modelView uniforms include it, but the editable model property doesn't.
+   */
+  void setMeshTransform(const mat4&) noexcept;
+
+  /// Sets how many copies of the mesh each draw call makes
+  void setInstanceCount(const uint) noexcept;
+
+public /* queries */:
+  /**
+   * @brief Returns how many pixels a sphere in model space spans on screen
+   * (its radius, not its diameter) with the current model, view, and
+   * projection. Huge if the camera is inside it.
+   */
+  float projectedRadius(const vec3& center, const float radius) const noexcept;
+
+  /**
+   * @brief Returns the six planes of the view frustum in model space, as for
+   * projectedRadius(); each is normalized, and faces into the frustum.
+   */
+  std::array<vec4, 6> frustumPlanes() const noexcept;
+
+  /// Returns where the camera is in model space, as for projectedRadius()
+  vec3 cameraPosition() const noexcept;
+
+public /* uniform values */:
+  /**
+   * @brief Returns where the named uniform's value is kept for uploading, or
+   * nullptr if the current shader doesn't use it. Valid until the next time
+   * the uniform list changes.
+   */
+  const shader::UniformSlot* slot(const QString&) const noexcept;
+
+  /**
+   * @brief Brings every built-in uniform's slot up to date; call once per
+   * frame. Custom uniforms' slots are updated whenever they're edited.
+   */
+  void refresh() noexcept;
+
+  /// Every built-in uniform at once, for the BallsBuiltins uniform block
+  shader::BuiltinBlockData builtinBlock() const noexcept;
+
+  /**
+   * @brief Makes elapsedTime report the given number of milliseconds instead
+   * of the real time, e.g. to render frames at a fixed step. Negative goes
+   * back to the real time.
+   */
+  void setFixedTime(const qint64) noexcept;
+signals:
+  /// A uniform's value was set from outside, e.g. in the uniform editor
+  void edited();
+
+  /// The mouse moved the model or the camera, or they were reset
+  void moved();
 public slots:
   void receiveUniforms(const UniformCollection&) noexcept;
 protected:
@@ -93,12 +171,33 @@ private /* helpers */:
   void _handleDiscardedUniforms(const UniformCollection&) noexcept;
   void _handleKeptUniforms(const UniformCollection&) noexcept;
 
+  /// Makes a slot for every uniform in the list
+  void _updateSlots() noexcept;
+
+private /* built-in uniform slots */:
+  using BuiltinWriter = void (*)(const Uniforms&, shader::UniformSlot&);
+
+  struct Builtin {
+    shader::UniformSlot* slot;
+
+    /// nullptr if the shader declared it with an unusual type
+    BuiltinWriter write;
+    QByteArray name;
+  };
+
+  /// The type each built-in uniform is usually declared as, and its writer
+  static const std::unordered_map<QString, std::pair<GLenum, BuiltinWriter>>&
+  _builtinWriters() noexcept;
+
 private /* meta info */:
   const QMetaObject* _meta;
   UniformCollection _uniformList;
+  std::unordered_map<QString, shader::UniformSlot> _slots;
+  std::vector<Builtin> _builtins;
 
 private /* uniform source values */:
   mat4 _model;
+  mat4 _meshTransform;
   mat4 _view;
   mat4 _projection;
   util::Trackball _trackball;
@@ -109,7 +208,9 @@ private /* uniform source values */:
   float _fov;
   float _farPlane;
   float _nearPlane;
+  uint _instanceCount;
   QElapsedTimer _elapsedTime;
+  qint64 _fixedTime;
 };
 
 inline bool Uniforms::active(const QString& name) const noexcept {
@@ -121,20 +222,40 @@ inline bool Uniforms::active(const QString& name) const noexcept {
   });
 }
 
+inline bool Uniforms::animated() const noexcept {
+  return active("elapsedTime");
+}
+
 inline const UniformCollection& Uniforms::uniformInfo() const noexcept {
   return this->_uniformList;
 }
 
 inline uint Uniforms::elapsedTime() const noexcept {
-  return _elapsedTime.elapsed();
+  return (_fixedTime < 0) ? _elapsedTime.elapsed() : _fixedTime;
 }
 
 inline const mat4 Uniforms::matrix() const noexcept {
-  return _projection * _view * _model;
+  return _projection * _view * meshModel();
 }
 
 inline const mat4 Uniforms::modelView() const noexcept {
-  return _view * _model;
+  return _view * meshModel();
+}
+
+inline const mat4 Uniforms::meshModel() const noexcept {
+  return _model * _meshTransform;
+}
+
+inline void Uniforms::setMeshTransform(const mat4& transform) noexcept {
+  _meshTransform = transform;
+}
+
+inline uint Uniforms::instanceCount() const noexcept {
+  return _instanceCount;
+}
+
+inline void Uniforms::setInstanceCount(const uint count) noexcept {
+  _instanceCount = count;
 }
 
 inline ivec2 Uniforms::mousePos() const noexcept {
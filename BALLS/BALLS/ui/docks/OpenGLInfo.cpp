@@ -1,7 +1,136 @@
-#include "OpenGLInfo.hpp"
+#include "precompiled.hpp"
+#include "ui/docks/OpenGLInfo.hpp"
 
-OpenGLInfo::OpenGLInfo(QWidget *parent) :
-  QDockWidget(parent)
+#include <algorithm>
+
+#include <QtCore/QTimerEvent>
+
+#include "util/GpuProfiler.hpp"
+#include "util/PipelineStats.hpp"
+
+namespace balls {
+
+constexpr int REFRESH_INTERVAL_MS = 500;
+
+OpenGLInfo::OpenGLInfo(QWidget* parent) :
+  QDockWidget(parent),
+  _profiler(nullptr),
+  _pipeline(nullptr)
 {
   ui.setupUi(this);
 }
+
+void OpenGLInfo::setProfiler(const util::GpuProfiler* profiler) noexcept {
+  _profiler = profiler;
+  _refresh();
+}
+
+void OpenGLInfo::setPipelineStats(const util::PipelineStats* pipeline) noexcept {
+  _pipeline = pipeline;
+  _refresh();
+}
+
+void OpenGLInfo::showEvent(QShowEvent* e) {
+  QDockWidget::showEvent(e);
+  _timer.start(REFRESH_INTERVAL_MS, this);
+  _refresh();
+}
+
+void OpenGLInfo::hideEvent(QHideEvent* e) {
+  QDockWidget::hideEvent(e);
+  _timer.stop();
+}
+
+void OpenGLInfo::timerEvent(QTimerEvent* e) {
+  if (e->timerId() == _timer.timerId()) {
+    _refresh();
+  }
+  else {
+    QDockWidget::timerEvent(e);
+  }
+}
+
+static void _setRow(QTableWidget* table, const int row,
+                    const QStringList& cells) noexcept {
+  for (int column = 0; column < cells.size(); ++column) {
+    QTableWidgetItem* item = table->item(row, column);
+
+    if (item == nullptr) {
+      item = new QTableWidgetItem;
+      table->setItem(row, column, item);
+    }
+
+    item->setText(cells[column]);
+  }
+}
+
+void OpenGLInfo::_refresh() noexcept {
+  _refreshTimes();
+  _refreshPipeline();
+}
+
+void OpenGLInfo::_refreshTimes() noexcept {
+  using util::GpuProfiler;
+
+  if (_profiler == nullptr || !_profiler->isCreated()) {
+    ui.glInfoTable->setRowCount(0);
+    ui.glInfoStatus->setText(tr("GPU times need OpenGL 3.3"));
+    return;
+  }
+
+  std::vector<GpuProfiler::Stats> stats = _profiler->stats();
+  ui.glInfoTable->setRowCount(static_cast<int>(stats.size()));
+
+  for (int row = 0; row < static_cast<int>(stats.size()); ++row) {
+    const GpuProfiler::Stats& s = stats[row];
+    _setRow(ui.glInfoTable, row, {
+      s.pass,
+      QString::number(s.min, 'f', 3),
+      QString::number(s.median, 'f', 3),
+      QString::number(s.p99, 'f', 3),
+    });
+  }
+
+  size_t samples = stats.empty() ? 0 : stats.back().samples;
+  ui.glInfoStatus->setText(tr("Over the last %1 frames; %2 weren't timed")
+                           .arg(samples).arg(_profiler->dropped()));
+}
+
+void OpenGLInfo::_refreshPipeline() noexcept {
+  using util::PipelineStats;
+
+  if (_pipeline == nullptr || _pipeline->history().empty()) {
+    ui.pipelineTable->setRowCount(0);
+    return;
+  }
+
+  const auto& history = _pipeline->history();
+  std::vector<GLuint64> counts(history.size());
+  int row = 0;
+
+  ui.pipelineTable->setRowCount(PipelineStats::COUNTERS);
+
+  for (int c = 0; c < PipelineStats::COUNTERS; ++c) {
+    PipelineStats::Counter counter = PipelineStats::Counter(c);
+
+    if (!_pipeline->supports(counter)) {
+      continue;
+    }
+
+    std::transform(history.begin(), history.end(), counts.begin(),
+    [c](const PipelineStats::Sample & sample) {
+      return sample[c];
+    });
+    std::nth_element(counts.begin(), counts.begin() + counts.size() / 2,
+                     counts.end());
+
+    _setRow(ui.pipelineTable, row++, {
+      PipelineStats::name(counter),
+      QString::number(history.back()[c]),
+      QString::number(counts[counts.size() / 2]),
+    });
+  }
+
+  ui.pipelineTable->setRowCount(row);
+}
+}
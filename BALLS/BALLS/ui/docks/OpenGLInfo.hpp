@@ -1,17 +1,46 @@
 #ifndef OPENGLINFO_HPP
 #define OPENGLINFO_HPP
 
+#include <QtCore/QBasicTimer>
+
 #include "ui_OpenGLInfo.h"
 
-class OpenGLInfo : public QDockWidget
-{
+namespace balls {
+
+namespace util {
+class GpuProfiler;
+class PipelineStats;
+}
+
+/**
+ * @brief Shows how long each pass of a frame takes on the GPU, and how much
+ * work each stage of the pipeline did, over the last few hundred frames. Only
+ * refreshed while it's visible.
+ */
+class OpenGLInfo : public QDockWidget {
   Q_OBJECT
 
 public:
-  explicit OpenGLInfo(QWidget *parent = 0);
+  explicit OpenGLInfo(QWidget* parent = 0);
+
+  void setProfiler(const util::GpuProfiler*) noexcept;
+  void setPipelineStats(const util::PipelineStats*) noexcept;
+
+protected:
+  void showEvent(QShowEvent*) override;
+  void hideEvent(QHideEvent*) override;
+  void timerEvent(QTimerEvent*) override;
 
 private:
+  void _refresh() noexcept;
+  void _refreshTimes() noexcept;
+  void _refreshPipeline() noexcept;
+
   Ui::OpenGLInfo ui;
+  const util::GpuProfiler* _profiler;
+  const util::PipelineStats* _pipeline;
+  QBasicTimer _timer;
 };
+}
 
 #endif // OPENGLINFO_HPP
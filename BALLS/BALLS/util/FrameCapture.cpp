@@ -0,0 +1,360 @@
+#include "precompiled.hpp"
+#include "util/FrameCapture.hpp"
+
+#include <cstring>
+
+#include <QtConcurrent/QtConcurrentRun>
+#include <QtCore/QFile>
+#include <QtCore/QProcess>
+#include <QtGui/QImage>
+#include <QtGui/QOpenGLFramebufferObject>
+#include <QtGui/QOpenGLFunctions_3_2_Core>
+
+#include "config/Settings.hpp"
+#include "util/Logging.hpp"
+
+namespace balls {
+namespace util {
+
+using config::ClientWaitSyncFlags;
+using config::SyncStatus;
+
+constexpr size_t FrameCapture::BUFFERS;
+constexpr int FrameCapture::MAX_QUEUED;
+
+constexpr int BYTES_PER_PIXEL = 4;
+
+/// How long stop() waits for a frame that's still on the GPU, in nanoseconds
+constexpr GLuint64 STOP_TIMEOUT = 1000000000;
+
+CaptureWriter::CaptureWriter(atomic<int>& queued) noexcept
+  : _queued(queued),
+    _format(CaptureFormat::Png),
+    _numbered(false),
+    _process(nullptr) {
+}
+
+void CaptureWriter::open(const int format, const QString& destination) noexcept {
+  _format = static_cast<CaptureFormat>(format);
+  _destination = destination;
+  _numbered = destination.contains("%1");
+
+  if (_format != CaptureFormat::Pipe) {
+    return;
+  }
+
+  _process = new QProcess(this);
+  _process->setProcessChannelMode(QProcess::ForwardedChannels);
+  _process->start(destination, QIODevice::WriteOnly);
+
+  if (!_process->waitForStarted()) {
+    emit failed(tr("Couldn't start \"%1\": %2")
+                .arg(destination, _process->errorString()));
+    delete _process;
+    _process = nullptr;
+  }
+}
+
+void CaptureWriter::write(const QByteArray& pixels, const QSize& size,
+                          const int index) noexcept {
+  QString path = _numbered ? _destination.arg(index, 5, 10, QChar('0'))
+                           : _destination;
+
+  switch (_format) {
+  case CaptureFormat::Png:
+    // PNG compression is the slow part, so spread it over the pool
+    QtConcurrent::run(&_encoders, [this, pixels, size, path]() {
+      QImage image(reinterpret_cast<const uchar*>(pixels.constData()),
+                   size.width(), size.height(), QImage::Format_RGBX8888);
+
+      if (!image.mirrored().save(path, "PNG")) {
+        emit failed(tr("Couldn't write %1").arg(path));
+      }
+
+      --_queued;
+    });
+    return;
+
+  case CaptureFormat::Raw: {
+    QFile file(path);
+
+    if (!file.open(QIODevice::WriteOnly) ||
+        file.write(_flipped(pixels, size)) != pixels.size()) {
+      emit failed(tr("Couldn't write %1: %2").arg(path, file.errorString()));
+    }
+
+    break;
+  }
+
+  case CaptureFormat::Pipe:
+    if (_process != nullptr) {
+      _process->write(_flipped(pixels, size));
+
+      // Let the encoder set the pace; frames pile up in MAX_QUEUED meanwhile
+      if (!_process->waitForBytesWritten()) {
+        emit failed(tr("Couldn't write to \"%1\": %2")
+                    .arg(_destination, _process->errorString()));
+        _process->kill();
+        _process->waitForFinished();
+        delete _process;
+        _process = nullptr;
+      }
+    }
+
+    break;
+  }
+
+  --_queued;
+}
+
+void CaptureWriter::close() noexcept {
+  _encoders.waitForDone();
+
+  if (_process != nullptr) {
+    _process->closeWriteChannel();
+
+    if (!_process->waitForFinished(-1) || _process->exitCode() != 0) {
+      emit failed(tr("\"%1\" exited with code %2")
+                  .arg(_destination).arg(_process->exitCode()));
+    }
+
+    delete _process;
+    _process = nullptr;
+  }
+}
+
+QByteArray CaptureWriter::_flipped(const QByteArray& pixels,
+                                   const QSize& size) noexcept {
+  int stride = size.width() * BYTES_PER_PIXEL;
+  QByteArray flipped(pixels.size(), Qt::Uninitialized);
+
+  for (int row = 0; row < size.height(); ++row) {
+    std::memcpy(flipped.data() + row * stride,
+                pixels.constData() + (size.height() - 1 - row) * stride,
+                static_cast<size_t>(stride));
+  }
+
+  return flipped;
+}
+
+FrameCapture::FrameCapture(QObject* parent) noexcept
+  : QObject(parent),
+    _gl(nullptr),
+    _next(0),
+    _active(false),
+    _index(0),
+    _captured(0),
+    _dropped(0),
+    _queued(0),
+    _writer(new CaptureWriter(_queued)) {
+  _writer->moveToThread(&_thread);
+  connect(&_thread, &QThread::finished, _writer, &QObject::deleteLater);
+  connect(_writer, &CaptureWriter::failed, this, &FrameCapture::failed);
+  _thread.setObjectName("Frame Capture");
+  _thread.start();
+}
+
+FrameCapture::~FrameCapture() {
+  _thread.quit();
+  _thread.wait();
+}
+
+bool FrameCapture::create(QOpenGLFunctions_3_2_Core* gl) noexcept {
+  if (gl == nullptr) {
+    qCWarning(logs::gl::Feature)
+        << "Fences need OpenGL 3.2; frames can't be captured";
+    return false;
+  }
+
+  _gl = gl;
+
+  for (Slot& slot : _slots) {
+    _gl->glGenBuffers(1, &slot.buffer);
+  }
+
+  qCDebug(logs::gl::Feature) << "Capturing frames through" << BUFFERS
+                             << "pixel-pack buffers";
+  return true;
+}
+
+void FrameCapture::destroy() noexcept {
+  if (_gl == nullptr) {
+    return;
+  }
+
+  stop();
+
+  for (Slot& slot : _slots) {
+    _gl->glDeleteBuffers(1, &slot.buffer);
+    slot = Slot();
+  }
+
+  _resolve.reset();
+  _bufferSize = QSize();
+  _gl = nullptr;
+}
+
+void FrameCapture::start(const CaptureTarget& target) noexcept {
+  if (_gl == nullptr) {
+    emit failed(tr("Capturing frames needs OpenGL 3.2"));
+    return;
+  }
+
+  stop();
+
+  _target = target;
+  _index = 0;
+  _captured = 0;
+  _dropped = 0;
+  _active = true;
+
+  QMetaObject::invokeMethod(_writer, "open", Qt::QueuedConnection,
+                            Q_ARG(int, static_cast<int>(target.format)),
+                            Q_ARG(QString, target.destination));
+  qCInfo(logs::gl::Resource) << "Capturing frames to" << target.destination;
+}
+
+void FrameCapture::stop() noexcept {
+  if (!_active) {
+    return;
+  }
+
+  for (size_t i = 0; i < BUFFERS; ++i) {
+    // Oldest first, so the writer gets them in order
+    Slot& slot = _slots[(_next + i) % BUFFERS];
+
+    if (slot.fence != nullptr) {
+      _collect(slot, true);
+    }
+  }
+
+  // Blocks until the last frame is written; stopping isn't a per-frame thing
+  QMetaObject::invokeMethod(_writer, "close", Qt::BlockingQueuedConnection);
+  _active = false;
+
+  qCInfo(logs::gl::Resource) << "Captured" << _captured << "frames, dropped"
+                             << _dropped;
+  emit stopped();
+}
+
+void FrameCapture::capture(const GLuint framebuffer, const QSize& size) noexcept {
+  if (!_active || size.isEmpty()) {
+    return;
+  }
+
+  for (size_t i = 0; i < BUFFERS; ++i) {
+    Slot& slot = _slots[(_next + i) % BUFFERS];
+
+    if (slot.fence != nullptr) {
+      _collect(slot, false);
+    }
+  }
+
+  if (size != _bufferSize) {
+    for (Slot& slot : _slots) {
+      if (slot.fence != nullptr) {
+        _collect(slot, true);
+      }
+    }
+
+    _resize(size);
+  }
+
+  Slot& slot = _slots[_next];
+
+  if (slot.fence != nullptr || _queued >= MAX_QUEUED) {
+    ++_dropped;
+    qCDebug(logs::gl::Resource) << "Capture is behind; dropped a frame";
+    return;
+  }
+
+  int w = size.width();
+  int h = size.height();
+
+  // Resolve the multisampled framebuffer first; glReadPixels can't read it
+  _gl->glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+  _gl->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _resolve->handle());
+  _gl->glBlitFramebuffer(0, 0, w, h, 0, 0, w, h, GL_COLOR_BUFFER_BIT,
+                         GL_NEAREST);
+
+  // With a pack buffer bound, glReadPixels returns without waiting
+  _gl->glBindFramebuffer(GL_READ_FRAMEBUFFER, _resolve->handle());
+  _gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+  _gl->glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  _gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  _gl->glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+  slot.fence = _gl->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  slot.size = size;
+  slot.index = _index++;
+  _next = (_next + 1) % BUFFERS;
+
+  if (_target.frames > 0 && _index >= _target.frames) {
+    stop();
+  }
+}
+
+bool FrameCapture::_collect(Slot& slot, const bool wait) noexcept {
+  Q_ASSERT(slot.fence != nullptr);
+
+  GLbitfield flags =
+      wait ? static_cast<GLbitfield>(ClientWaitSyncFlags::SyncFlushCommands) : 0;
+  SyncStatus status = static_cast<SyncStatus>(
+      _gl->glClientWaitSync(slot.fence, flags, wait ? STOP_TIMEOUT : 0));
+
+  if (status == SyncStatus::TimeoutExpired && !wait) {
+    return false;
+  }
+
+  _gl->glDeleteSync(slot.fence);
+  slot.fence = nullptr;
+
+  if (status == SyncStatus::TimeoutExpired || status == SyncStatus::WaitFailed) {
+    ++_dropped;
+    qCWarning(logs::gl::Resource) << "Gave up waiting for frame" << slot.index;
+    return false;
+  }
+
+  int bytes = slot.size.width() * slot.size.height() * BYTES_PER_PIXEL;
+  QByteArray pixels(bytes, Qt::Uninitialized);
+
+  _gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+  const void* data =
+      _gl->glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+
+  if (data == nullptr) {
+    _gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    ++_dropped;
+    qCWarning(logs::gl::Resource) << "Couldn't map frame" << slot.index;
+    return false;
+  }
+
+  // The only copy the render thread makes; the writer does the rest
+  std::memcpy(pixels.data(), data, static_cast<size_t>(bytes));
+  _gl->glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  _gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  ++_queued;
+  ++_captured;
+  QMetaObject::invokeMethod(_writer, "write", Qt::QueuedConnection,
+                            Q_ARG(QByteArray, pixels), Q_ARG(QSize, slot.size),
+                            Q_ARG(int, slot.index));
+  return true;
+}
+
+void FrameCapture::_resize(const QSize& size) noexcept {
+  GLsizeiptr bytes = size.width() * size.height() * BYTES_PER_PIXEL;
+
+  for (Slot& slot : _slots) {
+    _gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    _gl->glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+  }
+
+  _gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  _resolve.reset(new QOpenGLFramebufferObject(size));
+  _bufferSize = size;
+
+  qCDebug(logs::gl::Resource) << "Capture buffers resized to" << size;
+}
+}
+}
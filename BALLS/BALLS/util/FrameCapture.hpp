@@ -0,0 +1,170 @@
+#ifndef FRAMECAPTURE_HPP
+#define FRAMECAPTURE_HPP
+
+#include <array>
+#include <atomic>
+#include <memory>
+
+#include <QtCore/QObject>
+#include <QtCore/QSize>
+#include <QtCore/QString>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
+#include <QtGui/qopengl.h>
+
+class QOpenGLFramebufferObject;
+class QOpenGLFunctions_3_2_Core;
+class QProcess;
+
+namespace balls {
+namespace util {
+
+using std::array;
+using std::atomic;
+using std::unique_ptr;
+
+enum class CaptureFormat {
+  /// One PNG per frame
+  Png,
+
+  /// One file of raw, top-down RGBA bytes per frame
+  Raw,
+
+  /// Raw RGBA frames written one after another to another program's stdin
+  Pipe,
+};
+
+struct CaptureTarget {
+  CaptureFormat format = CaptureFormat::Png;
+
+  /**
+   * @brief For files, the path to write each frame to, where %1 is replaced
+   * by the frame's number (unless there's only one frame); for Pipe, the
+   * command line of the program to start, e.g. an ffmpeg reading rawvideo.
+   */
+  QString destination;
+
+  /// Stop after this many frames, or never if 0
+  int frames = 0;
+};
+
+/**
+ * @brief Encodes and writes captured frames; lives on FrameCapture's worker
+ * thread, so the render thread never does more than hand it the bytes.
+ */
+class CaptureWriter : public QObject {
+  Q_OBJECT
+
+public:
+  explicit CaptureWriter(atomic<int>& queued) noexcept;
+
+public slots:
+  void open(const int format, const QString& destination) noexcept;
+  void write(const QByteArray& pixels, const QSize&, const int index) noexcept;
+
+  /// Waits for every frame to be written, then closes the pipe if there is one
+  void close() noexcept;
+
+signals:
+  void failed(const QString&);
+
+private:
+  /// GL's rows go bottom-up; everything else wants them top-down
+  static QByteArray _flipped(const QByteArray&, const QSize&) noexcept;
+
+  atomic<int>& _queued;
+  CaptureFormat _format;
+  QString _destination;
+  bool _numbered;
+  QProcess* _process;
+  QThreadPool _encoders;
+};
+
+/**
+ * @brief Reads back what the canvas draws without stalling either side.
+ *
+ * Each frame is resolved into a single-sampled framebuffer and read into one
+ * of a ring of pixel-pack buffers, followed by a fence. A buffer is only
+ * mapped once its fence has signalled (usually a couple of frames later), and
+ * its bytes are handed to a CaptureWriter on a worker thread to be encoded.
+ * If the ring or the writer falls behind, frames are dropped rather than
+ * waited on.
+ *
+ * Needs OpenGL 3.2 for fences.
+ */
+class FrameCapture : public QObject {
+  Q_OBJECT
+
+public:
+  /// How many frames can be on their way back from the GPU at once
+  static constexpr size_t BUFFERS = 3;
+
+  /// How many frames can wait for the writer before new ones are dropped
+  static constexpr int MAX_QUEUED = 8;
+
+  explicit FrameCapture(QObject* parent = nullptr) noexcept;
+  ~FrameCapture();
+
+  bool create(QOpenGLFunctions_3_2_Core*) noexcept;
+
+  /// Stops capturing (keeping what's in flight) and frees the buffers
+  void destroy() noexcept;
+
+  bool isCreated() const noexcept { return _gl != nullptr; }
+  bool isActive() const noexcept { return _active; }
+
+  void start(const CaptureTarget&) noexcept;
+
+  /**
+   * @brief Waits for every frame that's still in flight, hands them to the
+   * writer, and closes it; needs the context to be current.
+   */
+  void stop() noexcept;
+
+  /**
+   * @brief Reads back the given framebuffer, which may be multisampled; call
+   * at the end of each frame with the context current. Does nothing unless
+   * capturing.
+   */
+  void capture(const GLuint framebuffer, const QSize&) noexcept;
+
+  size_t captured() const noexcept { return _captured; }
+  size_t dropped() const noexcept { return _dropped; }
+
+signals:
+  /// Emitted once the last frame was handed to the writer
+  void stopped();
+  void failed(const QString&);
+
+private:
+  struct Slot {
+    GLuint buffer = 0;
+    GLsync fence = nullptr;
+    QSize size;
+    int index = -1;
+  };
+
+  /// Hands the slot's frame to the writer if it's ready (or if wait is true)
+  bool _collect(Slot&, const bool wait) noexcept;
+  void _resize(const QSize&) noexcept;
+
+  QOpenGLFunctions_3_2_Core* _gl;
+  array<Slot, BUFFERS> _slots;
+  size_t _next;
+  unique_ptr<QOpenGLFramebufferObject> _resolve;
+  QSize _bufferSize;
+
+  CaptureTarget _target;
+  bool _active;
+  int _index;
+  size_t _captured;
+  size_t _dropped;
+
+  atomic<int> _queued;
+  QThread _thread;
+  CaptureWriter* _writer;
+};
+}
+}
+
+#endif // FRAMECAPTURE_HPP
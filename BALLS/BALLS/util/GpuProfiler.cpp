@@ -0,0 +1,188 @@
+#include "precompiled.hpp"
+#include "util/GpuProfiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <QtGui/QOpenGLFunctions_3_3_Core>
+
+#include "config/Settings.hpp"
+#include "util/Logging.hpp"
+
+namespace balls {
+namespace util {
+
+constexpr size_t GpuProfiler::FRAMES;
+constexpr size_t GpuProfiler::HISTORY;
+
+const QString GpuProfiler::TOTAL = "total";
+
+constexpr GLenum QUERY = static_cast<GLenum>(config::QueryType::TimeElapsed);
+constexpr double NS_PER_MS = 1e6;
+
+bool GpuProfiler::create(QOpenGLFunctions_3_3_Core* gl) noexcept {
+  if (gl == nullptr) {
+    qCWarning(logs::gl::Feature)
+        << "Timer queries need OpenGL 3.3; GPU times won't be available";
+    return false;
+  }
+
+  _gl = gl;
+  qCDebug(logs::gl::Feature) << "Timing passes with" << FRAMES
+                             << "frames of queries in flight";
+  return true;
+}
+
+void GpuProfiler::destroy() noexcept {
+  if (_gl == nullptr) {
+    return;
+  }
+
+  for (Frame& frame : _frames) {
+    if (!frame.queries.empty()) {
+      _gl->glDeleteQueries(static_cast<GLsizei>(frame.queries.size()),
+                           frame.queries.data());
+    }
+
+    frame = Frame();
+  }
+
+  _gl = nullptr;
+}
+
+void GpuProfiler::beginFrame() noexcept {
+  if (_gl == nullptr) {
+    return;
+  }
+
+  Q_ASSERT(!_inPass);
+
+  for (Frame& frame : _frames) {
+    if (frame.pending) {
+      _collect(frame);
+    }
+  }
+
+  _current = (_current + 1) % FRAMES;
+  Frame& frame = _frames[_current];
+
+  if (frame.pending) {
+    // Waiting on these would stall the pipeline, which is what we're avoiding
+    frame.pending = false;
+    ++_dropped;
+    qCDebug(logs::gl::Resource) << "GPU is" << FRAMES
+                                << "frames behind; dropped a frame's times";
+  }
+
+  frame.passes.clear();
+}
+
+void GpuProfiler::beginPass(const QString& pass) noexcept {
+  if (_gl == nullptr) {
+    return;
+  }
+
+  Q_ASSERT(!_inPass);
+
+  Frame& frame = _frames[_current];
+  size_t index = frame.passes.size();
+
+  if (index == frame.queries.size()) {
+    GLuint query = 0;
+    _gl->glGenQueries(1, &query);
+    frame.queries.push_back(query);
+  }
+
+  frame.passes.push_back(pass);
+  _gl->glBeginQuery(QUERY, frame.queries[index]);
+  _inPass = true;
+}
+
+void GpuProfiler::endPass() noexcept {
+  if (_gl == nullptr) {
+    return;
+  }
+
+  Q_ASSERT(_inPass);
+
+  _gl->glEndQuery(QUERY);
+  _inPass = false;
+  _frames[_current].pending = true;
+}
+
+vector<GpuProfiler::Stats> GpuProfiler::stats() const noexcept {
+  vector<Stats> stats;
+  stats.reserve(_history.size());
+
+  for (const auto& pass : _history) {
+    vector<GLuint64> times(pass.second.begin(), pass.second.end());
+
+    if (times.empty()) {
+      continue;
+    }
+
+    std::sort(times.begin(), times.end());
+
+    size_t n = times.size();
+    size_t p99 = static_cast<size_t>(std::ceil(0.99 * n)) - 1;
+
+    stats.push_back({
+      pass.first,
+      times.front() / NS_PER_MS,
+      times[n / 2] / NS_PER_MS,
+      times[std::min(p99, n - 1)] / NS_PER_MS,
+      n
+    });
+  }
+
+  return stats;
+}
+
+bool GpuProfiler::_collect(Frame& frame) noexcept {
+  Q_ASSERT(!frame.passes.empty());
+
+  GLuint available = GL_FALSE;
+  _gl->glGetQueryObjectuiv(frame.queries[frame.passes.size() - 1],
+                           GL_QUERY_RESULT_AVAILABLE, &available);
+  // Queries finish in order, so if the last one's in, they all are
+
+  if (!available) {
+    return false;
+  }
+
+  GLuint64 total = 0;
+
+  for (size_t i = 0; i < frame.passes.size(); ++i) {
+    GLuint64 time = 0;
+    _gl->glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &time);
+    _record(frame.passes[i], time);
+    total += time;
+  }
+
+  _record(TOTAL, total);
+  frame.pending = false;
+  return true;
+}
+
+void GpuProfiler::_record(const QString& pass, const GLuint64 time) noexcept {
+  auto history = std::find_if(_history.begin(), _history.end(),
+  [&pass](const pair<QString, deque<GLuint64>>& h) {
+    return h.first == pass;
+  });
+
+  if (history == _history.end()) {
+    bool beforeTotal = pass != TOTAL && !_history.empty() &&
+                       _history.back().first == TOTAL;
+    // Keep the total at the bottom, even if a new pass shows up later
+    history = _history.insert(beforeTotal ? _history.end() - 1 : _history.end(),
+                              {pass, deque<GLuint64>()});
+  }
+
+  history->second.push_back(time);
+
+  if (history->second.size() > HISTORY) {
+    history->second.pop_front();
+  }
+}
+}
+}
@@ -0,0 +1,93 @@
+#ifndef GPUPROFILER_HPP
+#define GPUPROFILER_HPP
+
+#include <array>
+#include <deque>
+#include <utility>
+#include <vector>
+
+#include <QtCore/QString>
+#include <QtGui/qopengl.h>
+
+class QOpenGLFunctions_3_3_Core;
+
+namespace balls {
+namespace util {
+
+using std::array;
+using std::deque;
+using std::pair;
+using std::vector;
+
+/**
+ * @brief Times each pass of a frame on the GPU without ever waiting for it.
+ *
+ * Every pass gets a GL_TIME_ELAPSED query, and each frame's queries live in
+ * one slot of a small ring. Results are only read once the driver says
+ * they're available, which is usually a frame or two later; if a slot comes
+ * around again and its results still aren't in, they're dropped rather than
+ * waited on.
+ *
+ * Needs OpenGL 3.3 (or ARB_timer_query); without it, nothing is timed.
+ */
+class GpuProfiler {
+public:
+  /// How many frames' queries can be in flight at once
+  static constexpr size_t FRAMES = 4;
+
+  /// How many of the most recent timings are kept for each pass
+  static constexpr size_t HISTORY = 240;
+
+  /// The name of the pseudo-pass that adds up every real one
+  static const QString TOTAL;
+
+  /// Rolling statistics for one pass, in milliseconds
+  struct Stats {
+    QString pass;
+    double min;
+    double median;
+    double p99;
+    size_t samples;
+  };
+
+  bool create(QOpenGLFunctions_3_3_Core*) noexcept;
+  void destroy() noexcept;
+
+  bool isCreated() const noexcept { return _gl != nullptr; }
+
+  /// Collects whatever earlier frames have finished, and starts a new one
+  void beginFrame() noexcept;
+
+  /// Passes can't overlap; end one before beginning the next
+  void beginPass(const QString&) noexcept;
+  void endPass() noexcept;
+
+  /// How many frames were never timed because the GPU was too far behind
+  size_t dropped() const noexcept { return _dropped; }
+
+  /// One entry per pass, in the order they were first seen, then the total
+  vector<Stats> stats() const noexcept;
+
+private:
+  struct Frame {
+    vector<GLuint> queries;
+    vector<QString> passes;
+    bool pending = false;
+  };
+
+  /// Reads the frame's results if they're all in; returns false if not
+  bool _collect(Frame&) noexcept;
+  void _record(const QString&, const GLuint64) noexcept;
+
+  QOpenGLFunctions_3_3_Core* _gl = nullptr;
+  array<Frame, FRAMES> _frames;
+  size_t _current = 0;
+  bool _inPass = false;
+  size_t _dropped = 0;
+  vector<pair<QString, deque<GLuint64>>> _history;
+  // Nanoseconds; a vector, since there are only ever a handful of passes
+};
+}
+}
+
+#endif // GPUPROFILER_HPP
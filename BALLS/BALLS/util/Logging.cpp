@@ -11,6 +11,10 @@ Q_LOGGING_CATEGORY(Version, "balls.version")
 namespace project {
 Q_LOGGING_CATEGORY(Name, "balls.project")
 }
+
+namespace headless {
+Q_LOGGING_CATEGORY(Name, "balls.headless")
+}
 }
 
 namespace system {
@@ -43,11 +47,20 @@ Q_LOGGING_CATEGORY(Env, "uniform.env")
 
 namespace shader {
 Q_LOGGING_CATEGORY(Name, "shader")
+Q_LOGGING_CATEGORY(Cache, "shader.cache")
+}
+
+namespace mesh {
+Q_LOGGING_CATEGORY(Name, "mesh")
+Q_LOGGING_CATEGORY(Cache, "mesh.cache")
+Q_LOGGING_CATEGORY(Optimize, "mesh.optimize")
+Q_LOGGING_CATEGORY(Import, "mesh.import")
 }
 
 
 namespace ui {
 Q_LOGGING_CATEGORY(Name, "ui")
+Q_LOGGING_CATEGORY(Frame, "ui.frame")
 }
 
 }
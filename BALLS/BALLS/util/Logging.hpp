@@ -13,6 +13,10 @@ Q_DECLARE_LOGGING_CATEGORY(Version)
 namespace project {
 Q_DECLARE_LOGGING_CATEGORY(Name)
 }
+
+namespace headless {
+Q_DECLARE_LOGGING_CATEGORY(Name)
+}
 }
 
 namespace system {
@@ -45,12 +49,21 @@ Q_DECLARE_LOGGING_CATEGORY(Env)
 
 namespace shader {
 Q_DECLARE_LOGGING_CATEGORY(Name)
+Q_DECLARE_LOGGING_CATEGORY(Cache)
+}
+
+namespace mesh {
+Q_DECLARE_LOGGING_CATEGORY(Name)
+Q_DECLARE_LOGGING_CATEGORY(Cache)
+Q_DECLARE_LOGGING_CATEGORY(Optimize)
+Q_DECLARE_LOGGING_CATEGORY(Import)
 }
 
 
 
 namespace ui {
 Q_DECLARE_LOGGING_CATEGORY(Name)
+Q_DECLARE_LOGGING_CATEGORY(Frame)
 }
 
 }
@@ -0,0 +1,45 @@
+#include "precompiled.hpp"
+#include "util/Parallel.hpp"
+
+#include <algorithm>
+
+#include <QtConcurrent/QtConcurrentMap>
+#include <QtCore/QThread>
+
+namespace balls {
+namespace util {
+
+using std::max;
+using std::min;
+using std::pair;
+using std::vector;
+
+constexpr size_t CHUNKS_PER_THREAD = 4;
+// A few chunks per thread so one slow chunk doesn't leave the others idle
+
+void parallelFor(const size_t count, const RangeFunction& body,
+                 const size_t grain) {
+  size_t threads = max(QThread::idealThreadCount(), 1);
+
+  if (count <= grain || threads == 1) {
+    // Not worth the overhead of waking up the thread pool
+    body(0, count);
+    return;
+  }
+
+  size_t chunks = min(threads * CHUNKS_PER_THREAD, (count + grain - 1) / grain);
+  size_t chunkSize = (count + chunks - 1) / chunks;
+
+  vector<pair<size_t, size_t>> ranges;
+  ranges.reserve(chunks);
+
+  for (size_t begin = 0; begin < count; begin += chunkSize) {
+    ranges.emplace_back(begin, min(begin + chunkSize, count));
+  }
+
+  QtConcurrent::blockingMap(ranges, [&body](const pair<size_t, size_t>& r) {
+    body(r.first, r.second);
+  });
+}
+}
+}
@@ -0,0 +1,29 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <cstddef>
+#include <functional>
+
+namespace balls {
+namespace util {
+
+using std::function;
+using std::size_t;
+
+/// Processes the half-open range [begin, end)
+using RangeFunction = function<void(const size_t, const size_t)>;
+
+/**
+ * @brief Splits [0, count) into contiguous chunks of at least grain elements
+ * and runs body over them on the global thread pool, blocking until every
+ * chunk is done. Small ranges are run on the calling thread.
+ *
+ * Chunks never overlap, so body may write to its own slice of a shared buffer
+ * without locking.
+ */
+void parallelFor(const size_t count, const RangeFunction& body,
+                 const size_t grain = 1024);
+}
+}
+
+#endif // PARALLEL_HPP
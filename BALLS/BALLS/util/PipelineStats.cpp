@@ -0,0 +1,161 @@
+#include "precompiled.hpp"
+#include "util/PipelineStats.hpp"
+
+#include <QtCore/QCoreApplication>
+#include <QtGui/QOpenGLFunctions_3_3_Core>
+
+#include "config/Settings.hpp"
+#include "util/Logging.hpp"
+
+#ifndef GL_VERTEX_SHADER_INVOCATIONS_ARB
+#define GL_VERTEX_SHADER_INVOCATIONS_ARB 0x82F0
+#endif
+
+#ifndef GL_FRAGMENT_SHADER_INVOCATIONS_ARB
+#define GL_FRAGMENT_SHADER_INVOCATIONS_ARB 0x82F4
+#endif
+
+namespace balls {
+namespace util {
+
+constexpr size_t PipelineStats::FRAMES;
+constexpr size_t PipelineStats::HISTORY;
+
+using config::QueryType;
+
+constexpr GLenum TARGETS[PipelineStats::COUNTERS] = {
+  static_cast<GLenum>(QueryType::SamplesPassed),
+  static_cast<GLenum>(QueryType::PrimitivesGenerated),
+  GL_VERTEX_SHADER_INVOCATIONS_ARB,
+  GL_FRAGMENT_SHADER_INVOCATIONS_ARB,
+};
+
+QString PipelineStats::name(const Counter counter) noexcept {
+  switch (counter) {
+  case SamplesPassed:
+    return QCoreApplication::translate("PipelineStats", "Samples passed");
+
+  case PrimitivesGenerated:
+    return QCoreApplication::translate("PipelineStats", "Primitives");
+
+  case VertexInvocations:
+    return QCoreApplication::translate("PipelineStats", "Vertex shader runs");
+
+  case FragmentInvocations:
+    return QCoreApplication::translate("PipelineStats", "Fragment shader runs");
+
+  default:
+    Q_UNREACHABLE();
+  }
+}
+
+bool PipelineStats::create(QOpenGLFunctions_3_3_Core* gl,
+                           const bool pipelineStatistics) noexcept {
+  if (gl == nullptr) {
+    qCWarning(logs::gl::Feature)
+        << "Pipeline statistics need OpenGL 3.3; they won't be available";
+    return false;
+  }
+
+  _gl = gl;
+  _pipelineStatistics = pipelineStatistics;
+
+  for (Frame& frame : _frames) {
+    _gl->glGenQueries(COUNTERS, frame.queries.data());
+  }
+
+  qCDebug(logs::gl::Feature)
+      << "Shader invocation counts" << (pipelineStatistics ? "available" :
+                                        "NOT available");
+  return true;
+}
+
+void PipelineStats::destroy() noexcept {
+  if (_gl == nullptr) {
+    return;
+  }
+
+  for (Frame& frame : _frames) {
+    _gl->glDeleteQueries(COUNTERS, frame.queries.data());
+    frame.pending = false;
+  }
+
+  _gl = nullptr;
+}
+
+bool PipelineStats::supports(const Counter counter) const noexcept {
+  return _gl != nullptr &&
+         (_pipelineStatistics || counter < VertexInvocations);
+}
+
+void PipelineStats::begin() noexcept {
+  if (_gl == nullptr) {
+    return;
+  }
+
+  for (Frame& frame : _frames) {
+    if (frame.pending) {
+      _collect(frame);
+    }
+  }
+
+  _current = (_current + 1) % FRAMES;
+  Frame& frame = _frames[_current];
+
+  if (frame.pending) {
+    frame.pending = false;
+    ++_dropped;
+  }
+
+  for (int c = 0; c < COUNTERS; ++c) {
+    if (supports(Counter(c))) {
+      _gl->glBeginQuery(TARGETS[c], frame.queries[c]);
+    }
+  }
+}
+
+void PipelineStats::end() noexcept {
+  if (_gl == nullptr) {
+    return;
+  }
+
+  for (int c = 0; c < COUNTERS; ++c) {
+    if (supports(Counter(c))) {
+      _gl->glEndQuery(TARGETS[c]);
+    }
+  }
+
+  _frames[_current].pending = true;
+}
+
+bool PipelineStats::_collect(Frame& frame) noexcept {
+  Sample sample = {};
+
+  for (int c = 0; c < COUNTERS; ++c) {
+    if (!supports(Counter(c))) {
+      continue;
+    }
+
+    GLuint available = GL_FALSE;
+    _gl->glGetQueryObjectuiv(frame.queries[c], GL_QUERY_RESULT_AVAILABLE,
+                             &available);
+
+    if (!available) {
+      // Each target finishes on its own schedule, so check them all
+      return false;
+    }
+
+    _gl->glGetQueryObjectui64v(frame.queries[c], GL_QUERY_RESULT, &sample[c]);
+  }
+
+  _history.push_back(sample);
+
+  if (_history.size() > HISTORY) {
+    _history.pop_front();
+  }
+
+  frame.pending = false;
+  return true;
+}
+}
+}
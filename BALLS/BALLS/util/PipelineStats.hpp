@@ -0,0 +1,83 @@
+#ifndef PIPELINESTATS_HPP
+#define PIPELINESTATS_HPP
+
+#include <array>
+#include <deque>
+
+#include <QtCore/QString>
+#include <QtGui/qopengl.h>
+
+class QOpenGLFunctions_3_3_Core;
+
+namespace balls {
+namespace util {
+
+using std::array;
+using std::deque;
+
+/**
+ * @brief Counts what the GPU did while drawing each frame: samples that
+ * passed the depth test, primitives generated, and (if the driver has
+ * GL_ARB_pipeline_statistics_query) how many times each shader stage ran.
+ *
+ * Comparing the vertex and fragment shader invocations tells you which stage
+ * a slowdown is in. Like GpuProfiler, every frame's queries go in a ring and
+ * are read only once they're available, so nothing ever waits on the GPU.
+ */
+class PipelineStats {
+public:
+  enum Counter {
+    SamplesPassed,
+    PrimitivesGenerated,
+    VertexInvocations,
+    FragmentInvocations,
+    COUNTERS
+  };
+
+  using Sample = array<GLuint64, COUNTERS>;
+
+  /// How many frames' queries can be in flight at once
+  static constexpr size_t FRAMES = 4;
+
+  /// How many frames' counts are kept
+  static constexpr size_t HISTORY = 240;
+
+  /// The counter's name, for display
+  static QString name(const Counter) noexcept;
+
+  /// The invocation counters are only used if pipelineStatistics is true
+  bool create(QOpenGLFunctions_3_3_Core*, const bool pipelineStatistics) noexcept;
+  void destroy() noexcept;
+
+  bool isCreated() const noexcept { return _gl != nullptr; }
+  bool supports(const Counter) const noexcept;
+
+  /// Called once per frame, around its draw calls
+  void begin() noexcept;
+  void end() noexcept;
+
+  /// The counts of the last HISTORY frames that came in, newest at the back
+  const deque<Sample>& history() const noexcept { return _history; }
+
+  /// How many frames were never counted because the GPU was too far behind
+  size_t dropped() const noexcept { return _dropped; }
+
+private:
+  struct Frame {
+    array<GLuint, COUNTERS> queries;
+    bool pending = false;
+  };
+
+  bool _collect(Frame&) noexcept;
+
+  QOpenGLFunctions_3_3_Core* _gl = nullptr;
+  bool _pipelineStatistics = false;
+  array<Frame, FRAMES> _frames;
+  size_t _current = 0;
+  size_t _dropped = 0;
+  deque<Sample> _history;
+};
+}
+}
+
+#endif // PIPELINESTATS_HPP